@@ -47,7 +47,10 @@ void SocketSentryDataEngine::init() {
     Q_ASSERT(!_watcherClient);
     QDBusConnection bus = QDBusConnection::systemBus();
     _watcherClient = new WatcherClient(bus, this);
-    connect(_watcherClient, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)),
+    // Subscribe to shared updates. The client reads the flows from the service's shared memory, so only sequence
+    // numbers go over the bus. Where that isn't possible, the client falls back to delta updates and reconstructs the
+    // flows from them.
+    connect(_watcherClient, SIGNAL(flowsUpdated(const QString&, const QList<CommunicationFlow>&)),
             this, SLOT(deviceUpdate(const QString&, const QList<CommunicationFlow>&)));
     connect(_watcherClient, SIGNAL(failure(const QString&, const QString&)),
             this, SLOT(deviceFailure(const QString&, const QString&)));
@@ -65,12 +68,12 @@ void SocketSentryDataEngine::renewSubscriptions() {
     // Renew remaining subscriptions.
     QSetIterator<QString> i(activeSources);
     while (i.hasNext()) {
-        _watcherClient->showInterest(i.next());
+        _watcherClient->showSharedInterest(i.next());
     }
 }
 
 bool SocketSentryDataEngine::sourceRequestEvent(const QString& device) {
-    _watcherClient->showInterest(device);
+    _watcherClient->showSharedInterest(device);
     setData(device, DataEngine::Data());
     return true;
 }
@@ -98,7 +98,8 @@ public slots:
     // "error" key on the special "status" source in this engine.
     void generalFailure(const QString& error);
 
-    // Called when the Watcher signals an update on a device. Sets the matching source data in this engine.
+    // Called when the Watcher client has the current flows of a device, read from the service's shared ring (or
+    // reconstructed from a delta update where the ring isn't available). Sets the matching source data in this engine.
     void deviceUpdate(const QString& device, const QList<CommunicationFlow>& flows);
 
     // Update subscription set from active sources and renew all subscriptions.
@@ -0,0 +1,50 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "CaptureSettings.h"
+
+// Default ring settings.
+const int CaptureSettings::DEFAULT_RING_SIZE_MB = 32;
+const int CaptureSettings::DEFAULT_RING_BLOCK_TIMEOUT_MS = 100;
+const int CaptureSettings::DEFAULT_FANOUT_WORKERS = 1;
+const int CaptureSettings::DEFAULT_MAX_FLOWS_PER_SECOND = 65536;
+
+// Default replay speed (as recorded).
+const int CaptureSettings::DEFAULT_REPLAY_SPEED = 1;
+
+// Prefix of replay device names.
+const QString CaptureSettings::REPLAY_DEVICE_PREFIX("file:");
+
+CaptureSettings CaptureSettings::INSTANCE;
+
+CaptureSettings::CaptureSettings() :
+    _ringSizeMb(DEFAULT_RING_SIZE_MB), _ringBlockTimeoutMs(DEFAULT_RING_BLOCK_TIMEOUT_MS),
+    _fanoutWorkers(DEFAULT_FANOUT_WORKERS), _maxFlowsPerSecond(DEFAULT_MAX_FLOWS_PER_SECOND),
+    _replaySpeed(DEFAULT_REPLAY_SPEED) {
+}
+
+CaptureSettings::~CaptureSettings() {
+}
+
+QStringList CaptureSettings::getReplayDevices() const {
+    QStringList result;
+    QStringListIterator i(_replayFiles);
+    while (i.hasNext()) {
+        result.append(REPLAY_DEVICE_PREFIX + i.next());
+    }
+    return result;
+}
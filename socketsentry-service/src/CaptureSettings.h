@@ -0,0 +1,124 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef CAPTURESETTINGS_H_
+#define CAPTURESETTINGS_H_
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/*
+ * A simple container of service packet capture settings. This singleton is NOT thread-safe and should only be accessed
+ * directly from the main thread.
+ */
+class CaptureSettings {
+public:
+    // New instance with default settings (libpcap capture on all devices).
+    CaptureSettings();
+    virtual ~CaptureSettings();
+
+    // Devices that should be captured from a memory-mapped packet ring instead of libpcap. The special value "*"
+    // selects all devices.
+    QStringList getRingDevices() const { return _ringDevices; }
+    void setRingDevices(const QStringList& ringDevices) { _ringDevices = ringDevices; }
+
+    // Total size of the packet ring in megabytes. Each megabyte is one ring block.
+    int getRingSizeMb() const { return _ringSizeMb; }
+    void setRingSizeMb(int ringSizeMb) { _ringSizeMb = ringSizeMb; }
+
+    // Maximum time in milliseconds the kernel holds a partially filled ring block before handing it to us.
+    int getRingBlockTimeoutMs() const { return _ringBlockTimeoutMs; }
+    void setRingBlockTimeoutMs(int ringBlockTimeoutMs) { _ringBlockTimeoutMs = ringBlockTimeoutMs; }
+
+    // Number of capture workers per packet ring device. If more than one, the workers share the device's traffic
+    // through a PACKET_FANOUT group.
+    int getFanoutWorkers() const { return _fanoutWorkers; }
+    void setFanoutWorkers(int fanoutWorkers) { _fanoutWorkers = fanoutWorkers; }
+
+    // Devices whose traffic should be counted by an eBPF program in the kernel instead of captured. The special value
+    // "*" selects all devices. Takes precedence over the packet ring.
+    QStringList getKernelFlowDevices() const { return _kernelFlowDevices; }
+    void setKernelFlowDevices(const QStringList& kernelFlowDevices) { _kernelFlowDevices = kernelFlowDevices; }
+
+    // Max number of distinct flows recorded per device per second. Traffic of additional flows is not recorded.
+    int getMaxFlowsPerSecond() const { return _maxFlowsPerSecond; }
+    void setMaxFlowsPerSecond(int maxFlowsPerSecond) { _maxFlowsPerSecond = maxFlowsPerSecond; }
+
+    // True if the given device should be captured from a memory-mapped packet ring.
+    bool useRing(const QString& device) const {
+        return _ringDevices.contains("*") || _ringDevices.contains(device);
+    }
+
+    // Packet trace files (in libpcap format) offered as replay devices. The device name of a trace is its path with
+    // the replay device prefix.
+    QStringList getReplayFiles() const { return _replayFiles; }
+    void setReplayFiles(const QStringList& replayFiles) { _replayFiles = replayFiles; }
+
+    // Speed of replays relative to the recorded speed, or 0 to replay as fast as possible.
+    int getReplaySpeed() const { return _replaySpeed; }
+    void setReplaySpeed(int replaySpeed) { _replaySpeed = replaySpeed; }
+
+    // Addresses of the host on which traces were recorded, used to tell which way replayed packets go. If empty, the
+    // source of each packet is taken to be local.
+    QStringList getReplayLocalAddresses() const { return _replayLocalAddresses; }
+    void setReplayLocalAddresses(const QStringList& addresses) { _replayLocalAddresses = addresses; }
+
+    // Device names of the replay files.
+    QStringList getReplayDevices() const;
+
+    // True if the traffic of the given device should be counted in the kernel.
+    bool useKernelFlows(const QString& device) const {
+        return _kernelFlowDevices.contains("*") || _kernelFlowDevices.contains(device);
+    }
+
+    // True if the device name refers to a replayed trace file rather than a network device.
+    static bool isReplayDevice(const QString& device) { return device.startsWith(REPLAY_DEVICE_PREFIX); }
+
+    // Get the singleton instance.
+    static const CaptureSettings& getInstance() { return INSTANCE; }
+
+    // Set the singleton instance.
+    static void setInstance(const CaptureSettings& instance) { INSTANCE = instance; }
+
+    // Default ring settings.
+    static const int DEFAULT_RING_SIZE_MB;
+    static const int DEFAULT_RING_BLOCK_TIMEOUT_MS;
+    static const int DEFAULT_FANOUT_WORKERS;
+    static const int DEFAULT_MAX_FLOWS_PER_SECOND;
+
+    // Default replay speed (as recorded).
+    static const int DEFAULT_REPLAY_SPEED;
+
+    // Prefix of replay device names (e.g. "file:/tmp/trace.pcap").
+    static const QString REPLAY_DEVICE_PREFIX;
+
+private:
+    QStringList _ringDevices;
+    QStringList _kernelFlowDevices;
+    int _ringSizeMb;
+    int _ringBlockTimeoutMs;
+    int _fanoutWorkers;
+    int _maxFlowsPerSecond;
+    QStringList _replayFiles;
+    int _replaySpeed;
+    QStringList _replayLocalAddresses;
+
+    // Singleton instance.
+    static CaptureSettings INSTANCE;
+};
+
+#endif /* CAPTURESETTINGS_H_ */
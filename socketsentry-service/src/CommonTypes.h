@@ -34,4 +34,11 @@ typedef enum {
     INBOUND, OUTBOUND, UNKNOWN_DIRECTION
 } Direction;
 
+/*
+ * Measures of how busy flows are: the recent rate of bytes per second, the peak rate, and the total bytes.
+ */
+typedef enum {
+    SORT_BY_RATE, SORT_BY_PEAK, SORT_BY_TOTAL
+} FlowSortKey;
+
 #endif /* COMMONTYPES_H_ */
@@ -19,97 +19,106 @@
 
 #include "OsProcess.h"
 #include "IpEndpointPair.h"
-#include "OsProcess.h"
 #include "CommonTypes.h"
 #include "LogSettings.h"
+#include "CorrelationSettings.h"
+#include "ProcEventListener.h"
 
-#include <netinet/in.h>
-
+#include <QtCore/QDebug>
 #include <QtCore/QHash>
 #include <QtCore/QHashIterator>
-#include <QtCore/QFile>
-#include <QtCore/QFileInfo>
 #include <QtCore/QList>
 #include <QtCore/QListIterator>
-#include <QtCore/QDir>
-#include <QtCore/QTextStream>
-#include <QtCore/QDateTime>
-
-// The following regex matches a line of data from /proc/net/tcp* or /proc/net/udp* and captures (in order)
-//   1) Local address in hex.
-//   2) Local port in hex.
-//   3) Remote address in hex.
-//   4) Remote port in hex.
-//   5) Connection state.
-//   6) Inode (socket identifier).
-//
-// Example data (TCP over IPv4):
-//  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode ref pointer drops
-//  49: 00000000:0044 00000000:0000 07 00000000:00000000 00:00000000 00000000     0        0 6703 2 ffff880123d0c000 0
-//  55: 0100007F:1F4A 00000000:0000 07 00000000:00000000 00:00000000 00000000  1000        0 8625 2 ffff88012545cd00 0
-//  84: 00000000:CE67 00000000:0000 07 00000000:00000000 00:00000000 00000000  1000        0 8643 2 ffff88012545d040 0
-//  86: 00000000:14E9 00000000:0000 07 00000000:00000000 00:00000000 00000000   105        0 5628 2 ffff88012545c000 0
-// 126: 00000000:8D11 00000000:0000 07 00000000:00000000 00:00000000 00000000   105        0 5629 2 ffff88012545c340 0
-//
-// Note that the only difference between IPv4 and v6 in these tables is the size of the addresses.
-const QString ConnectionProcessCorrelator::CONN_ENTRY_PATTERN("\\s*\\d+\\: (\\w{8,32})\\:(\\w{4}) (\\w{8,32})\\:(\\w{4}) (\\w{2}) (?:[\\w:]+\\s+){5}(\\w+)[^\\r\\n]*");
-// Regex matches a socket symlink target in /proc/<pid>/fd and captures the inode number.
-const QString ConnectionProcessCorrelator::SOCKET_SYMLINK_PATTERN("socket\\:\\[(\\d+)\\]");
-// Regex matches the process name in a /proc/<pid>/status file and captures the name.
-const QString ConnectionProcessCorrelator::PROC_NAME_PATTERN("Name\\:\\s*(\\S.+)");
-// Regex matches the process owner uid in a /proc/<pid>/status file and captures the uid.
-const QString ConnectionProcessCorrelator::PROC_UID_PATTERN("Uid\\:\\s*(\\d+)");
-
-// Hex string corresponding to a socket in LISTEN state (not a real connection).
-const QString ConnectionProcessCorrelator::LISTEN_STATE = "0A";
-
-// Paths to connection tables and socket file descriptors in the /proc filesystem.
-const QString ConnectionProcessCorrelator::DEFAULT_TCP4_PATH("/proc/net/tcp");
-const QString ConnectionProcessCorrelator::DEFAULT_TCP6_PATH("/proc/net/tcp6");
-const QString ConnectionProcessCorrelator::DEFAULT_UDP4_PATH("/proc/net/udp");
-const QString ConnectionProcessCorrelator::DEFAULT_UDP6_PATH("/proc/net/udp6");
-// Path to the root of the /proc filesystem.
-const QString ConnectionProcessCorrelator::PROC_PATH("/proc");
-// Template path to the file descrptor directory of a process.
-const QString ConnectionProcessCorrelator::FD_PATH_TEMPLATE("/proc/%1/fd");
-// // Template path to the status pseudo-file of a process.
-const QString ConnectionProcessCorrelator::STATUS_FILE_TEMPLATE("/proc/%1/status");
-
-// IP address lengths.
-const uint ConnectionProcessCorrelator::IPV4_ADDR_LEN = 4;
-const uint ConnectionProcessCorrelator::IPV6_ADDR_LEN = 16;
+#include <QtCore/QMutableHashIterator>
+#include <QtCore/QSet>
+#include <QtCore/QSetIterator>
+#include <QtCore/QVector>
+
+#include <string.h>
+#include <sys/stat.h>
 
 ConnectionProcessCorrelator::ConnectionProcessCorrelator() :
-    _connEntryRegex(CONN_ENTRY_PATTERN), _digitsRegex("\\d+"), _socketSymLinkRegex(SOCKET_SYMLINK_PATTERN),
-    _procNameRegex(PROC_NAME_PATTERN), _procUidRegex(PROC_UID_PATTERN), _tcp4Path(DEFAULT_TCP4_PATH),
-    _tcp6Path(DEFAULT_TCP6_PATH), _udp4Path(DEFAULT_UDP4_PATH), _udp6Path(DEFAULT_UDP6_PATH),
+    _procEventListener(NULL), _hostNetNamespace(0), _useSockDiag(true),
     _logStats(LogSettings::getInstance().logProcessCorrelation()) {
+    struct stat nsStat;
+    if (::stat("/proc/self/ns/net", &nsStat) == 0) {
+        _hostNetNamespace = nsStat.st_ino;
+    }
+    if (CorrelationSettings::getInstance().useProcEvents()) {
+        _procEventListener = new ProcEventListener(_processIndex);
+        QString error;
+        if (_procEventListener->open(error)) {
+            _processIndex.setEventDriven(true);
+        } else {
+            qWarning("Can't listen to proc events. Polling /proc instead. (%s)", error.toLatin1().constData());
+            delete _procEventListener;
+            _procEventListener = NULL;
+        }
+    }
 }
 
 ConnectionProcessCorrelator::~ConnectionProcessCorrelator() {
+    delete _procEventListener;
+    _procEventListener = NULL;
+    qDeleteAll(_namespaceReaders);
 }
 
 bool ConnectionProcessCorrelator::correlate(QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error) {
 
     // Get current connections by inode.
     QHash<int, IpEndpointPair> endpointsByInode;
-    bool ok = findInodes(_tcp4Path, TCP, endpointsByInode, error)
-            && findInodes(_udp4Path, UDP, endpointsByInode, error);
+    bool ok = findInodes(endpointsByInode, error);
     if (!ok) return false;
-    // IPv6 might not be available, so we don't report an error if we're unable to get this data.
-    QString ignored;
-    findInodes(_tcp6Path, TCP6, endpointsByInode, ignored);
-    findInodes(_udp6Path, UDP6, endpointsByInode, ignored);
 
     // Find related sockets and processes.
     ok = findProcessSockets(endpointsByInode, result, error);
     if (!ok) return false;
+
+    // The process index may have come across processes in network namespaces we haven't read yet (e.g. of a new
+    // container). Read those now rather than at the next correlation.
+    QVector<SocketRecord> sockets;
+    readNamespaceSockets(true, sockets);
+    if (!sockets.isEmpty()) {
+        QHash<int, IpEndpointPair> newEndpointsByInode;
+        addConnections(sockets, newEndpointsByInode);
+        ok = findProcessSockets(newEndpointsByInode, result, error);
+        if (!ok) return false;
+    }
+
     // Sometimes the kernel gives us IPv4 addresses mapped into IPv6 address space. Create IPv4 mirror entires
     // for these endpoint pairs.
     addMappedIpv4MirrorConnections(result);
     return true;
 }
 
+bool ConnectionProcessCorrelator::correlateEndpoints(const QSet<IpEndpointPair>& endpoints,
+        QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error) {
+
+    // Get the connections of interest by inode.
+    QHash<int, IpEndpointPair> endpointsByInode;
+    bool ok = findEndpointInodes(endpoints, endpointsByInode, error);
+    if (!ok) return false;
+
+    // Find related sockets and processes. Since the inodes are few, the process index usually has to rescan few or
+    // no processes.
+    ok = findProcessSockets(endpointsByInode, result, error);
+    if (!ok) return false;
+
+    // As with a full correlation, read network namespaces that the process index just came across.
+    QVector<SocketRecord> sockets;
+    readNamespaceSockets(true, sockets);
+    if (!sockets.isEmpty()) {
+        QHash<int, IpEndpointPair> allEndpointsByInode;
+        addConnections(sockets, allEndpointsByInode);
+        QHash<int, IpEndpointPair> newEndpointsByInode;
+        selectEndpoints(allEndpointsByInode, endpoints, newEndpointsByInode);
+        ok = findProcessSockets(newEndpointsByInode, result, error);
+        if (!ok) return false;
+    }
+    addMappedIpv4MirrorConnections(result);
+    return true;
+}
+
 void ConnectionProcessCorrelator::addMappedIpv4MirrorConnections(QHash<IpEndpointPair, QList<OsProcess> >& result) const {
     // Can't add to the hash while we're iterating over it, so we need to do this in two steps.
     QList<const IpEndpointPair*> mappedPairs;
@@ -131,174 +140,233 @@ void ConnectionProcessCorrelator::addMappedIpv4MirrorConnections(QHash<IpEndpoin
 
 }
 
-bool ConnectionProcessCorrelator::findInodes(const QString& filename, const L4Protocol protocol,
-        QHash<int, IpEndpointPair>& result, QString& error) const {
-
-    QFile file(filename);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        QString contents = in.readAll();
-        if (!contents.isNull()) {
-            int pos = 0;
-            // Loop over each line of connection data, which matches our regex.
-            while ((pos = _connEntryRegex.indexIn(contents, pos)) != -1) {
-                pos += _connEntryRegex.matchedLength();		// advance no matter what
-
-                // Parse line of connection data to get the fields we're interested in.
-                QString state = _connEntryRegex.cap(StateCaptureGroup);
-                if (state.compare(LISTEN_STATE, Qt::CaseInsensitive) == 0) continue;	// not a real connection
-
-                // Decode local and remote address and ports from hex strings.
-                QHostAddress localAddr = convertIpAddress(_connEntryRegex.cap(LocalAddressCaptureGroup));
-                if (localAddr.isNull()) continue;
-                QHostAddress remoteAddr = convertIpAddress(_connEntryRegex.cap(RemoteAddressCaptureGroup));
-                if (remoteAddr.isNull()) continue;
-                bool ok = false;
-                ushort localPort = _connEntryRegex.cap(LocalPortCaptureGroup).toUShort(&ok, 16);  // hex to bin
-                if (!ok) continue;
-                ushort remotePort = _connEntryRegex.cap(RemotePortCaptureGroup).toUShort(&ok, 16);  // hex to bin
-                if (!ok) continue;
-
-                // And now the inode key.
-                int inode = _connEntryRegex.cap(InodeCaptureGroup).toInt(&ok, 10);  // dec to bin
-                if (!ok || inode == 0) continue;
-
-                // All checks out. Add to the result.
-                IpEndpointPair& endpoints = result[inode];
-                endpoints.setLocalAddr(localAddr);
-                endpoints.setLocalPort(localPort);
-                endpoints.setRemoteAddr(remoteAddr);
-                endpoints.setRemotePort(remotePort);
-                endpoints.setTransport(protocol);
-
-                //
-            }
+bool ConnectionProcessCorrelator::findInodes(QHash<int, IpEndpointPair>& result, QString& error) {
+    QVector<SocketRecord> sockets;
+    bool ok = readSockets(TCP, sockets, error) && readSockets(UDP, sockets, error);
+    if (!ok && _useSockDiag) {
+        // Fall back to the /proc filesystem for good.
+        qWarning("Can't read connections with sock_diag. Using /proc instead. (%s)", error.toLatin1().constData());
+        _useSockDiag = false;
+        sockets.clear();
+        error.clear();
+        ok = readSockets(TCP, sockets, error) && readSockets(UDP, sockets, error);
+    }
+    if (!ok) return false;
+    // IPv6 might not be available, so we don't report an error if we're unable to get this data.
+    QString ignored;
+    readSockets(TCP6, sockets, ignored);
+    readSockets(UDP6, sockets, ignored);
+
+    // Add the connections of other network namespaces known to the process index.
+    readNamespaceSockets(false, sockets);
+    addConnections(sockets, result);
+    return true;
+}
+
+void ConnectionProcessCorrelator::addConnections(const QVector<SocketRecord>& sockets,
+        QHash<int, IpEndpointPair>& result) {
+    result.reserve(result.size() + sockets.size());
+    for (int i = 0; i < sockets.size(); i++) {
+        const SocketRecord& socket = sockets.at(i);
+        if (isAnyAddress(socket.flow.localAddr, socket.flow.isIpv6())
+                || isAnyAddress(socket.flow.remoteAddr, socket.flow.isIpv6())) {
+            continue;   // not a real connection
         }
-        return true;
-    } else {
-        error = QObject::tr("Can't access file %1").arg(filename);
-        return false;
+        result.insert(socket.inode, socket.flow.toEndpointPair());
     }
 }
 
-QHostAddress ConnectionProcessCorrelator::convertIpAddress(const QString& address) const {
-    QHostAddress result;
-
-    // Kernel gives us IP addresses in host byte order. QHostAddress expects IPv4 addresses in host byte order but
-    // IPv6 addresses in network byte order. So we need to handle each case separately.
-    QByteArray bytes = QByteArray::fromHex(address.toAscii());
-    if (bytes.size() == IPV4_ADDR_LEN) {
-        result.setAddress(*(const quint32*)bytes.constData());
-    } else if (bytes.size() == IPV6_ADDR_LEN) {
-        Q_ASSERT(bytes.size() % 4 == 0);
-        // Copy the input address as 32-bit words, converting to network byte order as we go.
-        const int words = IPV6_ADDR_LEN / 4;
-        quint32 netBytes[words];
-        const quint32* hostBytes = (const quint32*)bytes.constData();
-        for (int i = 0; i < words; i++) {
-            netBytes[i] = htonl(hostBytes[i]);
+void ConnectionProcessCorrelator::readNamespaceSockets(bool newOnly, QVector<SocketRecord>& result) {
+    const QHash<quint64, quint32> namespaces = _processIndex.getNetNamespaces();
+    QHashIterator<quint64, quint32> i(namespaces);
+    while (i.hasNext()) {
+        i.next();
+        const quint64 netNamespace = i.key();
+        if (netNamespace == _hostNetNamespace || (newOnly && _namespaceReaders.contains(netNamespace))) continue;
+
+        // Each namespace keeps its own reader, so its netlink socket is only opened once.
+        const QString pidPath = QString("%1/%2").arg(ProcessSocketIndex::DEFAULT_PROC_PATH).arg(i.value());
+        SockDiagReader*& reader = _namespaceReaders[netNamespace];
+        if (reader == NULL) {
+            reader = new SockDiagReader(pidPath + "/ns/net");
+        }
+        QVector<SocketRecord> sockets;
+        QString error;
+        bool ok = false;
+        if (_useSockDiag) {
+            ok = reader->readSockets(TCP, sockets, error) && reader->readSockets(UDP, sockets, error);
+            if (ok) {
+                reader->readSockets(TCP6, sockets, error);
+                reader->readSockets(UDP6, sockets, error);
+            } else {
+                sockets.clear();
+            }
+        }
+        if (!ok) {
+            // The tables in /proc/<pid>/net show the namespace of that process. They can be read without entering it.
+            ProcNetReader procNetReader(pidPath + "/net");
+            ok = procNetReader.readSockets(TCP, sockets, error) && procNetReader.readSockets(UDP, sockets, error);
+            if (ok) {
+                procNetReader.readSockets(TCP6, sockets, error);
+                procNetReader.readSockets(UDP6, sockets, error);
+            }
         }
-        result.setAddress((quint8*)netBytes);
+        if (!ok && _logStats) {
+            // The process may have exited. Try another one next time.
+            qDebug() << "Can't read connections of network namespace" << netNamespace << ":" << error;
+        }
+        result += sockets;
     }
 
-    // Discard address if it is the ANY address.
-    if (result == QHostAddress::Any || result == QHostAddress::AnyIPv6) {
+    // Close the readers of namespaces without processes, so the namespaces can go away.
+    if (!newOnly) {
+        QMutableHashIterator<quint64, SockDiagReader*> readerIter(_namespaceReaders);
+        while (readerIter.hasNext()) {
+            readerIter.next();
+            if (!namespaces.contains(readerIter.key())) {
+                delete readerIter.value();
+                readerIter.remove();
+            }
+        }
+    }
+}
+
+bool ConnectionProcessCorrelator::findEndpointInodes(const QSet<IpEndpointPair>& endpoints,
+        QHash<int, IpEndpointPair>& result, QString& error) {
+    if (_useSockDiag) {
+        bool ok = true;
+        QSetIterator<IpEndpointPair> i(endpoints);
+        while (ok && i.hasNext()) {
+            ok = findEndpointInode(i.next(), result, error);
+        }
+        if (ok) return true;
+        // Fall back to the /proc filesystem for good.
+        qWarning("Can't look up connections with sock_diag. Using /proc instead. (%s)", error.toLatin1().constData());
+        _useSockDiag = false;
         result.clear();
+        error.clear();
+    }
+
+    // The /proc filesystem can't look up single connections, so read the whole tables and keep the ones asked for.
+    QHash<int, IpEndpointPair> allInodes;
+    if (!findInodes(allInodes, error)) return false;
+    selectEndpoints(allInodes, endpoints, result);
+    return true;
+}
+
+void ConnectionProcessCorrelator::selectEndpoints(const QHash<int, IpEndpointPair>& connections,
+        const QSet<IpEndpointPair>& endpoints, QHash<int, IpEndpointPair>& result) {
+    QHashIterator<int, IpEndpointPair> i(connections);
+    while (i.hasNext()) {
+        i.next();
+        const IpEndpointPair& connection = i.value();
+        if (endpoints.contains(connection)
+                || (connection.isIpv4MappedAs6() && endpoints.contains(connection.demoteIpv6To4()))) {
+            result.insert(i.key(), connection);
+        }
     }
+}
+
+bool ConnectionProcessCorrelator::findEndpointInode(const IpEndpointPair& endpoints,
+        QHash<int, IpEndpointPair>& result, QString& error) {
+    if (endpoints.getTransport() == UNKNOWN_L4PROTO) return true;     // not a connection
+    const FlowKey flow = FlowKey::fromEndpointPair(endpoints);
+    if (!findSocketInode(_sockDiagReader, flow, result, error)) return false;
+
+    // Look in the other network namespaces, too. Failures there aren't fatal. (The namespace may be gone.)
+    QHashIterator<quint64, SockDiagReader*> i(_namespaceReaders);
+    while (i.hasNext()) {
+        i.next();
+        QString ignored;
+        findSocketInode(*i.value(), flow, result, ignored);
+    }
+    return true;
+}
 
+bool ConnectionProcessCorrelator::findSocketInode(SockDiagReader& reader, const FlowKey& flow,
+        QHash<int, IpEndpointPair>& result, QString& error) {
+    FlowKey lookupFlow = flow;
+    SocketRecord record;
+    bool found = false;
+    if (!reader.findSocket(lookupFlow, record, found, error)) return false;
+    if (!found && !lookupFlow.isIpv6()) {
+        // IPv6 sockets can hold IPv4 connections too.
+        lookupFlow = mapIpv4To6(lookupFlow);
+        if (!reader.findSocket(lookupFlow, record, found, error)) return false;
+    }
+    // The kernel may return a socket that only partly matches, such as an unconnected UDP socket.
+    if (found && record.flow == lookupFlow) {
+        result.insert(record.inode, record.flow.toEndpointPair());
+    }
+    return true;
+}
+
+FlowKey ConnectionProcessCorrelator::mapIpv4To6(const FlowKey& flow) {
+    FlowKey result = flow;
+    quint8* fields[] = { result.localAddr, result.remoteAddr };
+    for (int i = 0; i < 2; i++) {
+        ::memmove(fields[i] + 12, fields[i], 4);
+        ::memset(fields[i], 0, 10);
+        fields[i][10] = 0xff;
+        fields[i][11] = 0xff;
+    }
+    result.ipv6 = 1;
+    if (flow.getTransport() == TCP) result.transport = TCP6;
+    if (flow.getTransport() == UDP) result.transport = UDP6;
     return result;
 }
 
+bool ConnectionProcessCorrelator::readSockets(const L4Protocol protocol, QVector<SocketRecord>& result,
+        QString& error) {
+    if (_useSockDiag) {
+        return _sockDiagReader.readSockets(protocol, result, error);
+    } else {
+        return _procNetReader.readSockets(protocol, result, error);
+    }
+}
+
+bool ConnectionProcessCorrelator::isAnyAddress(const quint8* field, bool ipv6) {
+    const int length = ipv6 ? 16 : 4;
+    for (int i = 0; i < length; i++) {
+        if (field[i]) return false;
+    }
+    return true;
+}
+
 bool ConnectionProcessCorrelator::findProcessSockets(const QHash<int, IpEndpointPair>& inodeConnections,
         QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error) {
 
     if (inodeConnections.isEmpty()) return true;     // no connections to be mapped
 
-    QDir procDir(PROC_PATH);
-    QFileInfoList procEntries = procDir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
-    if (!procEntries.isEmpty()) {
-        // Iterate over all process pseudo-directories.
-        QListIterator<QFileInfo> procIter(procEntries);
-        while (procIter.hasNext()) {
-            const QFileInfo& procEntry = procIter.next();
-            const QString& procEntryFileName = procEntry.fileName();
-            const QDateTime& procStartTime = procEntry.created();
-            if (_digitsRegex.exactMatch(procEntryFileName)) {
-                // This directory represents a process.
-                quint32 pid = procEntryFileName.toUInt();
-                if (pid > 0) {
-                    // Find all file descriptors for this process.
-                    QDir fdDir(FD_PATH_TEMPLATE.arg(procEntryFileName));
-                    QFileInfoList fdEntries = fdDir.entryInfoList();
-                    QListIterator<QFileInfo> fdIter(fdEntries);
-                    OsProcess osProcess;
-                    while (fdIter.hasNext()) {
-                        // Is the file descriptor a socket?
-                        const QFileInfo& fdInfo = fdIter.next();
-                        QString symLinkTarget = fdInfo.symLinkTarget();
-                        if (_socketSymLinkRegex.indexIn(symLinkTarget) >= 0) {
-                            // File descriptor is a socket. Grab the inode number (first capture group).
-                            int inode = _socketSymLinkRegex.cap(1).toInt();
-                            if (inode > 0 && inodeConnections.contains(inode)) {
-                                // It's a socket AND we know the matching endpoint pair. Add a result entry.
-                                const IpEndpointPair& endpoints = inodeConnections[inode];
-                                // Have the process details already been fetched?
-                                if (osProcess.getPid() == 0) {
-                                    // No. Fill in the details.
-                                    populateProcess(pid, procStartTime, osProcess);
-                                }
-                                QList<OsProcess>& osProcesses = result[endpoints];     // adds an entry if needed
-                                osProcesses.append(osProcess);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    if (!_processIndex.update(inodeConnections.keys(), error)) return false;
 
-        if (_logStats) {
-            qDebug() << "Mapped" << result.size() << "out of" << inodeConnections.size() << "connection(s) to OS processes.";
+    QHashIterator<int, IpEndpointPair> connectionsIter(inodeConnections);
+    while (connectionsIter.hasNext()) {
+        connectionsIter.next();
+        QList<OsProcess> osProcesses;
+        _processIndex.findProcesses(connectionsIter.key(), osProcesses);
+        if (!osProcesses.isEmpty()) {
+            result[connectionsIter.value()] += osProcesses;     // adds an entry if needed
         }
+    }
 
-        // Fill out the result for any inodes that weren't found. Any connections not already mapped to a
-        // process gets mapped to an "empty" one here.
-        QHashIterator<int, IpEndpointPair> connectionsIter(inodeConnections);
-        while (connectionsIter.hasNext()) {
-            connectionsIter.next();
-            const IpEndpointPair& endpoints = connectionsIter.value();
-            if (! result.contains(endpoints)) {
-                QList<OsProcess> osProcesses;
-                osProcesses.append(OsProcess());
-                result.insert(endpoints, osProcesses);
-            }
-        }
-        return true;
-    } else {
-        error = QObject::tr("Can't access directory %1").arg(PROC_PATH);
-        return false;
+    if (_logStats) {
+        qDebug() << "Mapped" << result.size() << "out of" << inodeConnections.size() << "connection(s) to OS processes."
+                << "Rescanned" << _processIndex.getLastRescanCount() << "out of" << _processIndex.getProcessCount()
+                << "process(es).";
     }
-}
 
-void ConnectionProcessCorrelator::populateProcess(quint32 pid, const QDateTime& startTime, OsProcess& result) {
-    result.setPid(pid);
-    result.setStartTime(startTime);
-    QFile file(STATUS_FILE_TEMPLATE.arg(pid));
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        QString line = in.readLine();
-        bool foundName = false;
-        bool foundUid = false;
-        while (!line.isNull() && (!foundName || !foundUid)) {
-            if (!foundName && _procNameRegex.indexIn(line) >= 0) {
-                result.setProgram(_procNameRegex.cap(1));
-                foundName = true;
-            } else if (!foundUid && _procUidRegex.indexIn(line) >= 0) {
-                QString uid = _procUidRegex.cap(1);
-                QString username = _userNameResolver.resolve(uid);
-                result.setUser(username.isEmpty() ? uid : username);
-                foundUid = true;
-            }
-            line = in.readLine();
+    // Fill out the result for any inodes that weren't found. Any connections not already mapped to a
+    // process gets mapped to an "empty" one here.
+    connectionsIter.toFront();
+    while (connectionsIter.hasNext()) {
+        connectionsIter.next();
+        const IpEndpointPair& endpoints = connectionsIter.value();
+        if (! result.contains(endpoints)) {
+            QList<OsProcess> osProcesses;
+            osProcesses.append(OsProcess());
+            result.insert(endpoints, osProcesses);
         }
     }
+    return true;
 }
@@ -20,20 +20,26 @@
 
 #include "CommonTypes.h"
 #include "IConnectionProcessCorrelator.h"
-#include "UserNameResolver.h"
+#include "ProcNetReader.h"
+#include "ProcessSocketIndex.h"
+#include "SockDiagReader.h"
 
-#include <QtCore/QRegExp>
+#include <QtCore/QHash>
 
-template <class K, class V> class QHash;
 template <class E> class QList;
+template <class T> class QSet;
 class IpEndpointPair;
+class ProcEventListener;
 class OsProcess;
-class QHostAddress;
 class QString;
-class QDateTime;
 
 /*
- * Production implementation of IConnectionProcessCorrelator.
+ * Production implementation of IConnectionProcessCorrelator. Connection tables are read over sock_diag netlink
+ * sockets. If that fails (e.g. the kernel lacks sock_diag support), the correlator falls back to the /proc filesystem
+ * for good. Targeted correlations look up each connection with sock_diag, so only the processes that might hold the
+ * sockets are rescanned. Connections in the network namespaces of other processes (e.g. containers) are read too, once
+ * per namespace. If enabled in the correlation settings, process events from the kernel's proc connector keep the process
+ * index current between correlations.
  */
 class ConnectionProcessCorrelator : public IConnectionProcessCorrelator {
 public:
@@ -43,72 +49,77 @@ public:
     // This method implements behavior described in the interface.
     virtual bool correlate(QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error);
 
+    // This method implements behavior described in the interface.
+    virtual bool correlateEndpoints(const QSet<IpEndpointPair>& endpoints,
+            QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error);
+
 private:
-    // Regex matches a line of data from /proc/net/tcp* and /proc/net/udp* and captures important fields.
-    static const QString CONN_ENTRY_PATTERN;
-    // Regex matches a socket symlink target and captures the inode number.
-    static const QString SOCKET_SYMLINK_PATTERN;
-    // Regex matches the process name in a /proc/<pid>/status file and captures the name.
-    static const QString PROC_NAME_PATTERN;
-    // Regex matches the process owner uid in a /proc/<pid>/status file and captures the uid.
-    static const QString PROC_UID_PATTERN;
-
-    // Hex string corresponding to a socket in LISTEN state (not a real connection).
-    static const QString LISTEN_STATE;
-
-    // Capture groups in connection data regular expressions.
-    enum CaptureGroup {
-        LocalAddressCaptureGroup = 1,
-        LocalPortCaptureGroup,
-        RemoteAddressCaptureGroup,
-        RemotePortCaptureGroup,
-        StateCaptureGroup,
-        InodeCaptureGroup
-    };
-
-    // Paths to connection tables and socket file descriptors in the /proc filesystem.
-    static const QString DEFAULT_TCP4_PATH;
-    static const QString DEFAULT_TCP6_PATH;
-    static const QString DEFAULT_UDP4_PATH;
-    static const QString DEFAULT_UDP6_PATH;
-    // Path to the root of the /proc filesystem.
-    static const QString PROC_PATH;
-    // Template path to the file descrptor directory of a process.
-    static const QString FD_PATH_TEMPLATE;
-    // Template path to the status pseudo-file of a process.
-    static const QString STATUS_FILE_TEMPLATE;
-
-    // Regex object corresponding to V4_REGEX and V6_REGEX.
-    const QRegExp _connEntryRegex;
-    // Decimal digits.
-    const QRegExp _digitsRegex;
-    // Regex object corresponding to SOCKET_SYMLINK_PATTERN.
-    const QRegExp _socketSymLinkRegex;
-    // Regex object corresponding to PROC_NAME_PATTERN.
-    const QRegExp _procNameRegex;
-    // Regex object corresponding to PROC_UID_PATTERN.
-    const QRegExp _procUidRegex;
-
-    // Paths to connection data in the /proc filesystem.
-    const QString _tcp4Path;
-    const QString _tcp6Path;
-    const QString _udp4Path;
-    const QString _udp6Path;
+    // Connection table readers.
+    SockDiagReader _sockDiagReader;
+    ProcNetReader _procNetReader;
+
+    // Index of socket inodes to the processes holding them.
+    ProcessSocketIndex _processIndex;
+
+    // Source of process events for the index (or NULL if not used).
+    ProcEventListener* _procEventListener;
+
+    // Inode of the service's own network namespace (or 0 if unknown).
+    quint64 _hostNetNamespace;
+
+    // Connection table readers of other network namespaces by namespace inode.
+    QHash<quint64, SockDiagReader*> _namespaceReaders;
+
+    // True until reading connection tables with sock_diag fails.
+    bool _useSockDiag;
 
     // True if correlation stats should be logged to debug. False, otherwise.
     const bool _logStats;
 
-    // Address lengths in bytes.
-    static const uint IPV4_ADDR_LEN;
-    static const uint IPV6_ADDR_LEN;
+    // Read the kernel's IP connection tables and create a map of inodes representing socket file descriptors to IP
+    // endpoint pairs. The mappings are added to the result argument. Connections involving an ANY address are
+    // skipped. Returns true on success or false if it was not able to read the IPv4 tables. (IPv6 might not be
+    // available, so failing to read those tables is not an error.) On failure, the error argument is populated with
+    // the error message.
+    bool findInodes(QHash<int, IpEndpointPair>& result, QString& error);
+
+    // Add connections that don't involve an ANY address to the map of inodes to endpoint pairs.
+    static void addConnections(const QVector<SocketRecord>& sockets, QHash<int, IpEndpointPair>& result);
+
+    // Read the connection tables of the network namespaces known to the process index, other than the service's own,
+    // and append their sockets to the result. If the newOnly argument is true, only namespaces that haven't been read
+    // before are read. Else, readers of namespaces that no longer have processes are closed. Namespaces that can't
+    // be read are skipped.
+    void readNamespaceSockets(bool newOnly, QVector<SocketRecord>& result);
+
+    // Like findInodes, but only for connections with the given endpoint pairs (or IPv4 endpoint pairs mapped into
+    // IPv6 address space).
+    bool findEndpointInodes(const QSet<IpEndpointPair>& endpoints, QHash<int, IpEndpointPair>& result, QString& error);
 
-    // Read IP connection data from the /proc filesystem (or equivalent) and create a map of inodes representing socket
-    // file descriptors to IP endpoint pairs. The mappings are added to the result argument. The caller supplies the
-    // filename of the connection table "file" and the transport protocol. Returns true on success or false if it was
-    // not able to read the file. On failure, the error argument is populated with the error message.
-    bool findInodes(const QString& filename, const L4Protocol protocol, QHash<int, IpEndpointPair>& result, QString& error) const;
+    // Look up the connection of one endpoint pair with sock_diag in every known network namespace and add its inode to
+    // the result if found. Returns false on failure with the error argument populated.
+    bool findEndpointInode(const IpEndpointPair& endpoints, QHash<int, IpEndpointPair>& result, QString& error);
 
-    // Find socket file descriptors of all processes and match them to endpoint pairs via inodes in the supplied
+    // Look up one connection with the given reader and add its inode to the result if found. Returns false on failure
+    // with the error argument populated.
+    static bool findSocketInode(SockDiagReader& reader, const FlowKey& flow, QHash<int, IpEndpointPair>& result,
+            QString& error);
+
+    // Add the connections whose endpoint pairs (or IPv4 equivalents) are among the given ones to the result.
+    static void selectEndpoints(const QHash<int, IpEndpointPair>& connections, const QSet<IpEndpointPair>& endpoints,
+            QHash<int, IpEndpointPair>& result);
+
+    // Map the IPv4 addresses of a flow key into IPv6 address space (e.g. ::ffff:192.168.1.1), the way the kernel
+    // shows IPv4 connections of IPv6 sockets.
+    static FlowKey mapIpv4To6(const FlowKey& flow);
+
+    // Read the sockets of one transport protocol with the current reader.
+    bool readSockets(const L4Protocol protocol, QVector<SocketRecord>& result, QString& error);
+
+    // True if the address field of a flow key holds the ANY address.
+    static bool isAnyAddress(const quint8* field, bool ipv6);
+
+    // Bring the process index up to date and match processes to endpoint pairs via inodes in the supplied
     // connections table. For each entry in the inode-connections table, a new entry is added to the result table
     // with the matching OS processes. The list of processes for each endpoint pair in the result will contain
     // at least one element. If the inode cannot be matched to an OS process, an "empty" OS process is
@@ -118,23 +129,9 @@ private:
     bool findProcessSockets(const QHash<int, IpEndpointPair>& inodeConnections, QHash<IpEndpointPair,
             QList<OsProcess> >& result, QString& error);
 
-    // Given a process ID and start time, fill in an OS process object with details. This is best effort. If the process
-    // details cannot be fetched from the OS, only the PID and start time are initialized (copied into) in the result.
-    void populateProcess(quint32 pid, const QDateTime& dateTime, OsProcess& result);
-
     // Scan the input hash table for IPv6 endpoint pairs that actually represent IPv4 hosts mapped into the IPv6 address space.
     // For each such connection, add an equivalent IPv4 connection to the result correlated to the same processes.
     void addMappedIpv4MirrorConnections(QHash<IpEndpointPair, QList<OsProcess> >& result) const;
-
-    // Convert an IP address string from the kernel's connection table into a QHostAddress. Addresses are hex strings
-    // with each 32-bit word in host byte order. If the string address cannot be converted for any reason or the
-    // address corresponds to the ANY address, then the returned host is set to the default address and its
-    // "isNull" method returns true.
-    QHostAddress convertIpAddress(const QString& address) const;
-
-    // Process owner name resolver.
-    UserNameResolver _userNameResolver;
-
 };
 
 #endif /* CONNECTIONPROCESSCORRELATOR_H_ */
@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef CORRELATIONSETTINGS_H_
+#define CORRELATIONSETTINGS_H_
+
+/*
+ * A simple container of connection-process correlation settings. This singleton is NOT thread-safe and should only
+ * be accessed directly from the main thread.
+ */
+class CorrelationSettings {
+public:
+    // New instance with default settings (processes found by polling /proc only).
+    CorrelationSettings();
+    virtual ~CorrelationSettings();
+
+    // True if process fork, exec, and exit events from the kernel's proc connector should keep the process index
+    // current between correlations.
+    bool useProcEvents() const { return _useProcEvents; }
+    void setUseProcEvents(bool useProcEvents) { _useProcEvents = useProcEvents; }
+
+    // Get the singleton instance.
+    static const CorrelationSettings& getInstance() { return INSTANCE; }
+
+    // Set the singleton instance.
+    static void setInstance(const CorrelationSettings& instance) { INSTANCE = instance; }
+
+private:
+    bool _useProcEvents;
+
+    // Singleton instance.
+    static CorrelationSettings INSTANCE;
+};
+
+#endif /* CORRELATIONSETTINGS_H_ */
@@ -0,0 +1,69 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FanoutGroup.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <errno.h>
+#include <string.h>
+
+// Older kernel headers lack the flag. Kernels without it reject it, so the group fails to start rather than risk
+// joining a foreign group.
+#ifndef PACKET_FANOUT_FLAG_UNIQUEID
+#define PACKET_FANOUT_FLAG_UNIQUEID 0x2000
+#endif
+
+FanoutGroup::FanoutGroup() :
+    _id(-1) {
+}
+
+FanoutGroup::~FanoutGroup() {
+}
+
+bool FanoutGroup::join(int socket, QString& error) {
+    // Joining is quick, so workers take turns. The first one creates the group.
+    QMutexLocker locker(&_mutex);
+    // The mode goes in the high 16 bits. The flags reach the sign bit, so the argument is built unsigned.
+    const quint32 mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    if (_id < 0) {
+        quint32 fanoutArg = (mode | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+        if (::setsockopt(socket, SOL_PACKET, PACKET_FANOUT, &fanoutArg, sizeof(fanoutArg)) != 0) {
+            error = QObject::tr("Can't create packet fanout group. (%1)").arg(::strerror(errno));
+            return false;
+        }
+        // The kernel reports the ID it picked in the low 16 bits.
+        int fanoutValue = 0;
+        socklen_t len = sizeof(fanoutValue);
+        if (::getsockopt(socket, SOL_PACKET, PACKET_FANOUT, &fanoutValue, &len) != 0) {
+            error = QObject::tr("Can't read packet fanout group ID. (%1)").arg(::strerror(errno));
+            return false;
+        }
+        _id = fanoutValue & 0xffff;
+    } else {
+        quint32 fanoutArg = (quint32)_id | (mode << 16);
+        if (::setsockopt(socket, SOL_PACKET, PACKET_FANOUT, &fanoutArg, sizeof(fanoutArg)) != 0) {
+            error = QObject::tr("Can't join packet fanout group %1. (%2)").arg(_id).arg(::strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
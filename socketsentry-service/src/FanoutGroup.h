@@ -0,0 +1,46 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FANOUTGROUP_H_
+#define FANOUTGROUP_H_
+
+#include <QtCore/QMutex>
+
+class QString;
+
+/*
+ * PACKET_FANOUT group shared by the packet ring workers of one device. The first worker to join has the kernel
+ * assign a group ID that no other socket on the host uses, so the workers never end up in a group of another process
+ * by accident. The other workers join with the same ID.
+ *
+ * This class is thread-safe. Workers join from their own threads.
+ */
+class FanoutGroup {
+public:
+    FanoutGroup();
+    virtual ~FanoutGroup();
+
+    // Add a bound packet socket to the group in hash mode. Returns true if successful. Otherwise, false is returned and
+    // the error argument is populated.
+    bool join(int socket, QString& error);
+
+private:
+    QMutex _mutex;
+    int _id;                    // ID of the group, or -1 if no worker has joined yet
+};
+
+#endif /* FANOUTGROUP_H_ */
@@ -0,0 +1,317 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowBatchCodec.h"
+#include "CommunicationFlow.h"
+#include "IpEndpointPair.h"
+#include "OsProcess.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+#include "CommonTypes.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QListIterator>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QtEndian>
+#include <QtNetwork/QHostAddress>
+
+#include <string.h>
+
+// Version of the packed format.
+const quint32 FlowBatchCodec::FORMAT_VERSION = 1;
+
+// Magic bytes at the start of packed flows.
+static const char MAGIC[] = "SSFB";
+static const int MAGIC_LENGTH = 4;
+
+// Sizes of the fixed-width parts.
+static const int HEADER_SIZE = 24;
+static const int FLOW_RECORD_SIZE = 84;
+static const int PROCESS_RECORD_SIZE = 16;
+
+// Longest string that fits the string table. Longer ones are cut.
+static const int MAX_STRING_LENGTH = 0xffff;
+
+// Address families of the address table, which are also the lengths of the addresses.
+static const uchar NO_ADDRESS = 0;
+static const uchar IPV4_ADDRESS = 4;
+static const uchar IPV6_ADDRESS = 6;
+static const int IPV6_ADDRESS_LENGTH = 16;
+
+// Flags of flow records.
+static const uchar RECEIVING_NOW = 0x01;
+static const uchar SENDING_NOW = 0x02;
+
+// Return the number of a string in the table, appending it to the table's data if it's new.
+static quint32 internString(const QString& string, QHash<QString, quint32>& numbers, QByteArray& stringData) {
+    QHash<QString, quint32>::const_iterator i = numbers.constFind(string);
+    if (i != numbers.constEnd()) {
+        return i.value();
+    }
+    quint32 number = numbers.size();
+    numbers.insert(string, number);
+    QByteArray utf8 = string.toUtf8().left(MAX_STRING_LENGTH);
+    uchar length[2];
+    qToLittleEndian<quint16>(utf8.size(), length);
+    stringData.append(reinterpret_cast<const char*>(length), sizeof(length));
+    stringData.append(utf8);
+    return number;
+}
+
+// Return the number of an address in the table, appending it to the table's data if it's new. Each entry of the table
+// is the family followed by the address bytes in network order, and is also its key in the number hash.
+static quint32 internAddress(const QHostAddress& address, QHash<QByteArray, quint32>& numbers,
+        QByteArray& addressData) {
+    char entry[1 + IPV6_ADDRESS_LENGTH];
+    int entryLength = 1;
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        entry[0] = IPV4_ADDRESS;
+        qToBigEndian<quint32>(address.toIPv4Address(), reinterpret_cast<uchar*>(entry + 1));
+        entryLength += 4;
+    } else if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        entry[0] = IPV6_ADDRESS;
+        Q_IPV6ADDR ipv6 = address.toIPv6Address();
+        memcpy(entry + 1, ipv6.c, IPV6_ADDRESS_LENGTH);
+        entryLength += IPV6_ADDRESS_LENGTH;
+    } else {
+        entry[0] = NO_ADDRESS;
+    }
+    QByteArray key = QByteArray::fromRawData(entry, entryLength);
+    QHash<QByteArray, quint32>::const_iterator i = numbers.constFind(key);
+    if (i != numbers.constEnd()) {
+        return i.value();
+    }
+    quint32 number = numbers.size();
+    numbers.insert(QByteArray(entry, entryLength), number);
+    addressData.append(entry, entryLength);
+    return number;
+}
+
+// Look up a table entry by number. Returns false if there's no such entry.
+template<typename T>
+static bool lookUp(const QVector<T>& table, quint32 number, T& result) {
+    if (number >= (quint32)table.size()) {
+        return false;
+    }
+    result = table[number];
+    return true;
+}
+
+FlowBatchCodec::FlowBatchCodec() {
+}
+
+FlowBatchCodec::~FlowBatchCodec() {
+}
+
+QByteArray FlowBatchCodec::encode(const QList<CommunicationFlow>& flows) {
+    // The tables and the process records grow as the flow records are written. They're put together at the end.
+    QHash<QString, quint32> stringNumbers;
+    QByteArray stringData;
+    internString(QString(), stringNumbers, stringData);
+    QHash<QByteArray, quint32> addressNumbers;
+    QByteArray addressData;
+    QByteArray flowRecords(flows.size() * FLOW_RECORD_SIZE, '\0');
+    QByteArray processRecords;
+    quint32 processCount = 0;
+
+    uchar* record = reinterpret_cast<uchar*>(flowRecords.data());
+    QListIterator<CommunicationFlow> i(flows);
+    while (i.hasNext()) {
+        const CommunicationFlow& flow = i.next();
+        const IpEndpointPair ipEndpointPair = flow.getIpEndpointPair();
+        const FlowMetrics metrics = flow.getFlowMetrics();
+        const FlowStatistics statistics = flow.getFlowStatistics();
+        const QList<OsProcess> osProcesses = flow.getOsProcesses();
+
+        record[0] = (uchar)ipEndpointPair.getTransport();
+        record[1] = (statistics.isReceivingNow() ? RECEIVING_NOW : 0) | (statistics.isSendingNow() ? SENDING_NOW : 0);
+        qToLittleEndian<quint16>(ipEndpointPair.getLocalPort(), record + 2);
+        qToLittleEndian<quint16>(ipEndpointPair.getRemotePort(), record + 4);
+        qToLittleEndian<quint32>(internAddress(ipEndpointPair.getLocalAddr(), addressNumbers, addressData), record + 8);
+        qToLittleEndian<quint32>(internAddress(ipEndpointPair.getRemoteAddr(), addressNumbers, addressData),
+                record + 12);
+        qToLittleEndian<quint32>(internString(ipEndpointPair.getRemoteHostName(), stringNumbers, stringData),
+                record + 16);
+        qToLittleEndian<quint32>(processCount, record + 20);
+        qToLittleEndian<quint32>(osProcesses.size(), record + 24);
+        qToLittleEndian<quint64>(metrics.getBytesIn(), record + 28);
+        qToLittleEndian<quint64>(metrics.getBytesOut(), record + 36);
+        qToLittleEndian<quint64>(metrics.getPacketsIn(), record + 44);
+        qToLittleEndian<quint64>(metrics.getPacketsOut(), record + 52);
+        qToLittleEndian<quint64>(statistics.getRecentBytesInPerSec(), record + 60);
+        qToLittleEndian<quint64>(statistics.getRecentBytesOutPerSec(), record + 68);
+        qToLittleEndian<quint64>(statistics.getPeakBytesPerSec(), record + 76);
+        record += FLOW_RECORD_SIZE;
+
+        QListIterator<OsProcess> j(osProcesses);
+        while (j.hasNext()) {
+            const OsProcess& osProcess = j.next();
+            uchar processRecord[PROCESS_RECORD_SIZE];
+            qToLittleEndian<quint32>(osProcess.getPid(), processRecord);
+            quint32 program = internString(osProcess.getProgram(), stringNumbers, stringData);
+            quint32 user = internString(osProcess.getUser(), stringNumbers, stringData);
+            qToLittleEndian<quint32>(program, processRecord + 4);
+            qToLittleEndian<quint32>(user, processRecord + 8);
+            qToLittleEndian<quint32>(osProcess.getStartTime().toUTC().toTime_t(), processRecord + 12);
+            processRecords.append(reinterpret_cast<const char*>(processRecord), PROCESS_RECORD_SIZE);
+            processCount++;
+        }
+    }
+
+    uchar header[HEADER_SIZE];
+    memcpy(header, MAGIC, MAGIC_LENGTH);
+    qToLittleEndian<quint32>(FORMAT_VERSION, header + 4);
+    qToLittleEndian<quint32>(stringNumbers.size(), header + 8);
+    qToLittleEndian<quint32>(addressNumbers.size(), header + 12);
+    qToLittleEndian<quint32>(flows.size(), header + 16);
+    qToLittleEndian<quint32>(processCount, header + 20);
+
+    QByteArray result;
+    result.reserve(HEADER_SIZE + stringData.size() + addressData.size() + flowRecords.size() + processRecords.size());
+    result.append(reinterpret_cast<const char*>(header), HEADER_SIZE);
+    result.append(stringData);
+    result.append(addressData);
+    result.append(flowRecords);
+    result.append(processRecords);
+    return result;
+}
+
+bool FlowBatchCodec::decode(const QByteArray& data, QList<CommunicationFlow>& result, QString& error) {
+    const uchar* pos = reinterpret_cast<const uchar*>(data.constData());
+    const uchar* end = pos + data.size();
+    if (data.size() < HEADER_SIZE || memcmp(pos, MAGIC, MAGIC_LENGTH) != 0) {
+        error = QObject::tr("Can't unpack flows (not packed flows)");
+        return false;
+    }
+    quint32 version = qFromLittleEndian<quint32>(pos + 4);
+    if (version != FORMAT_VERSION) {
+        error = QObject::tr("Can't unpack flows (unsupported format version %1)").arg(version);
+        return false;
+    }
+    quint32 stringCount = qFromLittleEndian<quint32>(pos + 8);
+    quint32 addressCount = qFromLittleEndian<quint32>(pos + 12);
+    quint32 flowCount = qFromLittleEndian<quint32>(pos + 16);
+    quint32 processCount = qFromLittleEndian<quint32>(pos + 20);
+    pos += HEADER_SIZE;
+
+    // Read the string table. Every string takes at least two bytes, which bounds the count of a valid table.
+    QVector<QString> strings;
+    strings.reserve(qMin<qint64>(stringCount, (end - pos) / 2));
+    for (quint32 i = 0; i < stringCount; i++) {
+        if (end - pos < 2) {
+            error = QObject::tr("Can't unpack flows (truncated string table)");
+            return false;
+        }
+        quint16 length = qFromLittleEndian<quint16>(pos);
+        pos += 2;
+        if (end - pos < length) {
+            error = QObject::tr("Can't unpack flows (truncated string table)");
+            return false;
+        }
+        strings.append(QString::fromUtf8(reinterpret_cast<const char*>(pos), length));
+        pos += length;
+    }
+
+    // Read the address table. Every address takes at least one byte.
+    QVector<QHostAddress> addresses;
+    addresses.reserve(qMin<qint64>(addressCount, end - pos));
+    for (quint32 i = 0; i < addressCount; i++) {
+        if (pos == end) {
+            error = QObject::tr("Can't unpack flows (truncated address table)");
+            return false;
+        }
+        uchar family = *pos++;
+        int length = family == IPV6_ADDRESS ? IPV6_ADDRESS_LENGTH : family;
+        if (family != NO_ADDRESS && family != IPV4_ADDRESS && family != IPV6_ADDRESS) {
+            error = QObject::tr("Can't unpack flows (address %1 is invalid)").arg(i);
+            return false;
+        } else if (end - pos < length) {
+            error = QObject::tr("Can't unpack flows (truncated address table)");
+            return false;
+        }
+        if (family == IPV4_ADDRESS) {
+            addresses.append(QHostAddress(qFromBigEndian<quint32>(pos)));
+        } else if (family == IPV6_ADDRESS) {
+            Q_IPV6ADDR ipv6;
+            memcpy(ipv6.c, pos, IPV6_ADDRESS_LENGTH);
+            addresses.append(QHostAddress(ipv6));
+        } else {
+            addresses.append(QHostAddress());
+        }
+        pos += length;
+    }
+    if ((qint64)flowCount * FLOW_RECORD_SIZE + (qint64)processCount * PROCESS_RECORD_SIZE != end - pos) {
+        error = QObject::tr("Can't unpack flows (%1 bytes of records don't match %2 flows and %3 processes)")
+                .arg((qlonglong)(end - pos)).arg(flowCount).arg(processCount);
+        return false;
+    }
+
+    // Read the process records, which follow the flow records.
+    QVector<OsProcess> osProcesses;
+    osProcesses.reserve(processCount);
+    const uchar* processRecord = pos + flowCount * FLOW_RECORD_SIZE;
+    for (quint32 i = 0; i < processCount; i++) {
+        QString program;
+        QString user;
+        if (!lookUp(strings, qFromLittleEndian<quint32>(processRecord + 4), program)
+                || !lookUp(strings, qFromLittleEndian<quint32>(processRecord + 8), user)) {
+            error = QObject::tr("Can't unpack flows (process %1 has an invalid string number)").arg(i);
+            return false;
+        }
+        QDateTime startTime;
+        startTime.setTimeSpec(Qt::UTC);
+        startTime.setTime_t(qFromLittleEndian<quint32>(processRecord + 12));
+        osProcesses.append(OsProcess(qFromLittleEndian<quint32>(processRecord), program, user, startTime));
+        processRecord += PROCESS_RECORD_SIZE;
+    }
+
+    // Read the flow records.
+    QList<CommunicationFlow> flows;
+    flows.reserve(flowCount);
+    for (quint32 i = 0; i < flowCount; i++) {
+        const uchar* record = pos + i * FLOW_RECORD_SIZE;
+        QHostAddress localAddr;
+        QHostAddress remoteAddr;
+        QString remoteHostName;
+        bool valid = lookUp(addresses, qFromLittleEndian<quint32>(record + 8), localAddr)
+                && lookUp(addresses, qFromLittleEndian<quint32>(record + 12), remoteAddr)
+                && lookUp(strings, qFromLittleEndian<quint32>(record + 16), remoteHostName);
+        quint32 firstProcess = qFromLittleEndian<quint32>(record + 20);
+        quint32 flowProcessCount = qFromLittleEndian<quint32>(record + 24);
+        if (!valid || record[0] > UNKNOWN_L4PROTO || (qint64)firstProcess + flowProcessCount > processCount) {
+            error = QObject::tr("Can't unpack flows (flow %1 is invalid)").arg(i);
+            return false;
+        }
+        IpEndpointPair ipEndpointPair(localAddr, qFromLittleEndian<quint16>(record + 2),
+                remoteAddr, qFromLittleEndian<quint16>(record + 4), (L4Protocol)record[0]);
+        ipEndpointPair.setRemoteHostName(remoteHostName);
+        FlowMetrics metrics(qFromLittleEndian<quint64>(record + 28), qFromLittleEndian<quint64>(record + 36),
+                qFromLittleEndian<quint64>(record + 44), qFromLittleEndian<quint64>(record + 52));
+        FlowStatistics statistics(qFromLittleEndian<quint64>(record + 60), qFromLittleEndian<quint64>(record + 68),
+                qFromLittleEndian<quint64>(record + 76), record[1] & SENDING_NOW, record[1] & RECEIVING_NOW);
+        QList<OsProcess> flowProcesses;
+        for (quint32 j = firstProcess; j < firstProcess + flowProcessCount; j++) {
+            flowProcesses.append(osProcesses[j]);
+        }
+        flows.append(CommunicationFlow(ipEndpointPair, flowProcesses, metrics, statistics));
+    }
+    result = flows;
+    return true;
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWBATCHCODEC_H_
+#define FLOWBATCHCODEC_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+class QString;
+class CommunicationFlow;
+
+/*
+ * Packs a batch of communication flows into a compact byte array for the Watcher's "updatePacked" signal, and unpacks
+ * it again. Unlike the nested D-Bus structures of the flows, the packed form has fixed-width records and binary
+ * addresses, and each distinct address, host name, program name, and user name is stored only once.
+ *
+ * Layout (all integers are little-endian):
+ *   header     magic "SSFB", then the format version and the counts of strings, addresses, flows, and processes
+ *              (32 bits each)
+ *   strings    per string: length in bytes (16 bits) and UTF-8 text; string 0 is always empty
+ *   addresses  per address: family (8 bits; 0 if unknown, 4, or 6) and that many bytes in network order
+ *   flows      per flow: a fixed-width record of the transport, ports, address and host name numbers, the range of
+ *              its processes, metrics, and statistics
+ *   processes  per process: PID, program and user string numbers, and start time (time_t), 32 bits each
+ *
+ * Flows keep their order, and so do the processes of each flow.
+ */
+class FlowBatchCodec {
+public:
+    FlowBatchCodec();
+    virtual ~FlowBatchCodec();
+
+    // Pack the flows into a byte array.
+    static QByteArray encode(const QList<CommunicationFlow>& flows);
+
+    // Unpack the flows of a byte array into the result argument. Returns true if successful. Otherwise, false is
+    // returned and the error argument is populated.
+    static bool decode(const QByteArray& data, QList<CommunicationFlow>& result, QString& error);
+
+    // Version of the packed format.
+    static const quint32 FORMAT_VERSION;
+};
+
+#endif /* FLOWBATCHCODEC_H_ */
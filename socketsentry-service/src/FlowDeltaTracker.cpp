@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowDeltaTracker.h"
+
+#include <QtCore/QListIterator>
+
+FlowDeltaTracker::FlowDeltaTracker() :
+    _synchronized(false), _sequence(0) {
+}
+
+FlowDeltaTracker::~FlowDeltaTracker() {
+}
+
+bool FlowDeltaTracker::apply(qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+        const QList<IpEndpointPair>& removed) {
+    if (keyframe) {
+        // Start over from the keyframe.
+        _flows.clear();
+        _synchronized = true;
+    } else if (!_synchronized || sequence != _sequence + 1) {
+        // Missed an update. The tracked flows can't be trusted until the next keyframe.
+        _flows.clear();
+        _synchronized = false;
+        _sequence = sequence;
+        return false;
+    }
+    _sequence = sequence;
+    QListIterator<IpEndpointPair> i(removed);
+    while (i.hasNext()) {
+        _flows.remove(i.next());
+    }
+    QListIterator<CommunicationFlow> j(flows);
+    while (j.hasNext()) {
+        const CommunicationFlow& flow = j.next();
+        _flows.insert(flow.getIpEndpointPair(), flow);
+    }
+    return true;
+}
+
+void FlowDeltaTracker::clear() {
+    _flows.clear();
+    _synchronized = false;
+    _sequence = 0;
+}
@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWDELTATRACKER_H_
+#define FLOWDELTATRACKER_H_
+
+#include "CommunicationFlow.h"
+#include "IpEndpointPair.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+
+/*
+ * Reconstructs the current flows of one device from the delta updates of a Watcher (its "updateDelta" signal). A
+ * keyframe replaces the tracked flows. Every other update is applied on top of the previous one, but only if its
+ * sequence number follows directly. If an update was missed, the tracker is out of sync and ignores further updates
+ * until the next keyframe. Clients can ask the Watcher to "resync" to get one sooner.
+ */
+class FlowDeltaTracker {
+public:
+    FlowDeltaTracker();
+    virtual ~FlowDeltaTracker();
+
+    // Apply a delta update. Returns true if the tracked flows are current afterward. Else, false is returned and the
+    // tracker waits for a keyframe.
+    bool apply(qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+            const QList<IpEndpointPair>& removed);
+
+    // True if a keyframe was applied and no update was missed since.
+    bool isSynchronized() const { return _synchronized; }
+
+    // Sequence number of the last update received, or 0 if there was none.
+    qulonglong getSequence() const { return _sequence; }
+
+    // The current flows. Only meaningful if the tracker is synchronized.
+    QList<CommunicationFlow> getFlows() const { return _flows.values(); }
+
+    // Forget the tracked flows and wait for the next keyframe.
+    void clear();
+
+private:
+    bool _synchronized;
+    qulonglong _sequence;
+    QHash<IpEndpointPair, CommunicationFlow> _flows;
+};
+
+#endif /* FLOWDELTATRACKER_H_ */
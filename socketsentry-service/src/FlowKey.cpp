@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowKey.h"
+#include "IpEndpointPair.h"
+
+#include <QtNetwork/QHostAddress>
+#include <QtCore/QtEndian>
+
+#include <string.h>
+
+// The key must stay compact and free of compiler-inserted padding for bytewise comparison and hashing to work.
+typedef char FlowKeySizeCheck[sizeof(FlowKey) == 40 ? 1 : -1];
+
+IpEndpointPair FlowKey::toEndpointPair() const {
+    QHostAddress local;
+    QHostAddress remote;
+    if (isIpv6()) {
+        local.setAddress(const_cast<quint8*>(localAddr));
+        remote.setAddress(const_cast<quint8*>(remoteAddr));
+    } else {
+        quint32 ipv4;
+        ::memcpy(&ipv4, localAddr, sizeof(ipv4));
+        local.setAddress(qFromBigEndian(ipv4));
+        ::memcpy(&ipv4, remoteAddr, sizeof(ipv4));
+        remote.setAddress(qFromBigEndian(ipv4));
+    }
+    return IpEndpointPair(local, localPort, remote, remotePort, getTransport());
+}
+
+FlowKey FlowKey::fromEndpointPair(const IpEndpointPair& endpoints) {
+    FlowKey key = FlowKey();
+    key.ipv6 = copyAddress(endpoints.getLocalAddr(), key.localAddr);
+    copyAddress(endpoints.getRemoteAddr(), key.remoteAddr);
+    key.localPort = endpoints.getLocalPort();
+    key.remotePort = endpoints.getRemotePort();
+    key.transport = endpoints.getTransport();
+    return key;
+}
+
+bool FlowKey::copyAddress(const QHostAddress& address, quint8* field) {
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        Q_IPV6ADDR ipv6 = address.toIPv6Address();
+        ::memcpy(field, ipv6.c, 16);
+        return true;
+    } else {
+        quint32 ipv4 = qToBigEndian(address.toIPv4Address());
+        ::memset(field, 0, 16);
+        ::memcpy(field, &ipv4, sizeof(ipv4));
+        return false;
+    }
+}
+
+bool operator==(const FlowKey& lhs, const FlowKey& rhs) {
+    return ::memcmp(&lhs, &rhs, sizeof(FlowKey)) == 0;
+}
+
+// Finalizer from MurmurHash3 (public domain). Every input bit affects every output bit.
+static inline quint64 mix64(quint64 k) {
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+uint qHash(const FlowKey& key) {
+    quint64 words[sizeof(FlowKey) / sizeof(quint64)];
+    ::memcpy(words, &key, sizeof(words));
+    quint64 h = Q_UINT64_C(0x9e3779b97f4a7c15);
+    for (uint i = 0; i < sizeof(words) / sizeof(quint64); i++) {
+        // Mixing the running value in before each word makes the hash depend on word order.
+        h = mix64(h ^ words[i]) + i;
+    }
+    return (uint)(h ^ (h >> 32));
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWKEY_H_
+#define FLOWKEY_H_
+
+#include <QtCore/QtGlobal>
+
+#include "CommonTypes.h"
+
+class IpEndpointPair;
+class QHostAddress;
+
+/*
+ * Compact, fixed-size identity of a flow between two endpoints used on the packet capture path instead of
+ * IpEndpointPair. It is plain old data: it can be copied, compared, and hashed bytewise without touching the heap.
+ * IPv4 addresses occupy the first four bytes of an address field in network byte order; the rest of the field is
+ * zero. IPv6 addresses use all 16 bytes. Unused bytes must be zero, so always value-initialize new keys
+ * (e.g. "FlowKey key = FlowKey();").
+ */
+struct FlowKey {
+    quint8 localAddr[16];
+    quint8 remoteAddr[16];
+    quint16 localPort;
+    quint16 remotePort;
+    quint8 transport;           // an L4Protocol value
+    quint8 ipv6;                // non-zero if the addresses are IPv6
+    quint8 padding[2];          // always zero
+
+    // Transport layer protocol.
+    L4Protocol getTransport() const { return static_cast<L4Protocol>(transport); }
+
+    // True if the addresses are IPv6.
+    bool isIpv6() const { return ipv6 != 0; }
+
+    // Convert to an endpoint pair.
+    IpEndpointPair toEndpointPair() const;
+
+    // Convert from an endpoint pair. Both addresses must be of the same IP version.
+    static FlowKey fromEndpointPair(const IpEndpointPair& endpoints);
+
+    // Copy an address into one of the address fields in the key's format. Returns true if it's an IPv6 address.
+    static bool copyAddress(const QHostAddress& address, quint8* field);
+};
+
+// Bytewise equality.
+bool operator==(const FlowKey& lhs, const FlowKey& rhs);
+inline bool operator!=(const FlowKey& lhs, const FlowKey& rhs) { return !(lhs == rhs); }
+
+// Hash function for use in QHash and friends. Unlike the hash of IpEndpointPair, swapping the local and remote
+// endpoints changes the hash.
+uint qHash(const FlowKey& key);
+
+#endif /* FLOWKEY_H_ */
@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowSelection.h"
+#include "IpEndpointPair.h"
+#include "OsProcess.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QList>
+#include <QtCore/QListIterator>
+#include <QtDBus/QDBusArgument>
+
+FlowSelection::FlowSelection() {
+    _d = new FlowSelectionData();
+}
+
+FlowSelection::FlowSelection(FlowSortKey sortKey, int limit) {
+    _d = new FlowSelectionData();
+    _d->sortKey = sortKey;
+    _d->limit = limit;
+}
+
+bool FlowSelection::operator==(const FlowSelection& rhs) const {
+    if (_d == rhs._d)
+        return true;
+    return _d->sortKey == rhs.getSortKey()
+            && _d->limit == rhs.getLimit()
+            && _d->program == rhs.getProgram()
+            && _d->user == rhs.getUser()
+            && _d->minPort == rhs.getMinPort()
+            && _d->maxPort == rhs.getMaxPort()
+            && _d->remoteSubnet == rhs.getRemoteSubnet()
+            && _d->updateIntervalMs == rhs.getUpdateIntervalMs();
+}
+
+FlowSelection::~FlowSelection() {
+}
+
+void FlowSelection::setRemoteSubnet(const QString& remoteSubnet) {
+    _d->remoteSubnet = remoteSubnet;
+    if (remoteSubnet.isEmpty()) {
+        _d->parsedSubnet = qMakePair(QHostAddress(), -1);
+    } else {
+        _d->parsedSubnet = QHostAddress::parseSubnet(remoteSubnet);
+    }
+}
+
+bool FlowSelection::isValid() const {
+    return _d->sortKey >= SORT_BY_RATE && _d->sortKey <= SORT_BY_TOTAL
+            && _d->limit >= 0
+            && _d->updateIntervalMs >= 0
+            && _d->minPort <= _d->maxPort
+            && (_d->remoteSubnet.isEmpty() || _d->parsedSubnet.second >= 0);
+}
+
+bool FlowSelection::isRestrictive() const {
+    return _d->limit > 0 || !_d->program.isEmpty() || !_d->user.isEmpty() || _d->minPort > 0
+            || _d->maxPort < 65535 || !_d->remoteSubnet.isEmpty();
+}
+
+bool FlowSelection::matches(const IpEndpointPair& ipEndpointPair, const QList<OsProcess>& osProcesses) const {
+    ushort localPort = ipEndpointPair.getLocalPort();
+    ushort remotePort = ipEndpointPair.getRemotePort();
+    bool localInRange = localPort >= _d->minPort && localPort <= _d->maxPort;
+    bool remoteInRange = remotePort >= _d->minPort && remotePort <= _d->maxPort;
+    if (!localInRange && !remoteInRange) {
+        return false;
+    }
+    if (!_d->remoteSubnet.isEmpty() && !ipEndpointPair.getRemoteAddr().isInSubnet(_d->parsedSubnet)) {
+        return false;
+    }
+    if (_d->program.isEmpty() && _d->user.isEmpty()) {
+        return true;
+    }
+    QListIterator<OsProcess> i(osProcesses);
+    while (i.hasNext()) {
+        const OsProcess& osProcess = i.next();
+        if ((_d->program.isEmpty() || osProcess.getProgram() == _d->program)
+                && (_d->user.isEmpty() || osProcess.getUser() == _d->user)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qlonglong FlowSelection::sortValue(const FlowMetrics& metrics, const FlowStatistics& statistics) const {
+    switch (_d->sortKey) {
+    case SORT_BY_PEAK:
+        return statistics.getPeakBytesPerSec();
+    case SORT_BY_TOTAL:
+        return metrics.getTotalBytes();
+    default:
+        return statistics.getRecentBytesPerSec();
+    }
+}
+
+QString FlowSelection::toString() const {
+    return QString("Sort: %1 Limit: %2 Program: %3 User: %4 Ports: %5-%6 Subnet: %7 Interval: %8")
+            .arg(_d->sortKey)
+            .arg(_d->limit)
+            .arg(_d->program)
+            .arg(_d->user)
+            .arg(_d->minPort)
+            .arg(_d->maxPort)
+            .arg(_d->remoteSubnet)
+            .arg(_d->updateIntervalMs);
+}
+
+uint qHash(const FlowSelection& key) {
+    return qHash((int)key.getSortKey())
+            ^ qHash(key.getLimit())
+            ^ qHash(key.getProgram())
+            ^ qHash(key.getUser())
+            ^ qHash(((uint)key.getMinPort() << 16) | key.getMaxPort())
+            ^ qHash(key.getRemoteSubnet())
+            ^ qHash(key.getUpdateIntervalMs());
+}
+
+QDBusArgument& operator<<(QDBusArgument& arg, const FlowSelection& obj) {
+    arg.beginStructure();
+    arg << (int)obj.getSortKey() << obj.getLimit() << obj.getProgram() << obj.getUser() << obj.getMinPort()
+        << obj.getMaxPort() << obj.getRemoteSubnet() << obj.getUpdateIntervalMs();
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument& operator>>(const QDBusArgument& arg, FlowSelection& obj) {
+    arg.beginStructure();
+
+    int sortKeyEnc;
+    arg >> sortKeyEnc;
+    obj.setSortKey((FlowSortKey)sortKeyEnc);
+
+    int limit;
+    arg >> limit;
+    obj.setLimit(limit);
+
+    QString program;
+    arg >> program;
+    obj.setProgram(program);
+
+    QString user;
+    arg >> user;
+    obj.setUser(user);
+
+    ushort minPort;
+    arg >> minPort;
+    ushort maxPort;
+    arg >> maxPort;
+    obj.setPortRange(minPort, maxPort);
+
+    QString remoteSubnet;
+    arg >> remoteSubnet;
+    obj.setRemoteSubnet(remoteSubnet);
+
+    int updateIntervalMs;
+    arg >> updateIntervalMs;
+    obj.setUpdateIntervalMs(updateIntervalMs);
+
+    arg.endStructure();
+    return arg;
+}
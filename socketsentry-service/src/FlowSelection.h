@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWSELECTION_H_
+#define FLOWSELECTION_H_
+
+#include "FlowSelectionData.h"
+
+#include <QtCore/QMetaType>
+#include <QtCore/QSharedDataPointer>
+
+class QDBusArgument;
+class IpEndpointPair;
+class OsProcess;
+class FlowMetrics;
+class FlowStatistics;
+template<class T> class QList;
+
+/*
+ * Which flows of a device a client wants to see: those that pass a filter, optionally only the busiest few of them.
+ * The filter lets a flow through if one of its processes has the given program name and user (if set), one of its
+ * ports is in the given range, and its remote address is in the given subnet (if set). With a limit, only that many
+ * flows with the highest values of the sort key are selected, in descending order. Without one, all flows that pass
+ * the filter are selected, in no particular order.
+ *
+ * Each selection is a subscription of its own, so it also carries how often the client wants updates of it.
+ *
+ * A default selection lets every flow through at the watcher's usual pace.
+ */
+class FlowSelection {
+public:
+    FlowSelection();
+    FlowSelection(FlowSortKey sortKey, int limit);
+    bool operator==(const FlowSelection& rhs) const;
+    virtual ~FlowSelection();
+
+    FlowSortKey getSortKey() const { return _d->sortKey; }
+    void setSortKey(FlowSortKey sortKey) { _d->sortKey = sortKey; }
+
+    // Most flows to select, or 0 for no limit.
+    int getLimit() const { return _d->limit; }
+    void setLimit(int limit) { _d->limit = limit; }
+
+    // Program name and user of the processes to select flows of. Empty for any.
+    QString getProgram() const { return _d->program; }
+    void setProgram(const QString& program) { _d->program = program; }
+    QString getUser() const { return _d->user; }
+    void setUser(const QString& user) { _d->user = user; }
+
+    // Range of local or remote ports to select flows of (inclusive). Flows without ports have port 0.
+    ushort getMinPort() const { return _d->minPort; }
+    ushort getMaxPort() const { return _d->maxPort; }
+    void setPortRange(ushort minPort, ushort maxPort) { _d->minPort = minPort; _d->maxPort = maxPort; }
+
+    // Subnet of remote addresses to select flows of in CIDR notation (e.g. "10.0.0.0/8" or "2001:db8::/32"). Empty for
+    // any.
+    QString getRemoteSubnet() const { return _d->remoteSubnet; }
+    void setRemoteSubnet(const QString& remoteSubnet);
+
+    // Time between updates of the selection, or 0 for the watcher's default. Updates come no more often than the
+    // watcher wakes up, and less often while there's no traffic.
+    int getUpdateIntervalMs() const { return _d->updateIntervalMs; }
+    void setUpdateIntervalMs(int updateIntervalMs) { _d->updateIntervalMs = updateIntervalMs; }
+
+    // True if the selection can be applied: the sort key is known, the limit and update interval aren't negative, the
+    // port range isn't empty, and the remote subnet (if any) is valid.
+    bool isValid() const;
+
+    // True if the selection has a filter or a limit. Else, it selects every flow.
+    bool isRestrictive() const;
+
+    // True if a flow with the given endpoints and processes passes the filter.
+    bool matches(const IpEndpointPair& ipEndpointPair, const QList<OsProcess>& osProcesses) const;
+
+    // Value of the sort key for a flow with the given numbers.
+    qlonglong sortValue(const FlowMetrics& metrics, const FlowStatistics& statistics) const;
+
+    // Return a string for this object suitable for debugging, but not end-user consumption.
+    virtual QString toString() const;
+
+private:
+    QSharedDataPointer<FlowSelectionData> _d;
+};
+
+// Hash function so that selections can be used as keys.
+uint qHash(const FlowSelection& key);
+
+// DBUS argument marshalling.
+QDBusArgument& operator<<(QDBusArgument& argument, const FlowSelection& obj);
+// DBUS argument unmarshalling.
+const QDBusArgument& operator>>(const QDBusArgument& argument, FlowSelection& obj);
+
+// Make visible as a D-Bus data type.
+Q_DECLARE_METATYPE(FlowSelection)
+
+#endif /* FLOWSELECTION_H_ */
@@ -0,0 +1,50 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWSELECTIONDATA_H_
+#define FLOWSELECTIONDATA_H_
+
+#include "CommonTypes.h"
+
+#include <QtCore/QPair>
+#include <QtCore/QSharedData>
+#include <QtCore/QString>
+#include <QtNetwork/QHostAddress>
+
+/*
+ * Shared data for FlowSelection.
+ */
+class FlowSelectionData : public QSharedData {
+public:
+    FlowSelectionData();
+    virtual ~FlowSelectionData();
+
+    FlowSortKey sortKey;
+    int limit;
+    QString program;
+    QString user;
+    ushort minPort;
+    ushort maxPort;
+    QString remoteSubnet;
+    int updateIntervalMs;
+
+    // The remote subnet parsed into its network address and prefix length, or (null address, -1) if it's empty or
+    // invalid.
+    QPair<QHostAddress, int> parsedSubnet;
+};
+
+#endif /* FLOWSELECTIONDATA_H_ */
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowSlotTable.h"
+
+#include <string.h>
+
+const int FlowSlotTable::DEFAULT_MAX_FLOWS = 65536;
+
+// Capacity of a new table.
+static const int INITIAL_CAPACITY = 64;
+
+// True if a table of the given capacity holding the given number of flows is too full to take another one. Max load
+// is 7/8.
+static inline bool isTooFull(int size, int capacity) {
+    return (size + 1) * 8 > capacity * 7;
+}
+
+FlowSlotTable::FlowSlotTable(int maxFlows) :
+    _buckets(INITIAL_CAPACITY), _size(0), _maxFlows(maxFlows) {
+    ::memset(&_overflow, 0, sizeof(_overflow));
+}
+
+FlowSlotTable::~FlowSlotTable() {
+}
+
+bool FlowSlotTable::add(const FlowKey& flow, const FlowCounters& counters) {
+    const int capacity = _buckets.size();
+    const int mask = capacity - 1;
+    FlowSlotBucket* buckets = _buckets.data();  // detaches if shared
+    int pos = qHash(flow) & mask;
+    quint32 distance = 1;
+
+    // Look for the flow. With robin-hood placement, it can't be further away than an entry closer to its home.
+    while (buckets[pos].distance >= distance) {
+        if (buckets[pos].distance == distance && buckets[pos].key == flow) {
+            buckets[pos].counters.add(counters);
+            return true;
+        }
+        pos = (pos + 1) & mask;
+        distance++;
+    }
+
+    // It's a new flow. Is there room?
+    if (_size >= _maxFlows) {
+        _overflow.add(counters);
+        return false;
+    }
+    if (isTooFull(_size, capacity)) {
+        rehash(capacity * 2);
+        buckets = _buckets.data();
+        FlowSlotBucket* bucket = insertNew(buckets, _buckets.size(), flow);
+        bucket->counters = counters;
+    } else {
+        FlowSlotBucket* bucket = insertNew(buckets, capacity, flow);
+        bucket->counters = counters;
+    }
+    _size++;
+    return true;
+}
+
+FlowSlotBucket* FlowSlotTable::insertNew(FlowSlotBucket* buckets, int capacity, const FlowKey& flow) {
+    const int mask = capacity - 1;
+    int pos = qHash(flow) & mask;
+    FlowSlotBucket carry;
+    carry.key = flow;
+    ::memset(&carry.counters, 0, sizeof(carry.counters));
+    carry.distance = 1;
+    FlowSlotBucket* result = NULL;
+    while (true) {
+        FlowSlotBucket& bucket = buckets[pos];
+        if (bucket.distance == 0) {
+            // Empty. Done.
+            bucket = carry;
+            return result ? result : &bucket;
+        } else if (bucket.distance < carry.distance) {
+            // The resident is closer to home than we are. Take its place and move it along instead.
+            qSwap(bucket, carry);
+            if (!result) {
+                result = &bucket;
+            }
+        }
+        pos = (pos + 1) & mask;
+        carry.distance++;
+    }
+}
+
+const FlowCounters* FlowSlotTable::find(const FlowKey& flow) const {
+    const int mask = _buckets.size() - 1;
+    const FlowSlotBucket* buckets = _buckets.constData();
+    int pos = qHash(flow) & mask;
+    quint32 distance = 1;
+    while (buckets[pos].distance >= distance) {
+        if (buckets[pos].distance == distance && buckets[pos].key == flow) {
+            return &buckets[pos].counters;
+        }
+        pos = (pos + 1) & mask;
+        distance++;
+    }
+    return NULL;
+}
+
+void FlowSlotTable::rehash(int newCapacity) {
+    QVector<FlowSlotBucket> old = _buckets;
+    _buckets = QVector<FlowSlotBucket>(newCapacity);    // zero-filled, so all empty
+    FlowSlotBucket* buckets = _buckets.data();
+    const FlowSlotBucket* oldBuckets = old.constData();
+    for (int i = 0; i < old.size(); i++) {
+        if (oldBuckets[i].distance) {
+            insertNew(buckets, newCapacity, oldBuckets[i].key)->counters = oldBuckets[i].counters;
+        }
+    }
+}
+
+void FlowSlotTable::clear() {
+    if (_size > 0) {
+        if (_buckets.isDetached()) {
+            // Reuse the memory.
+            FlowSlotBucket* buckets = _buckets.data();
+            for (int i = 0; i < _buckets.size(); i++) {
+                buckets[i].distance = 0;
+            }
+        } else {
+            // A copy is still using the memory. Don't touch it.
+            _buckets = QVector<FlowSlotBucket>(_buckets.size());
+        }
+        _size = 0;
+    }
+    ::memset(&_overflow, 0, sizeof(_overflow));
+}
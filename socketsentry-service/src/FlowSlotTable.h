@@ -0,0 +1,153 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWSLOTTABLE_H_
+#define FLOWSLOTTABLE_H_
+
+#include <QtCore/QVector>
+
+#include "FlowKey.h"
+
+// Traffic counters of one flow.
+struct FlowCounters {
+    qlonglong bytesIn;
+    qlonglong bytesOut;
+    qlonglong packetsIn;
+    qlonglong packetsOut;
+
+    // Add another set of counters to this one.
+    void add(const FlowCounters& other) {
+        bytesIn += other.bytesIn;
+        bytesOut += other.bytesOut;
+        packetsIn += other.packetsIn;
+        packetsOut += other.packetsOut;
+    }
+
+    // Subtract another set of counters from this one.
+    void subtract(const FlowCounters& other) {
+        bytesIn -= other.bytesIn;
+        bytesOut -= other.bytesOut;
+        packetsIn -= other.packetsIn;
+        packetsOut -= other.packetsOut;
+    }
+};
+
+// An entry in a FlowSlotTable. A distance of zero means the bucket is empty. Otherwise, it's one more than the number
+// of buckets between the entry's home bucket (given by its hash) and where it's stored.
+struct FlowSlotBucket {
+    FlowKey key;
+    FlowCounters counters;
+    quint32 distance;
+};
+
+Q_DECLARE_TYPEINFO(FlowSlotBucket, Q_PRIMITIVE_TYPE);
+
+/*
+ * Flat, open-addressing hash table of flow counters for one second of network history. Entries are stored inline in
+ * a single array and placed with robin-hood hashing, which keeps probe sequences short even when the table is nearly
+ * full. Clearing the table keeps its memory, so a table reused every time history rolls around stops allocating once
+ * it has grown to fit the traffic. The table never grows beyond a configurable number of flows; records of new flows
+ * beyond that are dropped and counted as overflow.
+ *
+ * The storage is implicitly shared, so copies are cheap until one of them is modified.
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class FlowSlotTable {
+public:
+    // New, empty table that holds up to the given number of flows.
+    explicit FlowSlotTable(int maxFlows = DEFAULT_MAX_FLOWS);
+    virtual ~FlowSlotTable();
+
+    // Add counters to the given flow, inserting the flow if it's new. Returns true if successful. If the table is
+    // already holding the maximum number of flows and the flow is new, the counters are added to the overflow
+    // instead and false is returned.
+    bool add(const FlowKey& flow, const FlowCounters& counters);
+
+    // Get the counters of the given flow or NULL if the table doesn't have it.
+    const FlowCounters* find(const FlowKey& flow) const;
+
+    // Remove all flows and reset the overflow. Memory is retained for reuse unless it's shared with a copy.
+    void clear();
+
+    // Number of flows in the table.
+    int size() const { return _size; }
+    bool isEmpty() const { return _size == 0; }
+
+    // Number of entries the table has room for before it has to grow.
+    int capacity() const { return _buckets.size(); }
+
+    // Max number of flows.
+    int getMaxFlows() const { return _maxFlows; }
+
+    // Change the max number of flows. Flows already in the table are kept even if there are more than the new max.
+    void setMaxFlows(int maxFlows) { _maxFlows = maxFlows; }
+
+    // Sum of the counters that couldn't be recorded because the table was full.
+    const FlowCounters& getOverflow() const { return _overflow; }
+
+    // Default max number of flows.
+    static const int DEFAULT_MAX_FLOWS;
+
+private:
+    friend class FlowSlotTableIterator;
+
+    // Grow to the given capacity (a power of two), moving all entries.
+    void rehash(int newCapacity);
+
+    // Insert an entry known not to be in the table, robin-hood style. Returns the entry's new location.
+    FlowSlotBucket* insertNew(FlowSlotBucket* buckets, int capacity, const FlowKey& flow);
+
+    QVector<FlowSlotBucket> _buckets;           // the table (size is always a power of two)
+    int _size;                          // number of flows
+    int _maxFlows;                      // max number of flows
+    FlowCounters _overflow;             // counters of flows that didn't fit
+};
+
+Q_DECLARE_TYPEINFO(FlowSlotTable, Q_MOVABLE_TYPE);
+
+/*
+ * Java-style iterator over the flows in a FlowSlotTable, in no particular order. Modifying the table while iterating
+ * over it is not allowed.
+ */
+class FlowSlotTableIterator {
+public:
+    FlowSlotTableIterator(const FlowSlotTable& table) :
+        _buckets(table._buckets.constData()), _capacity(table._buckets.size()), _pos(-1), _next(-1) {
+        advance();
+    }
+
+    bool hasNext() const { return _next < _capacity; }
+    void next() { _pos = _next; advance(); }
+    const FlowKey& key() const { return _buckets[_pos].key; }
+    const FlowCounters& value() const { return _buckets[_pos].counters; }
+
+private:
+    // Move the look-ahead position to the next used bucket.
+    void advance() {
+        do {
+            _next++;
+        } while (_next < _capacity && _buckets[_next].distance == 0);
+    }
+
+    const FlowSlotBucket* _buckets;
+    int _capacity;
+    int _pos;
+    int _next;
+};
+
+#endif /* FLOWSLOTTABLE_H_ */
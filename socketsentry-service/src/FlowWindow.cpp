@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowWindow.h"
+
+FlowWindow::FlowWindow() : _recentBytesIn(0), _recentBytesOut(0), _slotCount(0) {
+    _totals.bytesIn = _totals.bytesOut = _totals.packetsIn = _totals.packetsOut = 0;
+}
+
+FlowWindow::~FlowWindow() {
+}
+
+void FlowWindow::addSlot(const FlowCounters& counters, bool newSlot) {
+    _totals.add(counters);
+    if (newSlot) {
+        _slotCount++;
+    }
+}
+
+void FlowWindow::removeSlot(const FlowCounters& counters) {
+    _totals.subtract(counters);
+    _slotCount--;
+}
+
+void FlowWindow::raisePeak(time_t time, qlonglong bytes) {
+    // Find the first sample at or after the given time.
+    int pos = _peaks.size();
+    while (pos > 0 && _peaks.at(pos - 1).time >= time) {
+        pos--;
+    }
+    if (pos < _peaks.size()) {
+        if (_peaks.at(pos).bytes >= bytes) {
+            // A sample at least as large lasts at least as long, so this one can never be the peak.
+            return;
+        }
+        if (_peaks.at(pos).time == time) {
+            _peaks.remove(pos);
+        }
+    }
+
+    // Earlier samples that are no larger can never be the peak again.
+    while (pos > 0 && _peaks.at(pos - 1).bytes <= bytes) {
+        _peaks.remove(--pos);
+    }
+    PeakSample sample;
+    sample.time = time;
+    sample.bytes = bytes;
+    _peaks.insert(pos, sample);
+}
+
+void FlowWindow::expirePeaks(time_t time) {
+    int expired = 0;
+    while (expired < _peaks.size() && _peaks.at(expired).time <= time) {
+        expired++;
+    }
+    if (expired) {
+        _peaks.remove(0, expired);
+    }
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWWINDOW_H_
+#define FLOWWINDOW_H_
+
+#include <QtCore/QVector>
+
+#include <time.h>
+
+#include "FlowSlotTable.h"
+
+// Total bytes of a flow in one time slot, as tracked for the peak rate.
+struct PeakSample {
+    time_t time;
+    qlonglong bytes;
+};
+
+Q_DECLARE_TYPEINFO(PeakSample, Q_PRIMITIVE_TYPE);
+
+/*
+ * Running totals of one flow over the time slots in a network history's statistics window. The totals are adjusted
+ * as slots enter and leave the window, so the flow's statistics can be read without rescanning the slots. The peak
+ * rate is tracked with a monotonic queue: samples are ordered by time with strictly decreasing byte counts, so the
+ * first one is always the peak of the window.
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class FlowWindow {
+public:
+    FlowWindow();
+    virtual ~FlowWindow();
+
+    // Add a slot's counters to the totals. "newSlot" is true if the flow was not yet in that slot.
+    void addSlot(const FlowCounters& counters, bool newSlot);
+
+    // Subtract the counters of a slot that has left the window.
+    void removeSlot(const FlowCounters& counters);
+
+    // Add to the recent byte totals. Negative values subtract.
+    void addRecent(qlonglong bytesIn, qlonglong bytesOut) {
+        _recentBytesIn += bytesIn;
+        _recentBytesOut += bytesOut;
+    }
+
+    // Set the total bytes of the flow at the given time for peak tracking. This works both for a slot that has just
+    // entered the window and for one whose total has grown since.
+    void raisePeak(time_t time, qlonglong bytes);
+
+    // Drop peak samples at or before the given time.
+    void expirePeaks(time_t time);
+
+    // Number of slots in the window in which the flow appears.
+    int getSlotCount() const { return _slotCount; }
+
+    // Counters summed over the window.
+    const FlowCounters& getTotals() const { return _totals; }
+
+    // Bytes summed over the recent part of the window.
+    qlonglong getRecentBytesIn() const { return _recentBytesIn; }
+    qlonglong getRecentBytesOut() const { return _recentBytesOut; }
+
+    // Highest total bytes of any slot in the window.
+    qlonglong getPeakBytes() const { return _peaks.isEmpty() ? 0 : _peaks.first().bytes; }
+
+private:
+    FlowCounters _totals;
+    qlonglong _recentBytesIn;
+    qlonglong _recentBytesOut;
+    int _slotCount;
+
+    // Monotonic queue of peak candidates. Holds at most one sample per slot in the window.
+    QVector<PeakSample> _peaks;
+};
+
+#endif /* FLOWWINDOW_H_ */
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "HistoryTier.h"
+
+#include <QtCore/QtAlgorithms>
+
+const int HistoryTier::DEFAULT_MAX_FLOWS_PER_BUCKET = 256;
+
+HistoryTier::HistoryTier(int bucketSecs, int bucketCount, int maxFlowsPerBucket) :
+    _bucketSecs(bucketSecs), _bucketCount(bucketCount), _maxFlowsPerBucket(maxFlowsPerBucket), _openStart(0),
+    _sealed(bucketCount), _sealedStart(bucketCount) {
+}
+
+HistoryTier::~HistoryTier() {
+}
+
+void HistoryTier::record(const FlowKey& flow, const FlowCounters& counters, const time_t& time) {
+    rollForward(time);
+    if (time >= _openStart) {
+        _open.add(flow, counters);
+    } // Else, the bucket is sealed. Skip it.
+}
+
+void HistoryTier::recordSlot(const FlowSlotTable& slot, const time_t& time) {
+    rollForward(time);
+    if (time >= _openStart) {
+        FlowSlotTableIterator iter(slot);
+        while (iter.hasNext()) {
+            iter.next();
+            _open.add(iter.key(), iter.value());
+        }
+    }
+}
+
+void HistoryTier::rollForward(const time_t& rollTo) {
+    time_t start = rollTo - rollTo % _bucketSecs;
+    if (_openStart < start) {
+        seal();
+        _open.clear();
+        _openStart = start;
+    }
+}
+
+void HistoryTier::seal() {
+    QVector<TierEntry> entries(_open.size());
+    TierEntry* entry = entries.data();
+    FlowSlotTableIterator iter(_open);
+    while (iter.hasNext()) {
+        iter.next();
+        entry->flow = iter.key();
+        entry->counters = iter.value();
+        entry++;
+    }
+    if (entries.size() > _maxFlowsPerBucket) {
+        qSort(entries.begin(), entries.end(), HistoryTier::busierThan);
+        entries.resize(_maxFlowsPerBucket);
+        entries.squeeze();
+    }
+    int index = indexOf(_openStart);
+    _sealed[index] = entries;
+    _sealedStart[index] = _openStart;
+}
+
+void HistoryTier::exportSince(const time_t& startTime, QHash<FlowKey, FlowWindow>& result) const {
+    // Oldest bucket still in the tier, or the one that overlaps the start time if that's later.
+    time_t oldest = qMax(_openStart - (_bucketCount - 1) * _bucketSecs, startTime - startTime % _bucketSecs);
+    oldest = qMax(oldest, (time_t)0);
+    for (time_t start = oldest; start < _openStart; start += _bucketSecs) {
+        int index = indexOf(start);
+        if (_sealedStart.at(index) == start) {
+            const QVector<TierEntry>& entries = _sealed.at(index);
+            for (int i = 0; i < entries.size(); i++) {
+                const TierEntry& entry = entries.at(i);
+                FlowWindow& window = result[entry.flow];
+                window.addSlot(entry.counters, true);
+                window.raisePeak(start, entry.counters.bytesIn + entry.counters.bytesOut);
+            }
+        } // Else, nothing was recorded in that bucket.
+    }
+    FlowSlotTableIterator iter(_open);
+    while (iter.hasNext()) {
+        iter.next();
+        const FlowCounters& counters = iter.value();
+        FlowWindow& window = result[iter.key()];
+        window.addSlot(counters, true);
+        window.raisePeak(_openStart, counters.bytesIn + counters.bytesOut);
+    }
+}
+
+bool HistoryTier::busierThan(const TierEntry& entry1, const TierEntry& entry2) {
+    return entry1.counters.bytesIn + entry1.counters.bytesOut > entry2.counters.bytesIn + entry2.counters.bytesOut;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef HISTORYTIER_H_
+#define HISTORYTIER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+#include <time.h>
+
+#include "FlowKey.h"
+#include "FlowSlotTable.h"
+#include "FlowWindow.h"
+
+// A flow's traffic in one sealed bucket of a history tier.
+struct TierEntry {
+    FlowKey flow;
+    FlowCounters counters;
+};
+
+Q_DECLARE_TYPEINFO(TierEntry, Q_PRIMITIVE_TYPE);
+
+/*
+ * A downsampled tier of network history. The tier is a ring of buckets that each sum the traffic of a fixed number of
+ * seconds. The newest bucket is open and collects every flow. When time moves past it, the bucket is sealed: only its
+ * busiest flows are kept (the rest are dropped) and it's stored compactly in the ring. This bounds the memory of a
+ * tier regardless of how many flows pass through it.
+ *
+ * Seconds are expected to arrive in order. Traffic for a time before the open bucket is ignored.
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class HistoryTier {
+public:
+    // New tier of the given number of buckets, each covering the given number of seconds. Sealed buckets keep at
+    // most the given number of flows.
+    HistoryTier(int bucketSecs = 1, int bucketCount = 1, int maxFlowsPerBucket = DEFAULT_MAX_FLOWS_PER_BUCKET);
+    virtual ~HistoryTier();
+
+    // Add traffic of a flow at the given time. The tier is rolled forward to the time first (if necessary).
+    void record(const FlowKey& flow, const FlowCounters& counters, const time_t& time);
+
+    // Add all traffic of one second of history.
+    void recordSlot(const FlowSlotTable& slot, const time_t& time);
+
+    // Roll the tier forward (if necessary) so the open bucket includes the given time, sealing the previous one.
+    void rollForward(const time_t& rollTo);
+
+    // Fold the traffic of every bucket that overlaps the time range starting at the given time into the result.
+    // Each bucket is added to the flow windows as one slot, so the peaks are the busiest bucket of each flow.
+    void exportSince(const time_t& startTime, QHash<FlowKey, FlowWindow>& result) const;
+
+    // Seconds covered by each bucket.
+    int getBucketSecs() const { return _bucketSecs; }
+
+    // Seconds covered by the whole tier.
+    int getSpanSecs() const { return _bucketSecs * _bucketCount; }
+
+    // Default max number of flows kept in a sealed bucket.
+    static const int DEFAULT_MAX_FLOWS_PER_BUCKET;
+
+private:
+    // Keep the busiest flows of the open bucket in its place in the ring.
+    void seal();
+
+    // True if a flow's traffic in a bucket is more than another's.
+    static bool busierThan(const TierEntry& entry1, const TierEntry& entry2);
+
+    // Get the index of a bucket start time in the ring.
+    int indexOf(const time_t& start) const { return (start / _bucketSecs) % _bucketCount; }
+
+    int _bucketSecs;                    // seconds per bucket
+    int _bucketCount;                   // number of buckets, including the open one
+    int _maxFlowsPerBucket;             // max flows kept in a sealed bucket
+
+    FlowSlotTable _open;                // traffic of the open bucket
+    time_t _openStart;                  // start time of the open bucket
+
+    QVector<QVector<TierEntry> > _sealed;   // ring of sealed buckets
+    QVector<time_t> _sealedStart;           // start time of each sealed bucket (to detect stale ones)
+};
+
+Q_DECLARE_TYPEINFO(HistoryTier, Q_MOVABLE_TYPE);
+
+#endif /* HISTORYTIER_H_ */
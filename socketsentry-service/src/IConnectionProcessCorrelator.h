@@ -21,6 +21,7 @@
 
 template <class K, class V> class QHash;
 template <class E> class QList;
+template <class T> class QSet;
 class IpEndpointPair;
 class OsProcess;
 class QHostAddress;
@@ -42,7 +43,15 @@ public:
     //
     // The caller supplies an empty result object to receive the output. It returns true on success. If it fails
     // to obtain the data it needs from the OS, it returns false and the error argument is populated with a message.
+    // The watcher calls this method on a worker thread, but never on more than one thread at a time.
     virtual bool correlate(QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error) = 0;
+
+    // Like correlate, but only look for the given endpoint pairs, typically ones seen in captured traffic that an
+    // earlier correlation didn't include. The result holds those that match a connection, and possibly their IPv4 or
+    // IPv6 counterparts. Endpoint pairs without a connection are left out. This is much cheaper than a full
+    // correlation when there are few endpoint pairs to look for. It has the same threading rules as correlate.
+    virtual bool correlateEndpoints(const QSet<IpEndpointPair>& endpoints,
+            QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error) = 0;
 };
 
 #endif /* ICONNECTIONPROCESSCORRELATOR_H_ */
@@ -61,6 +61,10 @@ public:
     virtual bool fillStatistics(const QString& device, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
             QString& error) const = 0;
 
+    // Same as above, but for a longer time range of the given number of seconds, taken from the downsampled history.
+    virtual bool fillHistory(const QString& device, int windowSecs,
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error) const = 0;
+
     // Returns true if the manager is currently capturing on the device. Returns false if the manager is not managing
     // the device OR the capture has stopped due to an error, expiration, or cancellation. If a client finds that a
     // previously active capture has become inactive, it may call "release" to reset the device, cleaning any error state.
@@ -72,8 +76,9 @@ public:
     // Stop capturing packets on all devices and mark resources for cleanup.
     virtual void releaseAll() = 0;
 
-    // Check to see if any devices have seen traffic since the specified time.
-    virtual bool anyTrafficSince(time_t timeSecs) const = 0;
+    // Check to see if the device has seen no traffic for more than the given number of seconds, measured on the clock
+    // of its capture (see IPcapThread::isIdle). A device that isn't being captured is idle.
+    virtual bool isIdle(const QString& device, int secs) const = 0;
 
     // Returns true if the manager is not managing any packet capture threads.
     virtual bool isStopped() const = 0;
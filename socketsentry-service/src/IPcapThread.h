@@ -54,14 +54,20 @@ public:
     // the problem.
     virtual bool fillStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error) = 0;
 
+    // Same as above, but for a longer time range of the given number of seconds, taken from the downsampled history.
+    // See NetworkHistory::exportHistory.
+    virtual bool fillHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+            QString& error) = 0;
+
     // Start the thread running. (Synonym for non-virtual method QThread::start.)
     virtual void begin() = 0;
 
     // Has the thread finished running? (Synonym for non-virtual method QThread::isFinished.)
     virtual bool isDone() const = 0;
 
-    // Check to see if the device has seen traffic since the specified time.
-    virtual bool anyTrafficSince(time_t timeSecs) const = 0;
+    // Check to see if the device has seen no traffic for more than the given number of seconds. Time is measured on the
+    // capture's own clock, so a replayed trace is idle only when the trace has a gap.
+    virtual bool isIdle(int secs) const = 0;
 
     // True only if the thread has not expired, has no error, and has not been canceled.
     // When the thread can no longer continue, it automatically ends the packet capture and
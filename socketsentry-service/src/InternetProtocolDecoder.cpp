@@ -23,6 +23,9 @@
 #include <QtNetwork/QHostAddress>
 #include <QtNetwork/QNetworkAddressEntry>
 #include <QtCore/QPair>
+#include <QtCore/QtEndian>
+
+#include <string.h>
 
 #include "CommonTypes.h"
 #include "IpEndpointPair.h"
@@ -36,20 +39,51 @@ struct TransportHeader {
     u_int16_t	destPort;
 };
 
-InternetProtocolDecoder::InternetProtocolDecoder() {
+InternetProtocolDecoder::InternetProtocolDecoder() :
+    _anyIpv4MulticastLocal(false) {
 }
 
 InternetProtocolDecoder::~InternetProtocolDecoder() {
 }
 
-Direction InternetProtocolDecoder::decode(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const {
-    Direction result = tryIpv4(linkLayerDirection, caplen, packet, endpoints);
+void InternetProtocolDecoder::setLocalAddresses(const QList<QNetworkAddressEntry>& localAddresses) {
+    _localAddresses = localAddresses;
+
+    // Convert the addresses up front so decoding doesn't have to.
+    _localKeys.clear();
+    _ipv4Broadcasts.clear();
+    _anyIpv4MulticastLocal = false;
+    foreach (const QNetworkAddressEntry& entry, _localAddresses) {
+        LocalAddress local;
+        local.ipv6 = FlowKey::copyAddress(entry.ip(), local.addr);
+        _localKeys.append(local);
+        if (entry.broadcast().protocol() == QAbstractSocket::IPv4Protocol) {
+            _ipv4Broadcasts.append(qToBigEndian(entry.broadcast().toIPv4Address()));
+        }
+        quint32 firstQuad = entry.ip().toIPv4Address() >> 24;
+        if (firstQuad >= 224 && firstQuad <= 239) {
+            _anyIpv4MulticastLocal = true;
+        }
+    }
+}
+
+Direction InternetProtocolDecoder::decode(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const {
+    Direction result = tryIpv4(linkLayerDirection, caplen, packet, flow);
     if (result != UNKNOWN_DIRECTION) return result;
-    result = tryIpv6(linkLayerDirection, caplen, packet, endpoints);
+    result = tryIpv6(linkLayerDirection, caplen, packet, flow);
+    return result;
+}
+
+Direction InternetProtocolDecoder::decode(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const {
+    FlowKey flow = FlowKey();
+    Direction result = decode(linkLayerDirection, caplen, packet, flow);
+    if (result != UNKNOWN_DIRECTION) {
+        endpoints = flow.toEndpointPair();
+    }
     return result;
 }
 
-Direction InternetProtocolDecoder::tryIpv4(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const {
+Direction InternetProtocolDecoder::tryIpv4(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const {
     Q_ASSERT(packet);
     Direction result = UNKNOWN_DIRECTION;
     if (caplen > sizeof(ip)) {
@@ -62,18 +96,20 @@ Direction InternetProtocolDecoder::tryIpv4(const Direction linkLayerDirection, u
                 TransportHeader* trptr = (TransportHeader*)trPacket;
                 u_int16_t srcPort = ntohs(trptr->srcPort);
                 u_int16_t destPort = ntohs(trptr->destPort);
-                // Determine the source and destination addresses.
-                QHostAddress srcAddr(ntohl(iptr->ip_src.s_addr));
-                QHostAddress destAddr(ntohl(iptr->ip_dst.s_addr));
+                // Determine the source and destination addresses. They're already in flow key format.
+                quint8 srcAddr[16] = { 0 };
+                quint8 destAddr[16] = { 0 };
+                ::memcpy(srcAddr, &iptr->ip_src, 4);
+                ::memcpy(destAddr, &iptr->ip_dst, 4);
                 // Determine the direction.
                 result = linkLayerDirection;
                 if (result == UNKNOWN_DIRECTION) {
                     // Data link decoder couldn't determine direction. Let's try to do it by IP.
-                    result  = findDirection(srcAddr, destAddr, 4);
+                    result  = findDirection(srcAddr, destAddr, false);
                 }
                 if (result != UNKNOWN_DIRECTION) {
                     L4Protocol transport = iptr->ip_p == IPPROTO_TCP ? TCP : UDP;
-                    populateEndpoints(result, srcAddr, srcPort, destAddr, destPort, transport, endpoints);
+                    populateFlow(result, srcAddr, srcPort, destAddr, destPort, transport, false, flow);
                 }
             }
         }
@@ -82,37 +118,33 @@ Direction InternetProtocolDecoder::tryIpv4(const Direction linkLayerDirection, u
     return result;
 }
 
-Direction InternetProtocolDecoder::findDirection(const QHostAddress& srcAddr, const QHostAddress& destAddr, uint ipVersion) const {
+Direction InternetProtocolDecoder::findDirection(const quint8* srcAddr, const quint8* destAddr, bool ipv6) const {
     // First see if the source or destination IP address can be matched up to one of the interface addresses.
-     QListIterator<QNetworkAddressEntry> i(_localAddresses);
-     while (i.hasNext()) {
-         const QNetworkAddressEntry& entry = i.next();
-         QHostAddress ip = entry.ip();
-         if(srcAddr == ip) {
-             return OUTBOUND;
-         } else if (destAddr == ip) {
-             return INBOUND;
-         }
-     }
-
-     if (ipVersion == 4) {
-         // Is it IPv4 broadcast or multicast?
-         i.toFront();
-         while (i.hasNext()) {
-             const QNetworkAddressEntry& entry = i.next();
-             if (destAddr == entry.broadcast()) {
-                 return INBOUND;	// IPv4 broadcast, treat as incoming
-             } else {
-                 quint32 firstQuad = entry.ip().toIPv4Address() >> 24;
-                 if (firstQuad >= 224 && firstQuad <= 239) {
-                     return INBOUND;	// IPv4 multicast, treat as incoming
-                 }
-             }
-         }
-     }
-
-     // We don't handle IPv6 directionality for multicast (yet).
-     // Hopefully the link layer decoder has determined it for us.
+    for (int i = 0; i < _localKeys.size(); i++) {
+        const LocalAddress& local = _localKeys[i];
+        if (local.ipv6 != ipv6) {
+            continue;
+        }
+        if (::memcmp(srcAddr, local.addr, 16) == 0) {
+            return OUTBOUND;
+        } else if (::memcmp(destAddr, local.addr, 16) == 0) {
+            return INBOUND;
+        }
+    }
+
+    if (!ipv6) {
+        // Is it IPv4 broadcast or multicast?
+        quint32 destIpv4;
+        ::memcpy(&destIpv4, destAddr, sizeof(destIpv4));
+        if (_ipv4Broadcasts.contains(destIpv4)) {
+            return INBOUND;     // IPv4 broadcast, treat as incoming
+        } else if (_anyIpv4MulticastLocal) {
+            return INBOUND;     // IPv4 multicast, treat as incoming
+        }
+    }
+
+    // We don't handle IPv6 directionality for multicast (yet).
+    // Hopefully the link layer decoder has determined it for us.
 
     return UNKNOWN_DIRECTION;
 }
@@ -161,15 +193,15 @@ bool InternetProtocolDecoder::findIpv6Transport(uint caplen, const u_char* heade
     return false;
 }
 
-Direction InternetProtocolDecoder::tryIpv6(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const {
+Direction InternetProtocolDecoder::tryIpv6(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const {
     Q_ASSERT(packet);
     Direction result = UNKNOWN_DIRECTION;
     if (caplen > sizeof(ip6_hdr)) {
         ip6_hdr* iptr = (ip6_hdr*)packet;
         if ((iptr->ip6_vfc >> 4) == 6) {
-            // Looks like an IPv6 header. So far so good.
-            QHostAddress srcAddr((quint8*)&iptr->ip6_src);
-            QHostAddress destAddr((quint8*)&iptr->ip6_dst);
+            // Looks like an IPv6 header. So far so good. The addresses are already in flow key format.
+            const quint8* srcAddr = (const quint8*)&iptr->ip6_src;
+            const quint8* destAddr = (const quint8*)&iptr->ip6_dst;
             const u_char* nextHeader = packet + sizeof(ip6_hdr);
             TransportSummary transport;
             if (findIpv6Transport(caplen - sizeof(ip6_hdr), nextHeader, iptr->ip6_nxt, transport)) {
@@ -177,11 +209,11 @@ Direction InternetProtocolDecoder::tryIpv6(const Direction linkLayerDirection, u
                 result = linkLayerDirection;
                 if (result == UNKNOWN_DIRECTION) {
                     // Data link decoder couldn't determine direction. Let's try to do it by IP.
-                    result = findDirection(srcAddr, destAddr, 6);
+                    result = findDirection(srcAddr, destAddr, true);
                 }
                 if (result != UNKNOWN_DIRECTION) {
-                    populateEndpoints(result, srcAddr, transport.srcPort, destAddr, transport.destPort,
-                            transport.protocol, endpoints);
+                    populateFlow(result, srcAddr, transport.srcPort, destAddr, transport.destPort,
+                            transport.protocol, true, flow);
                 }
             }
         }
@@ -189,29 +221,29 @@ Direction InternetProtocolDecoder::tryIpv6(const Direction linkLayerDirection, u
     return result;
 }
 
-void InternetProtocolDecoder::populateEndpoints(const Direction direction, const QHostAddress& srcAddr,
-        const u_int16_t srcPort, const QHostAddress& destAddr, const u_int16_t destPort,
-        const L4Protocol l4protocol, IpEndpointPair& output) const {
+void InternetProtocolDecoder::populateFlow(const Direction direction, const quint8* srcAddr,
+        const u_int16_t srcPort, const quint8* destAddr, const u_int16_t destPort,
+        const L4Protocol l4protocol, bool ipv6, FlowKey& output) const {
 
     // Populate the result.
     switch (direction) {
     case INBOUND:
-        output.setLocalAddr(destAddr);
-        output.setLocalPort(destPort);
-        output.setRemoteAddr(srcAddr);
-        output.setRemotePort(srcPort);
-        output.setTransport(l4protocol);
+        ::memcpy(output.localAddr, destAddr, 16);
+        output.localPort = destPort;
+        ::memcpy(output.remoteAddr, srcAddr, 16);
+        output.remotePort = srcPort;
+        output.transport = l4protocol;
         break;
     case OUTBOUND:
-        output.setLocalAddr(srcAddr);
-        output.setLocalPort(srcPort);
-        output.setRemoteAddr(destAddr);
-        output.setRemotePort(destPort);
-        output.setTransport(l4protocol);
+        ::memcpy(output.localAddr, srcAddr, 16);
+        output.localPort = srcPort;
+        ::memcpy(output.remoteAddr, destAddr, 16);
+        output.remotePort = destPort;
+        output.transport = l4protocol;
         break;
     default:
-        break;
+        return;
     }
-
+    output.ipv6 = ipv6;
+    ::memset(output.padding, 0, sizeof(output.padding));
 }
-
@@ -20,8 +20,10 @@
 
 
 #include "CommonTypes.h"
+#include "FlowKey.h"
 
 #include <QtCore/QList>
+#include <QtCore/QVector>
 #include <QtNetwork/QNetworkAddressEntry>
 #include <sys/types.h>
 
@@ -37,8 +39,8 @@ struct TransportSummary {
 };
 
 /*
- * Decodes IP headers and transport layer type and ports to produce an IP endpoint pair. This decoder supports both
- * IPv4 and IPv6 headers.
+ * Decodes IP headers and transport layer type and ports to produce a flow key (or IP endpoint pair). This decoder
+ * supports both IPv4 and IPv6 headers. Decoding to a flow key does not allocate memory.
  */
 class InternetProtocolDecoder {
 public:
@@ -46,26 +48,36 @@ public:
     virtual ~InternetProtocolDecoder();
 
 
-    // Decode the given TCP/IP or UDP/IP header to determine the endpoint pair and direction of traffic flow.
+    // Decode the given TCP/IP or UDP/IP header to determine the flow key and direction of traffic flow.
     // Caller supplies the directionality from the data link layer (if known), a pointer to the start of the IP header,
     // and the length of the captured packet (excluding data link layer encapsulation) as input. This method attempts
-    // to decode the packet and populate the endpoint pair output parameter with the two endpoints. If it successfully
+    // to decode the packet and populate the flow key output parameter with the two endpoints. If it successfully
     // decodes the packet, it returns the final direction of the traffic flow. Else, it returns UNKNOWN_DIRECTION and
-    // the endpoint pair output parameter is unchanged.
+    // the flow key output parameter is unchanged.
+    Direction decode(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const;
+
+    // Same as above, but the result is converted to an endpoint pair.
     Direction decode(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const;
 
     const QList<QNetworkAddressEntry>& getLocalAddresses() const { return this->_localAddresses; }
-    void setLocalAddresses(const QList<QNetworkAddressEntry>& localAddresses) { this->_localAddresses = localAddresses; }
+    void setLocalAddresses(const QList<QNetworkAddressEntry>& localAddresses);
 
 private:
+    // A local address converted to flow key format for fast comparison.
+    struct LocalAddress {
+        quint8 addr[16];
+        bool ipv6;
+    };
+
     // Try to decode the packet as IPv4.
-    Direction tryIpv4(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const;
+    Direction tryIpv4(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const;
 
     // Try to decode the packet as IPv6.
-    Direction tryIpv6(const Direction linkLayerDirection, uint caplen, const u_char* packet, IpEndpointPair& endpoints) const;
+    Direction tryIpv6(const Direction linkLayerDirection, uint caplen, const u_char* packet, FlowKey& flow) const;
 
-    // Try to determine the direction of the packet based on the IP source and destination addresses.
-    Direction findDirection(const QHostAddress& srcAddr, const QHostAddress& destAddr, uint ipVersion) const;
+    // Try to determine the direction of the packet based on the IP source and destination addresses, which are in
+    // flow key format.
+    Direction findDirection(const quint8* srcAddr, const quint8* destAddr, bool ipv6) const;
 
     // Skips through zero or more IPv6 extension headers and tries to find the transport layer source and destination
     // ports and protocol (TCP or UDP). The caller passes a pointer to the next header in the packet buffer (either a
@@ -74,15 +86,22 @@ private:
     // the transport summary output argument and returns true. Else, it returns false.
     bool findIpv6Transport(uint caplen, const u_char* header, u_int8_t headerType, TransportSummary& output) const;
 
-    // Populate an IP endpoint pair given source and destination addresses/ports and a direction. If the direction
-    // is INBOUND, the source is remote and the destination is local. If the direction is OUTBOUND, the source is
-    // local and the destination is remote. If the direction is UNKNOWN_DIRECTION, no change is made to the endpoint
-    // pair.
-    void populateEndpoints(const Direction direction, const QHostAddress& srcAddr, const u_int16_t srcPort,
-            const QHostAddress& destAddr, const u_int16_t destPort, const L4Protocol l4protocol,
-            IpEndpointPair& output) const;
+    // Populate a flow key given source and destination addresses (in flow key format), IP version, ports, and a direction. If
+    // the direction is INBOUND, the source is remote and the destination is local. If the direction is OUTBOUND, the
+    // source is local and the destination is remote. If the direction is UNKNOWN_DIRECTION, no change is made to the
+    // flow key.
+    void populateFlow(const Direction direction, const quint8* srcAddr, const u_int16_t srcPort,
+            const quint8* destAddr, const u_int16_t destPort, const L4Protocol l4protocol, bool ipv6,
+            FlowKey& output) const;
 
     QList<QNetworkAddressEntry> _localAddresses;
+
+    // Local addresses and IPv4 broadcast addresses in flow key format. Derived from the list above.
+    QVector<LocalAddress> _localKeys;
+    QVector<quint32> _ipv4Broadcasts;   // network byte order
+
+    // True if any local address is IPv4 multicast. Derived from the list above.
+    bool _anyIpv4MulticastLocal;
 };
 
 #endif /* INTERNETPROTOCOLDECODER_H_ */
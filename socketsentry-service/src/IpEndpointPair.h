@@ -22,6 +22,7 @@
 
 #include <QtCore/QMetaType>
 #include <QtCore/QSharedDataPointer>
+#include <QtCore/QList>
 
 class QString;
 class QDBusArgument;
@@ -120,5 +121,6 @@ const QDBusArgument& operator>>(const QDBusArgument& argument, IpEndpointPair& o
 
 // Make visible as a D-Bus data type.
 Q_DECLARE_METATYPE(IpEndpointPair)
+Q_DECLARE_METATYPE(QList<IpEndpointPair>)
 
 #endif /* IPENDPOINTPAIR_H_ */
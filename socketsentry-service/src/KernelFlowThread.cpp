@@ -0,0 +1,550 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "KernelFlowThread.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <linux/bpf.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef SO_ATTACH_BPF
+#define SO_ATTACH_BPF 50
+#endif
+
+const int KernelFlowThread::POLL_TIMEOUT_MS = 333;     // wake up at least every 1/3 second
+const int KernelFlowThread::IDLE_POLLS = 5;
+const int KernelFlowThread::STATS_INTERVAL_SECS = 10;
+
+// DLT_RAW on Linux. The libpcap headers can't be included here, since they define a different struct bpf_insn.
+static const int RAW_LINK_TYPE = 12;
+
+// Size of the verifier log fetched when the program fails to load.
+static const int VERIFIER_LOG_SIZE = 64 * 1024;
+
+// Stack offsets of the flow key and a zeroed value used to insert new flows.
+static const int KEY_OFFSET = -(int)sizeof(FlowKey);
+static const int ZERO_VALUE_OFFSET = KEY_OFFSET - (int)sizeof(FlowCounters);
+
+// Invoke the bpf(2) system call.
+static inline int bpf(int cmd, bpf_attr& attr) {
+    return ::syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
+/*
+ * Minimal eBPF assembler. Jumps refer to labels, which may be placed after the jumps. Offsets are patched in when the
+ * program is finished.
+ */
+class ProgramBuilder {
+public:
+    // Labels in the socket filter program.
+    enum Label { DROP, OUTGOING, PARSE, IPV4, IPV4_PROTO, IPV6_PROTO, PORTS, LOOKUP, COUNT };
+
+    // Append one instruction.
+    void emit(quint8 code, quint8 dst, quint8 src, qint16 off, qint32 imm) {
+        bpf_insn insn;
+        ::memset(&insn, 0, sizeof(insn));
+        insn.code = code;
+        insn.dst_reg = dst;
+        insn.src_reg = src;
+        insn.off = off;
+        insn.imm = imm;
+        _insns.append(insn);
+    }
+
+    // Append a jump to a label. The op is a BPF_J* operation comparing the dst register to the immediate value (or
+    // BPF_JA for an unconditional jump).
+    void jump(quint8 op, quint8 dst, qint32 imm, Label target) {
+        _jumps.append(qMakePair(_insns.size(), (int)target));
+        emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+    }
+
+    // Place a label at the next instruction.
+    void label(Label label) { _labels.insert(label, _insns.size()); }
+
+    // Load the map file descriptor into a register (a two-instruction load that the kernel resolves to the map).
+    void loadMap(quint8 dst, int mapFd) {
+        emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, mapFd);
+        emit(0, 0, 0, 0, 0);
+    }
+
+    // Patch the jumps and return the program.
+    QVector<bpf_insn> finish() {
+        QListIterator<QPair<int, int> > i(_jumps);
+        while (i.hasNext()) {
+            const QPair<int, int>& jump = i.next();
+            Q_ASSERT(_labels.contains(jump.second));
+            _insns[jump.first].off = _labels.value(jump.second) - jump.first - 1;
+        }
+        return _insns;
+    }
+
+private:
+    QVector<bpf_insn> _insns;
+    QHash<int, int> _labels;
+    QList<QPair<int, int> > _jumps;
+};
+
+// Build the socket filter program. For each TCP/UDP packet, it builds a flow key on the stack, with the local endpoint
+// first, and adds the packet to the per-CPU counters of the key in the map. The counters have the layout of
+// FlowCounters. The packet length is taken from the network header on, so the length of the link layer header is
+// added. Packets are always dropped, since the counters are all we need. The packet socket is of type SOCK_DGRAM, so
+// packet offsets start at the network header.
+static QVector<bpf_insn> buildProgram(int mapFd, int linkHeaderLength, int loopbackIndex) {
+    ProgramBuilder p;
+    const quint8 CTX = BPF_REG_6;       // socket buffer (as required by packet loads)
+    const quint8 DIRECTION = BPF_REG_7; // offset of the byte counter of the packet's direction in the value
+    const quint8 TRANSPORT = BPF_REG_8; // L4Protocol of the packet
+    const quint8 L4_OFFSET = BPF_REG_9; // offset of the transport header
+
+    // Stack offsets of the key fields and value offsets of the byte counters.
+    const int LOCAL_ADDR = KEY_OFFSET + (int)offsetof(FlowKey, localAddr);
+    const int REMOTE_ADDR = KEY_OFFSET + (int)offsetof(FlowKey, remoteAddr);
+    const int LOCAL_PORT = KEY_OFFSET + (int)offsetof(FlowKey, localPort);
+    const int REMOTE_PORT = KEY_OFFSET + (int)offsetof(FlowKey, remotePort);
+    const int TRANSPORT_FIELD = KEY_OFFSET + (int)offsetof(FlowKey, transport);
+    const int IPV6_FIELD = KEY_OFFSET + (int)offsetof(FlowKey, ipv6);
+    const int BYTES_IN = (int)offsetof(FlowCounters, bytesIn);
+    const int BYTES_OUT = (int)offsetof(FlowCounters, bytesOut);
+
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, CTX, BPF_REG_1, 0, 0);
+
+    // Which way did the packet go? Loopback packets show up twice, once going out and once coming in. Like libpcap,
+    // count only the latter. Packets for other hosts are not ours.
+    p.emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, CTX, (int)offsetof(__sk_buff, pkt_type), 0);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, DIRECTION, 0, 0, BYTES_IN);
+    p.jump(BPF_JEQ, BPF_REG_2, PACKET_OUTGOING, ProgramBuilder::OUTGOING);
+    p.jump(BPF_JGT, BPF_REG_2, PACKET_MULTICAST, ProgramBuilder::DROP);
+    p.jump(BPF_JA, 0, 0, ProgramBuilder::PARSE);
+    p.label(ProgramBuilder::OUTGOING);
+    if (loopbackIndex) {
+        p.emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, CTX, (int)offsetof(__sk_buff, ifindex), 0);
+        p.jump(BPF_JEQ, BPF_REG_2, loopbackIndex, ProgramBuilder::DROP);
+    }
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, DIRECTION, 0, 0, BYTES_OUT);
+
+    // Zero the key, including the fields IPv4 doesn't use.
+    p.label(ProgramBuilder::PARSE);
+    for (int i = 0; i < (int)sizeof(FlowKey); i += 8) {
+        p.emit(BPF_ST | BPF_DW | BPF_MEM, BPF_REG_10, 0, KEY_OFFSET + i, 0);
+    }
+    p.emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, CTX, (int)offsetof(__sk_buff, protocol), 0);
+    p.jump(BPF_JEQ, BPF_REG_2, htons(ETH_P_IP), ProgramBuilder::IPV4);
+    p.jump(BPF_JNE, BPF_REG_2, htons(ETH_P_IPV6), ProgramBuilder::DROP);
+
+    // IPv6. Extension headers are not followed.
+    p.emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 0, 6);  // next header
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, TRANSPORT, 0, 0, TCP6);
+    p.jump(BPF_JEQ, BPF_REG_0, IPPROTO_TCP, ProgramBuilder::IPV6_PROTO);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, TRANSPORT, 0, 0, UDP6);
+    p.jump(BPF_JNE, BPF_REG_0, IPPROTO_UDP, ProgramBuilder::DROP);
+    p.label(ProgramBuilder::IPV6_PROTO);
+    p.emit(BPF_ST | BPF_B | BPF_MEM, BPF_REG_10, 0, IPV6_FIELD, 1);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, L4_OFFSET, 0, 0, 40);
+    const int IPV6_SRC = 8;
+    const int ADDRESS_FIELDS[2][2] = { { IPV6_SRC, 16 }, { IPV6_SRC + 16, 16 } };
+    for (int i = 0; i < 2; ++i) {
+        // Source goes to the local address, destination to the remote one. They're swapped below if inbound.
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, CTX, 0, 0);
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, ADDRESS_FIELDS[i][0]);
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0);
+        p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, (i ? REMOTE_ADDR : LOCAL_ADDR));
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, ADDRESS_FIELDS[i][1]);
+        p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_skb_load_bytes);
+        p.jump(BPF_JNE, BPF_REG_0, 0, ProgramBuilder::DROP);
+    }
+    p.jump(BPF_JA, 0, 0, ProgramBuilder::PORTS);
+
+    // IPv4. Only the first fragment has ports.
+    p.label(ProgramBuilder::IPV4);
+    p.emit(BPF_LD | BPF_H | BPF_ABS, 0, 0, 0, 6);  // flags and fragment offset
+    p.emit(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0x1fff);
+    p.jump(BPF_JNE, BPF_REG_0, 0, ProgramBuilder::DROP);
+    p.emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 0, 9);  // protocol
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, TRANSPORT, 0, 0, TCP);
+    p.jump(BPF_JEQ, BPF_REG_0, IPPROTO_TCP, ProgramBuilder::IPV4_PROTO);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, TRANSPORT, 0, 0, UDP);
+    p.jump(BPF_JNE, BPF_REG_0, IPPROTO_UDP, ProgramBuilder::DROP);
+    p.label(ProgramBuilder::IPV4_PROTO);
+    p.emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 0, 0);  // version and header length
+    p.emit(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0x0f);
+    p.emit(BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_0, 0, 0, 2);
+    p.jump(BPF_JLT, BPF_REG_0, 20, ProgramBuilder::DROP);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, L4_OFFSET, BPF_REG_0, 0, 0);
+    for (int i = 0; i < 2; ++i) {
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, CTX, 0, 0);
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, 12 + i * 4);
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0);
+        p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, (i ? REMOTE_ADDR : LOCAL_ADDR));
+        p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 4);
+        p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_skb_load_bytes);
+        p.jump(BPF_JNE, BPF_REG_0, 0, ProgramBuilder::DROP);
+    }
+
+    // Ports, in host byte order. Packet loads convert them for us.
+    p.label(ProgramBuilder::PORTS);
+    p.emit(BPF_STX | BPF_B | BPF_MEM, BPF_REG_10, TRANSPORT, TRANSPORT_FIELD, 0);
+    p.emit(BPF_LD | BPF_H | BPF_IND, 0, L4_OFFSET, 0, 0);
+    p.emit(BPF_STX | BPF_H | BPF_MEM, BPF_REG_10, BPF_REG_0, LOCAL_PORT, 0);
+    p.emit(BPF_LD | BPF_H | BPF_IND, 0, L4_OFFSET, 0, 2);
+    p.emit(BPF_STX | BPF_H | BPF_MEM, BPF_REG_10, BPF_REG_0, REMOTE_PORT, 0);
+
+    // Inbound packets come from the remote endpoint, so swap the endpoints.
+    p.jump(BPF_JNE, DIRECTION, BYTES_IN, ProgramBuilder::LOOKUP);
+    for (int i = 0; i < 16; i += 8) {
+        p.emit(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_1, BPF_REG_10, LOCAL_ADDR + i, 0);
+        p.emit(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_2, BPF_REG_10, REMOTE_ADDR + i, 0);
+        p.emit(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_2, LOCAL_ADDR + i, 0);
+        p.emit(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_1, REMOTE_ADDR + i, 0);
+    }
+    p.emit(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_1, BPF_REG_10, LOCAL_PORT, 0);
+    p.emit(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_2, BPF_REG_10, REMOTE_PORT, 0);
+    p.emit(BPF_STX | BPF_H | BPF_MEM, BPF_REG_10, BPF_REG_2, LOCAL_PORT, 0);
+    p.emit(BPF_STX | BPF_H | BPF_MEM, BPF_REG_10, BPF_REG_1, REMOTE_PORT, 0);
+
+    // Find the flow's counters, adding them if this is a new flow. If the map is full, the packet isn't counted.
+    p.label(ProgramBuilder::LOOKUP);
+    p.loadMap(BPF_REG_1, mapFd);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, KEY_OFFSET);
+    p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem);
+    p.jump(BPF_JNE, BPF_REG_0, 0, ProgramBuilder::COUNT);
+    for (int i = 0; i < (int)sizeof(FlowCounters); i += 8) {
+        p.emit(BPF_ST | BPF_DW | BPF_MEM, BPF_REG_10, 0, ZERO_VALUE_OFFSET + i, 0);
+    }
+    p.loadMap(BPF_REG_1, mapFd);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, KEY_OFFSET);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, ZERO_VALUE_OFFSET);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, BPF_NOEXIST);
+    p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_update_elem);
+    p.loadMap(BPF_REG_1, mapFd);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, KEY_OFFSET);
+    p.emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem);
+    p.jump(BPF_JEQ, BPF_REG_0, 0, ProgramBuilder::DROP);
+
+    // Count the packet. The counters are per CPU, so plain adds are safe.
+    p.label(ProgramBuilder::COUNT);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_0, DIRECTION, 0, 0);
+    p.emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_1, CTX, (int)offsetof(__sk_buff, len), 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_1, 0, 0, linkHeaderLength);
+    p.emit(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_2, BPF_REG_0, 0, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_2, BPF_REG_1, 0, 0);
+    p.emit(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_0, BPF_REG_2, 0, 0);
+    const int PACKETS = (int)offsetof(FlowCounters, packetsIn) - BYTES_IN;
+    p.emit(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_2, BPF_REG_0, PACKETS, 0);
+    p.emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, 1);
+    p.emit(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_0, BPF_REG_2, PACKETS, 0);
+
+    p.label(ProgramBuilder::DROP);
+    p.emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0);
+    p.emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+    return p.finish();
+}
+
+KernelFlowThread::KernelFlowThread(QObject* parent, const QString& device, const QString& customFilter,
+        int mapEntries) :
+    PcapThread(parent, device, customFilter), _mapEntries(qMax(mapEntries, 1)),
+    _socket(-1), _mapFd(-1), _programFd(-1), _cpus(0), _mapFull(false), _flowsEvicted(0) {
+}
+
+KernelFlowThread::~KernelFlowThread() {
+    // In case the thread was never run to completion.
+    closeCapture();
+}
+
+bool KernelFlowThread::openCapture(int& linkType, QString& message) {
+    Q_ASSERT(_socket == -1);
+    if (_customFilter.length() > 0) {
+        message = tr("Custom capture filters are not supported with kernel flow counting.");
+        return false;
+    }
+
+    // Which interface? The "any" device captures from all of them.
+    int ifIndex = 0;
+    if (_device != "any") {
+        ifIndex = ::if_nametoindex(_device.toAscii());
+        if (ifIndex == 0) {
+            message = tr("Can't find network device. (%1)").arg(::strerror(errno));
+            return false;
+        }
+    }
+
+    // Packets are counted from the network header on. Count the link layer header too, like libpcap does for Ethernet
+    // (and loopback, which has fake Ethernet headers).
+    int hwType = ARPHRD_VOID;
+    if (ifIndex) {
+        int probe = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (probe >= 0) {
+            ifreq ifr;
+            ::memset(&ifr, 0, sizeof(ifr));
+            ::strncpy(ifr.ifr_name, _device.toAscii(), IFNAMSIZ - 1);
+            if (::ioctl(probe, SIOCGIFHWADDR, &ifr) == 0) {
+                hwType = ifr.ifr_hwaddr.sa_family;
+            }
+            ::close(probe);
+        }
+    }
+    int linkHeaderLength = (hwType == ARPHRD_ETHER || hwType == ARPHRD_LOOPBACK) ? ETH_HLEN : 0;
+
+    // No packets reach us, so the link type only matters to the (unused) packet decoder.
+    linkType = RAW_LINK_TYPE;
+    _cpus = possibleCpus();
+    if (!createMap(message) || !loadProgram(linkHeaderLength, ::if_nametoindex("lo"), message)) {
+        closeCapture();
+        return false;
+    }
+
+    // A packet socket opened without a protocol isn't hooked into the stack, so nothing reaches it until it's bound.
+    _socket = ::socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (_socket < 0) {
+        message = tr("Can't open packet socket. (%1)").arg(::strerror(errno));
+        closeCapture();
+        return false;
+    }
+
+    // Attach the program before binding to all protocols on the device, so every packet runs through it and none is
+    // queued to us unfiltered.
+    if (::setsockopt(_socket, SOL_SOCKET, SO_ATTACH_BPF, &_programFd, sizeof(_programFd)) != 0) {
+        message = tr("Can't attach flow counting program. (%1)").arg(::strerror(errno));
+        closeCapture();
+        return false;
+    }
+    sockaddr_ll addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifIndex;
+    if (::bind(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        if (errno == ENETDOWN) {
+            message = tr("Can't activate packet capture because device is offline.");
+        } else {
+            message = tr("Can't activate packet capture. (%1)").arg(::strerror(errno));
+        }
+        closeCapture();
+        return false;
+    }
+    qDebug("[%s]: Counting flows in the kernel with a map of %d entries on %d CPUs.",
+            (const char*)_device.toLatin1(), _mapEntries, _cpus);
+    return true;
+}
+
+bool KernelFlowThread::createMap(QString& message) {
+    // Kernels before 5.11 charge maps and programs against the locked memory limit, which is tiny by default.
+    rlimit unlimited;
+    unlimited.rlim_cur = RLIM_INFINITY;
+    unlimited.rlim_max = RLIM_INFINITY;
+    ::setrlimit(RLIMIT_MEMLOCK, &unlimited);
+
+    bpf_attr attr;
+    ::memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_PERCPU_HASH;
+    attr.key_size = sizeof(FlowKey);
+    attr.value_size = sizeof(FlowCounters);
+    attr.max_entries = _mapEntries;
+    _mapFd = bpf(BPF_MAP_CREATE, attr);
+    if (_mapFd < 0) {
+        message = tr("Can't create kernel flow map. (%1)").arg(::strerror(errno));
+        return false;
+    }
+    _values.resize(_cpus);
+    return true;
+}
+
+bool KernelFlowThread::loadProgram(int linkHeaderLength, int loopbackIndex, QString& message) {
+    QVector<bpf_insn> program = buildProgram(_mapFd, linkHeaderLength, loopbackIndex);
+    static const char LICENSE[] = "GPL";
+    bpf_attr attr;
+    ::memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = reinterpret_cast<quint64>(program.constData());
+    attr.insn_cnt = program.size();
+    attr.license = reinterpret_cast<quint64>(LICENSE);
+    _programFd = bpf(BPF_PROG_LOAD, attr);
+    if (_programFd < 0) {
+        int loadError = errno;
+        // Load it again with the verifier log for the debug output.
+        QByteArray log(VERIFIER_LOG_SIZE, '\0');
+        attr.log_buf = reinterpret_cast<quint64>(log.data());
+        attr.log_size = log.size();
+        attr.log_level = 1;
+        int retryFd = bpf(BPF_PROG_LOAD, attr);
+        if (retryFd >= 0) {
+            ::close(retryFd);
+        }
+        qDebug("[%s]: Verifier log:\n%s", (const char*)_device.toLatin1(), log.constData());
+        message = tr("Can't load flow counting program. (%1)").arg(::strerror(loadError));
+        return false;
+    }
+    return true;
+}
+
+void KernelFlowThread::captureLoop(QString& error) {
+    Q_ASSERT(_mapFd >= 0);
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    time_t lastRead = tv.tv_sec;
+    time_t nextStatsTime = tv.tv_sec + STATS_INTERVAL_SECS;
+    while (canContinue()) {
+        // Sleep until just after the next second begins, but check regularly whether we can continue.
+        ::gettimeofday(&tv, NULL);
+        int untilNextSecondMs = 1000 - tv.tv_usec / 1000 + 1;
+        msleep(qMin(untilNextSecondMs, POLL_TIMEOUT_MS));
+
+        // Once per second, collect the traffic of the second that just ended.
+        ::gettimeofday(&tv, NULL);
+        if (tv.tv_sec != lastRead) {
+            if (!readMap(tv.tv_sec - 1, error)) {
+                break;
+            }
+            lastRead = tv.tv_sec;
+        }
+        commitBatch();
+
+        if (_logStats && tv.tv_sec >= nextStatsTime) {
+            logStats();
+            nextStatsTime = tv.tv_sec + STATS_INTERVAL_SECS;
+        }
+    }
+}
+
+bool KernelFlowThread::readMap(time_t sampleTime, QString& error) {
+    // Deleting keys during the walk would restart it, so idle flows are deleted afterwards.
+    QList<FlowKey> idleFlows;
+    FlowKey key = FlowKey();
+    FlowKey nextKey = FlowKey();
+    bpf_attr attr;
+    ::memset(&attr, 0, sizeof(attr));
+    attr.map_fd = _mapFd;
+    attr.key = 0;   // start with the first key
+    attr.next_key = reinterpret_cast<quint64>(&nextKey);
+    int flows = 0;
+    while (bpf(BPF_MAP_GET_NEXT_KEY, attr) == 0) {
+        key = nextKey;
+        attr.key = reinterpret_cast<quint64>(&key);
+        ++flows;
+
+        bpf_attr lookup;
+        ::memset(&lookup, 0, sizeof(lookup));
+        lookup.map_fd = _mapFd;
+        lookup.key = reinterpret_cast<quint64>(&key);
+        lookup.value = reinterpret_cast<quint64>(_values.data());
+        if (bpf(BPF_MAP_LOOKUP_ELEM, lookup) != 0) {
+            continue;   // deleted under us
+        }
+        FlowCounters current = FlowCounters();
+        for (int cpu = 0; cpu < _cpus; ++cpu) {
+            current.add(_values[cpu]);
+        }
+
+        // Record what's new since the last read.
+        FlowTotals& totals = _totals[key];
+        FlowCounters delta = current;
+        delta.subtract(totals.counters);
+        if (delta.packetsIn || delta.packetsOut) {
+            processCounters(key, delta, sampleTime);
+            totals.counters = current;
+            totals.idlePolls = 0;
+        } else if (++totals.idlePolls >= IDLE_POLLS) {
+            idleFlows.append(key);
+        }
+    }
+    if (errno != ENOENT) {
+        error = tr("Failed to read kernel flow map. (%1)").arg(::strerror(errno));
+        return false;
+    }
+
+    // Make room for new flows. A packet counted between the last read and the delete is lost, but the flow was idle.
+    QListIterator<FlowKey> i(idleFlows);
+    while (i.hasNext()) {
+        const FlowKey& idleFlow = i.next();
+        bpf_attr remove;
+        ::memset(&remove, 0, sizeof(remove));
+        remove.map_fd = _mapFd;
+        remove.key = reinterpret_cast<quint64>(&idleFlow);
+        bpf(BPF_MAP_DELETE_ELEM, remove);
+        _totals.remove(idleFlow);
+        ++_flowsEvicted;
+    }
+
+    bool mapFull = flows >= _mapEntries;
+    if (mapFull && !_mapFull) {
+        qWarning("[%s]: Kernel flow map is full. Traffic of new flows is not counted until others go idle.",
+                (const char*)_device.toLatin1());
+    }
+    _mapFull = mapFull;
+    return true;
+}
+
+void KernelFlowThread::logStats() const {
+    qDebug("[%s]: Flows in kernel map: %d, idle flows deleted: %llu",
+            (const char*)_device.toLatin1(), _totals.size(), (unsigned long long)_flowsEvicted);
+}
+
+int KernelFlowThread::possibleCpus() {
+    // The file lists ranges of CPU numbers, e.g. "0-3,8-11".
+    int cpus = 0;
+    QFile possible("/sys/devices/system/cpu/possible");
+    if (possible.open(QIODevice::ReadOnly)) {
+        QStringList ranges = QString(possible.readAll()).trimmed().split(',', QString::SkipEmptyParts);
+        QStringListIterator i(ranges);
+        while (i.hasNext()) {
+            QStringList bounds = i.next().split('-');
+            cpus += bounds.last().toInt() - bounds.first().toInt() + 1;
+        }
+    }
+    return qMax(cpus, 1);
+}
+
+void KernelFlowThread::closeCapture() {
+    if (_socket >= 0) {
+        if (_logStats) {
+            logStats();
+        }
+        ::close(_socket);
+        _socket = -1;
+    }
+    if (_programFd >= 0) {
+        ::close(_programFd);
+        _programFd = -1;
+    }
+    if (_mapFd >= 0) {
+        ::close(_mapFd);
+        _mapFd = -1;
+    }
+    _totals.clear();
+}
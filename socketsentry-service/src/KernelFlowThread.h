@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef KERNELFLOWTHREAD_H_
+#define KERNELFLOWTHREAD_H_
+
+#include "PcapThread.h"
+#include "FlowKey.h"
+#include "FlowSlotTable.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+/*
+ * Capture thread that lets the kernel count the traffic. An eBPF socket filter on a packet socket bound to the device
+ * adds the length of every TCP/UDP packet to a per-CPU hash map of flow keys and then drops the packet, so no packet
+ * is ever copied to user space. Instead of processing packets, the thread reads the map once a second and records the
+ * traffic since the previous read to network history. Counters in the map are never reset. Flows that have been idle
+ * for a few seconds are deleted from the map to make room for new ones. The program and map are created with the
+ * bpf(2) system call, so no compiler or library is needed at run time. Custom capture filters are not supported.
+ *
+ * This class is reentrant and thread-safe. Public methods can be called from any thread.
+ */
+class KernelFlowThread : public PcapThread {
+public:
+    // Create a new capture thread for the given device. The kernel map holds up to "mapEntries" flows.
+    KernelFlowThread(QObject* parent, const QString& device, const QString& customFilter, int mapEntries);
+    virtual ~KernelFlowThread();
+
+protected:
+    virtual bool openCapture(int& linkType, QString& message);
+    virtual void captureLoop(QString& error);
+    virtual void closeCapture();
+
+private:
+    // Running counters of one flow in the map as of the last read.
+    struct FlowTotals {
+        FlowTotals() : counters(FlowCounters()), idlePolls(0) {}
+        FlowCounters counters;
+        int idlePolls;                          // consecutive reads without new traffic
+    };
+
+    // Create the flow map. Returns true if successful. Otherwise, false is returned and the message argument is
+    // populated with the error.
+    bool createMap(QString& message);
+
+    // Load the socket filter program. Returns true if successful. Otherwise, false is returned and the message
+    // argument is populated with the error.
+    bool loadProgram(int linkHeaderLength, int loopbackIndex, QString& message);
+
+    // Read the whole map and record the traffic of each flow since the last read at the given time. Idle flows are
+    // deleted. Returns false on failure with the error argument populated.
+    bool readMap(time_t sampleTime, QString& error);
+
+    // Log the running capture totals.
+    void logStats() const;
+
+    // Number of possible CPUs, which is the number of values per key in a per-CPU map.
+    static int possibleCpus();
+
+    // Immutables
+    static const int POLL_TIMEOUT_MS;           // max time to sleep before checking if we can continue
+    static const int IDLE_POLLS;                // reads without traffic before a flow is deleted from the map
+    static const int STATS_INTERVAL_SECS;       // how often to log capture statistics (if enabled)
+    const int _mapEntries;
+
+    // Unshared (thread private)
+    int _socket;                                // packet socket (or -1 if not open)
+    int _mapFd;                                 // flow map (or -1 if not created)
+    int _programFd;                             // socket filter program (or -1 if not loaded)
+    int _cpus;                                  // values per key in the map
+    QVector<FlowCounters> _values;              // per-CPU values of one key, as read from the map
+    QHash<FlowKey, FlowTotals> _totals;         // counters of each flow in the map as of the last read
+    bool _mapFull;                              // true if the map was full at the last read
+    quint64 _flowsEvicted;                      // running total of idle flows deleted from the map
+};
+
+#endif /* KERNELFLOWTHREAD_H_ */
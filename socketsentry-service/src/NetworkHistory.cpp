@@ -23,54 +23,175 @@
 #include "FlowMetrics.h"
 #include "FlowStatistics.h"
 #include "IpEndpointPair.h"
+#include "PacketBatch.h"
 
 const int NetworkHistory::DEFAULT_HISTORY_SECS = 30;
 const int NetworkHistory::DEFAULT_RECENT_HISTORY_SECS = DEFAULT_HISTORY_SECS / 3;
 
+// Downsampled tiers: ten-second buckets for ten minutes and one-minute buckets for an hour.
+static const int TIER_BUCKET_SECS[] = { 10, 60 };
+static const int TIER_BUCKET_COUNT = 60;
+
 NetworkHistory::NetworkHistory():
     _historySecs(DEFAULT_HISTORY_SECS), _recentHistorySecs(DEFAULT_RECENT_HISTORY_SECS),
-    _lastRoll(0), _lastRecording(0), _circularBuf(DEFAULT_HISTORY_SECS) {
+    _lastRoll(0), _lastRecording(0), _overflowPackets(0), _circularBuf(DEFAULT_HISTORY_SECS) {
+    initTiers();
 }
 
 NetworkHistory::NetworkHistory(const int historySecs, const int recentHistorySecs):
     _historySecs(historySecs), _recentHistorySecs(recentHistorySecs),
-    _lastRoll(0), _lastRecording(0), _circularBuf(historySecs) {
+    _lastRoll(0), _lastRecording(0), _overflowPackets(0), _circularBuf(historySecs) {
+    initTiers();
 }
 
 
 NetworkHistory::~NetworkHistory() {
 }
 
+void NetworkHistory::initTiers() {
+    const int tiers = sizeof(TIER_BUCKET_SECS) / sizeof(TIER_BUCKET_SECS[0]);
+    _tiers.reserve(tiers);
+    for (int i = 0; i < tiers; i++) {
+        _tiers.append(HistoryTier(TIER_BUCKET_SECS[i], TIER_BUCKET_COUNT));
+    }
+}
+
 void NetworkHistory::record(const IpEndpointPair& flow, const FlowMetrics& newMetrics, const time_t& sampleTime) {
+    record(FlowKey::fromEndpointPair(flow), newMetrics, sampleTime);
+}
+
+void NetworkHistory::record(const FlowKey& flow, const FlowMetrics& newMetrics, const time_t& sampleTime) {
+    FlowCounters counters;
+    counters.bytesIn = newMetrics.getBytesIn();
+    counters.bytesOut = newMetrics.getBytesOut();
+    counters.packetsIn = newMetrics.getPacketsIn();
+    counters.packetsOut = newMetrics.getPacketsOut();
+    record(flow, counters, sampleTime);
+}
+
+void NetworkHistory::record(const FlowKey& flow, const FlowCounters& counters, const time_t& sampleTime) {
     if(sampleTime > _lastRoll - _historySecs) {
         // Sample falls within historical range. Accumulate the metrics for this flow at the specified time.
         rollForward(sampleTime);
-        QHash<IpEndpointPair, FlowMetrics>& activityAtTime = _circularBuf[indexOf(sampleTime)];
-        FlowMetrics& metrics = activityAtTime[flow];
-        metrics.combineTimeIntervals(newMetrics);
+        FlowSlotTable& activityAtTime = _circularBuf[indexOf(sampleTime)];
+        if (sampleTime < _lastRoll) {
+            // Late arrival for a slot that's already in the statistics window.
+            recordClosed(activityAtTime, flow, counters, sampleTime);
+        } else if (!activityAtTime.add(flow, counters)) {
+            // Too many flows this second.
+            _overflowPackets += counters.packetsIn + counters.packetsOut;
+        }
         if (_lastRecording < sampleTime) {
             _lastRecording = sampleTime;
         }
     } // Else, sample is too old. Skip it.
 }
 
+void NetworkHistory::recordClosed(FlowSlotTable& slot, const FlowKey& flow, const FlowCounters& counters,
+        const time_t& sampleTime) {
+    const FlowCounters* existing = slot.find(flow);
+    FlowCounters before = existing ? *existing : FlowCounters();
+    if (!slot.add(flow, counters)) {
+        _overflowPackets += counters.packetsIn + counters.packetsOut;
+        return;
+    }
+
+    FlowWindow& window = _windows[flow];
+    window.addSlot(counters, !existing);
+    FlowCounters after = before;
+    after.add(counters);
+    window.raisePeak(sampleTime, after.bytesIn + after.bytesOut);
+    if (sampleTime > _lastRoll - _recentHistorySecs) {
+        window.addRecent(recentShare(after.bytesIn) - recentShare(before.bytesIn),
+                recentShare(after.bytesOut) - recentShare(before.bytesOut));
+    }
+    for (int i = 0; i < _tiers.size(); i++) {
+        _tiers[i].record(flow, counters, sampleTime);
+    }
+}
+
+void NetworkHistory::recordBatch(const PacketBatch& batch) {
+    for (int i = 0; i < batch.size(); i++) {
+        const PacketBatch::Entry& entry = batch.at(i);
+        FlowCounters counters;
+        counters.bytesIn = entry.bytesIn;
+        counters.bytesOut = entry.bytesOut;
+        counters.packetsIn = entry.packetsIn;
+        counters.packetsOut = entry.packetsOut;
+        record(entry.flow, counters, entry.sampleTime);
+    }
+}
+
+void NetworkHistory::setMaxFlowsPerSecond(int maxFlows) {
+    for (int i = 0; i < _historySecs; i++) {
+        _circularBuf[i].setMaxFlows(maxFlows);
+    }
+}
+
 void NetworkHistory::rollForward(const time_t& rollTo) {
     if (_lastRoll < rollTo) {
         if (_lastRoll + _historySecs <= rollTo) {
-            // Entire history is obsolete. Reset the buffer.
+            // Entire history is obsolete. The current second never closed, so roll it up before resetting the buffer.
+            for (int i = 0; i < _tiers.size(); i++) {
+                _tiers[i].recordSlot(_circularBuf.at(indexOf(_lastRoll)), _lastRoll);
+            }
             for (int i = 0; i < _historySecs; i++) {
                 _circularBuf[i].clear();
             }
+            _windows.clear();
+            _lastRoll = rollTo;
         } else {
-            // Clear history between last roll time (exclusive) and roll-to time (inclusive).
+            // Advance one second at a time from last roll time (exclusive) to roll-to time (inclusive).
             for(time_t i = _lastRoll + 1; i <= rollTo; i++) {
-                _circularBuf[indexOf(i)].clear();
+                advanceOne(i);
             }
         }
-        _lastRoll = rollTo;
     } // Else, history has already advanced to or beyond the specified point, so nothing to do.
 }
 
+void NetworkHistory::advanceOne(const time_t& newLastRoll) {
+    // The previous second closes and enters the window, including its recent part.
+    const FlowSlotTable& closedSlot = _circularBuf.at(indexOf(newLastRoll - 1));
+    FlowSlotTableIterator closed(closedSlot);
+    while (closed.hasNext()) {
+        closed.next();
+        const FlowCounters& counters = closed.value();
+        FlowWindow& window = _windows[closed.key()];
+        window.addSlot(counters, true);
+        window.raisePeak(newLastRoll - 1, counters.bytesIn + counters.bytesOut);
+        window.addRecent(recentShare(counters.bytesIn), recentShare(counters.bytesOut));
+    }
+    for (int i = 0; i < _tiers.size(); i++) {
+        _tiers[i].recordSlot(closedSlot, newLastRoll - 1);
+    }
+
+    // The oldest second of recent history becomes merely history.
+    const time_t notRecent = newLastRoll - _recentHistorySecs;
+    if (notRecent >= 0) {
+        FlowSlotTableIterator aged(_circularBuf.at(indexOf(notRecent)));
+        while (aged.hasNext()) {
+            aged.next();
+            const FlowCounters& counters = aged.value();
+            _windows[aged.key()].addRecent(-recentShare(counters.bytesIn), -recentShare(counters.bytesOut));
+        }
+    }
+
+    // The oldest second leaves the window. Its slot is reused for the new second.
+    FlowSlotTable& expired = _circularBuf[indexOf(newLastRoll)];
+    FlowSlotTableIterator iter(expired);
+    while (iter.hasNext()) {
+        iter.next();
+        QHash<FlowKey, FlowWindow>::iterator window = _windows.find(iter.key());
+        window->removeSlot(iter.value());
+        window->expirePeaks(newLastRoll - _historySecs);
+        if (window->getSlotCount() == 0) {
+            _windows.erase(window);
+        }
+    }
+    expired.clear();
+    _lastRoll = newLastRoll;
+}
+
 void NetworkHistory::exportStatistics(
         QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
         const time_t& endTime) {
@@ -78,51 +199,77 @@ void NetworkHistory::exportStatistics(
     result.clear();	// just in case
     rollForward(endTime);
 
-    // Loop over historical range from oldest time (inclusive) to newest time (exclusive).
-    for (time_t timePos = _lastRoll - _historySecs + 1; timePos < _lastRoll; timePos++) {
-        QHash<IpEndpointPair, FlowMetrics>& flowsAtTime = _circularBuf[indexOf(timePos)];
-        QHashIterator<IpEndpointPair, FlowMetrics> iter(flowsAtTime);
-        // Loop over all flows for the current time slot.
-        while (iter.hasNext()) {
-            iter.next();
-            const IpEndpointPair& endpoints = iter.key();
-            const FlowMetrics& metricsAtTime = iter.value();
-
-            QPair<FlowMetrics, FlowStatistics>& endpointResult = result[endpoints];
-            FlowMetrics& rangeMetrics = endpointResult.first;
-            FlowStatistics& rangeStats = endpointResult.second;
-
-            // Fold metrics into roll-up.
-            rangeMetrics.combineTimeIntervals(metricsAtTime);
-
-            // Update peak rate.
-            if (metricsAtTime.getTotalBytes() > rangeStats.getPeakBytesPerSec()) {
-                rangeStats.setPeakBytesPerSec(metricsAtTime.getTotalBytes());
-            }
+    // The last closed slot tells whether we are sending and/or receiving data "now".
+    const FlowSlotTable* lastSlot = _lastRoll > 0 ? &_circularBuf.at(indexOf(_lastRoll - 1)) : NULL;
 
-            if (timePos > _lastRoll - _recentHistorySecs) {
-                // This time slot is "recent history". Add current time slot's contribution
-                // to the= transfer rate. We lose some precision doing integer division, but
-                // it's not significant.
-                qlonglong oldBpsInRate = rangeStats.getRecentBytesInPerSec();
-                qlonglong newBytesInContrib = metricsAtTime.getBytesIn() / (_recentHistorySecs - 1);
-                rangeStats.setRecentBytesInPerSec(oldBpsInRate + newBytesInContrib);
-
-                qlonglong oldBpsOutRate = rangeStats.getRecentBytesOutPerSec();
-                qlonglong newBytesOutContrib = metricsAtTime.getBytesOut() / (_recentHistorySecs - 1);
-                rangeStats.setRecentBytesOutPerSec(oldBpsOutRate + newBytesOutContrib);
-
-                if (timePos == _lastRoll - 1) {
-                    // This is the last time slot. Set flags to indicate that we
-                    // are sending and/or receiving data "now".
-                    bool receivingNow = metricsAtTime.getBytesIn() > 0;
-                    rangeStats.setReceivingNow(receivingNow);
-                    bool sendingNow = metricsAtTime.getBytesOut() > 0;
-                    rangeStats.setSendingNow(sendingNow);
-                }
-            }
+    result.reserve(_windows.size());
+    QHashIterator<FlowKey, FlowWindow> iter(_windows);
+    while (iter.hasNext()) {
+        iter.next();
+        const FlowWindow& window = iter.value();
+        const FlowCounters& totals = window.getTotals();
+        FlowMetrics rangeMetrics(totals.bytesIn, totals.bytesOut, totals.packetsIn, totals.packetsOut);
+        FlowStatistics rangeStats;
+        rangeStats.setPeakBytesPerSec(window.getPeakBytes());
+        rangeStats.setRecentBytesInPerSec(window.getRecentBytesIn());
+        rangeStats.setRecentBytesOutPerSec(window.getRecentBytesOut());
+        const FlowCounters* lastCounters = lastSlot ? lastSlot->find(iter.key()) : NULL;
+        if (lastCounters) {
+            rangeStats.setReceivingNow(lastCounters->bytesIn > 0);
+            rangeStats.setSendingNow(lastCounters->bytesOut > 0);
+        }
+        result.insert(iter.key().toEndpointPair(), qMakePair(rangeMetrics, rangeStats));
+    }
+}
+
+void NetworkHistory::exportHistory(int windowSecs,
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, const time_t& endTime) {
+    exportHistory(snapshotTiers(endTime), windowSecs, result);
+}
+
+TierSnapshot NetworkHistory::snapshotTiers(const time_t& endTime) {
+    rollForward(endTime);
+
+    // Bring the tiers up to the last closed second, so the snapshot is complete without being rolled.
+    for (int i = 0; i < _tiers.size(); i++) {
+        _tiers[i].rollForward(_lastRoll - 1);
+    }
+    TierSnapshot snapshot;
+    snapshot.tiers = _tiers;
+    snapshot.lastRoll = _lastRoll;
+    return snapshot;
+}
+
+void NetworkHistory::exportHistory(const TierSnapshot& snapshot, int windowSecs,
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result) {
+
+    result.clear();
+
+    // Pick the finest tier that covers the range.
+    const QVector<HistoryTier>& tiers = snapshot.tiers;
+    int tierIndex = tiers.size() - 1;
+    for (int i = 0; i < tiers.size(); i++) {
+        if (tiers.at(i).getSpanSecs() >= windowSecs) {
+            tierIndex = i;
+            break;
         }
     }
+    const HistoryTier& tier = tiers.at(tierIndex);
+    QHash<FlowKey, FlowWindow> windows;
+    tier.exportSince(snapshot.lastRoll - windowSecs, windows);
+
+    result.reserve(windows.size());
+    QHashIterator<FlowKey, FlowWindow> iter(windows);
+    while (iter.hasNext()) {
+        iter.next();
+        const FlowCounters& totals = iter.value().getTotals();
+        FlowMetrics rangeMetrics(totals.bytesIn, totals.bytesOut, totals.packetsIn, totals.packetsOut);
+        FlowStatistics rangeStats;
+        rangeStats.setRecentBytesInPerSec(totals.bytesIn / windowSecs);
+        rangeStats.setRecentBytesOutPerSec(totals.bytesOut / windowSecs);
+        rangeStats.setPeakBytesPerSec(iter.value().getPeakBytes() / tier.getBucketSecs());
+        result.insert(iter.key().toEndpointPair(), qMakePair(rangeMetrics, rangeStats));
+    }
 }
 
 bool NetworkHistory::anyTrafficSince(time_t timeSecs) const {
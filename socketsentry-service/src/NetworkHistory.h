@@ -18,16 +18,34 @@
 #ifndef NETWORKHISTORY_H_
 #define NETWORKHISTORY_H_
 
+#include <QtCore/QHash>
 #include <QtCore/QVector>
 
+#include "FlowKey.h"
+#include "FlowSlotTable.h"
+#include "FlowWindow.h"
+#include "HistoryTier.h"
+
 class FlowMetrics;
 class FlowStatistics;
-template <class K, class V> class QHash;
 class IpEndpointPair;
+class PacketBatch;
 template <class F, class S> class QPair;
 
+// The downsampled tiers of a network history at one point in time. A snapshot shares memory with the history, so it's
+// cheap to take. It's never modified, so statistics can be exported from it on any thread.
+struct TierSnapshot {
+    QVector<HistoryTier> tiers;         // tiers rolled forward to the last closed second
+    time_t lastRoll;                    // upper bound of the historical range when the snapshot was taken
+};
+
 /*
- * A rolling history of network activity observed on a packet capture device.
+ * A rolling history of network activity observed on a packet capture device. Running totals of each flow over the
+ * statistics window are maintained as traffic is recorded and the history rolls forward, so exporting statistics
+ * takes time proportional to the number of active flows rather than the length of the history.
+ *
+ * As seconds leave the one-second history, they are also rolled up into downsampled tiers (ten-second buckets for ten
+ * minutes and one-minute buckets for an hour) so clients can ask about longer time ranges.
  */
 class NetworkHistory {
 public:
@@ -46,17 +64,51 @@ public:
     // are combined with any existing metrics for the same endpoint pair at that time. If there were no metrics
     // for the pair at that time, the given metrics are stored as-is. If the sample time is earlier than the
     // earliest point in the historical range, the metrics are silently discarded as being too old.
+    void record(const FlowKey& flow, const FlowMetrics& newMetrics, const time_t& sampleTime);
+
+    // Same as above, but with raw counters.
+    void record(const FlowKey& flow, const FlowCounters& counters, const time_t& sampleTime);
+
+    // Same as above, but for an endpoint pair.
     void record(const IpEndpointPair& flow, const FlowMetrics& newMetrics, const time_t& sampleTime);
 
+    // Record all entries of a batch of packets, as if each entry were passed to "record" in order.
+    void recordBatch(const PacketBatch& batch);
+
     // Export statics based on current history. First, the historical range is rolled forward to the given
     // end time (if necessary). Then, the history is consolidated into one set of flow metrics and statistics
-    // per IP endpoint pair. The statistics hashtable should be empty when this method is called. It will be
-    // filled upon return.
+    // per IP endpoint pair. Flow keys are converted to endpoint pairs only here. The statistics hashtable should be
+    // empty when this method is called. It will be filled upon return.
     void exportStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, const time_t& endTime);
 
+    // Export statistics over a longer time range from the downsampled tiers of history. The history is first rolled
+    // forward to the given end time (if necessary). Then, the traffic of the given number of seconds before the end
+    // time is consolidated per IP endpoint pair, using the finest tier that covers that many seconds (or the coarsest
+    // tier if none does). The range is rounded out to whole buckets, and only the busiest flows of each bucket are
+    // remembered, so the result is an approximation. The recent transfer rates are averages over the range and the
+    // peak rate is the average of the busiest bucket. The statistics hashtable will be filled upon return.
+    void exportHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+            const time_t& endTime);
+
+    // Same as above, but from a snapshot of the tiers. The snapshot is left unchanged.
+    static void exportHistory(const TierSnapshot& snapshot, int windowSecs,
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result);
+
+    // Roll the history forward to the given end time (if necessary) and take a snapshot of its downsampled tiers.
+    TierSnapshot snapshotTiers(const time_t& endTime);
+
     // Check to see if traffic has been recorded since the specified time.
     bool anyTrafficSince(time_t timeSecs) const;
 
+    // Time of the most recent traffic recording (or zero if none).
+    time_t getLastRecording() const { return _lastRecording; }
+
+    // Limit the number of distinct flows recorded per second. Packets of additional flows are counted as overflow.
+    void setMaxFlowsPerSecond(int maxFlows);
+
+    // Total number of packets not recorded because there were too many flows at the time.
+    qlonglong getOverflowPackets() const { return _overflowPackets; }
+
 private:
     // The size of the historical range in seconds. Must be >= 2 because the "current" second is not considered
     // in statistics generation.
@@ -70,6 +122,21 @@ private:
     // is before the current end of the historical range, then nothing happens.
     void rollForward(const time_t& rollTo);
 
+    // Create the downsampled tiers of history.
+    void initTiers();
+
+    // Advance the end of the historical range by one second to the given time, moving the closed slot into the
+    // statistics window and expiring the oldest slot.
+    void advanceOne(const time_t& newLastRoll);
+
+    // Record counters to a slot that has already closed, updating the running totals of the flow.
+    void recordClosed(FlowSlotTable& slot, const FlowKey& flow, const FlowCounters& counters,
+            const time_t& sampleTime);
+
+    // A slot's contribution to the recent transfer rate. We lose some precision doing integer division per slot,
+    // but it's not significant.
+    qlonglong recentShare(qlonglong bytes) const { return bytes / (_recentHistorySecs - 1); }
+
     // Get the index of a time in the circular buffer.
     int indexOf(const time_t& pos) { return pos % _historySecs; }
 
@@ -87,10 +154,20 @@ private:
     // Time of the most recent traffic recording.
     time_t _lastRecording;
 
+    // Total number of packets not recorded because there were too many flows at the time.
+    qlonglong _overflowPackets;
+
     // The circular buffer to which history is recorded. Each element holds a second's worth of network activity
-    // in wall clock time. The hashtable maps IP endpoint pairs to observed activity between those endpoints in
-    // one second.
-    QVector<QHash<IpEndpointPair, FlowMetrics> > _circularBuf;
+    // in wall clock time. The table maps flows to observed activity between their endpoints in one second. Tables are
+    // reused as the history rolls around.
+    QVector<FlowSlotTable> _circularBuf;
+
+    // Running totals of each flow over the statistics window, which covers the closed slots of the historical range
+    // (all but the current second).
+    QHash<FlowKey, FlowWindow> _windows;
+
+    // Downsampled tiers of history, from finest to coarsest. Closed seconds are added to every tier.
+    QVector<HistoryTier> _tiers;
 };
 
 #endif /* NETWORKHISTORY_H_ */
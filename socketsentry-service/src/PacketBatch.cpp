@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PacketBatch.h"
+
+#include <string.h>
+
+PacketBatch::PacketBatch() :
+    _size(0), _last(-1) {
+    ::memset(_index, -1, sizeof(_index));
+}
+
+PacketBatch::~PacketBatch() {
+}
+
+void PacketBatch::add(const FlowKey& flow, Direction direction, uint length, time_t sampleTime) {
+    Q_ASSERT(!isFull());
+    Entry& entry = findOrInsert(flow, sampleTime);
+    if (direction == INBOUND) {
+        entry.bytesIn += length;
+        entry.packetsIn++;
+    } else {
+        entry.bytesOut += length;
+        entry.packetsOut++;
+    }
+}
+
+PacketBatch::Entry& PacketBatch::findOrInsert(const FlowKey& flow, time_t sampleTime) {
+    // Consecutive packets usually belong to the same flow, so check the last one before hashing.
+    if (_last >= 0 && _entries[_last].sampleTime == sampleTime && _entries[_last].flow == flow) {
+        return _entries[_last];
+    }
+
+    uint pos = (qHash(flow) ^ (uint)sampleTime * 2654435761U) & (INDEX_SIZE - 1);
+    while (_index[pos] >= 0) {
+        Entry& candidate = _entries[_index[pos]];
+        if (candidate.sampleTime == sampleTime && candidate.flow == flow) {
+            _last = _index[pos];
+            return candidate;
+        }
+        pos = (pos + 1) & (INDEX_SIZE - 1);
+    }
+
+    // New entry.
+    _last = _size++;
+    _index[pos] = _last;
+    Entry& entry = _entries[_last];
+    entry.flow = flow;
+    entry.sampleTime = sampleTime;
+    entry.bytesIn = 0;
+    entry.bytesOut = 0;
+    entry.packetsIn = 0;
+    entry.packetsOut = 0;
+    return entry;
+}
+
+void PacketBatch::clear() {
+    if (_size > 0) {
+        ::memset(_index, -1, sizeof(_index));
+        _size = 0;
+        _last = -1;
+    }
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PACKETBATCH_H_
+#define PACKETBATCH_H_
+
+#include <QtCore/QtGlobal>
+#include <sys/types.h>
+
+#include "FlowKey.h"
+#include "CommonTypes.h"
+
+/*
+ * A fixed-size buffer of decoded packets waiting to be committed to network history. Packets of the same flow
+ * captured in the same second are aggregated into a single entry as they are added, so a bulk transfer of many
+ * packets becomes one history update per batch. The buffer is allocated once and reused after each commit. Adding
+ * packets never allocates memory.
+ *
+ * This class is NOT thread-safe.
+ */
+class PacketBatch {
+public:
+    // Aggregated traffic of one flow in one second.
+    struct Entry {
+        FlowKey flow;
+        time_t sampleTime;
+        qlonglong bytesIn;
+        qlonglong bytesOut;
+        qlonglong packetsIn;
+        qlonglong packetsOut;
+    };
+
+    // New, empty batch.
+    PacketBatch();
+    virtual ~PacketBatch();
+
+    // Add one packet of the given length observed at the given time. The direction must be INBOUND or OUTBOUND.
+    // The batch must not be full.
+    void add(const FlowKey& flow, Direction direction, uint length, time_t sampleTime);
+
+    // True if no more packets can be added until the batch is cleared.
+    bool isFull() const { return _size == CAPACITY; }
+
+    // True if the batch has no entries.
+    bool isEmpty() const { return _size == 0; }
+
+    // Number of entries (distinct flows per second) in the batch.
+    int size() const { return _size; }
+
+    // Get an entry.
+    const Entry& at(int i) const { return _entries[i]; }
+
+    // Remove all entries. Memory is retained for reuse.
+    void clear();
+
+    // Max number of entries.
+    static const int CAPACITY = 256;
+
+private:
+    // Disable copying.
+    PacketBatch(const PacketBatch&);
+    PacketBatch& operator=(const PacketBatch&);
+
+    // Size of the index of entries. Must be a power of two, larger than the capacity.
+    static const int INDEX_SIZE = CAPACITY * 2;
+
+    // Find the entry of the given flow and time in the index, inserting a new one if there isn't one.
+    Entry& findOrInsert(const FlowKey& flow, time_t sampleTime);
+
+    Entry _entries[CAPACITY];           // entries in the order they were added
+    qint16 _index[INDEX_SIZE];          // open-addressing index of entry positions (-1 if unused)
+    int _size;                          // number of entries in use
+    int _last;                          // position of the most recently updated entry (or -1)
+};
+
+#endif /* PACKETBATCH_H_ */
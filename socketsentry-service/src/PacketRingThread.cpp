@@ -0,0 +1,320 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PacketRingThread.h"
+#include "FanoutGroup.h"
+
+#include <QtCore/QString>
+
+#include <pcap/pcap.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+const int PacketRingThread::BLOCK_SIZE = 1 << 20;
+const int PacketRingThread::FRAME_SIZE = 2048;
+const int PacketRingThread::POLL_TIMEOUT_MS = 333;     // wake up every 1/3 second
+const int PacketRingThread::STATS_INTERVAL_SECS = 10;
+
+PacketRingThread::PacketRingThread(QObject* parent, const QString& device, const QString& customFilter,
+        int ringSizeMb, int blockTimeoutMs, FanoutGroup* fanoutGroup) :
+    PcapThread(parent, device, customFilter), _ringSizeMb(qMax(ringSizeMb, 1)), _blockTimeoutMs(blockTimeoutMs),
+    _fanoutGroup(fanoutGroup),
+    _socket(-1), _ring(NULL), _ringLength(0), _cooked(false), _loopbackIndex(0),
+    _packetsReceived(0), _packetsDropped(0), _queueFreezes(0) {
+}
+
+PacketRingThread::~PacketRingThread() {
+    // In case the thread was never run to completion.
+    closeCapture();
+}
+
+bool PacketRingThread::openCapture(int& linkType, QString& message) {
+    Q_ASSERT(_socket == -1);
+
+    // Which interface? The "any" device captures from all of them.
+    int ifIndex = 0;
+    if (_device != "any") {
+        ifIndex = ::if_nametoindex(_device.toAscii());
+        if (ifIndex == 0) {
+            message = tr("Can't find network device. (%1)").arg(::strerror(errno));
+            return false;
+        }
+    }
+
+    // Pick the socket type and matching link type. Ethernet (and loopback, which has fake Ethernet headers) is
+    // captured with link headers so custom filters see the same packets as they would with libpcap. Anything else
+    // is captured without link headers and decoded as raw IP.
+    int hwType = ARPHRD_VOID;
+    if (ifIndex) {
+        int probe = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (probe >= 0) {
+            ifreq ifr;
+            ::memset(&ifr, 0, sizeof(ifr));
+            ::strncpy(ifr.ifr_name, _device.toAscii(), IFNAMSIZ - 1);
+            if (::ioctl(probe, SIOCGIFHWADDR, &ifr) == 0) {
+                hwType = ifr.ifr_hwaddr.sa_family;
+            }
+            ::close(probe);
+        }
+    }
+    _loopbackIndex = ::if_nametoindex("lo");
+    _cooked = (hwType != ARPHRD_ETHER && hwType != ARPHRD_LOOPBACK);
+    linkType = _cooked ? DLT_RAW : DLT_EN10MB;
+
+    // A packet socket opened without a protocol isn't hooked into the stack, so nothing reaches it until it's bound.
+    _socket = ::socket(AF_PACKET, _cooked ? SOCK_DGRAM : SOCK_RAW, 0);
+    if (_socket < 0) {
+        message = tr("Can't open packet socket. (%1)").arg(::strerror(errno));
+        return false;
+    }
+
+    // Attach the filter and set up the ring before binding to all protocols on the device, so we never see
+    // unfiltered traffic, nor traffic of other devices. A member of a fanout group drops everything until it has
+    // joined, since until then it sees all of the device's traffic, which the other members count too.
+    if (_fanoutGroup ? !attachDropFilter(message) : !attachFilter(linkType, message)) {
+        closeCapture();
+        return false;
+    }
+
+    // Set up the ring.
+    int version = TPACKET_V3;
+    tpacket_req3 req;
+    ::memset(&req, 0, sizeof(req));
+    req.tp_block_size = BLOCK_SIZE;
+    req.tp_block_nr = _ringSizeMb;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (BLOCK_SIZE / FRAME_SIZE) * _ringSizeMb;
+    req.tp_retire_blk_tov = _blockTimeoutMs;
+    if (::setsockopt(_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ||
+            ::setsockopt(_socket, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+        message = tr("Can't create packet ring. (%1)").arg(::strerror(errno));
+        closeCapture();
+        return false;
+    }
+    _ringLength = (size_t)req.tp_block_size * req.tp_block_nr;
+    void* ring = ::mmap(NULL, _ringLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, _socket, 0);
+    if (ring == MAP_FAILED) {
+        // Locking the pages is nice to have, but can exceed RLIMIT_MEMLOCK.
+        ring = ::mmap(NULL, _ringLength, PROT_READ | PROT_WRITE, MAP_SHARED, _socket, 0);
+    }
+    if (ring == MAP_FAILED) {
+        message = tr("Can't map packet ring. (%1)").arg(::strerror(errno));
+        _ringLength = 0;
+        closeCapture();
+        return false;
+    }
+    _ring = reinterpret_cast<u_char*>(ring);
+
+    // Start receiving from the device.
+    sockaddr_ll addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifIndex;
+    if (::bind(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        if (errno == ENETDOWN) {
+            message = tr("Can't activate packet capture because device is offline.");
+        } else {
+            message = tr("Can't activate packet capture. (%1)").arg(::strerror(errno));
+        }
+        closeCapture();
+        return false;
+    }
+
+    // Share the device's traffic with the other members of the fanout group (if any). This has to be done after
+    // binding. Then replace the drop filter with the real one.
+    if (_fanoutGroup && (!_fanoutGroup->join(_socket, message) || !attachFilter(linkType, message))) {
+        closeCapture();
+        return false;
+    }
+    qDebug("[%s]: Using %d MB packet ring with %d ms block timeout.",
+            (const char*)_device.toLatin1(), _ringSizeMb, _blockTimeoutMs);
+    return true;
+}
+
+bool PacketRingThread::attachFilter(int linkType, QString& message) {
+    // We only want TCP/UDP and user's custom criteria (if any).
+    QString filterText("(tcp or udp)");
+    if (_customFilter.length() > 0) {
+        filterText += " and (" + _customFilter + ")";
+    }
+
+    // The compiled program returns SNAPLEN for accepted packets, so the kernel truncates them for us too.
+    bool successful = false;
+    pcap_t* deadHandle = pcap_open_dead(linkType, SNAPLEN);
+    if (deadHandle) {
+        bpf_program filterProg;
+        if (pcap_compile(deadHandle, &filterProg, filterText.toAscii(), 1, 0) == 0) {
+            sock_fprog socketProg;
+            socketProg.len = filterProg.bf_len;
+            socketProg.filter = reinterpret_cast<sock_filter*>(filterProg.bf_insns);
+            if (::setsockopt(_socket, SOL_SOCKET, SO_ATTACH_FILTER, &socketProg, sizeof(socketProg)) == 0) {
+                successful = true;
+            } else {
+                message = tr("Can't apply filter \"%1\". (%2)").arg(filterText).arg(::strerror(errno));
+            }
+            pcap_freecode(&filterProg);
+        } else {
+            message = tr("Can't apply filter \"%1\". (%2)").arg(filterText).arg(pcap_geterr(deadHandle));
+        }
+        pcap_close(deadHandle);
+    } else {
+        message = tr("Can't compile filter \"%1\".").arg(filterText);
+    }
+    return successful;
+}
+
+bool PacketRingThread::attachDropFilter(QString& message) {
+    sock_filter dropAll = BPF_STMT(BPF_RET | BPF_K, 0);
+    sock_fprog socketProg;
+    socketProg.len = 1;
+    socketProg.filter = &dropAll;
+    if (::setsockopt(_socket, SOL_SOCKET, SO_ATTACH_FILTER, &socketProg, sizeof(socketProg)) != 0) {
+        message = tr("Can't apply filter to drop all packets. (%1)").arg(::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void PacketRingThread::captureLoop(QString& error) {
+    Q_ASSERT(_ring);
+    pollfd pfd;
+    pfd.fd = _socket;
+    pfd.events = POLLIN | POLLERR;
+    int blockIndex = 0;
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    time_t nextStatsTime = tv.tv_sec + STATS_INTERVAL_SECS;
+    while (canContinue()) {
+        tpacket_block_desc* block = reinterpret_cast<tpacket_block_desc*>(_ring + (size_t)blockIndex * BLOCK_SIZE);
+        if (block->hdr.bh1.block_status & TP_STATUS_USER) {
+            processBlock(reinterpret_cast<const u_char*>(block));
+            // Hand the block back to the kernel.
+            __sync_synchronize();
+            block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            blockIndex = (blockIndex + 1) % _ringSizeMb;
+            commitBatch();
+        } else {
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, POLL_TIMEOUT_MS) < 0 && errno != EINTR) {
+                error = tr("Failed during packet capture. (%1)").arg(::strerror(errno));
+                break;
+            }
+            if (pfd.revents & POLLERR) {
+                int sockError = 0;
+                socklen_t len = sizeof(sockError);
+                ::getsockopt(_socket, SOL_SOCKET, SO_ERROR, &sockError, &len);
+                if (sockError == ENETDOWN) {
+                    error = tr("Failed during packet capture because device went offline.");
+                } else {
+                    error = tr("Failed during packet capture. (%1)").arg(::strerror(sockError));
+                }
+                break;
+            }
+            commitBatch();
+        }
+
+        if (_logStats) {
+            ::gettimeofday(&tv, NULL);
+            if (tv.tv_sec >= nextStatsTime) {
+                updateStats();
+                logStats();
+                nextStatsTime = tv.tv_sec + STATS_INTERVAL_SECS;
+            }
+        }
+    }
+}
+
+void PacketRingThread::processBlock(const u_char* block) {
+    const tpacket_block_desc* desc = reinterpret_cast<const tpacket_block_desc*>(block);
+    const u_char* frame = block + desc->hdr.bh1.offset_to_first_pkt;
+    for (unsigned int i = 0; i < desc->hdr.bh1.num_pkts; ++i) {
+        const tpacket3_hdr* hdr = reinterpret_cast<const tpacket3_hdr*>(frame);
+        const sockaddr_ll* addr = reinterpret_cast<const sockaddr_ll*>(frame + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+
+        // Loopback packets show up twice, once going out and once coming in. Like libpcap, keep only the latter.
+        if (addr->sll_pkttype == PACKET_OUTGOING && _loopbackIndex && addr->sll_ifindex == _loopbackIndex) {
+            frame += hdr->tp_next_offset;
+            continue;
+        }
+
+        // The socket knows which way the packet went, which helps when the link layer headers can't tell us.
+        Direction direction = UNKNOWN_DIRECTION;
+        if (addr->sll_pkttype == PACKET_OUTGOING) {
+            direction = OUTBOUND;
+        } else if (addr->sll_pkttype == PACKET_HOST || addr->sll_pkttype == PACKET_BROADCAST ||
+                addr->sll_pkttype == PACKET_MULTICAST) {
+            direction = INBOUND;
+        }
+
+        pcap_pkthdr pcapHeader;
+        pcapHeader.ts.tv_sec = hdr->tp_sec;
+        pcapHeader.ts.tv_usec = hdr->tp_nsec / 1000;
+        pcapHeader.caplen = hdr->tp_snaplen;
+        pcapHeader.len = hdr->tp_len;
+        processPacket(&pcapHeader, frame + (_cooked ? hdr->tp_net : hdr->tp_mac), direction);
+
+        frame += hdr->tp_next_offset;
+    }
+}
+
+void PacketRingThread::updateStats() {
+    // The kernel resets its counters every time we read them.
+    tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (_socket >= 0 && ::getsockopt(_socket, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+        _packetsReceived += stats.tp_packets;
+        _packetsDropped += stats.tp_drops;
+        _queueFreezes += stats.tp_freeze_q_cnt;
+    }
+}
+
+void PacketRingThread::logStats() const {
+    qDebug("[%s]: Packets received: %llu, dropped by kernel: %llu, ring full: %llu times",
+            (const char*)_device.toLatin1(), (unsigned long long)_packetsReceived,
+            (unsigned long long)_packetsDropped, (unsigned long long)_queueFreezes);
+}
+
+void PacketRingThread::closeCapture() {
+    if (_socket >= 0) {
+        updateStats();
+        if (_ring) {
+            logStats();
+        }
+    }
+    if (_ring) {
+        ::munmap(_ring, _ringLength);
+        _ring = NULL;
+        _ringLength = 0;
+    }
+    if (_socket >= 0) {
+        ::close(_socket);
+        _socket = -1;
+    }
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PACKETRINGTHREAD_H_
+#define PACKETRINGTHREAD_H_
+
+#include "PcapThread.h"
+
+#include <sys/types.h>
+
+class FanoutGroup;
+
+/*
+ * Capture thread that reads packets from a memory-mapped TPACKET_V3 receive ring instead of libpcap. The kernel
+ * fills whole blocks of packets and hands them to us at once, so there is no per-packet system call or copy. A
+ * block is handed over when it is full or when the block timeout elapses, whichever comes first. The capture filter
+ * is still compiled by libpcap and attached directly to the socket.
+ *
+ * This class is reentrant and thread-safe. Public methods can be called from any thread.
+ */
+class PacketRingThread : public PcapThread {
+public:
+    // Create a new capture thread for the given device. The ring has "ringSizeMb" blocks of one megabyte each.
+    // Partially filled blocks are handed over after "blockTimeoutMs" milliseconds. If "fanoutGroup" is not NULL, the
+    // socket joins that PACKET_FANOUT group, sharing the device's traffic with the other members of the group. The
+    // group must outlive the thread.
+    PacketRingThread(QObject* parent, const QString& device, const QString& customFilter,
+            int ringSizeMb, int blockTimeoutMs, FanoutGroup* fanoutGroup = NULL);
+    virtual ~PacketRingThread();
+
+protected:
+    virtual bool openCapture(int& linkType, QString& message);
+    virtual void captureLoop(QString& error);
+    virtual void closeCapture();
+
+private:
+    // Compile the capture filter for the given link type and attach it to the socket. Returns true if successful.
+    // Otherwise, false is returned and the message argument is populated with the error.
+    bool attachFilter(int linkType, QString& message);
+
+    // Attach a filter that drops all packets to the socket, until the capture filter replaces it. Returns true if
+    // successful. Otherwise, false is returned and the message argument is populated with the error.
+    bool attachDropFilter(QString& message);
+
+    // Process all packets in a block handed over by the kernel.
+    void processBlock(const u_char* block);
+
+    // Read the kernel's counters since the last call and add them to the running totals.
+    void updateStats();
+
+    // Log the running capture totals.
+    void logStats() const;
+
+    // Immutables
+    static const int BLOCK_SIZE;                // size of one ring block
+    static const int FRAME_SIZE;                // nominal frame size (V3 packs frames of varying length)
+    static const int POLL_TIMEOUT_MS;           // max time to wait for a block before checking if we can continue
+    static const int STATS_INTERVAL_SECS;       // how often to log capture statistics (if enabled)
+    const int _ringSizeMb;
+    const int _blockTimeoutMs;
+    FanoutGroup* const _fanoutGroup;
+
+    // Unshared (thread private)
+    int _socket;                                // packet socket (or -1 if not open)
+    u_char* _ring;                              // memory-mapped ring (or NULL if not mapped)
+    size_t _ringLength;                         // length of the mapped ring
+    bool _cooked;                               // true if the socket delivers packets without link layer headers
+    int _loopbackIndex;                         // loopback interface index (or 0 if unknown)
+    quint64 _packetsReceived;                   // running total of packets received
+    quint64 _packetsDropped;                    // running total of packets dropped by the kernel
+    quint64 _queueFreezes;                      // running total of times the ring was full
+};
+
+#endif /* PACKETRINGTHREAD_H_ */
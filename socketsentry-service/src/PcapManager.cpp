@@ -24,6 +24,11 @@
 #include <QtCore/QHashIterator>
 
 #include "PcapThread.h"
+#include "PacketRingThread.h"
+#include "KernelFlowThread.h"
+#include "PcapReplayThread.h"
+#include "PcapThreadGroup.h"
+#include "CaptureSettings.h"
 #include "IpEndpointPair.h"
 
 #include <pcap/pcap.h>
@@ -99,14 +104,9 @@ void PcapManager::release(const QString& device) {
     }
 }
 
-bool PcapManager::anyTrafficSince(time_t timeSecs) const {
-    QHashIterator<QString, IPcapThread*> i(_threads);
-    while (i.hasNext()) {
-        i.next();
-        IPcapThread* thread = i.value();
-        if (thread->anyTrafficSince(timeSecs)) return true;
-    }
-    return false;
+bool PcapManager::isIdle(const QString& device, int secs) const {
+    IPcapThread* thread = _threads.value(device);
+    return !thread || thread->isIdle(secs);
 }
 
 void PcapManager::releaseAll() {
@@ -140,6 +140,18 @@ bool PcapManager::fillStatistics(const QString& device, QHash<IpEndpointPair, QP
     }
 }
 
+bool PcapManager::fillHistory(const QString& device, int windowSecs,
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error) const {
+
+    if (_threads.contains(device)) {
+        IPcapThread* thread = _threads[device];
+        return thread->fillHistory(windowSecs, result, error);
+    } else {
+        error = tr("Not capturing packets on device %1").arg(device);
+        return false;
+    }
+}
+
 void PcapManager::restartAll() {
     QStringList currentDevices = _threads.keys();
     releaseAll();
@@ -178,6 +190,9 @@ QStringList PcapManager::findAllDevices(QString& error) const {
         interfaces = NULL;
     }
 
+    // Trace files offered for replay count as devices too.
+    result.append(CaptureSettings::getInstance().getReplayDevices());
+
     if (!error.isEmpty()) {
         qWarning("Problem finding devices: %s", error.toLatin1().constData());
     } else {
@@ -192,7 +207,25 @@ QStringList PcapManager::findCurrentDevices() const {
 }
 
 IPcapThread* PcapManager::createPcapThread(const QString& device, const QString& customFilter) {
-    return new PcapThread(0, device, customFilter);
+    const CaptureSettings& settings = CaptureSettings::getInstance();
+    if (CaptureSettings::isReplayDevice(device)) {
+        QList<QHostAddress> localAddresses;
+        QStringListIterator i(settings.getReplayLocalAddresses());
+        while (i.hasNext()) {
+            localAddresses.append(QHostAddress(i.next()));
+        }
+        QString fileName = device.mid(CaptureSettings::REPLAY_DEVICE_PREFIX.length());
+        return new PcapReplayThread(0, device, fileName, customFilter, settings.getReplaySpeed(), localAddresses);
+    } else if (settings.useKernelFlows(device)) {
+        return new KernelFlowThread(0, device, customFilter, settings.getMaxFlowsPerSecond());
+    } else if (settings.useRing(device) && settings.getFanoutWorkers() > 1) {
+        return PcapThreadGroup::createFanout(device, customFilter, settings.getFanoutWorkers(),
+                settings.getRingSizeMb(), settings.getRingBlockTimeoutMs());
+    } else if (settings.useRing(device)) {
+        return new PacketRingThread(0, device, customFilter, settings.getRingSizeMb(), settings.getRingBlockTimeoutMs());
+    } else {
+        return new PcapThread(0, device, customFilter);
+    }
 }
 
 bool PcapManager::isStopped() const {
@@ -50,9 +50,11 @@ public:
     virtual QStringList findCurrentDevices() const;
     virtual bool fillStatistics(const QString& device, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
             QString& error) const;
+    virtual bool fillHistory(const QString& device, int windowSecs,
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error) const;
     virtual void release(const QString& device);
     virtual void releaseAll();
-    virtual bool anyTrafficSince(time_t timeSecs) const;
+    virtual bool isIdle(const QString& device, int secs) const;
     virtual bool isStopped() const;
     virtual bool isActive(const QString& device) const;
     virtual QString getCustomFilter() const { return _customFilter; }
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PcapReplayThread.h"
+#include "DateTimeUtils.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include <pcap/pcap.h>
+
+const int PcapReplayThread::POLL_TIMEOUT_MS = 333;     // wake up every 1/3 second
+const int PcapReplayThread::COMMIT_PACKETS = 4096;
+
+PcapReplayThread::PcapReplayThread(QObject* parent, const QString& device, const QString& fileName,
+        const QString& customFilter, int speed, const QList<QHostAddress>& localAddresses) :
+    PcapThread(parent, device, customFilter), _fileName(fileName), _speed(qMax(speed, 0)),
+    _directionHint(localAddresses.isEmpty() ? OUTBOUND : UNKNOWN_DIRECTION),
+    _simulatedTime(0), _replayDone(0), _packetsReplayed(0),
+    _replayHandle(NULL), _replayed(0), _traceStartMs(0), _replayStartMs(0) {
+    setLocalAddresses(localAddresses);
+}
+
+PcapReplayThread::~PcapReplayThread() {
+    // In case the thread was never run to completion.
+    closeCapture();
+}
+
+bool PcapReplayThread::openCapture(int& linkType, QString& message) {
+    Q_ASSERT(_replayHandle == NULL);
+    char errbuf[PCAP_ERRBUF_SIZE];
+    _replayHandle = pcap_open_offline(QFile::encodeName(_fileName).constData(), errbuf);
+    if (!_replayHandle) {
+        message = tr("Can't open packet trace. (%1)").arg(errbuf);
+        return false;
+    }
+    if (!applyFilter(_replayHandle, message)) {
+        closeCapture();
+        return false;
+    }
+    linkType = pcap_datalink(_replayHandle);
+    if (_speed) {
+        qDebug("[%s]: Replaying %s at %dx speed.", (const char*)_device.toLatin1(),
+                (const char*)_fileName.toLocal8Bit(), _speed);
+    } else {
+        qDebug("[%s]: Replaying %s as fast as possible.", (const char*)_device.toLatin1(),
+                (const char*)_fileName.toLocal8Bit());
+    }
+    return true;
+}
+
+void PcapReplayThread::captureLoop(QString& error) {
+    Q_ASSERT(_replayHandle);
+    pcap_pkthdr* header = NULL;
+    const u_char* bytes = NULL;
+    int status = 0;
+    int sinceCommit = 0;
+    while (canContinue() && (status = pcap_next_ex(_replayHandle, &header, &bytes)) >= 0) {
+        if (status == 0) {
+            continue;   // read timeout (live captures only)
+        }
+        if (!waitForPacket(header->ts)) {
+            return;
+        }
+        processPacket(header, bytes, _directionHint);
+        ++_replayed;
+        if (++sinceCommit == COMMIT_PACKETS) {
+            commit();
+            sinceCommit = 0;
+        }
+    }
+    if (status == -1) {
+        error = tr("Failed during packet replay. (%1)").arg(pcap_geterr(_replayHandle));
+        return;
+    } else if (status != -2) {
+        return;     // can't continue
+    }
+
+    // End of the trace. Statistics never include the current second, so when replaying as fast as possible, stop
+    // the clock just after the last packet.
+    if (!_speed && _simulatedTime) {
+        _simulatedTime.fetchAndAddOrdered(1);
+    }
+    commit(true);
+    _replayDone.fetchAndStoreOrdered(1);
+    qDebug("[%s]: Replayed %d packets.", (const char*)_device.toLatin1(), _replayed);
+
+    // Keep the history available until it's no longer needed.
+    while (canContinue()) {
+        msleep(POLL_TIMEOUT_MS);
+        advanceClock();
+        commit();
+    }
+}
+
+bool PcapReplayThread::waitForPacket(const timeval& timestamp) {
+    qlonglong packetMs = toMs(timestamp);
+    if (!_replayStartMs) {
+        // First packet.
+        _traceStartMs = packetMs;
+        _replayStartMs = DateTimeUtils::currentTimeMs();
+    }
+    if (_speed) {
+        qlonglong dueMs = _replayStartMs + (packetMs - _traceStartMs) / _speed;
+        qlonglong nowMs = DateTimeUtils::currentTimeMs();
+        while (nowMs < dueMs) {
+            // Make the packets so far visible while we wait.
+            commit();
+            msleep(qMin(dueMs - nowMs, (qlonglong)POLL_TIMEOUT_MS));
+            if (!canContinue()) {
+                return false;
+            }
+            advanceClock();
+            nowMs = DateTimeUtils::currentTimeMs();
+        }
+    }
+    // The clock never runs behind the packets or backward (if the trace is out of order).
+    if (timestamp.tv_sec > (time_t)_simulatedTime) {
+        _simulatedTime.fetchAndStoreOrdered((int)timestamp.tv_sec);
+    }
+    return true;
+}
+
+void PcapReplayThread::advanceClock() {
+    if (_speed && _replayStartMs) {
+        qlonglong nowMs = DateTimeUtils::currentTimeMs();
+        time_t simulatedTime = (_traceStartMs + (nowMs - _replayStartMs) * _speed) / 1000;
+        if (simulatedTime > (time_t)_simulatedTime) {
+            _simulatedTime.fetchAndStoreOrdered((int)simulatedTime);
+        }
+    }
+}
+
+void PcapReplayThread::commit(bool forcePublish) {
+    commitBatch(forcePublish);
+    _packetsReplayed.fetchAndStoreOrdered(_replayed);
+}
+
+time_t PcapReplayThread::currentTime() const {
+    return (time_t)_simulatedTime;
+}
+
+void PcapReplayThread::closeCapture() {
+    if (_replayHandle) {
+        pcap_close(_replayHandle);
+        _replayHandle = NULL;
+    }
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PCAPREPLAYTHREAD_H_
+#define PCAPREPLAYTHREAD_H_
+
+#include "PcapThread.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtNetwork/QHostAddress>
+
+#include <sys/time.h>
+
+/*
+ * Capture thread that replays a packet trace file (in libpcap format) instead of capturing live traffic. Packets go
+ * through the same decoders and network history as live ones. The replay runs on a simulated clock that follows the
+ * timestamps of the trace, so statistics are exported as of the trace time being replayed. Packets can be replayed at
+ * the recorded speed, at a multiple of it, or as fast as possible. Once the end of the trace is reached, the history
+ * stays available until the thread is no longer needed. The clock keeps running at the replay speed, or stops just
+ * after the last packet when replaying as fast as possible.
+ *
+ * This class is reentrant and thread-safe. Public methods can be called from any thread.
+ */
+class PcapReplayThread : public PcapThread {
+public:
+    // Create a new replay thread for the given trace file. The speed is relative to the recorded speed, or 0 to replay
+    // as fast as possible. Local addresses tell which way packets go. If there are none, the source of each packet is
+    // taken to be local.
+    PcapReplayThread(QObject* parent, const QString& device, const QString& fileName, const QString& customFilter,
+            int speed, const QList<QHostAddress>& localAddresses = QList<QHostAddress>());
+    virtual ~PcapReplayThread();
+
+    // True once the whole trace has been replayed.
+    bool isReplayDone() const { return _replayDone != 0; }
+
+    // Number of packets replayed so far.
+    int getPacketsReplayed() const { return _packetsReplayed; }
+
+protected:
+    virtual bool openCapture(int& linkType, QString& message);
+    virtual void captureLoop(QString& error);
+    virtual void closeCapture();
+    virtual time_t currentTime() const;
+
+private:
+    // Wait until it's time to replay a packet with the given timestamp, advancing the simulated clock meanwhile.
+    // Returns false if the thread can no longer continue.
+    bool waitForPacket(const timeval& timestamp);
+
+    // Advance the simulated clock to match the system clock at the replay speed.
+    void advanceClock();
+
+    // Record the packets replayed so far to history and publish the count.
+    void commit(bool forcePublish = false);
+
+    // Milliseconds since the epoch of a timestamp.
+    static qlonglong toMs(const timeval& timestamp) {
+        return (qlonglong)timestamp.tv_sec * 1000 + timestamp.tv_usec / 1000;
+    }
+
+    // Immutables
+    static const int POLL_TIMEOUT_MS;           // max time to wait before checking if we can continue
+    static const int COMMIT_PACKETS;            // packets replayed between commits when not waiting
+    const QString _fileName;
+    const int _speed;
+    const Direction _directionHint;             // direction of packets the decoders can't tell
+
+    // These members are shared with multiple threads and mutable. They are atomic, so no lock is needed.
+    QAtomicInt _simulatedTime;                  // current time of the simulated clock (or 0 before the first packet)
+    QAtomicInt _replayDone;                     // non-zero once the whole trace has been replayed
+    QAtomicInt _packetsReplayed;                // number of packets replayed so far
+
+    // Unshared (thread private)
+    pcap_t* _replayHandle;                      // replay handle (or NULL if not open)
+    int _replayed;                              // number of packets replayed (published on commit)
+    qlonglong _traceStartMs;                    // time of the first packet in the trace
+    qlonglong _replayStartMs;                   // system time at which the first packet was replayed
+};
+
+#endif /* PCAPREPLAYTHREAD_H_ */
@@ -15,7 +15,8 @@
  *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
  ***************************************************************************/
 
-#include <QtCore/QMutexLocker>
+#include <QtCore/QList>
+#include <QtNetwork/QHostAddress>
 #include <QtNetwork/QNetworkInterface>
 
 #include <sys/time.h>
@@ -27,14 +28,16 @@
 #include "DataLinkPacketDecoder.h"
 #include "CommonTypes.h"
 #include "LogSettings.h"
+#include "CaptureSettings.h"
 
 const int PcapThread::DEFAULT_TIMEOUT_SECS = 30;
 const int PcapThread::SNAPLEN = 128;
 
 PcapThread::PcapThread(QObject* parent, const QString& device, const QString& customFilter) :
     QThread(parent),  _device(device), _customFilter(customFilter),
-    _timeoutSecs(DEFAULT_TIMEOUT_SECS), _logStats(LogSettings::getInstance().logPacketCapture()),
-    _mutex(QMutex::Recursive), _pcapHandle(NULL), _networkInterface(NULL), _dataLinkDecoder(NULL) {
+    _logStats(LogSettings::getInstance().logPacketCapture()), _timeoutSecs(DEFAULT_TIMEOUT_SECS),
+    _lastTraffic(0), _canceled(0), _failed(0), _stopped(0),
+    _pcapHandle(NULL), _networkInterface(NULL), _dataLinkDecoder(NULL), _lastPublished(0), _reportedOverflow(0) {
 
     // Do we have a network interface?
     QNetworkInterface iface = QNetworkInterface::interfaceFromName(device);
@@ -46,8 +49,9 @@ PcapThread::PcapThread(QObject* parent, const QString& device, const QString& cu
     // Update last ping to now.
     timeval tv;
     ::gettimeofday(&tv, NULL);
-    _sharedMutables.lastPing = tv.tv_sec;
-    _sharedMutables.canceled = false;
+    _lastPing.fetchAndStoreOrdered((int)tv.tv_sec);
+    _history.setMaxFlowsPerSecond(CaptureSettings::getInstance().getMaxFlowsPerSecond());
+    _sharedMutables.tiers = _history.snapshotTiers(0);
 }
 
 PcapThread::~PcapThread() {
@@ -57,29 +61,25 @@ PcapThread::~PcapThread() {
 
 
 bool PcapThread::keepAlive() {
-    QMutexLocker locker(&_mutex);
     bool success = canContinue();
     if (success) {
         timeval tv;
         ::gettimeofday(&tv, NULL);
-        _sharedMutables.lastPing = tv.tv_sec;
+        _lastPing.fetchAndStoreOrdered((int)tv.tv_sec);
     }
     return success;
 }
 
 void PcapThread::cancel() {
-    QMutexLocker locker(&_mutex);
-    _sharedMutables.canceled = true;
+    _canceled.fetchAndStoreOrdered(1);
 }
 
 bool PcapThread::canContinue() const {
-    QMutexLocker locker(&_mutex);
-    return !isExpired() && _sharedMutables.lastError.isEmpty() && !_sharedMutables.canceled;
+    return !_stopped && !_failed && !_canceled && !isExpired();
 }
 
 bool PcapThread::isExpired() const {
-    QMutexLocker locker(&_mutex);
-    time_t expireTime = _sharedMutables.lastPing + _timeoutSecs;
+    time_t expireTime = (time_t)_lastPing + _timeoutSecs;
     timeval tv;
     ::gettimeofday(&tv, NULL);
     time_t currTime = tv.tv_sec;
@@ -87,15 +87,15 @@ bool PcapThread::isExpired() const {
 }
 
 void PcapThread::run() {
-    Q_ASSERT(_pcapHandle == NULL);
+    Q_ASSERT(_dataLinkDecoder == NULL);
     keepAlive();
 
-    // WARNING: We do not lock the mutex through most of this. Hands off mutable shared state!
+    // WARNING: We do not lock the mutex through most of this. Hands off mutable shared state except atomics!
     QString initMessage;
     QString captureError;
-    _pcapHandle = initializePcap(initMessage);
-    if (_pcapHandle) {
-        _dataLinkDecoder = DataLinkPacketDecoder::fromLinkType(pcap_datalink(_pcapHandle), _networkInterface);
+    int linkType = 0;
+    if (openCapture(linkType, initMessage)) {
+        _dataLinkDecoder = DataLinkPacketDecoder::fromLinkType(linkType, _networkInterface);
         if (_dataLinkDecoder) {
             if (!initMessage.isEmpty()) {
                 qWarning("[%s]: Packet capture started with warning. (%s)",
@@ -106,32 +106,27 @@ void PcapThread::run() {
             qDebug("[%s]: Using %s packet decoder.",
                 (const char*)_device.toLatin1(), (const char*)_dataLinkDecoder->name().toLatin1());
             // Main capture loop.
-            int loopStatus = 0;
             _startupLatch.flip();   // Let other threads know we're up and running.
-            while (canContinue() && loopStatus >= 0) {
-                loopStatus = pcap_loop(_pcapHandle, -1, PcapThread::packetCallback, reinterpret_cast<u_char*>(this));
-            }
-            if (loopStatus == -1) {
-                captureError = tr("Failed during packet capture. (%1)").arg(pcap_geterr(_pcapHandle));
-            }
+            captureLoop(captureError);
             delete _dataLinkDecoder;
             _dataLinkDecoder = NULL;
         } else {
             // Don't know how to decode packets for the data link type.
-            captureError = tr("Unsupported data link layer type %1.").arg(pcap_datalink(_pcapHandle));
+            captureError = tr("Unsupported data link layer type %1.").arg(linkType);
         }
-        pcap_close(_pcapHandle);
-        _pcapHandle = NULL;
+        closeCapture();
     } else {
-        // Failed to get a pcap handle.
+        // Failed to open the capture source.
         captureError = initMessage;
     }
 
     // Emit any error and shut down.
+    _stopped.fetchAndStoreOrdered(1);
     if (!captureError.isEmpty()) {
         _mutex.lock();
         _sharedMutables.lastError = captureError;
         _mutex.unlock();
+        _failed.fetchAndStoreOrdered(1);
         captureError = "[" + _device + "]: " + captureError;
         qWarning("%s", (const char*)captureError.toLatin1());
     }
@@ -139,6 +134,42 @@ void PcapThread::run() {
     qDebug("[%s]: Capture thread is shutting down.", (const char*)_device.toLatin1());
 }
 
+bool PcapThread::openCapture(int& linkType, QString& message) {
+    Q_ASSERT(_pcapHandle == NULL);
+    _pcapHandle = initializePcap(message);
+    if (_pcapHandle) {
+        linkType = pcap_datalink(_pcapHandle);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void PcapThread::captureLoop(QString& error) {
+    // Each dispatch returns after a buffer full of packets or the read timeout, so this checks whether we can
+    // continue at least every 1/3 second without checking on every packet.
+    int loopStatus = 0;
+    while (canContinue() && loopStatus >= 0) {
+        loopStatus = pcap_dispatch(_pcapHandle, -1, PcapThread::packetCallback, reinterpret_cast<u_char*>(this));
+        commitBatch();
+    }
+    if (loopStatus == -1) {
+        error = tr("Failed during packet capture. (%1)").arg(pcap_geterr(_pcapHandle));
+    }
+}
+
+void PcapThread::closeCapture() {
+    if (_pcapHandle) {
+        pcap_stat stats;
+        if (pcap_stats(_pcapHandle, &stats) == 0) {
+            qDebug("[%s]: Packets received: %u, dropped by kernel: %u, dropped by interface: %u",
+                    (const char*)_device.toLatin1(), stats.ps_recv, stats.ps_drop, stats.ps_ifdrop);
+        }
+        pcap_close(_pcapHandle);
+        _pcapHandle = NULL;
+    }
+}
+
 pcap_t* PcapThread::initializePcap(QString& message) const {
     char errbuf[PCAP_ERRBUF_SIZE];
     const int READ_TIMEOUT = 333;	// wake up every 1/3 second
@@ -149,13 +180,6 @@ pcap_t* PcapThread::initializePcap(QString& message) const {
         pcap_set_snaplen(pcapHandle, SNAPLEN);		// just headers
         pcap_set_timeout(pcapHandle, READ_TIMEOUT);
 
-        // We only want TCP/UDP and user's custom criteria (if any).
-        bpf_program filterProg;
-        QString filterText("(tcp or udp)");
-        if (_customFilter.length() > 0) {
-            filterText += " and (" + _customFilter + ")";
-        }
-
         // Activate.
         int pcapFailed = pcap_activate(pcapHandle);
         if (!pcapFailed || pcapFailed == PCAP_WARNING) {
@@ -163,17 +187,7 @@ pcap_t* PcapThread::initializePcap(QString& message) const {
                 message = pcap_geterr(pcapHandle);
             }
             // Apply the filter here. This has to be done after activation.
-            pcapFailed = pcap_compile(pcapHandle, &filterProg, filterText.toAscii(), 1, 0);
-            if (!pcapFailed) {
-                pcapFailed = pcap_setfilter(pcapHandle, &filterProg);
-            }
-            if (!pcapFailed) {
-                // DONE!
-                successful = true;
-            } else {
-                // Failed to apply filter.
-                message = tr("Can't apply filter \"%1\". (%2)").arg(filterText).arg(pcap_geterr(pcapHandle));
-            }
+            successful = applyFilter(pcapHandle, message);
         } else if (pcapFailed == PCAP_ERROR_IFACE_NOT_UP) {
             // Common case of iface being offline.
             message = tr("Can't activate packet capture because device is offline.");
@@ -193,55 +207,142 @@ pcap_t* PcapThread::initializePcap(QString& message) const {
     return pcapHandle;
 }
 
-void PcapThread::processPacket(const pcap_pkthdr* pcapHeader, const u_char* bytes) {
-    if (!canContinue()) {
-        pcap_breakloop(_pcapHandle);
-    } else {
-        Q_ASSERT(_dataLinkDecoder);
-        // Decode data link layer packet to determine start of IP packet and directionality (if applicable).
-        IpHeader ipHeader = _dataLinkDecoder->decode(pcapHeader, bytes);
-        if (ipHeader.start && ipHeader.start < bytes + pcapHeader->caplen) {
-            // We seem to have a valid IP packet. Decode the packet to determine endpoints and directionality.
-            int ipCapLen = bytes + pcapHeader->caplen - ipHeader.start;
-            IpEndpointPair endpoints;
-            Direction direction = _ipDecoder.decode(ipHeader.direction, ipCapLen, ipHeader.start,  endpoints);
-            if (direction != UNKNOWN_DIRECTION) {
-                // Found a valid IP packet. Accumulate metrics and add to history.
-                FlowMetrics metrics;
-                if (direction == INBOUND) {
-                    metrics.setBytesIn(pcapHeader->len);
-                    metrics.setPacketsIn(1);
-                } else {
-                    metrics.setBytesOut(pcapHeader->len);
-                    metrics.setPacketsOut(1);
-                }
-                time_t capTime = pcapHeader->ts.tv_sec;
-                _mutex.lock();
-                _sharedMutables.history.record(endpoints, metrics, capTime);
-                _mutex.unlock();
-                if (_logStats) {
-                    qDebug("[%s]: %s %s %d bytes", _device.toLatin1().constData(),
-                            (direction == INBOUND) ? "In " : "Out",
-                            endpoints.toString().toLatin1().constData(),
-                            pcapHeader->len);
-                }
-            } // Else, couldn't decode IP packet. Oh well.
-        } // Else, not an IP packet. Oh well.
+bool PcapThread::applyFilter(pcap_t* pcapHandle, QString& message) const {
+    // We only want TCP/UDP and user's custom criteria (if any).
+    QString filterText("(tcp or udp)");
+    if (_customFilter.length() > 0) {
+        filterText += " and (" + _customFilter + ")";
+    }
+    bpf_program filterProg;
+    int pcapFailed = pcap_compile(pcapHandle, &filterProg, filterText.toAscii(), 1, 0);
+    if (!pcapFailed) {
+        pcapFailed = pcap_setfilter(pcapHandle, &filterProg);
+        pcap_freecode(&filterProg);
+    }
+    if (pcapFailed) {
+        message = tr("Can't apply filter \"%1\". (%2)").arg(filterText).arg(pcap_geterr(pcapHandle));
+        return false;
+    }
+    return true;
+}
+
+void PcapThread::setLocalAddresses(const QList<QHostAddress>& addresses) {
+    QList<QNetworkAddressEntry> entries;
+    QListIterator<QHostAddress> i(addresses);
+    while (i.hasNext()) {
+        QNetworkAddressEntry entry;
+        entry.setIp(i.next());
+        entries.append(entry);
+    }
+    _ipDecoder.setLocalAddresses(entries);
+}
+
+time_t PcapThread::currentTime() const {
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return tv.tv_sec;
+}
+
+void PcapThread::processPacket(const pcap_pkthdr* pcapHeader, const u_char* bytes, Direction directionHint) {
+    Q_ASSERT(_dataLinkDecoder);
+    // Decode data link layer packet to determine start of IP packet and directionality (if applicable).
+    IpHeader ipHeader = _dataLinkDecoder->decode(pcapHeader, bytes);
+    if (ipHeader.direction == UNKNOWN_DIRECTION) {
+        ipHeader.direction = directionHint;
+    }
+    if (ipHeader.start && ipHeader.start < bytes + pcapHeader->caplen) {
+        // We seem to have a valid IP packet. Decode the packet to determine endpoints and directionality.
+        int ipCapLen = bytes + pcapHeader->caplen - ipHeader.start;
+        FlowKey flow = FlowKey();
+        Direction direction = _ipDecoder.decode(ipHeader.direction, ipCapLen, ipHeader.start, flow);
+        if (direction != UNKNOWN_DIRECTION) {
+            // Found a valid IP packet. Accumulate metrics in the batch. They go to history when it's committed.
+            time_t capTime = pcapHeader->ts.tv_sec;
+            _batch.add(flow, direction, pcapHeader->len, capTime);
+            if (_batch.isFull()) {
+                _history.recordBatch(_batch);
+                _batch.clear();
+            }
+            if (_logStats) {
+                qDebug("[%s]: %s %s %d bytes", _device.toLatin1().constData(),
+                        (direction == INBOUND) ? "In " : "Out",
+                        flow.toEndpointPair().toString().toLatin1().constData(),
+                        pcapHeader->len);
+            }
+        } // Else, couldn't decode IP packet. Oh well.
+    } // Else, not an IP packet. Oh well.
+}
+
+void PcapThread::processCounters(const FlowKey& flow, const FlowCounters& counters, time_t sampleTime) {
+    _history.record(flow, counters, sampleTime);
+    if (_logStats) {
+        qDebug("[%s]: %s %lld bytes in, %lld bytes out", _device.toLatin1().constData(),
+                flow.toEndpointPair().toString().toLatin1().constData(), counters.bytesIn, counters.bytesOut);
+    }
+}
+
+void PcapThread::commitBatch(bool forcePublish) {
+    _history.recordBatch(_batch);
+    _batch.clear();
+
+    time_t lastRecording = _history.getLastRecording();
+    if (lastRecording > (time_t)_lastTraffic) {
+        _lastTraffic.fetchAndStoreOrdered((int)lastRecording);
+    }
+
+    // Statistics never include the current second, so publishing more than once per second buys readers nothing.
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    if (tv.tv_sec != _lastPublished || forcePublish) {
+        // Export outside the lock. The stale results are released after it, too.
+        const time_t endTime = currentTime();
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > statistics;
+        _history.exportStatistics(statistics, endTime);
+        TierSnapshot tiers = _history.snapshotTiers(endTime);
+        _mutex.lock();
+        qSwap(statistics, _sharedMutables.statistics);
+        qSwap(tiers, _sharedMutables.tiers);
+        _mutex.unlock();
+        _lastPublished = tv.tv_sec;
+
+        if (_history.getOverflowPackets() > _reportedOverflow) {
+            qWarning("[%s]: Too many flows per second. %lld packets were not recorded.",
+                    (const char*)_device.toLatin1(), _history.getOverflowPackets() - _reportedOverflow);
+            _reportedOverflow = _history.getOverflowPackets();
+        }
     }
 }
 
 bool PcapThread::fillStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error) {
+    TierSnapshot tiers;
+    return getPublished(result, tiers, error);
+}
+
+bool PcapThread::fillHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+        QString& error) {
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > statistics;
+    TierSnapshot tiers;
+    if (!getPublished(statistics, tiers, error)) {
+        return false;
+    }
+    NetworkHistory::exportHistory(tiers, windowSecs, result);
+    return true;
+}
+
+bool PcapThread::getPublished(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& statistics,
+        TierSnapshot& tiers, QString& error) {
     _startupLatch.wait();   // Wait for startup in case there's an error we need to pick up.
-    QMutexLocker locker(&_mutex);
+    _mutex.lock();
     if(!_sharedMutables.lastError.isEmpty()) {
         error = _sharedMutables.lastError;
+        _mutex.unlock();
         return false;
-    } else {
-        timeval tv;
-        ::gettimeofday(&tv, NULL);
-        _sharedMutables.history.exportStatistics(result, tv.tv_sec);
-        return true;
     }
+    // The published results are never modified, so sharing them is enough.
+    statistics = _sharedMutables.statistics;
+    tiers = _sharedMutables.tiers;
+    _mutex.unlock();
+    return true;
 }
 
 void PcapThread::packetCallback(u_char* obj, const pcap_pkthdr* header, const u_char* bytes) {
@@ -257,7 +358,6 @@ bool PcapThread::isDone() const {
     return isFinished();
 }
 
-bool PcapThread::anyTrafficSince(time_t timeSecs) const {
-    QMutexLocker locker(&_mutex);
-    return _sharedMutables.history.anyTrafficSince(timeSecs);
+bool PcapThread::isIdle(int secs) const {
+    return (time_t)_lastTraffic < currentTime() - secs;
 }
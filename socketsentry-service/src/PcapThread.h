@@ -18,22 +18,39 @@
 #ifndef PCAPTHREAD_H_
 #define PCAPTHREAD_H_
 
+#include <QtCore/QHash>
+#include <QtCore/QPair>
 #include <QtCore/QString>
 #include <QtCore/QThread>
 #include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
 
 #include "NetworkHistory.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
 #include "InternetProtocolDecoder.h"
+#include "PacketBatch.h"
+#include "CommonTypes.h"
 #include "IPcapThread.h"
 #include "Latch.h"
 
 struct pcap_pkthdr;
 typedef struct pcap pcap_t;
 class QNetworkInterface;
+class QHostAddress;
+template <class E> class QList;
 class DataLinkPacketDecoder;
 
 /*
- * Main implementation of IPcapThread.
+ * Main implementation of IPcapThread. By default, packets are captured with libpcap. Subclasses can capture from
+ * other sources by overriding the capture source methods ("openCapture", "captureLoop", and "closeCapture") and feeding
+ * packets to "processPacket" (or traffic counters to "processCounters").
+ *
+ * The capture thread owns its network history privately and records packets without locking. Once a second, it
+ * exports the statistics and takes a snapshot of the downsampled tiers for readers. Readers share these published
+ * results but never modify them, and the history itself is never shared, so rolling it forward doesn't copy anything.
+ * Shutdown conditions are kept in atomics and checked once per batch of packets, not per packet.
  *
  * This class is reentrant and thread-safe. Public methods can be called from any thread.
  */
@@ -50,14 +67,60 @@ public:
     virtual bool keepAlive();
     virtual void cancel();
     virtual bool fillStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error);
+    virtual bool fillHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+            QString& error);
     virtual void begin();
     virtual bool isDone() const;
-    virtual bool anyTrafficSince(time_t timeSecs) const;
+    virtual bool isIdle(int secs) const;
     virtual bool canContinue() const;
 
 protected:
     virtual void run();
 
+    // Open the capture source and return true if successful. On success, the data link type of captured packets is
+    // returned through the argument (a DLT_* constant from libpcap). If the source opens with a warning, the message
+    // argument is also initialized. On failure, false is returned and the message describes the problem. The default
+    // implementation opens a live capture handle with libpcap.
+    virtual bool openCapture(int& linkType, QString& message);
+
+    // Capture packets until this thread can no longer continue or an error occurs, calling "processPacket" for each
+    // captured packet and "commitBatch" after each batch of packets (or read timeout). On error, the argument is
+    // populated with a message.
+    virtual void captureLoop(QString& error);
+
+    // Close the capture source opened by "openCapture" and log any capture statistics.
+    virtual void closeCapture();
+
+    // Process a new captured packet. If the data link decoder can't determine the direction of the packet, the
+    // caller may supply a hint from the capture source.
+    void processPacket(const pcap_pkthdr* pcapHeader, const u_char* bytes,
+            Direction directionHint = UNKNOWN_DIRECTION);
+
+    // Record traffic of one flow that was counted elsewhere (e.g. by the kernel) at the given time. Like packets, it
+    // becomes visible to other threads with the next "commitBatch".
+    void processCounters(const FlowKey& flow, const FlowCounters& counters, time_t sampleTime);
+
+    // Record the current batch of packets to history and make the packets processed so far visible to other threads.
+    // The history is published at most once per second, unless the argument is true.
+    void commitBatch(bool forcePublish = false);
+
+    // Compile the capture filter (TCP/UDP and the custom filter, if any) and apply it to a capture handle. Returns
+    // true if successful. Otherwise, false is returned and the message argument is populated with the error.
+    bool applyFilter(pcap_t* pcapHandle, QString& message) const;
+
+    // Use the given addresses instead of the device's to tell which way packets go.
+    void setLocalAddresses(const QList<QHostAddress>& addresses);
+
+    // Current time in seconds of the clock that statistics are exported at. The default implementation returns the
+    // system time. This method must be thread-safe.
+    virtual time_t currentTime() const;
+
+    // Immutables
+    static const int SNAPLEN;                   // max captured packet length; we only need headers
+    const QString _device;                      // the OS device name
+    const QString _customFilter;                // if specifiied, it'll be added to the capture filter
+    const bool _logStats;                       // true if packet capture stats should be logged to debug
+
 private:
 
     // Create and initialize a new capture handle. The handle is activated before return. If an error occurs,
@@ -67,36 +130,40 @@ private:
     // member (and data link decoder).
     pcap_t* initializePcap(QString& message) const;
 
-    // Process a new packet produced by the pcap library.
-    void processPacket(const pcap_pkthdr* pcapHeader, const u_char* bytes);
-
     // True if the thread has been running for too long without a call to keep it alive.
     // Once a thread has expired, it automatically ends the packet capture and shuts down.
     bool isExpired() const;
 
+    // Get the results published last. They're shared rather than copied. Returns true if successful. If the capture
+    // has failed, false is returned and the error argument is populated.
+    bool getPublished(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& statistics, TierSnapshot& tiers,
+            QString& error);
+
     // Callback invoked by the pcap library upon successful packet capture.
     static void packetCallback(u_char* obj, const pcap_pkthdr* header, const u_char* bytes);
 
     // Immutables
     static const int DEFAULT_TIMEOUT_SECS;      // default max time the thread stays alive without a ping
-    static const int SNAPLEN;                   // max captured packet length; we only need headers
-    const QString _device;                      // the OS device name
-    const QString _customFilter;                // if specifiied, it'll be added to the capture filter
     const int _timeoutSecs;                     // max time the thread stays alive without a ping
-    const bool _logStats;                       // true if packet capture stats should be logged to debug
 
-    // Mutex for shared mutable state.
+    // Mutex for the published results and last error.
     mutable QMutex _mutex;
 
     // Blocks other threads until this object has completed or failed initialization.
     Latch _startupLatch;
 
+    // These members are shared with multiple threads and mutable. They are atomic, so no lock is needed.
+    QAtomicInt _lastPing;                       // last time a client expressed interest in our traffic
+    QAtomicInt _lastTraffic;                    // time of the most recent captured traffic (see "currentTime")
+    QAtomicInt _canceled;                       // non-zero if the client wants us to shutdown
+    QAtomicInt _failed;                         // non-zero if there is a capture error (see "lastError")
+    QAtomicInt _stopped;                        // non-zero once the capture has ended
+
     // These members are shared with multiple threads and mutable. Protect access to them with mutex.
     struct Shared {
-        time_t lastPing;                        // last time a client expressed interest in our traffic
         QString lastError;                      // last capture error
-        bool canceled;                          // true if the client wants us to shutdown
-        NetworkHistory history;                 // rolling history of network traffic
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > statistics;  // latest published statistics
+        TierSnapshot tiers;                     // latest published snapshot of the downsampled tiers
     } _sharedMutables;
 
     // Unshared (thread private)
@@ -104,6 +171,10 @@ private:
     const QNetworkInterface* _networkInterface;     // the network interface (if it is known)
     DataLinkPacketDecoder* _dataLinkDecoder;        // decodes data link layer packets
     InternetProtocolDecoder _ipDecoder;             // decodes network layer packets (and a little TCP/UDP)
+    PacketBatch _batch;                             // packets processed but not yet recorded to history
+    NetworkHistory _history;                        // rolling history of network traffic
+    time_t _lastPublished;                          // time the results were last published
+    qlonglong _reportedOverflow;                    // number of unrecorded packets already reported
 
 };
 
@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PcapThreadGroup.h"
+#include "PacketRingThread.h"
+#include "FanoutGroup.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QHashIterator>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+
+PcapThreadGroup::PcapThreadGroup(const QList<IPcapThread*>& workers, FanoutGroup* fanoutGroup) :
+    _workers(workers), _fanoutGroup(fanoutGroup) {
+    Q_ASSERT(!_workers.isEmpty());
+}
+
+PcapThreadGroup::~PcapThreadGroup() {
+    qDeleteAll(_workers);
+    delete _fanoutGroup;
+}
+
+PcapThreadGroup* PcapThreadGroup::createFanout(const QString& device, const QString& customFilter, int workers,
+        int ringSizeMb, int blockTimeoutMs) {
+    FanoutGroup* fanoutGroup = new FanoutGroup;
+    QList<IPcapThread*> threads;
+    for (int i = 0; i < qMax(workers, 1); i++) {
+        threads.append(new PacketRingThread(0, device, customFilter, ringSizeMb, blockTimeoutMs, fanoutGroup));
+    }
+    return new PcapThreadGroup(threads, fanoutGroup);
+}
+
+bool PcapThreadGroup::keepAlive() {
+    foreach (IPcapThread* worker, _workers) {
+        if (!worker->keepAlive()) {
+            // If any worker is shutting down, we can't account for all of the traffic anymore. Take down the rest.
+            cancel();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PcapThreadGroup::cancel() {
+    foreach (IPcapThread* worker, _workers) {
+        worker->cancel();
+    }
+}
+
+bool PcapThreadGroup::fillStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+        QString& error) {
+    result.clear();
+    foreach (IPcapThread* worker, _workers) {
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > shard;
+        if (!worker->fillStatistics(shard, error)) {
+            result.clear();
+            return false;
+        }
+        mergeShard(shard, result);
+    }
+    return true;
+}
+
+bool PcapThreadGroup::fillHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+        QString& error) {
+    result.clear();
+    foreach (IPcapThread* worker, _workers) {
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > shard;
+        if (!worker->fillHistory(windowSecs, shard, error)) {
+            result.clear();
+            return false;
+        }
+        mergeShard(shard, result);
+    }
+    return true;
+}
+
+void PcapThreadGroup::mergeShard(const QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& shard,
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result) {
+    if (result.isEmpty()) {
+        result = shard;
+    } else {
+        // The kernel usually keeps a flow on one worker, but not always (e.g. when the group size changes or the
+        // two directions of a flow hash differently), so combine flows that appear in more than one shard.
+        QHashIterator<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > i(shard);
+        while (i.hasNext()) {
+            i.next();
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >::iterator existing = result.find(i.key());
+            if (existing == result.end()) {
+                result.insert(i.key(), i.value());
+            } else {
+                existing.value().first.combineConnections(i.value().first);
+                existing.value().second.combineConnections(i.value().second);
+            }
+        }
+    }
+}
+
+void PcapThreadGroup::begin() {
+    foreach (IPcapThread* worker, _workers) {
+        worker->begin();
+    }
+}
+
+bool PcapThreadGroup::isDone() const {
+    foreach (IPcapThread* worker, _workers) {
+        if (!worker->isDone()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PcapThreadGroup::isIdle(int secs) const {
+    foreach (IPcapThread* worker, _workers) {
+        if (!worker->isIdle(secs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PcapThreadGroup::canContinue() const {
+    foreach (IPcapThread* worker, _workers) {
+        if (!worker->canContinue()) {
+            return false;
+        }
+    }
+    return true;
+}
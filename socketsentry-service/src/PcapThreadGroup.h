@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PCAPTHREADGROUP_H_
+#define PCAPTHREADGROUP_H_
+
+#include <QtCore/QList>
+
+#include "IPcapThread.h"
+
+class QString;
+class FanoutGroup;
+
+/*
+ * A group of capture threads that share the traffic of a single device. Each worker keeps its own history of the
+ * packets it sees. The group behaves like a single capture thread to its clients, merging the workers' statistics on
+ * request. The group is alive only while all of its workers are.
+ *
+ * This class is reentrant and thread-safe as long as the workers are.
+ */
+class PcapThreadGroup : public IPcapThread {
+public:
+    // New group of the given workers. The group takes ownership of them and of the fanout group they share (if any).
+    // There must be at least one worker.
+    PcapThreadGroup(const QList<IPcapThread*>& workers, FanoutGroup* fanoutGroup = NULL);
+    virtual ~PcapThreadGroup();
+
+    // Create a group of packet ring workers that capture from the given device. The workers join a PACKET_FANOUT
+    // group in hash mode, so the kernel keeps all packets of a flow on the same worker.
+    static PcapThreadGroup* createFanout(const QString& device, const QString& customFilter, int workers,
+            int ringSizeMb, int blockTimeoutMs);
+
+    // These methods implement behavior described in the interface.
+    virtual bool keepAlive();
+    virtual void cancel();
+    virtual bool fillStatistics(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error);
+    virtual bool fillHistory(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+            QString& error);
+    virtual void begin();
+    virtual bool isDone() const;
+    virtual bool isIdle(int secs) const;
+    virtual bool canContinue() const;
+
+private:
+    // Add one worker's statistics to the combined result of the group.
+    static void mergeShard(const QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& shard,
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result);
+
+    const QList<IPcapThread*> _workers;
+    FanoutGroup* const _fanoutGroup;
+};
+
+#endif /* PCAPTHREADGROUP_H_ */
@@ -0,0 +1,142 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ProcEventListener.h"
+#include "ProcessSocketIndex.h"
+
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QString>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+// Size of the receive buffer. Each event is a small message of its own.
+static const int RECEIVE_BUFFER_SIZE = 16 * 1024;
+
+// Size of the socket's receive queue in the kernel. Process churn on a busy machine comes in bursts (think parallel
+// builds), and the index has to start over from /proc if the queue overflows.
+static const int SOCKET_QUEUE_SIZE = 1024 * 1024;
+
+ProcEventListener::ProcEventListener(ProcessSocketIndex& index, QObject* parent) :
+    QObject(parent), _index(index), _socket(-1), _notifier(NULL) {
+}
+
+ProcEventListener::~ProcEventListener() {
+    delete _notifier;
+    if (_socket >= 0) {
+        ::close(_socket);
+    }
+}
+
+bool ProcEventListener::open(QString& error) {
+    _socket = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (_socket < 0) {
+        error = QObject::tr("Can't open proc connector socket. (%1)").arg(::strerror(errno));
+        return false;
+    }
+    // Best effort. (Only root may exceed the system-wide limit.)
+    ::setsockopt(_socket, SOL_SOCKET, SO_RCVBUFFORCE, &SOCKET_QUEUE_SIZE, sizeof(SOCKET_QUEUE_SIZE));
+
+    sockaddr_nl local;
+    ::memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = CN_IDX_PROC;
+    if (::bind(_socket, (sockaddr*)&local, sizeof(local)) < 0) {
+        error = QObject::tr("Can't bind proc connector socket. (%1)").arg(::strerror(errno));
+        ::close(_socket);
+        _socket = -1;
+        return false;
+    }
+
+    // Ask the kernel to start multicasting proc events.
+    char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(quint32))];
+    ::memset(request, 0, sizeof(request));
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(request);
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(quint32));
+    header->nlmsg_type = NLMSG_DONE;
+    cn_msg* message = reinterpret_cast<cn_msg*>(NLMSG_DATA(header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(quint32);
+    const quint32 operation = PROC_CN_MCAST_LISTEN;
+    ::memcpy(message->data, &operation, sizeof(operation));
+    if (::send(_socket, request, header->nlmsg_len, 0) < 0) {
+        error = QObject::tr("Can't subscribe to proc events. (%1)").arg(::strerror(errno));
+        ::close(_socket);
+        _socket = -1;
+        return false;
+    }
+
+    _buffer.resize(RECEIVE_BUFFER_SIZE);
+    _notifier = new QSocketNotifier(_socket, QSocketNotifier::Read);
+    connect(_notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+    return true;
+}
+
+void ProcEventListener::readEvents() {
+    while (true) {
+        ssize_t length = ::recv(_socket, _buffer.data(), _buffer.size(), 0);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                // The kernel dropped events. The index can't trust what it knows anymore.
+                _index.resync();
+                continue;
+            }
+            break;      // EAGAIN: no more events for now
+        }
+        parseMessages(_buffer.constData(), length, _index);
+    }
+}
+
+void ProcEventListener::parseMessages(const char* buffer, int length, ProcessSocketIndex& index) {
+    const nlmsghdr* message = reinterpret_cast<const nlmsghdr*>(buffer);
+    for (; NLMSG_OK(message, (unsigned)length); message = NLMSG_NEXT(message, length)) {
+        if (message->nlmsg_len < NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_event))) {
+            continue;   // too short to be a proc event
+        }
+        const cn_msg* connectorMessage = reinterpret_cast<const cn_msg*>(NLMSG_DATA(message));
+        if (connectorMessage->id.idx != CN_IDX_PROC || connectorMessage->id.val != CN_VAL_PROC) {
+            continue;
+        }
+
+        // Threads of a process share its descriptors, so only whole processes matter.
+        const proc_event* event = reinterpret_cast<const proc_event*>(connectorMessage->data);
+        switch (event->what) {
+        case proc_event::PROC_EVENT_FORK:
+            if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid) {
+                index.processStarted(event->event_data.fork.child_tgid);
+            }
+            break;
+        case proc_event::PROC_EVENT_EXEC:
+            index.processExecuted(event->event_data.exec.process_tgid);
+            break;
+        case proc_event::PROC_EVENT_EXIT:
+            if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid) {
+                index.processExited(event->event_data.exit.process_tgid);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PROCEVENTLISTENER_H_
+#define PROCEVENTLISTENER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+
+class ProcessSocketIndex;
+class QSocketNotifier;
+class QString;
+
+/*
+ * Listens to process fork, exec, and exit events from the kernel's proc connector (NETLINK_CONNECTOR) and passes
+ * them on to a process socket index as they arrive, so the index doesn't have to poll /proc to learn about new and
+ * exited processes. Events are read from the event loop of the thread that opened the listener. Listening requires
+ * the CAP_NET_ADMIN capability.
+ *
+ * This class is NOT thread-safe.
+ */
+class ProcEventListener : public QObject {
+    Q_OBJECT
+
+public:
+    // New listener feeding the given index. The listener is idle until opened.
+    explicit ProcEventListener(ProcessSocketIndex& index, QObject* parent = 0);
+    virtual ~ProcEventListener();
+
+    // Subscribe to proc events. Returns true on success. On failure, returns false and populates the error argument.
+    bool open(QString& error);
+
+    // Decode a buffer of proc connector messages and pass the events to the index. Thread events are skipped.
+    static void parseMessages(const char* buffer, int length, ProcessSocketIndex& index);
+
+private slots:
+    // Read all pending events.
+    void readEvents();
+
+private:
+    // Index fed by the events.
+    ProcessSocketIndex& _index;
+
+    // Netlink socket (or -1 if not open).
+    int _socket;
+
+    // Notifies us when events are waiting.
+    QSocketNotifier* _notifier;
+
+    // Receive buffer, reused between reads.
+    QByteArray _buffer;
+};
+
+#endif /* PROCEVENTLISTENER_H_ */
@@ -0,0 +1,197 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ProcNetReader.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Each line of data in /proc/net/tcp* or /proc/net/udp* holds (among other things) the local address and port, the
+// remote address and port, and the connection state in hex, and the inode (socket identifier) in decimal.
+//
+// Example data (TCP over IPv4):
+//  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode ref pointer drops
+//  49: 00000000:0044 00000000:0000 07 00000000:00000000 00:00000000 00000000     0        0 6703 2 ffff880123d0c000 0
+//  55: 0100007F:1F4A 00000000:0000 07 00000000:00000000 00:00000000 00000000  1000        0 8625 2 ffff88012545cd00 0
+//  84: 00000000:CE67 00000000:0000 07 00000000:00000000 00:00000000 00000000  1000        0 8643 2 ffff88012545d040 0
+//  86: 00000000:14E9 00000000:0000 07 00000000:00000000 00:00000000 00000000   105        0 5628 2 ffff88012545c000 0
+// 126: 00000000:8D11 00000000:0000 07 00000000:00000000 00:00000000 00000000   105        0 5629 2 ffff88012545c340 0
+//
+// Note that the only difference between IPv4 and v6 in these tables is the size of the addresses.
+
+// Path to connection tables in the /proc filesystem.
+const QString ProcNetReader::DEFAULT_NET_PATH("/proc/net");
+
+// Connection state of a socket in LISTEN state (not a real connection).
+static const quint32 LISTEN_STATE = 0x0a;
+
+// Initial size of the read buffer. The kernel hands out a page or so per read.
+static const int READ_BUFFER_SIZE = 64 * 1024;
+
+// Number of fields between the connection state and the inode: tx_queue:rx_queue, tr:tm->when, retrnsmt, uid, and
+// timeout.
+static const int SKIPPED_FIELDS = 5;
+
+// Value of a hex digit, or -1 if it isn't one.
+static inline int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;      // lower case
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline void skipSpaces(const char*& pos, const char* end) {
+    while (pos < end && (*pos == ' ' || *pos == '\t')) pos++;
+}
+
+// Parse exactly the given number of hex digits (up to 8).
+static inline bool parseHex(const char*& pos, const char* end, int digits, quint32& value) {
+    if (end - pos < digits) return false;
+    value = 0;
+    for (int i = 0; i < digits; i++) {
+        int digit = hexValue(*pos++);
+        if (digit < 0) return false;
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+// Parse a decimal number of at least one digit.
+static inline bool parseDecimal(const char*& pos, const char* end, quint32& value) {
+    const char* start = pos;
+    value = 0;
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        value = value * 10 + (*pos++ - '0');
+    }
+    return pos > start;
+}
+
+static inline bool expect(const char*& pos, const char* end, char c) {
+    if (pos == end || *pos != c) return false;
+    pos++;
+    return true;
+}
+
+// Parse an address and port, e.g. "0100007F:1F4A". The kernel prints addresses as 32-bit words in host byte order, so
+// storing each word in host byte order gives back the network byte order that flow keys want.
+static inline bool parseEndpoint(const char*& pos, const char* end, bool ipv6, quint8* address, quint16& port) {
+    const int words = ipv6 ? 4 : 1;
+    for (int i = 0; i < words; i++) {
+        quint32 word;
+        if (!parseHex(pos, end, 8, word)) return false;
+        ::memcpy(address + i * sizeof(word), &word, sizeof(word));
+    }
+    quint32 value;
+    if (!expect(pos, end, ':') || !parseHex(pos, end, 4, value)) return false;
+    port = value;
+    return true;
+}
+
+ProcNetReader::ProcNetReader(const QString& netPath) :
+    _netPath(netPath) {
+}
+
+ProcNetReader::~ProcNetReader() {
+}
+
+bool ProcNetReader::readSockets(const L4Protocol protocol, QVector<SocketRecord>& result, QString& error) {
+    const bool ipv6 = protocol == TCP6 || protocol == UDP6;
+    QString filename = _netPath + ((protocol == TCP || protocol == TCP6) ? "/tcp" : "/udp") + (ipv6 ? "6" : "");
+    int file = ::open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        error = QObject::tr("Can't access file %1").arg(filename);
+        return false;
+    }
+    if (_buffer.isEmpty()) {
+        _buffer.resize(READ_BUFFER_SIZE);
+    }
+
+    // Read a chunk at a time and parse the complete lines in it. A partial line at the end of a chunk moves to the
+    // front of the buffer to be completed by the next read.
+    SocketRecord record;
+    int filled = 0;
+    bool eof = false;
+    while (!eof) {
+        ssize_t length = ::read(file, _buffer.data() + filled, _buffer.size() - filled);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            error = QObject::tr("Can't read file %1. (%2)").arg(filename).arg(::strerror(errno));
+            ::close(file);
+            return false;
+        }
+        eof = length == 0;
+        filled += length;
+
+        const char* pos = _buffer.constData();
+        const char* end = pos + filled;
+        while (pos < end) {
+            const char* lineEnd = static_cast<const char*>(::memchr(pos, '\n', end - pos));
+            if (!lineEnd) {
+                if (!eof) break;    // wait for the rest of the line
+                lineEnd = end;      // last line has no line break
+            }
+            if (parseLine(pos, lineEnd, protocol, record)) {
+                result.append(record);
+            }
+            pos = lineEnd < end ? lineEnd + 1 : end;
+        }
+        filled = end - pos;
+        if (filled > 0) {
+            ::memmove(_buffer.data(), pos, filled);
+            if (filled == _buffer.size()) {
+                _buffer.resize(_buffer.size() * 2);     // line longer than the buffer
+            }
+        }
+    }
+    ::close(file);
+    return true;
+}
+
+bool ProcNetReader::parseLine(const char* pos, const char* end, const L4Protocol protocol, SocketRecord& record) {
+    const bool ipv6 = protocol == TCP6 || protocol == UDP6;
+    quint32 value;
+
+    // Slot number. The header line fails here.
+    skipSpaces(pos, end);
+    if (!parseDecimal(pos, end, value) || !expect(pos, end, ':')) return false;
+
+    record.flow = FlowKey();
+    skipSpaces(pos, end);
+    if (!parseEndpoint(pos, end, ipv6, record.flow.localAddr, record.flow.localPort)) return false;
+    skipSpaces(pos, end);
+    if (!parseEndpoint(pos, end, ipv6, record.flow.remoteAddr, record.flow.remotePort)) return false;
+    skipSpaces(pos, end);
+    if (!parseHex(pos, end, 2, value) || value == LISTEN_STATE) return false;   // not a real connection
+
+    for (int i = 0; i < SKIPPED_FIELDS; i++) {
+        skipSpaces(pos, end);
+        const char* field = pos;
+        while (pos < end && *pos != ' ' && *pos != '\t') pos++;
+        if (pos == field) return false;
+    }
+    skipSpaces(pos, end);
+    if (!parseDecimal(pos, end, record.inode) || record.inode == 0) return false;
+
+    record.flow.transport = protocol;
+    record.flow.ipv6 = ipv6;
+    return true;
+}
@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PROCNETREADER_H_
+#define PROCNETREADER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "CommonTypes.h"
+#include "SocketRecord.h"
+
+/*
+ * Reads the kernel's IP connection tables from the text files in /proc/net (tcp, tcp6, udp, and udp6). This is
+ * slower than SockDiagReader, but works on kernels without sock_diag support. Sockets in the TCP LISTEN state are
+ * skipped. The tables are read in fixed chunks and parsed byte by byte in place.
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class ProcNetReader {
+public:
+    // New reader of the connection tables in the given directory.
+    explicit ProcNetReader(const QString& netPath = DEFAULT_NET_PATH);
+    virtual ~ProcNetReader();
+
+    // Read all sockets of the given transport protocol (TCP, UDP, TCP6, or UDP6) from the connection table and append
+    // them to the result. Returns true on success. If the table can't be read, returns false and populates the error
+    // argument.
+    bool readSockets(const L4Protocol protocol, QVector<SocketRecord>& result, QString& error);
+
+    // Decode one line of a connection table (without the line break) into a record. Returns false if the line is not
+    // a socket (e.g. the header), is malformed, or is a listening or inode-less socket.
+    static bool parseLine(const char* line, const char* end, const L4Protocol protocol, SocketRecord& record);
+
+    // Default path to the connection tables.
+    static const QString DEFAULT_NET_PATH;
+
+private:
+    // Path to the connection tables.
+    const QString _netPath;
+
+    // Read buffer, reused between reads. It grows if a line doesn't fit.
+    QByteArray _buffer;
+};
+
+#endif /* PROCNETREADER_H_ */
@@ -0,0 +1,494 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ProcessSocketIndex.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHashIterator>
+#include <QtCore/QList>
+#include <QtCore/QListIterator>
+#include <QtCore/QMutableHashIterator>
+#include <QtCore/QObject>
+#include <QtCore/QSetIterator>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtConcurrentMap>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Regex matches the process name in a /proc/<pid>/status file and captures the name.
+const QString ProcessSocketIndex::PROC_NAME_PATTERN("Name\\:\\s*(\\S.+)");
+// Regex matches the process owner uid in a /proc/<pid>/status file and captures the uid.
+const QString ProcessSocketIndex::PROC_UID_PATTERN("Uid\\:\\s*(\\d+)");
+
+// Default path to the root of the /proc filesystem.
+const QString ProcessSocketIndex::DEFAULT_PROC_PATH("/proc");
+
+// Target of a socket descriptor's symlink, up to the inode number.
+static const char SOCKET_LINK_PREFIX[] = "socket:[";
+
+// Size of the buffer for file descriptor directory entries. One read fits a few hundred descriptors.
+static const int DIRECTORY_BUFFER_SIZE = 16 * 1024;
+
+// Number of spaces from the end of the command name (field 2) in a /proc/<pid>/stat file to the start time (field 22).
+static const int STAT_START_TIME_SPACES = 22 - 2;
+
+// Size of the buffer for a /proc/<pid>/stat file. The start time comes well before the end.
+static const int STAT_BUFFER_SIZE = 1024;
+
+// Fewest processes worth scanning on the thread pool. Smaller batches are scanned on the calling thread.
+static const int MIN_PARALLEL_SCAN = 64;
+
+ProcessSocketIndex::ProcessSocketIndex(const QString& procPath) :
+    _procPath(procPath), _digitsRegex("\\d+"), _procNameRegex(PROC_NAME_PATTERN), _procUidRegex(PROC_UID_PATTERN),
+    _resyncNeeded(true), _eventDriven(false), _generation(0), _lastRescanCount(0), _bootTime(0),
+    _clockTicks(::sysconf(_SC_CLK_TCK)) {
+    // Process start times count clock ticks since boot.
+    QFile stat(_procPath + "/stat");
+    if (stat.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&stat);
+        QString line = in.readLine();
+        while (!line.isNull()) {
+            if (line.startsWith("btime ")) {
+                _bootTime = line.mid(6).trimmed().toUInt();
+                break;
+            }
+            line = in.readLine();
+        }
+    }
+    if (_clockTicks <= 0) {
+        _clockTicks = 100;
+    }
+}
+
+ProcessSocketIndex::~ProcessSocketIndex() {
+}
+
+bool ProcessSocketIndex::update(const QList<int>& inodes, QString& error) {
+    // Take the events received so far. New ones may arrive while we work.
+    _eventMutex.lock();
+    QSet<quint32> startedPids = _startedPids;
+    QSet<quint32> executedPids = _executedPids;
+    QSet<quint32> exitedPids = _exitedPids;
+    const bool resyncNeeded = _resyncNeeded;
+    _startedPids.clear();
+    _executedPids.clear();
+    _exitedPids.clear();
+    _resyncNeeded = false;
+    _eventMutex.unlock();
+
+    _generation++;
+    _lastRescanCount = 0;
+
+    // Exits go first, in case a PID was reused since.
+    QSetIterator<quint32> exitedIter(exitedPids);
+    while (exitedIter.hasNext()) {
+        removeProcess(exitedIter.next());
+    }
+    QSetIterator<quint32> executedIter(executedPids);
+    while (executedIter.hasNext()) {
+        const quint32 pid = executedIter.next();
+        QHash<quint32, ProcessEntry>::iterator existing = _processes.find(pid);
+        if (existing != _processes.end()) {
+            existing->process = OsProcess();    // new program
+            existing->uid.clear();
+        }
+        startedPids.insert(pid);
+    }
+
+    QList<quint32> rescans;
+    if (_eventDriven && !resyncNeeded) {
+        // Events told us which processes need a look.
+        QSetIterator<quint32> startedIter(startedPids);
+        while (startedIter.hasNext()) {
+            const quint32 pid = startedIter.next();
+            QFileInfo procEntry(QString("%1/%2").arg(_procPath).arg(pid));
+            if (!procEntry.exists()) {
+                removeProcess(pid);     // already gone
+            } else if (refreshProcess(pid, procEntry, true)) {
+                rescans.append(pid);
+            }
+        }
+    } else {
+        QDir procDir(_procPath);
+        QFileInfoList procEntries = procDir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+        if (procEntries.isEmpty()) {
+            error = QObject::tr("Can't access directory %1").arg(_procPath);
+            resync();   // try again next time
+            return false;
+        }
+
+        // Find processes that are new or whose file descriptors changed.
+        QSet<quint32> running;
+        running.reserve(procEntries.size());
+        QListIterator<QFileInfo> procIter(procEntries);
+        while (procIter.hasNext()) {
+            const QFileInfo& procEntry = procIter.next();
+            const QString& procEntryFileName = procEntry.fileName();
+            if (!_digitsRegex.exactMatch(procEntryFileName)) continue;     // not a process
+            quint32 pid = procEntryFileName.toUInt();
+            if (pid == 0) continue;
+            running.insert(pid);
+            if (refreshProcess(pid, procEntry, startedPids.contains(pid))) {
+                rescans.append(pid);
+            }
+        }
+
+        // Drop processes that have exited.
+        QMutableHashIterator<quint32, ProcessEntry> processIter(_processes);
+        while (processIter.hasNext()) {
+            processIter.next();
+            if (!running.contains(processIter.key())) {
+                forgetSockets(processIter.key(), processIter.value());
+                forgetNetNamespace(processIter.key(), processIter.value());
+                processIter.remove();
+            }
+        }
+    }
+    scanSockets(rescans);
+
+    // Events don't tell about new descriptors, so a socket we haven't seen before is most likely held by a process
+    // that was already indexed. Rescan those whose descriptor count changed before resorting to a full rescan.
+    bool missing = isAnyUnknown(inodes);
+    if (missing && _eventDriven && !resyncNeeded) {
+        rescans.clear();
+        const QList<quint32> pids = _processes.keys();
+        QListIterator<quint32> pidIter(pids);
+        while (pidIter.hasNext()) {
+            const quint32 pid = pidIter.next();
+            if (_processes.constFind(pid)->scanGeneration == _generation) continue;     // just scanned
+            QFileInfo procEntry(QString("%1/%2").arg(_procPath).arg(pid));
+            if (!procEntry.exists()) {
+                removeProcess(pid);     // exit event was lost
+            } else if (refreshProcess(pid, procEntry, false)) {
+                rescans.append(pid);
+            }
+        }
+        scanSockets(rescans);
+        missing = isAnyUnknown(inodes);
+    }
+
+    // A socket we still haven't seen may belong to a process whose descriptor count didn't change (or whose kernel
+    // doesn't report it). If so, rescan everything. Sockets that can't be found even then (e.g. held by processes in
+    // other namespaces) are remembered so they don't cause a full rescan every time.
+    QListIterator<int> inodeIter(inodes);
+    QSet<quint32> orphanInodes;
+    if (missing) {
+        rescans.clear();
+        QHashIterator<quint32, ProcessEntry> processIter(_processes);
+        while (processIter.hasNext()) {
+            processIter.next();
+            if (processIter.value().scanGeneration != _generation) {
+                rescans.append(processIter.key());
+            }
+        }
+        scanSockets(rescans);
+    }
+    if (missing || !_orphanInodes.isEmpty()) {
+        inodeIter.toFront();
+        while (inodeIter.hasNext()) {
+            const quint32 inode = inodeIter.next();
+            if (!_pidsByInode.contains(inode) && (missing || _orphanInodes.contains(inode))) {
+                orphanInodes.insert(inode);
+            }
+        }
+    }
+    _orphanInodes = orphanInodes;
+    return true;
+}
+
+bool ProcessSocketIndex::isAnyUnknown(const QList<int>& inodes) const {
+    QListIterator<int> inodeIter(inodes);
+    while (inodeIter.hasNext()) {
+        const quint32 inode = inodeIter.next();
+        if (!_pidsByInode.contains(inode) && !_orphanInodes.contains(inode)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ProcessSocketIndex::refreshProcess(quint32 pid, const QFileInfo& procEntry, bool force) {
+    const quint64 startTime = readStartTime(procEntry.absoluteFilePath());
+    const qint64 signature = fdSignature(procEntry.absoluteFilePath());
+    QHash<quint32, ProcessEntry>::iterator existing = _processes.find(pid);
+    if (existing == _processes.end()) {
+        existing = _processes.insert(pid, ProcessEntry());
+    } else if (existing->startTime != startTime) {
+        // The PID belongs to a different process now. Nothing we know about it is valid.
+        forgetSockets(pid, *existing);
+        forgetNetNamespace(pid, *existing);
+        *existing = ProcessEntry();
+    } else if (existing->fdSignature == signature && !force) {
+        return false;
+    }
+    existing->startTime = startTime;
+    existing->fdSignature = signature;
+    refreshNetNamespace(pid, *existing, procEntry.absoluteFilePath());
+    return true;
+}
+
+void ProcessSocketIndex::removeProcess(quint32 pid) {
+    QHash<quint32, ProcessEntry>::iterator existing = _processes.find(pid);
+    if (existing != _processes.end()) {
+        forgetSockets(pid, *existing);
+        forgetNetNamespace(pid, *existing);
+        _processes.erase(existing);
+    }
+}
+
+void ProcessSocketIndex::refreshNetNamespace(quint32 pid, ProcessEntry& entry, const QString& procEntryPath) {
+    // The namespace file is a special link whose inode identifies the namespace.
+    struct stat nsStat;
+    quint64 netNamespace = 0;
+    if (::stat(QFile::encodeName(procEntryPath + "/ns/net").constData(), &nsStat) == 0) {
+        netNamespace = nsStat.st_ino;
+    }
+    if (netNamespace != entry.netNamespace) {
+        forgetNetNamespace(pid, entry);
+        entry.netNamespace = netNamespace;
+        if (netNamespace != 0) {
+            _pidsByNetNamespace[netNamespace].insert(pid);
+        }
+    }
+}
+
+void ProcessSocketIndex::forgetNetNamespace(quint32 pid, const ProcessEntry& entry) {
+    QHash<quint64, QSet<quint32> >::iterator pids = _pidsByNetNamespace.find(entry.netNamespace);
+    if (pids != _pidsByNetNamespace.end()) {
+        pids->remove(pid);
+        if (pids->isEmpty()) {
+            _pidsByNetNamespace.erase(pids);
+        }
+    }
+}
+
+QHash<quint64, quint32> ProcessSocketIndex::getNetNamespaces() const {
+    QHash<quint64, quint32> result;
+    QHashIterator<quint64, QSet<quint32> > i(_pidsByNetNamespace);
+    while (i.hasNext()) {
+        i.next();
+        result.insert(i.key(), *i.value().constBegin());
+    }
+    return result;
+}
+
+void ProcessSocketIndex::processStarted(quint32 pid) {
+    _eventMutex.lock();
+    _startedPids.insert(pid);
+    _eventMutex.unlock();
+}
+
+void ProcessSocketIndex::processExecuted(quint32 pid) {
+    _eventMutex.lock();
+    _executedPids.insert(pid);
+    _eventMutex.unlock();
+}
+
+void ProcessSocketIndex::processExited(quint32 pid) {
+    _eventMutex.lock();
+    _startedPids.remove(pid);
+    _executedPids.remove(pid);
+    _exitedPids.insert(pid);
+    _eventMutex.unlock();
+}
+
+void ProcessSocketIndex::resync() {
+    _eventMutex.lock();
+    _resyncNeeded = true;
+    _eventMutex.unlock();
+}
+
+void ProcessSocketIndex::findProcesses(quint32 inode, QList<OsProcess>& result) {
+    QMultiHash<quint32, quint32>::const_iterator iter = _pidsByInode.constFind(inode);
+    while (iter != _pidsByInode.constEnd() && iter.key() == inode) {
+        const quint32 pid = iter.value();
+        ProcessEntry& entry = _processes[pid];
+        if (entry.process.getPid() == 0) {
+            populateProcess(pid, entry);
+        } else if (!entry.uid.isEmpty() && entry.process.getUser() == entry.uid) {
+            // The owner's name wasn't known last time. Maybe it is now.
+            QString username = _userNameResolver.resolve(entry.uid);
+            if (!username.isEmpty()) {
+                entry.process.setUser(username);
+            }
+        }
+        result.append(entry.process);
+        ++iter;
+    }
+}
+
+quint64 ProcessSocketIndex::readStartTime(const QString& procEntryPath) {
+    // The command name may contain spaces and parentheses, so the fields are counted from the last ")".
+    int file = ::open(QFile::encodeName(procEntryPath + "/stat").constData(), O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+    char buffer[STAT_BUFFER_SIZE];
+    ssize_t length = ::read(file, buffer, sizeof(buffer) - 1);
+    ::close(file);
+    if (length <= 0) {
+        return 0;
+    }
+    buffer[length] = '\0';
+    const char* pos = ::strrchr(buffer, ')');
+    if (!pos) {
+        return 0;
+    }
+    for (int field = 0; field < STAT_START_TIME_SPACES; field++) {
+        pos = ::strchr(pos + 1, ' ');
+        if (!pos) {
+            return 0;
+        }
+    }
+    return ::strtoull(pos + 1, NULL, 10);
+}
+
+qint64 ProcessSocketIndex::fdSignature(const QString& procEntryPath) {
+    struct stat fdStat;
+    if (::stat(QFile::encodeName(procEntryPath + "/fd").constData(), &fdStat) == 0) {
+        return fdStat.st_size;
+    }
+    return 0;
+}
+
+void ProcessSocketIndex::scanSockets(const QList<quint32>& pids) {
+    QStringList fdPaths;
+    fdPaths.reserve(pids.size());
+    for (int i = 0; i < pids.size(); i++) {
+        fdPaths.append(QString("%1/%2/fd").arg(_procPath).arg(pids.at(i)));
+    }
+    QList<QVector<quint32> > socketInodes;
+    if (pids.size() >= MIN_PARALLEL_SCAN) {
+        socketInodes = QtConcurrent::blockingMapped<QList<QVector<quint32> > >(fdPaths,
+                &ProcessSocketIndex::readSocketInodes);
+    } else {
+        for (int i = 0; i < fdPaths.size(); i++) {
+            socketInodes.append(readSocketInodes(fdPaths.at(i)));
+        }
+    }
+
+    // Merge the results.
+    for (int i = 0; i < pids.size(); i++) {
+        const quint32 pid = pids.at(i);
+        ProcessEntry& entry = _processes[pid];
+        forgetSockets(pid, entry);
+        entry.socketInodes = socketInodes.at(i);
+        for (int j = 0; j < entry.socketInodes.size(); j++) {
+            _pidsByInode.insert(entry.socketInodes.at(j), pid);
+        }
+        entry.scanGeneration = _generation;
+    }
+    _lastRescanCount += pids.size();
+}
+
+// Inode number of a socket given the target of its descriptor's symlink (e.g. "socket:[12345]"), or 0 if the target
+// isn't a socket.
+static inline quint32 parseSocketLink(const char* target, ssize_t length) {
+    const int prefixLength = sizeof(SOCKET_LINK_PREFIX) - 1;
+    if (length <= prefixLength || ::memcmp(target, SOCKET_LINK_PREFIX, prefixLength) != 0) {
+        return 0;
+    }
+    quint32 inode = 0;
+    for (const char* pos = target + prefixLength; pos < target + length && *pos >= '0' && *pos <= '9'; pos++) {
+        inode = inode * 10 + (*pos - '0');
+    }
+    return inode;
+}
+
+QVector<quint32> ProcessSocketIndex::readSocketInodes(const QString& fdPath) {
+    QVector<quint32> result;
+    int fdDir = ::open(QFile::encodeName(fdPath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fdDir < 0) {
+        return result;      // process exited or can't be accessed
+    }
+
+    // Read the directory entries a batch at a time, and the target of each symlink, into buffers on the stack. Nothing
+    // is allocated per descriptor. (The raw getdents64 entries have the same layout as dirent64.)
+    char entries[DIRECTORY_BUFFER_SIZE];
+    char target[64];
+    long length;
+    while ((length = ::syscall(SYS_getdents64, fdDir, entries, sizeof(entries))) > 0) {
+        for (long offset = 0; offset < length; ) {
+            const dirent64* entry = reinterpret_cast<const dirent64*>(entries + offset);
+            offset += entry->d_reclen;
+            if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+                continue;   // "." and ".."
+            }
+            // Is the file descriptor a socket? If so, grab the inode number.
+            quint32 inode = parseSocketLink(target, ::readlinkat(fdDir, entry->d_name, target, sizeof(target)));
+            if (inode > 0) {
+                result.append(inode);
+            }
+        }
+    }
+    ::close(fdDir);
+
+    // A socket may be open on more than one descriptor, but it's only indexed once.
+    qSort(result);
+    int unique = 0;
+    for (int i = 0; i < result.size(); i++) {
+        if (unique == 0 || result.at(unique - 1) != result.at(i)) {
+            result[unique++] = result.at(i);
+        }
+    }
+    result.resize(unique);
+    return result;
+}
+
+void ProcessSocketIndex::forgetSockets(quint32 pid, const ProcessEntry& entry) {
+    for (int i = 0; i < entry.socketInodes.size(); i++) {
+        _pidsByInode.remove(entry.socketInodes.at(i), pid);
+    }
+}
+
+void ProcessSocketIndex::populateProcess(quint32 pid, ProcessEntry& entry) {
+    OsProcess& result = entry.process;
+    result.setPid(pid);
+    const quint64 startSecs = entry.startTime / _clockTicks;
+    result.setStartTime(QDateTime::fromTime_t((uint)(_bootTime + startSecs))
+            .addMSecs((entry.startTime % _clockTicks) * 1000 / _clockTicks));
+    QFile file(QString("%1/%2/status").arg(_procPath).arg(pid));
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&file);
+        QString line = in.readLine();
+        bool foundName = false;
+        bool foundUid = false;
+        while (!line.isNull() && (!foundName || !foundUid)) {
+            if (!foundName && _procNameRegex.indexIn(line) >= 0) {
+                result.setProgram(_procNameRegex.cap(1));
+                foundName = true;
+            } else if (!foundUid && _procUidRegex.indexIn(line) >= 0) {
+                entry.uid = _procUidRegex.cap(1);
+                QString username = _userNameResolver.resolve(entry.uid);
+                result.setUser(username.isEmpty() ? entry.uid : username);
+                foundUid = true;
+            }
+            line = in.readLine();
+        }
+    }
+}
@@ -0,0 +1,206 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PROCESSSOCKETINDEX_H_
+#define PROCESSSOCKETINDEX_H_
+
+#include "OsProcess.h"
+#include "UserNameResolver.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QRegExp>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+template <class E> class QList;
+class QFileInfo;
+
+/*
+ * A persistent index of socket inodes to the processes that hold them, built from the file descriptor directories in
+ * /proc. The index is updated incrementally. Only processes that are new, or whose set of file descriptors appears to
+ * have changed, are rescanned. Other processes keep their cached sockets and details, and exited processes are
+ * dropped. Optionally, process events (see ProcEventListener) name the processes to look at, so the whole process
+ * directory doesn't have to be read on every update. (Sockets opened by processes that are already indexed are found
+ * by checking their descriptor counts when a socket is missing.) File descriptor directories are scanned on a pool of worker
+ * threads when there are many to scan. The network namespace of each process is noted, too, so connections in other
+ * namespaces (e.g. of containers) can be found.
+ *
+ * This class is reentrant, but NOT thread-safe, except that the process event methods may be called from any thread
+ * at any time.
+ */
+class ProcessSocketIndex {
+public:
+    // New, empty index of the processes in the given /proc directory.
+    explicit ProcessSocketIndex(const QString& procPath = DEFAULT_PROC_PATH);
+    virtual ~ProcessSocketIndex();
+
+    // Bring the index up to date with the running processes. The inodes argument lists the sockets the caller is
+    // interested in. If any of them are still unknown after the new and changed processes are rescanned,
+    // all remaining processes are rescanned too. (An inode that isn't found even then is not chased again.) Returns
+    // true on success or false if the process directory can't be read. On failure, the error argument is populated.
+    bool update(const QList<int>& inodes, QString& error);
+
+    // Process events, typically from the kernel's proc connector. A started or executed process is rescanned on the
+    // next update. (Exec closes close-on-exec descriptors and changes the program name.) An exited process is
+    // dropped on the next update without a look at the process directory.
+    void processStarted(quint32 pid);
+    void processExecuted(quint32 pid);
+    void processExited(quint32 pid);
+
+    // Make the next update read the whole process directory again, e.g. because some process events were lost.
+    void resync();
+
+    // If true, process events keep the index current, so updates rescan only the processes named in the events
+    // instead of reading the whole process directory.
+    void setEventDriven(bool eventDriven) { _eventDriven = eventDriven; }
+
+    // Append the processes holding the given socket inode to the result. Nothing is appended if the inode isn't known.
+    void findProcesses(quint32 inode, QList<OsProcess>& result);
+
+    // Network namespaces of the indexed processes by inode, each with the PID of one process in it. Processes whose
+    // namespace can't be determined are left out.
+    QHash<quint64, quint32> getNetNamespaces() const;
+
+    // Number of processes in the index.
+    int getProcessCount() const { return _processes.size(); }
+
+    // Number of processes whose file descriptors were scanned during the last update.
+    int getLastRescanCount() const { return _lastRescanCount; }
+
+    // Read the socket inodes from a file descriptor directory. The result is sorted without duplicates. This function
+    // is thread-safe.
+    static QVector<quint32> readSocketInodes(const QString& fdPath);
+
+    // Default path to the root of the /proc filesystem.
+    static const QString DEFAULT_PROC_PATH;
+
+private:
+    // What the index knows about one process.
+    struct ProcessEntry {
+        ProcessEntry() : startTime(0), fdSignature(0), netNamespace(0), scanGeneration(0) {}
+        // Start time of the process in clock ticks since boot, or 0 if unknown. A different value means the PID was
+        // reused.
+        quint64 startTime;
+        // Size reported for the file descriptor directory. Recent kernels report the number of open descriptors
+        // here. Older ones always report 0, in which case a change can't be detected this way.
+        qint64 fdSignature;
+        // Inode of the network namespace, or 0 if unknown. Read again whenever the process is rescanned, since a
+        // process may have moved to a new namespace before opening its sockets.
+        quint64 netNamespace;
+        // Update during which the descriptors were last scanned.
+        quint32 scanGeneration;
+        // Socket inodes held by the process as of the last scan.
+        QVector<quint32> socketInodes;
+        // Process details. Fetched the first time the process is looked up. (PID is 0 until then.)
+        OsProcess process;
+        // Owner UID as read from the status file. Kept so the owner name can be resolved later if the resolver
+        // doesn't know it yet.
+        QString uid;
+    };
+
+    // Regex matches the process name in a /proc/<pid>/status file and captures the name.
+    static const QString PROC_NAME_PATTERN;
+    // Regex matches the process owner uid in a /proc/<pid>/status file and captures the uid.
+    static const QString PROC_UID_PATTERN;
+
+    // Bring one running process up to date, given its directory in /proc. Returns true if it must be rescanned because
+    // it is new, its PID was reused, its descriptors changed, or the force argument is true.
+    bool refreshProcess(quint32 pid, const QFileInfo& procEntry, bool force);
+
+    // True if any of the given socket inodes is neither indexed nor known to be an orphan.
+    bool isAnyUnknown(const QList<int>& inodes) const;
+
+    // Drop one process from the index.
+    void removeProcess(quint32 pid);
+
+    // Note the network namespace of a process, given its directory in /proc.
+    void refreshNetNamespace(quint32 pid, ProcessEntry& entry, const QString& procEntryPath);
+
+    // Remove a process from the namespace index.
+    void forgetNetNamespace(quint32 pid, const ProcessEntry& entry);
+
+    // Start time of a process in clock ticks since boot, read from its stat file, or 0 if unknown.
+    static quint64 readStartTime(const QString& procEntryPath);
+
+    // Size of the file descriptor directory of a process, or 0 if unknown.
+    static qint64 fdSignature(const QString& procEntryPath);
+
+    // Read the socket inodes of the given processes and update their entries and the reverse index. Large batches are
+    // spread across the global thread pool.
+    void scanSockets(const QList<quint32>& pids);
+
+    // Remove all inodes of a process from the reverse index.
+    void forgetSockets(quint32 pid, const ProcessEntry& entry);
+
+    // Fill in the details of the process from its status file. This is best effort. If the details cannot be read,
+    // only the PID and start time are initialized.
+    void populateProcess(quint32 pid, ProcessEntry& entry);
+
+    // Path to the root of the /proc filesystem.
+    const QString _procPath;
+
+    // Decimal digits.
+    const QRegExp _digitsRegex;
+    // Regex object corresponding to PROC_NAME_PATTERN.
+    const QRegExp _procNameRegex;
+    // Regex object corresponding to PROC_UID_PATTERN.
+    const QRegExp _procUidRegex;
+
+    // Indexed processes by PID.
+    QHash<quint32, ProcessEntry> _processes;
+
+    // PIDs of the processes holding each socket inode.
+    QMultiHash<quint32, quint32> _pidsByInode;
+
+    // PIDs of the processes in each network namespace.
+    QHash<quint64, QSet<quint32> > _pidsByNetNamespace;
+
+    // Inodes that weren't found after a full rescan. They don't trigger another one while they last.
+    QSet<quint32> _orphanInodes;
+
+    // Guards the process events received since the last update.
+    QMutex _eventMutex;
+
+    // Processes started, executed, and exited since the last update.
+    QSet<quint32> _startedPids;
+    QSet<quint32> _executedPids;
+    QSet<quint32> _exitedPids;
+
+    // True if the next update must read the whole process directory.
+    bool _resyncNeeded;
+
+    // True if process events keep the index current.
+    bool _eventDriven;
+
+    // Number of the current update.
+    quint32 _generation;
+
+    // Number of processes rescanned during the last update.
+    int _lastRescanCount;
+
+    // Boot time of the host in seconds since the epoch (or 0 if unknown), and clock ticks per second, to convert
+    // process start times.
+    uint _bootTime;
+    long _clockTicks;
+
+    // Process owner name resolver.
+    UserNameResolver _userNameResolver;
+};
+
+#endif /* PROCESSSOCKETINDEX_H_ */
@@ -0,0 +1,248 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "SharedFlowRing.h"
+#include "FlowBatchCodec.h"
+#include "CommunicationFlow.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+// Magic bytes and version at the start of a ring.
+static const char MAGIC[] = "SSRG";
+static const int MAGIC_LENGTH = 4;
+static const quint32 RING_VERSION = 1;
+
+// Slots start on cache lines of their own, after a line for the ring header.
+static const size_t LINE_SIZE = 64;
+
+// Start of the ring. It's written once, except for the retired flag.
+struct RingHeader {
+    char magic[MAGIC_LENGTH];
+    quint32 version;
+    quint32 slotCount;
+    quint32 slotSize;
+    volatile quint32 retired;
+};
+
+// Start of each slot, followed by the snapshot. The sequence number is 0 while the slot is empty or being written.
+struct SlotHeader {
+    volatile quint64 sequence;
+    quint32 length;
+};
+
+// Invoke the memfd_create(2) system call, which older C libraries lack.
+static inline int memfdCreate(const char* name, unsigned int flags) {
+    return ::syscall(__NR_memfd_create, name, flags);
+}
+
+SharedFlowRing::SharedFlowRing() :
+    _ring(NULL), _length(0), _fd(-1), _device(0), _inode(0), _slotCount(0), _slotSize(0), _slotStride(0) {
+}
+
+SharedFlowRing::~SharedFlowRing() {
+    close();
+}
+
+bool SharedFlowRing::create(int slotCount, int slotSize, QString& error) {
+    Q_ASSERT(!isOpen());
+    Q_ASSERT(slotCount > 0 && slotSize > 0);
+    _slotCount = slotCount;
+    _slotSize = slotSize;
+    _slotStride = (sizeof(SlotHeader) + slotSize + LINE_SIZE - 1) / LINE_SIZE * LINE_SIZE;
+    _length = LINE_SIZE + _slotStride * slotCount;
+
+    // Seal the size so that no reader can make the mappings of the others fault.
+    struct stat status;
+    _fd = memfdCreate("socksent-flows", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (_fd < 0 || ::ftruncate(_fd, _length) != 0
+            || ::fcntl(_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0
+            || ::fstat(_fd, &status) != 0) {
+        error = QObject::tr("Can't create a shared ring (%1)").arg(::strerror(errno));
+        close();
+        return false;
+    }
+    void* ring = ::mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (ring == MAP_FAILED) {
+        error = QObject::tr("Can't map a shared ring (%1)").arg(::strerror(errno));
+        close();
+        return false;
+    }
+    _ring = static_cast<uchar*>(ring);
+
+    // A reader could reopen its descriptor for writing through /proc/self/fd. Now that the writer's mapping exists,
+    // seal off writes through any other mapping or descriptor. Kernels before 5.1 lack that seal. There, taking away
+    // the write permission of the memory file at least keeps out readers of other users.
+    if (::fchmod(_fd, S_IRUSR) != 0
+            || (::fcntl(_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0
+                    && (errno != EINVAL || ::fcntl(_fd, F_ADD_SEALS, F_SEAL_SEAL) != 0))) {
+        error = QObject::tr("Can't protect a shared ring (%1)").arg(::strerror(errno));
+        close();
+        return false;
+    }
+    _device = status.st_dev;
+    _inode = status.st_ino;
+
+    // The memory file starts out zeroed, so all slots are empty.
+    RingHeader* header = reinterpret_cast<RingHeader*>(_ring);
+    memcpy(header->magic, MAGIC, MAGIC_LENGTH);
+    header->version = RING_VERSION;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    return true;
+}
+
+bool SharedFlowRing::attach(int fd, QString& error) {
+    Q_ASSERT(!isOpen());
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        error = QObject::tr("Can't attach a shared ring (%1)").arg(::strerror(errno));
+        return false;
+    } else if (status.st_size < (off_t)LINE_SIZE) {
+        error = QObject::tr("Can't attach a shared ring (not a ring)");
+        return false;
+    }
+    void* ring = ::mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        error = QObject::tr("Can't map a shared ring (%1)").arg(::strerror(errno));
+        return false;
+    }
+    _ring = static_cast<uchar*>(ring);
+    _length = status.st_size;
+
+    // Check that the header describes a ring of exactly this size.
+    const RingHeader* header = reinterpret_cast<const RingHeader*>(_ring);
+    if (memcmp(header->magic, MAGIC, MAGIC_LENGTH) != 0 || header->version != RING_VERSION
+            || header->slotCount == 0 || header->slotSize == 0 || header->slotSize > (quint32)INT_MAX) {
+        error = QObject::tr("Can't attach a shared ring (not a ring)");
+        close();
+        return false;
+    }
+    _slotCount = header->slotCount;
+    _slotSize = header->slotSize;
+    _slotStride = (sizeof(SlotHeader) + _slotSize + LINE_SIZE - 1) / LINE_SIZE * LINE_SIZE;
+    if ((quint64)_slotStride * _slotCount + LINE_SIZE != (quint64)_length) {
+        error = QObject::tr("Can't attach a shared ring (size doesn't match %1 slots of %2 bytes)")
+                .arg(_slotCount).arg(_slotSize);
+        close();
+        return false;
+    }
+    _device = status.st_dev;
+    _inode = status.st_ino;
+    return true;
+}
+
+bool SharedFlowRing::isSameRing(int fd) const {
+    struct stat status;
+    return isOpen() && ::fstat(fd, &status) == 0 && status.st_dev == _device && status.st_ino == _inode;
+}
+
+int SharedFlowRing::openReader(QString& error) const {
+    Q_ASSERT(_fd >= 0);
+    // Reopening the memory file read-only gives a descriptor that can't be mapped for writing. (The seals keep readers
+    // from writing through a descriptor they reopen, too.)
+    QByteArray path = QString("/proc/self/fd/%1").arg(_fd).toLatin1();
+    int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = QObject::tr("Can't open a shared ring for reading (%1)").arg(::strerror(errno));
+    }
+    return fd;
+}
+
+bool SharedFlowRing::publish(qulonglong sequence, const QByteArray& packedFlows) {
+    Q_ASSERT(_fd >= 0 && sequence > 0);
+    if (packedFlows.size() > _slotSize) {
+        return false;
+    }
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(slotOf(sequence));
+    slot->sequence = 0;
+    __sync_synchronize();
+    slot->length = packedFlows.size();
+    memcpy(slot + 1, packedFlows.constData(), packedFlows.size());
+    __sync_synchronize();
+    slot->sequence = sequence;
+    return true;
+}
+
+void SharedFlowRing::retire() {
+    Q_ASSERT(_fd >= 0);
+    __sync_synchronize();
+    reinterpret_cast<RingHeader*>(_ring)->retired = 1;
+}
+
+bool SharedFlowRing::isRetired() const {
+    return reinterpret_cast<const RingHeader*>(_ring)->retired != 0;
+}
+
+bool SharedFlowRing::read(qulonglong sequence, QList<CommunicationFlow>& result) const {
+    Q_ASSERT(isOpen());
+    const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(slotOf(sequence));
+    if (sequence == 0 || slot->sequence != sequence) {
+        return false;
+    }
+    __sync_synchronize();
+    // Unpack in place. The codec checks every count and number against the length it's given, so a snapshot that's
+    // overwritten meanwhile can't make it read outside the slot. The sequence number tells if that happened.
+    int length = qMin<quint32>(slot->length, _slotSize);
+    QByteArray packedFlows = QByteArray::fromRawData(reinterpret_cast<const char*>(slot + 1), length);
+    QList<CommunicationFlow> flows;
+    QString error;
+    bool ok = FlowBatchCodec::decode(packedFlows, flows, error);
+    __sync_synchronize();
+    if (!ok || slot->sequence != sequence) {
+        return false;
+    }
+    result = flows;
+    return true;
+}
+
+void SharedFlowRing::close() {
+    if (_ring) {
+        ::munmap(_ring, _length);
+        _ring = NULL;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+uchar* SharedFlowRing::slotOf(qulonglong sequence) const {
+    return _ring + LINE_SIZE + _slotStride * (size_t)(sequence % _slotCount);
+}
@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SHAREDFLOWRING_H_
+#define SHAREDFLOWRING_H_
+
+#include <QtCore/QtGlobal>
+
+#include <sys/types.h>
+
+class QByteArray;
+class QString;
+template<class T> class QList;
+class CommunicationFlow;
+
+/*
+ * Ring of flow snapshots in shared memory, which the Watcher publishes for clients on the same host. The service
+ * creates the ring in an anonymous memory file (memfd) and hands each client a read-only descriptor of it over D-Bus.
+ * The memory file is sealed so that only the service's own mapping can write to it.
+ * From then on, only the sequence numbers of new snapshots travel over the bus. Clients read the snapshots straight
+ * from their own mapping of the ring.
+ *
+ * The ring has a fixed number of slots of a fixed size. Each snapshot holds flows packed by FlowBatchCodec and goes
+ * into the slot of its sequence number modulo the slot count, overwriting the snapshot that was there. The slot's
+ * sequence number is cleared while it's written, so readers can tell a snapshot that was overwritten during the read
+ * and drop it. A snapshot that doesn't fit the slots calls for a new ring; the writer retires the old one, and readers
+ * that find their ring retired open the new one.
+ *
+ * Each instance is either the writer ("create") or a reader ("attach") of a ring. This class is reentrant, but NOT
+ * thread-safe. One writer and any number of readers in other processes may use the same ring concurrently.
+ */
+class SharedFlowRing {
+public:
+    SharedFlowRing();
+    virtual ~SharedFlowRing();
+
+    // Create a new ring with the given number of slots of the given size and map it for writing. Returns true if
+    // successful. Otherwise, false is returned and the error argument is populated.
+    bool create(int slotCount, int slotSize, QString& error);
+
+    // Map the ring of a descriptor for reading. The descriptor stays open and owned by the caller. Returns true if
+    // successful. Otherwise, false is returned and the error argument is populated.
+    bool attach(int fd, QString& error);
+
+    // True if a ring is mapped.
+    bool isOpen() const { return _ring != NULL; }
+
+    // True if the given descriptor refers to the ring this instance has mapped.
+    bool isSameRing(int fd) const;
+
+    // Number and size of the slots.
+    int getSlotCount() const { return _slotCount; }
+    int getSlotSize() const { return _slotSize; }
+
+    // Writer only: open a new read-only descriptor of the ring for a reader. The caller must close it. Returns -1 and
+    // populates the error argument on failure.
+    int openReader(QString& error) const;
+
+    // Writer only: publish packed flows as the snapshot with the given sequence number, which must be greater than
+    // zero. Returns false if the snapshot doesn't fit a slot.
+    bool publish(qulonglong sequence, const QByteArray& packedFlows);
+
+    // Writer only: mark the ring as retired. Nothing is published to it afterwards.
+    void retire();
+
+    // True if the writer has retired the ring.
+    bool isRetired() const;
+
+    // Read the flows of the snapshot with the given sequence number into the result argument. Returns false if the
+    // snapshot isn't in the ring (anymore) or was overwritten during the read.
+    bool read(qulonglong sequence, QList<CommunicationFlow>& result) const;
+
+private:
+    Q_DISABLE_COPY(SharedFlowRing)
+
+    // Unmap the ring and close its descriptor.
+    void close();
+
+    // Address of the slot of a sequence number.
+    uchar* slotOf(qulonglong sequence) const;
+
+    // Mapping of the ring and its length.
+    uchar* _ring;
+    size_t _length;
+
+    // Descriptor of the memory file (writer only, else -1).
+    int _fd;
+
+    // Identity of the memory file.
+    dev_t _device;
+    ino_t _inode;
+
+    // Number and size of the slots, and the distance between the starts of two slots.
+    int _slotCount;
+    int _slotSize;
+    size_t _slotStride;
+};
+
+#endif /* SHAREDFLOWRING_H_ */
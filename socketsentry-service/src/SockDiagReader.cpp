@@ -0,0 +1,276 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "SockDiagReader.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <QtCore/QFile>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+// TCP state number of listening sockets (from the kernel's tcp_states.h).
+static const int TCP_LISTEN_STATE = 10;
+
+// Size of the receive buffer. Dumps arrive in messages of up to a page or so each, several per read.
+static const int RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+SockDiagReader::SockDiagReader(const QString& netNamespacePath) :
+    _netNamespacePath(netNamespacePath), _socket(-1), _sequence(0) {
+}
+
+SockDiagReader::~SockDiagReader() {
+    if (_socket >= 0) {
+        ::close(_socket);
+    }
+}
+
+bool SockDiagReader::ensureOpen(QString& error) {
+    if (_socket < 0) {
+        if (_netNamespacePath.isEmpty()) {
+            _socket = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+            if (_socket < 0) {
+                error = QObject::tr("Can't open sock_diag netlink socket. (%1)").arg(::strerror(errno));
+            }
+        } else {
+            _socket = openInNamespace(error);
+        }
+        if (_socket < 0) {
+            return false;
+        }
+        _buffer.resize(RECEIVE_BUFFER_SIZE);
+    }
+    return true;
+}
+
+int SockDiagReader::openInNamespace(QString& error) {
+    // A socket stays in the namespace it was created in, so this thread only has to visit the namespace briefly.
+    // Namespaces are per thread, so the rest of the process isn't affected.
+    const QString ownPath = QString("/proc/self/task/%1/ns/net").arg(::syscall(SYS_gettid));
+    int own = ::open(QFile::encodeName(ownPath).constData(), O_RDONLY | O_CLOEXEC);
+    if (own < 0) {
+        error = QObject::tr("Can't access file %1. (%2)").arg(ownPath).arg(::strerror(errno));
+        return -1;
+    }
+    int other = ::open(QFile::encodeName(_netNamespacePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (other < 0) {
+        error = QObject::tr("Can't access file %1. (%2)").arg(_netNamespacePath).arg(::strerror(errno));
+        ::close(own);
+        return -1;
+    }
+    int result = -1;
+    if (::setns(other, CLONE_NEWNET) < 0) {
+        error = QObject::tr("Can't enter network namespace %1. (%2)").arg(_netNamespacePath).arg(::strerror(errno));
+    } else {
+        result = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+        if (result < 0) {
+            error = QObject::tr("Can't open sock_diag netlink socket. (%1)").arg(::strerror(errno));
+        }
+        if (::setns(own, CLONE_NEWNET) < 0) {
+            // Should never happen, since we were just there. Sockets this thread opens later end up in the wrong place.
+            qCritical("Can't return to own network namespace. (%s)", ::strerror(errno));
+        }
+    }
+    ::close(other);
+    ::close(own);
+    return result;
+}
+
+bool SockDiagReader::readSockets(const L4Protocol protocol, QVector<SocketRecord>& result, QString& error) {
+    if (!ensureOpen(error)) {
+        return false;
+    }
+
+    // Ask for a dump of all sockets of one address family and protocol, except listening ones.
+    struct {
+        nlmsghdr header;
+        inet_diag_req_v2 body;
+    } request;
+    ::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++_sequence;
+    request.body.sdiag_family = (protocol == TCP6 || protocol == UDP6) ? AF_INET6 : AF_INET;
+    request.body.sdiag_protocol = (protocol == TCP || protocol == TCP6) ? IPPROTO_TCP : IPPROTO_UDP;
+    request.body.idiag_states = ~(1U << TCP_LISTEN_STATE);
+
+    sockaddr_nl kernel;
+    ::memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (::sendto(_socket, &request, sizeof(request), 0, (sockaddr*)&kernel, sizeof(kernel)) < 0) {
+        error = QObject::tr("Can't send sock_diag request. (%1)").arg(::strerror(errno));
+        return false;
+    }
+
+    // Read replies until the end of the dump. A dump that was cut short can leave datagrams queued on the socket, so
+    // messages from earlier requests are skipped. With MSG_TRUNC, recv reports the full length of the datagram, which
+    // tells us if part of it didn't fit in the buffer.
+    bool done = false;
+    while (!done) {
+        ssize_t length = ::recv(_socket, _buffer.data(), _buffer.size(), MSG_TRUNC);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            error = QObject::tr("Can't receive sock_diag reply. (%1)").arg(::strerror(errno));
+            return false;
+        }
+        if (length == 0) {
+            error = QObject::tr("Unexpected end of sock_diag reply.");
+            return false;
+        }
+        if (length > _buffer.size()) {
+            error = QObject::tr("Truncated sock_diag reply.");
+            return false;
+        }
+        if (!parseMessages(_buffer.constData(), length, protocol, _sequence, result, done, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SockDiagReader::findSocket(const FlowKey& flow, SocketRecord& record, bool& found, QString& error) {
+    found = false;
+    if (!ensureOpen(error)) {
+        return false;
+    }
+
+    // Ask for the one socket with the given endpoints. Without NLM_F_DUMP, the kernel does an exact lookup.
+    const L4Protocol protocol = flow.getTransport();
+    const size_t addrLength = flow.isIpv6() ? 16 : 4;
+    struct {
+        nlmsghdr header;
+        inet_diag_req_v2 body;
+    } request;
+    ::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.header.nlmsg_flags = NLM_F_REQUEST;
+    request.header.nlmsg_seq = ++_sequence;
+    request.body.sdiag_family = flow.isIpv6() ? AF_INET6 : AF_INET;
+    request.body.sdiag_protocol = (protocol == TCP || protocol == TCP6) ? IPPROTO_TCP : IPPROTO_UDP;
+    request.body.idiag_states = ~0U;
+    request.body.id.idiag_sport = htons(flow.localPort);
+    request.body.id.idiag_dport = htons(flow.remotePort);
+    ::memcpy(request.body.id.idiag_src, flow.localAddr, addrLength);
+    ::memcpy(request.body.id.idiag_dst, flow.remoteAddr, addrLength);
+    request.body.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+    request.body.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+
+    sockaddr_nl kernel;
+    ::memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (::sendto(_socket, &request, sizeof(request), 0, (sockaddr*)&kernel, sizeof(kernel)) < 0) {
+        error = QObject::tr("Can't send sock_diag request. (%1)").arg(::strerror(errno));
+        return false;
+    }
+
+    // Read the reply, skipping any left over from an earlier request.
+    while (true) {
+        ssize_t length = ::recv(_socket, _buffer.data(), _buffer.size(), MSG_TRUNC);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            error = QObject::tr("Can't receive sock_diag reply. (%1)").arg(::strerror(errno));
+            return false;
+        }
+        if (length > _buffer.size()) {
+            error = QObject::tr("Truncated sock_diag reply.");
+            return false;
+        }
+        const nlmsghdr* message = reinterpret_cast<const nlmsghdr*>(_buffer.constData());
+        if (!NLMSG_OK(message, (unsigned)length)) {
+            error = QObject::tr("Unexpected end of sock_diag reply.");
+            return false;
+        }
+        if (message->nlmsg_seq == _sequence) {
+            return parseLookupReply(_buffer.constData(), length, protocol, record, found, error);
+        }
+    }
+}
+
+bool SockDiagReader::parseLookupReply(const char* buffer, int length, const L4Protocol protocol,
+        SocketRecord& record, bool& found, QString& error) {
+
+    found = false;
+    const nlmsghdr* message = reinterpret_cast<const nlmsghdr*>(buffer);
+    if (NLMSG_OK(message, (unsigned)length) && message->nlmsg_type == NLMSG_ERROR
+            && message->nlmsg_len >= NLMSG_LENGTH(sizeof(nlmsgerr))
+            && reinterpret_cast<const nlmsgerr*>(NLMSG_DATA(message))->error == -ENOENT) {
+        return true;    // no such socket
+    }
+    QVector<SocketRecord> sockets;
+    bool done = false;
+    if (!parseMessages(buffer, length, protocol, message->nlmsg_seq, sockets, done, error)) {
+        return false;
+    }
+    if (!sockets.isEmpty()) {
+        record = sockets.first();
+        found = true;
+    }
+    return true;
+}
+
+bool SockDiagReader::parseMessages(const char* buffer, int length, const L4Protocol protocol, quint32 sequence,
+        QVector<SocketRecord>& result, bool& done, QString& error) {
+
+    const bool ipv6 = protocol == TCP6 || protocol == UDP6;
+    const size_t addrLength = ipv6 ? 16 : 4;
+    const nlmsghdr* message = reinterpret_cast<const nlmsghdr*>(buffer);
+    for (; NLMSG_OK(message, (unsigned)length); message = NLMSG_NEXT(message, length)) {
+        if (message->nlmsg_seq != sequence) {
+            continue;   // left over from an earlier request
+        }
+        if (message->nlmsg_type == NLMSG_DONE) {
+            done = true;
+            return true;
+        }
+        if (message->nlmsg_type == NLMSG_ERROR) {
+            const nlmsgerr* failure = reinterpret_cast<const nlmsgerr*>(NLMSG_DATA(message));
+            error = QObject::tr("The kernel rejected the sock_diag request. (%1)").arg(::strerror(-failure->error));
+            return false;
+        }
+        if (message->nlmsg_type != SOCK_DIAG_BY_FAMILY || message->nlmsg_len < NLMSG_LENGTH(sizeof(inet_diag_msg))) {
+            continue;   // not a socket record
+        }
+
+        const inet_diag_msg* socket = reinterpret_cast<const inet_diag_msg*>(NLMSG_DATA(message));
+        if (socket->idiag_inode == 0) continue;
+        SocketRecord record;
+        record.inode = socket->idiag_inode;
+        record.flow = FlowKey();
+        // Addresses and ports are in network byte order, which is what the flow key wants for addresses.
+        ::memcpy(record.flow.localAddr, socket->id.idiag_src, addrLength);
+        ::memcpy(record.flow.remoteAddr, socket->id.idiag_dst, addrLength);
+        record.flow.localPort = ntohs(socket->id.idiag_sport);
+        record.flow.remotePort = ntohs(socket->id.idiag_dport);
+        record.flow.transport = protocol;
+        record.flow.ipv6 = ipv6;
+        result.append(record);
+    }
+    return true;
+}
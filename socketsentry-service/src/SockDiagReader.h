@@ -0,0 +1,87 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SOCKDIAGREADER_H_
+#define SOCKDIAGREADER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "CommonTypes.h"
+#include "SocketRecord.h"
+
+/*
+ * Reads the kernel's IP connection tables over a NETLINK_SOCK_DIAG socket. The kernel sends binary socket records
+ * that already include the inodes, so there is no text to format or parse as there is with the /proc filesystem.
+ * Sockets in the TCP LISTEN state are filtered out by the kernel. Single connections can also be looked up without
+ * dumping a whole table. The netlink socket is opened on first use and kept open for later reads. By default, it
+ * reads the connections of the service's own network namespace, but it can be pointed at another one.
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class SockDiagReader {
+public:
+    // New reader of the connections in the network namespace referred to by the given file (e.g. /proc/<pid>/ns/net),
+    // or the current network namespace if the path is empty. Entering another namespace requires privileges
+    // (CAP_SYS_ADMIN).
+    explicit SockDiagReader(const QString& netNamespacePath = QString());
+    virtual ~SockDiagReader();
+
+    // Read all sockets of the given transport protocol (TCP, UDP, TCP6, or UDP6) from the kernel and append them to
+    // the result. Returns true on success. On failure, returns false and populates the error argument.
+    bool readSockets(const L4Protocol protocol, QVector<SocketRecord>& result, QString& error);
+
+    // Look up the socket of one connection, given the transport protocol, addresses, and ports in a flow key. Returns
+    // true on success, with the found argument set if the kernel knows a socket with an inode for the connection. On
+    // failure, returns false and populates the error argument.
+    bool findSocket(const FlowKey& flow, SocketRecord& record, bool& found, QString& error);
+
+    // Decode the reply to a lookup of one connection. A "no such socket" error is not a failure, but leaves the found
+    // argument false. Returns true on success. If the kernel reported another error, returns false and populates the
+    // error argument.
+    static bool parseLookupReply(const char* buffer, int length, const L4Protocol protocol, SocketRecord& record,
+            bool& found, QString& error);
+
+    // Decode a buffer of sock_diag response messages, appending a record to the result for each socket with an inode.
+    // Messages whose sequence number doesn't match the given one are skipped. The "done" argument is set to true if the
+    // buffer includes the end of the response. Returns true on success. If the kernel reported an error, returns false
+    // and populates the error argument.
+    static bool parseMessages(const char* buffer, int length, const L4Protocol protocol, quint32 sequence,
+            QVector<SocketRecord>& result, bool& done, QString& error);
+
+private:
+    // Open the netlink socket if it's not open yet. Returns true on success or false with the error argument set.
+    bool ensureOpen(QString& error);
+
+    // Create the netlink socket inside the network namespace of this reader. Returns the socket or -1 on failure.
+    int openInNamespace(QString& error);
+
+    // Network namespace file (or empty for the current namespace).
+    const QString _netNamespacePath;
+
+    // Netlink socket (or -1 if not open yet).
+    int _socket;
+
+    // Sequence number of the last request.
+    quint32 _sequence;
+
+    // Receive buffer, reused between reads.
+    QByteArray _buffer;
+};
+
+#endif /* SOCKDIAGREADER_H_ */
@@ -0,0 +1,31 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SOCKETRECORD_H_
+#define SOCKETRECORD_H_
+
+#include "FlowKey.h"
+
+// One socket from the kernel's IP connection table: the socket's inode and its endpoints.
+struct SocketRecord {
+    quint32 inode;
+    FlowKey flow;
+};
+
+Q_DECLARE_TYPEINFO(SocketRecord, Q_PRIMITIVE_TYPE);
+
+#endif /* SOCKETRECORD_H_ */
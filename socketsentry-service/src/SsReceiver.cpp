@@ -23,15 +23,71 @@
 
 #include "WatcherClient.h"
 #include "WatcherClientConsolePrinter.h"
+#include "FlowSelection.h"
 
 void printUsage(QTextStream& err) {
     QStringList args = QCoreApplication::arguments();
     Q_ASSERT(args.size() >= 1);
-    err << endl << "Usage: " << args[0] << " [--session] <device> [<device> ...]" << endl;
+    err << endl << "Usage: " << args[0] << " [--session] [--shared] [<selection>] <device> [<device> ...]" << endl;
     err << "       " << "Listens to traffic on named device(s)." << endl << endl;
     err << "   Or: " << args[0] << " [--session] --eavesdrop" << endl;
     err << "       " << "Listens to service signals without subscribing to devices." << endl << endl;
     err << "Use --session to connect to service over the session bus instead of the system bus." << endl;
+    err << "Use --shared to read traffic from the service's shared memory rings instead of D-Bus signals." << endl;
+    err << "Selection options make the service send only some flows, or send them at a pace of their own:" << endl;
+    err << "   --top=N                   only the N busiest flows" << endl;
+    err << "   --sort=rate|peak|total    measure of how busy flows are (default: rate)" << endl;
+    err << "   --program=NAME            only flows of processes with this program name" << endl;
+    err << "   --user=NAME               only flows of processes of this user" << endl;
+    err << "   --ports=MIN[-MAX]         only flows with a local or remote port in this range" << endl;
+    err << "   --subnet=CIDR             only flows with a remote address in this subnet" << endl;
+    err << "   --interval=MS             time between updates in milliseconds (default: the service's)" << endl;
+}
+
+// Build a selection of flows from the selection options among the arguments. Returns true if successful. Otherwise,
+// false is returned and the error argument is populated.
+bool parseSelection(const QStringList& args, FlowSelection& selection, QString& error) {
+    QListIterator<QString> i(args);
+    while (i.hasNext()) {
+        const QString& arg = i.next();
+        QString value = arg.section('=', 1);
+        bool ok = true;
+        if (arg.startsWith("--top=")) {
+            selection.setLimit(value.toInt(&ok));
+            ok = ok && selection.getLimit() > 0;
+        } else if (arg.startsWith("--sort=")) {
+            if (value == "rate") {
+                selection.setSortKey(SORT_BY_RATE);
+            } else if (value == "peak") {
+                selection.setSortKey(SORT_BY_PEAK);
+            } else if (value == "total") {
+                selection.setSortKey(SORT_BY_TOTAL);
+            } else {
+                ok = false;
+            }
+        } else if (arg.startsWith("--program=")) {
+            selection.setProgram(value);
+        } else if (arg.startsWith("--user=")) {
+            selection.setUser(value);
+        } else if (arg.startsWith("--ports=")) {
+            bool maxOk = true;
+            ushort minPort = value.section('-', 0, 0).toUShort(&ok);
+            ushort maxPort = value.contains('-') ? value.section('-', 1).toUShort(&maxOk) : minPort;
+            ok = ok && maxOk && minPort <= maxPort;
+            selection.setPortRange(minPort, maxPort);
+        } else if (arg.startsWith("--subnet=")) {
+            selection.setRemoteSubnet(value);
+            ok = selection.isValid();
+        } else if (arg.startsWith("--interval=")) {
+            selection.setUpdateIntervalMs(value.toInt(&ok));
+            ok = ok && selection.getUpdateIntervalMs() > 0;
+        }
+        if (!ok) {
+            error = QString("Invalid option: %1").arg(arg);
+            return false;
+        }
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -55,9 +111,16 @@ int main(int argc, char* argv[]) {
         err << "The service has encountered a problem or is not running." << endl;
         printUsage(err);
         return -1;
+    }
+    FlowSelection selection;
+    if (!parseSelection(args, selection, error)) {
+        err << "ERROR: " << error << endl;
+        printUsage(err);
+        return -1;
     } else {
         // Found service. Looks OK.
-        WatcherClientConsolePrinter* printer = new WatcherClientConsolePrinter(&watcher);
+        WatcherClientConsolePrinter* printer = new WatcherClientConsolePrinter(&watcher, args.contains("--shared"),
+                selection);
         if (args.contains("--eavesdrop")) {
             // Eavesdrop only; don't subscribe.
             return app.exec();
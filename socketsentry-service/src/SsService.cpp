@@ -25,15 +25,41 @@
 #include "Watcher.h"
 #include "WatcherDBusAdaptor.h"
 #include "LogSettings.h"
+#include "CaptureSettings.h"
+#include "CorrelationSettings.h"
 
 void printUsage(QTextStream& err) {
     QStringList args = QCoreApplication::arguments();
     Q_ASSERT(args.size() >= 1);
-    err << endl << "Usage: " << args[0] << " [--session] [--log <proc|pcap|proc,pcap>]" << endl << endl;
+    err << endl << "Usage: " << args[0] << " [--session] [--log <proc|pcap|proc,pcap>]" << endl;
+    err << "       [--ring <device,...|*>] [--ring-size <MB>] [--ring-timeout <ms>] [--fanout <N>]" << endl;
+    err << "       [--kernel-flows <device,...|*>] [--max-flows <N>] [--proc-events]" << endl;
+    err << "       [--replay <file,...>] [--replay-speed <N|max>] [--replay-local <address,...>]" << endl << endl;
     err << "Specify --session to attach to the session bus instead of the system bus." << endl << endl;
     err << "Specify --log proc to log process corrleation stats" << endl;
     err << "        --log pcap to log packet capture stats" << endl;
     err << "        --log proc,pcap to log both" << endl << endl;
+    err << "Specify --ring to capture from a memory-mapped packet ring instead of libpcap on the listed devices" << endl;
+    err << "        (or * for all devices)." << endl;
+    err << "        --ring-size sets the ring size in megabytes (default "
+            << CaptureSettings::DEFAULT_RING_SIZE_MB << ")." << endl;
+    err << "        --ring-timeout sets the max time the kernel holds partially filled ring blocks (default "
+            << CaptureSettings::DEFAULT_RING_BLOCK_TIMEOUT_MS << " ms)." << endl;
+    err << "        --fanout sets the number of capture threads sharing each ring device (default "
+            << CaptureSettings::DEFAULT_FANOUT_WORKERS << "). Each one has its own ring." << endl << endl;
+    err << "Specify --kernel-flows to count traffic per flow in the kernel with eBPF instead of capturing packets" << endl;
+    err << "        on the listed devices (or * for all devices). --max-flows also sets the size of the kernel's" << endl;
+    err << "        flow map." << endl << endl;
+    err << "Specify --max-flows to limit the number of flows recorded per device per second (default "
+            << CaptureSettings::DEFAULT_MAX_FLOWS_PER_SECOND << ")." << endl << endl;
+    err << "Specify --proc-events to track processes with kernel proc connector events instead of polling /proc." << endl
+            << endl;
+    err << "Specify --replay to offer the listed packet trace files as devices named \""
+            << CaptureSettings::REPLAY_DEVICE_PREFIX << "<file>\"." << endl;
+    err << "        --replay-speed sets the replay speed relative to the recorded speed, or max to replay as fast" << endl;
+    err << "        as possible (default " << CaptureSettings::DEFAULT_REPLAY_SPEED << ")." << endl;
+    err << "        --replay-local lists the addresses of the host the traces were recorded on. Without them, the" << endl;
+    err << "        source of each packet is taken to be local." << endl << endl;
 }
 
 // If app was passed the "--log" argument, parse out the comma-separated items to be logged
@@ -55,11 +81,110 @@ void initLogOptions(QStringList& appArgs) {
     }
 }
 
+// If app was passed an integer option with the given name, parse out its value into the integer argument and remove
+// both from the list. Returns false if the option was passed in without a positive integer value, in which case the
+// list is not changed. If the option was not passed in, then no changes are made and true is returned.
+bool takeIntOption(QStringList& appArgs, const QString& option, int& value) {
+    int idx = appArgs.indexOf(option);
+    if (idx >= 0) {
+        if (appArgs.size() <= idx + 1) {
+            return false;
+        }
+        bool ok = false;
+        int parsed = appArgs[idx + 1].toInt(&ok);
+        if (!ok || parsed <= 0) {
+            return false;
+        }
+        value = parsed;
+        appArgs.removeAt(idx);  // consume option
+        appArgs.removeAt(idx);  // consume option arg
+    }
+    return true;
+}
+
+// If app was passed any of the packet capture arguments, parse them out and initialize the capture settings singleton.
+// Remove the arguments from the list. Invalid arguments are left in the list.
+void initCaptureOptions(QStringList& appArgs) {
+    CaptureSettings settings = CaptureSettings::getInstance();
+    int idx = appArgs.indexOf("--ring");
+    if (idx >= 0 && appArgs.size() > idx + 1) {
+        settings.setRingDevices(appArgs[idx + 1].split(',', QString::SkipEmptyParts));
+        appArgs.removeAt(idx);  // consume --ring option
+        appArgs.removeAt(idx);  // consume --ring option args
+    }
+    idx = appArgs.indexOf("--kernel-flows");
+    if (idx >= 0 && appArgs.size() > idx + 1) {
+        settings.setKernelFlowDevices(appArgs[idx + 1].split(',', QString::SkipEmptyParts));
+        appArgs.removeAt(idx);  // consume --kernel-flows option
+        appArgs.removeAt(idx);  // consume --kernel-flows option args
+    }
+    int ringSizeMb = settings.getRingSizeMb();
+    if (takeIntOption(appArgs, "--ring-size", ringSizeMb)) {
+        settings.setRingSizeMb(ringSizeMb);
+    }
+    int ringBlockTimeoutMs = settings.getRingBlockTimeoutMs();
+    if (takeIntOption(appArgs, "--ring-timeout", ringBlockTimeoutMs)) {
+        settings.setRingBlockTimeoutMs(ringBlockTimeoutMs);
+    }
+    int fanoutWorkers = settings.getFanoutWorkers();
+    if (takeIntOption(appArgs, "--fanout", fanoutWorkers)) {
+        settings.setFanoutWorkers(fanoutWorkers);
+    }
+    idx = appArgs.indexOf("--replay");
+    if (idx >= 0 && appArgs.size() > idx + 1) {
+        settings.setReplayFiles(appArgs[idx + 1].split(',', QString::SkipEmptyParts));
+        appArgs.removeAt(idx);  // consume --replay option
+        appArgs.removeAt(idx);  // consume --replay option args
+    }
+    idx = appArgs.indexOf("--replay-speed");
+    if (idx >= 0 && appArgs.size() > idx + 1 && appArgs[idx + 1] == "max") {
+        settings.setReplaySpeed(0);
+        appArgs.removeAt(idx);  // consume --replay-speed option
+        appArgs.removeAt(idx);  // consume --replay-speed option arg
+    }
+    int replaySpeed = settings.getReplaySpeed();
+    if (takeIntOption(appArgs, "--replay-speed", replaySpeed)) {
+        settings.setReplaySpeed(replaySpeed);
+    }
+    idx = appArgs.indexOf("--replay-local");
+    if (idx >= 0 && appArgs.size() > idx + 1) {
+        settings.setReplayLocalAddresses(appArgs[idx + 1].split(',', QString::SkipEmptyParts));
+        appArgs.removeAt(idx);  // consume --replay-local option
+        appArgs.removeAt(idx);  // consume --replay-local option args
+    }
+    int maxFlowsPerSecond = settings.getMaxFlowsPerSecond();
+    if (takeIntOption(appArgs, "--max-flows", maxFlowsPerSecond)) {
+        settings.setMaxFlowsPerSecond(maxFlowsPerSecond);
+    }
+    CaptureSettings::setInstance(settings);
+}
+
+// If app was passed any of the correlation arguments, parse them out and initialize the correlation settings
+// singleton. Remove the arguments from the list.
+void initCorrelationOptions(QStringList& appArgs) {
+    CorrelationSettings settings = CorrelationSettings::getInstance();
+    if (appArgs.removeOne("--proc-events")) {
+        settings.setUseProcEvents(true);
+    }
+    CorrelationSettings::setInstance(settings);
+}
+
 // Usage: ./socksent-service [--session] [--log <proc|pcap|proc,pcap>]
+//                           [--ring <device,...|*>] [--ring-size <MB>] [--ring-timeout <ms>] [--fanout <N>]
+//                           [--kernel-flows <device,...|*>] [--max-flows <N>] [--proc-events]
+//                           [--replay <file,...>] [--replay-speed <N|max>] [--replay-local <address,...>]
 // Use --session to attach to the session bus instead of the system bus.
 // Use --log proc to log process corrleation stats
 //     --log pcap to log packet capture stats
 //     --log proc,pcap to log both
+// Use --ring to capture from a memory-mapped packet ring on the listed devices (or * for all)
+//     --ring-size and --ring-timeout to tune the ring
+//     --fanout to share each ring device between multiple capture threads
+// Use --kernel-flows to count traffic in the kernel with eBPF on the listed devices (or * for all)
+// Use --max-flows to limit the flows recorded per device per second
+// Use --proc-events to track processes with proc connector events
+// Use --replay to offer packet trace files as devices
+//     --replay-speed and --replay-local to tune the replay
 int main(int argc, char* argv[]) {
     QCoreApplication app(argc, argv);
     QStringList args = app.arguments();
@@ -69,6 +194,8 @@ int main(int argc, char* argv[]) {
     // Initiaze logging, which also removes those options from the argument list.
     // This needs to happen before the Watcher is initalized.
     initLogOptions(args);
+    initCaptureOptions(args);
+    initCorrelationOptions(args);
 
     // Consume the "--session" arg, if present.
     QTextStream err(stderr);
@@ -83,8 +210,9 @@ int main(int argc, char* argv[]) {
         // Register adapter with the system bus by default or the session bus if "--session" was specified. The
         // latter may be useful for testing, since registering with the session bus usually requires no explicit
         // D-Bus configuration.
-        if (geteuid() != 0) {
-            qCritical("The service must be run as root.");
+        // Replaying packet traces needs no privileges, so it can be tried out without root.
+        if (geteuid() != 0 && CaptureSettings::getInstance().getReplayFiles().isEmpty()) {
+            qCritical("The service must be run as root (unless it replays packet traces).");
             return -1;
         }
         // Initialize the watcher.
@@ -93,6 +221,12 @@ int main(int argc, char* argv[]) {
         if (adaptor->openForBusiness(!useSessionBus)) {
             qDebug() << "Logging proc correlations :" << LogSettings::getInstance().logProcessCorrelation();
             qDebug() << "Logging packet captures   :" << LogSettings::getInstance().logPacketCapture();
+            qDebug() << "Packet ring devices       :" << CaptureSettings::getInstance().getRingDevices();
+            qDebug() << "Capture threads per ring  :" << CaptureSettings::getInstance().getFanoutWorkers();
+            qDebug() << "Kernel flow devices       :" << CaptureSettings::getInstance().getKernelFlowDevices();
+            qDebug() << "Max flows per second      :" << CaptureSettings::getInstance().getMaxFlowsPerSecond();
+            qDebug() << "Replay files              :" << CaptureSettings::getInstance().getReplayFiles();
+            qDebug() << "Proc connector events     :" << CorrelationSettings::getInstance().useProcEvents();
             qDebug() << "Registered Watcher object with D-Bus. Ready for action!";
             return app.exec();
         } else {
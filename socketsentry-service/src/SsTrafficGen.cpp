@@ -0,0 +1,211 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <pcap/pcap.h>
+#include <unistd.h>
+
+#include "TrafficGenerator.h"
+#include "SyntheticTrafficThread.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+// Device name of the in-process feed.
+static const QString FEED_DEVICE("synthetic");
+
+// Packets written to a trace file unless set otherwise: ten seconds' worth.
+static const int DEFAULT_TRACE_SECS = 10;
+
+void printUsage(QTextStream& err) {
+    QStringList args = QCoreApplication::arguments();
+    Q_ASSERT(args.size() >= 1);
+    err << endl << "Usage: " << args[0] << " [--link <ethernet|cooked|raw>] [--vlan] [--flows <N>]" << endl;
+    err << "       [--rate <N>] [--skew <S>] [--ipv6 <percent>] [--ext-headers] [--seed <N>]" << endl;
+    err << "       (--write <file> [--packets <N>] | --feed <seconds>)" << endl << endl;
+    err << "Synthesizes packets for load tests." << endl << endl;
+    err << "Specify --write to write packets to a trace file in libpcap format, which the service can replay" << endl;
+    err << "        (default " << DEFAULT_TRACE_SECS << " seconds' worth of packets, or as many as --packets)." << endl;
+    err << "Specify --feed to feed packets through the service's capture pipeline in this process for the" << endl;
+    err << "        given number of seconds, printing the flows and packets recorded each second." << endl << endl;
+    err << "Specify --link to choose the data link layer of the frames (default ethernet)." << endl;
+    err << "        --vlan to tag Ethernet frames with an 802.1Q header." << endl;
+    err << "        --flows to set the number of distinct flows (default " << TrafficGenerator::DEFAULT_FLOW_COUNT
+            << ")." << endl;
+    err << "        --rate to set the number of packets per second (default " << TrafficGenerator::DEFAULT_PACKET_RATE
+            << ")." << endl;
+    err << "        --skew to set the skew of the Zipf distribution of packets over flows (default "
+            << TrafficGenerator::DEFAULT_ZIPF_SKEW << ", 0 for even)." << endl;
+    err << "        --ipv6 to set the percentage of flows over IPv6 (default 0)." << endl;
+    err << "        --ext-headers to add extension headers to IPv6 packets." << endl;
+    err << "        --seed to vary the pseudo-random stream (default " << TrafficGenerator::DEFAULT_SEED << ")."
+            << endl;
+}
+
+// If app was passed an option with the given name, parse out its value into the string argument and remove both from
+// the list. Returns false if the option was passed in without a value, in which case the list is not changed. If the
+// option was not passed in, then no changes are made and true is returned.
+bool takeOption(QStringList& appArgs, const QString& option, QString& value) {
+    int idx = appArgs.indexOf(option);
+    if (idx >= 0) {
+        if (appArgs.size() <= idx + 1) {
+            return false;
+        }
+        value = appArgs[idx + 1];
+        appArgs.removeAt(idx);  // consume option
+        appArgs.removeAt(idx);  // consume option arg
+    }
+    return true;
+}
+
+// Like takeOption, but the value must be an integer of at least the given minimum.
+bool takeIntOption(QStringList& appArgs, const QString& option, int minimum, int& value) {
+    QString text;
+    if (!takeOption(appArgs, option, text)) {
+        return false;
+    }
+    if (!text.isEmpty()) {
+        bool ok = false;
+        int parsed = text.toInt(&ok);
+        if (!ok || parsed < minimum) {
+            return false;
+        }
+        value = parsed;
+    }
+    return true;
+}
+
+// Parse the generator options out of the argument list into the generator. Returns false if any are invalid.
+bool initGenerator(QStringList& appArgs, TrafficGenerator& generator) {
+    QString link;
+    if (!takeOption(appArgs, "--link", link)) {
+        return false;
+    }
+    if (link == "cooked") {
+        generator.setLinkType(DLT_LINUX_SLL);
+    } else if (link == "raw") {
+        generator.setLinkType(DLT_RAW);
+    } else if (link.isEmpty() || link == "ethernet") {
+        generator.setLinkType(DLT_EN10MB);
+    } else {
+        return false;
+    }
+    generator.setVlan(appArgs.removeOne("--vlan"));
+    generator.setExtensionHeaders(appArgs.removeOne("--ext-headers"));
+
+    int flowCount = generator.getFlowCount();
+    int packetRate = generator.getPacketRate();
+    int ipv6Percent = generator.getIpv6Percent();
+    int seed = generator.getSeed();
+    if (!takeIntOption(appArgs, "--flows", 1, flowCount) || !takeIntOption(appArgs, "--rate", 1, packetRate)
+            || !takeIntOption(appArgs, "--ipv6", 0, ipv6Percent) || ipv6Percent > 100
+            || !takeIntOption(appArgs, "--seed", 1, seed)) {
+        return false;
+    }
+    generator.setFlowCount(flowCount);
+    generator.setPacketRate(packetRate);
+    generator.setIpv6Percent(ipv6Percent);
+    generator.setSeed(seed);
+
+    QString skew;
+    if (!takeOption(appArgs, "--skew", skew)) {
+        return false;
+    }
+    if (!skew.isEmpty()) {
+        bool ok = false;
+        double zipfSkew = skew.toDouble(&ok);
+        if (!ok || zipfSkew < 0) {
+            return false;
+        }
+        generator.setZipfSkew(zipfSkew);
+    }
+    return true;
+}
+
+// Feed the generator's packets through the capture pipeline for the given number of seconds, printing the recorded
+// traffic once a second. Returns false if the capture fails.
+bool feed(const TrafficGenerator& generator, int seconds, QTextStream& out, QTextStream& err) {
+    SyntheticTrafficThread thread(0, FEED_DEVICE, generator);
+    thread.begin();
+    bool ok = true;
+    for (int second = 1; second <= seconds && ok; ++second) {
+        ::sleep(1);
+        thread.keepAlive();
+        QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > stats;
+        QString error;
+        if (thread.fillStatistics(stats, error)) {
+            qlonglong packets = 0;
+            QHashIterator<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > i(stats);
+            while (i.hasNext()) {
+                i.next();
+                packets += i.value().first.getPacketsIn() + i.value().first.getPacketsOut();
+            }
+            out << second << "s: " << thread.getPacketsFed() << " packets fed, " << thread.getLagMs()
+                    << " ms behind, " << stats.size() << " flows and " << packets << " packets recorded" << endl;
+        } else {
+            err << "ERROR: " << error << endl;
+            ok = false;
+        }
+    }
+    thread.cancel();
+    thread.wait();
+    return ok;
+}
+
+// Usage: ./socksent-trafficgen [--link <ethernet|cooked|raw>] [--vlan] [--flows <N>] [--rate <N>]
+//                              [--skew <S>] [--ipv6 <percent>] [--ext-headers] [--seed <N>]
+//                              (--write <file> [--packets <N>] | --feed <seconds>)
+// Use --write to write a trace file
+// Use --feed to feed the packets through the capture pipeline in this process
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    TrafficGenerator generator;
+    QString fileName;
+    int packets = 0;
+    int seconds = 0;
+    if (!initGenerator(args, generator) || !takeOption(args, "--write", fileName)
+            || !takeIntOption(args, "--packets", 1, packets) || !takeIntOption(args, "--feed", 1, seconds)
+            || fileName.isEmpty() == !seconds || args.size() != 1) {
+        // Invalid or unrecognized args, or not exactly one of --write and --feed. Show usage and exit.
+        printUsage(err);
+        return -1;
+    }
+
+    if (seconds) {
+        return feed(generator, seconds, out, err) ? 0 : -2;
+    } else {
+        if (!packets) {
+            packets = generator.getPacketRate() * DEFAULT_TRACE_SECS;
+        }
+        QString error;
+        if (!generator.writeFile(fileName, packets, error)) {
+            err << "ERROR: " << error << endl;
+            return -2;
+        }
+        out << "Wrote " << packets << " packets of " << generator.getFlowCount() << " flows to " << fileName << endl;
+        return 0;
+    }
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "SyntheticTrafficThread.h"
+#include "DateTimeUtils.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <pcap/pcap.h>
+
+const int SyntheticTrafficThread::POLL_INTERVAL_MS = 10;
+const int SyntheticTrafficThread::COMMIT_PACKETS = 4096;
+
+SyntheticTrafficThread::SyntheticTrafficThread(QObject* parent, const QString& device,
+        const TrafficGenerator& generator, int packetLimit) :
+    PcapThread(parent, device, ""), _packetLimit(qMax(packetLimit, 0)), _feedDone(0), _packetsFed(0), _lagMs(0),
+    _generator(generator), _feedStartMs(0) {
+    setLocalAddresses(TrafficGenerator::localAddresses());
+}
+
+SyntheticTrafficThread::~SyntheticTrafficThread() {
+}
+
+bool SyntheticTrafficThread::openCapture(int& linkType, QString& message) {
+    Q_UNUSED(message);
+    _feedStartMs = DateTimeUtils::currentTimeMs();
+    timeval startTime;
+    startTime.tv_sec = _feedStartMs / 1000;
+    startTime.tv_usec = (_feedStartMs % 1000) * 1000;
+    _generator.setStartTime(startTime);
+    _generator.restart();
+    linkType = _generator.getLinkType();
+    qDebug("[%s]: Feeding %d flows at %d packets per second.", (const char*)_device.toLatin1(),
+            _generator.getFlowCount(), _generator.getPacketRate());
+    return true;
+}
+
+void SyntheticTrafficThread::captureLoop(QString& error) {
+    Q_UNUSED(error);
+    const qlonglong packetRate = qMax(_generator.getPacketRate(), 1);
+    pcap_pkthdr header;
+    QByteArray frame;
+    while (canContinue()) {
+        // Feed the packets due by now, committing now and then if there are many.
+        qlonglong dueMs = DateTimeUtils::currentTimeMs() - _feedStartMs;
+        qlonglong due = dueMs * packetRate / 1000;
+        if (_packetLimit) {
+            due = qMin(due, (qlonglong)_packetLimit);
+        }
+        int sinceCommit = 0;
+        while (_generator.getPacketCount() < due && sinceCommit < COMMIT_PACKETS) {
+            _generator.nextPacket(header, frame);
+            processPacket(&header, (const u_char*)frame.constData());
+            ++sinceCommit;
+        }
+        commit(dueMs);
+        if (_packetLimit && _generator.getPacketCount() == _packetLimit) {
+            break;
+        }
+        if (_generator.getPacketCount() == due) {
+            msleep(POLL_INTERVAL_MS);
+        }
+    }
+    if (!canContinue()) {
+        return;
+    }
+
+    // Out of packets. Keep the history available until it's no longer needed.
+    commit(0, true);
+    _feedDone.fetchAndStoreOrdered(1);
+    qDebug("[%s]: Fed %d packets.", (const char*)_device.toLatin1(), _packetLimit);
+    while (canContinue()) {
+        msleep(POLL_INTERVAL_MS);
+        commitBatch();
+    }
+}
+
+void SyntheticTrafficThread::commit(qlonglong dueMs, bool forcePublish) {
+    commitBatch(forcePublish);
+    const qlonglong packetsFed = _generator.getPacketCount();
+    _packetsFed.fetchAndStoreOrdered((int)packetsFed);
+    // The lag is the time since the next packet was due.
+    const qlonglong nextDueMs = packetsFed * 1000 / qMax(_generator.getPacketRate(), 1);
+    _lagMs.fetchAndStoreOrdered((int)qMax(dueMs - nextDueMs, 0LL));
+}
+
+void SyntheticTrafficThread::closeCapture() {
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SYNTHETICTRAFFICTHREAD_H_
+#define SYNTHETICTRAFFICTHREAD_H_
+
+#include "PcapThread.h"
+#include "TrafficGenerator.h"
+
+#include <QtCore/QAtomicInt>
+
+/*
+ * Capture thread that feeds packets of a traffic generator through the capture pipeline instead of capturing live
+ * traffic, for load tests. The packets are generated in real time at the generator's packet rate, with timestamps
+ * starting when the thread starts. If the pipeline can't keep up, the feed falls behind and catches up when it can.
+ * After the last packet (if there is a limit), the history stays available until the thread is no longer needed.
+ *
+ * This class is reentrant and thread-safe. Public methods can be called from any thread.
+ */
+class SyntheticTrafficThread : public PcapThread {
+public:
+    // Create a new thread feeding packets of a copy of the given generator. If the packet limit is positive, the feed
+    // stops after that many packets.
+    SyntheticTrafficThread(QObject* parent, const QString& device, const TrafficGenerator& generator,
+            int packetLimit = 0);
+    virtual ~SyntheticTrafficThread();
+
+    // True once the packet limit has been reached.
+    bool isFeedDone() const { return _feedDone != 0; }
+
+    // Number of packets fed so far.
+    int getPacketsFed() const { return _packetsFed; }
+
+    // How far in milliseconds the feed was behind the packet rate at the last commit.
+    int getLagMs() const { return _lagMs; }
+
+protected:
+    virtual bool openCapture(int& linkType, QString& message);
+    virtual void captureLoop(QString& error);
+    virtual void closeCapture();
+
+private:
+    // Record the packets fed so far to history and publish the count and lag.
+    void commit(qlonglong dueMs, bool forcePublish = false);
+
+    // Immutables
+    static const int POLL_INTERVAL_MS;          // time to sleep when the feed is ahead
+    static const int COMMIT_PACKETS;            // packets fed between commits when behind
+    const int _packetLimit;
+
+    // These members are shared with multiple threads and mutable. They are atomic, so no lock is needed.
+    QAtomicInt _feedDone;                       // non-zero once the packet limit has been reached
+    QAtomicInt _packetsFed;                     // number of packets fed so far
+    QAtomicInt _lagMs;                          // lag at the last commit
+
+    // Unshared (thread private)
+    TrafficGenerator _generator;                // source of the packets
+    qlonglong _feedStartMs;                     // system time at which the feed started
+};
+
+#endif /* SYNTHETICTRAFFICTHREAD_H_ */
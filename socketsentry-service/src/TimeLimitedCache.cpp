@@ -41,8 +41,9 @@ void TimeLimitedCache::timerEvent(QTimerEvent* event) {
     qlonglong nowMs = DateTimeUtils::currentTimeMs();
     // Look for cache entries that are older than the maximum allowed age and remove them from the cache.
     // The map is ordered by request time, so as soon as we see an entry that's not old, we can stop.
-    QMutableMapIterator<qlonglong, QString> iter(_keysByRequestTimeMs);
     QSet<QString> evictedKeys;
+    _mutex.lock();
+    QMutableMapIterator<qlonglong, QString> iter(_keysByRequestTimeMs);
     while (iter.hasNext()) {
         iter.next();
         qlonglong requestTimeMs = iter.key();
@@ -57,36 +58,63 @@ void TimeLimitedCache::timerEvent(QTimerEvent* event) {
             break;
         }
     }
+    _mutex.unlock();
     if (!evictedKeys.isEmpty()) emit evicted(evictedKeys);
 }
 
+int TimeLimitedCache::size() const {
+    _mutex.lock();
+    int result = _lookupTable.size();
+    _mutex.unlock();
+    return result;
+}
+
+bool TimeLimitedCache::contains(const QString& key) const {
+    _mutex.lock();
+    bool result = _lookupTable.contains(key);
+    _mutex.unlock();
+    return result;
+}
+
+const QVariant TimeLimitedCache::value(const QString& key) const {
+    _mutex.lock();
+    QVariant result = _lookupTable.value(key);
+    _mutex.unlock();
+    return result;
+}
+
 void TimeLimitedCache::passiveUpdate(const QString& key, const QVariant& value) {
+    _mutex.lock();
     if (_lookupTable.contains(key)) {
         _lookupTable.insert(key, value);
     }
+    _mutex.unlock();
 }
 
 bool TimeLimitedCache::insertNew(const QString& key, const QVariant& value) {
+    QSet<QString> evictedKeys;
+    _mutex.lock();
     bool exists = _lookupTable.contains(key);
     if (!exists) {
         // Cache miss. We'll add it now.
         if (_keysByRequestTimeMs.size() >= _maxSize) {
             // Cache full. Cut it down.
-            reduceSize();
+            reduceSize(evictedKeys);
         }
         // Create entries in the name table and address by request time map.
         qlonglong nowMs = DateTimeUtils::currentTimeMs();
         _lookupTable.insert(key, value);
         _keysByRequestTimeMs.insert(nowMs, key);
     }
+    _mutex.unlock();
+    if (!evictedKeys.isEmpty()) emit evicted(evictedKeys);
     return !exists;
 }
 
-void TimeLimitedCache::reduceSize() {
+void TimeLimitedCache::reduceSize(QSet<QString>& evictedKeys) {
     Q_ASSERT(_retentionPercent >= 0 && _retentionPercent < 100);
     const uint newSize = _maxSize * _retentionPercent / 100;
     QMutableMapIterator<qlonglong, QString> iter(_keysByRequestTimeMs);
-    QSet<QString> evictedKeys;
     while(iter.hasNext() && _lookupTable.size() > newSize) {
         iter.next();
         const QString& key = iter.value();
@@ -94,6 +122,5 @@ void TimeLimitedCache::reduceSize() {
         evictedKeys << key;
         iter.remove();
     }
-    if (!evictedKeys.isEmpty()) emit evicted(evictedKeys);
 }
 
@@ -21,6 +21,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QHash>
 #include <QtCore/QMultiMap>
+#include <QtCore/QMutex>
 #include <QtCore/QVariant>
 
 template <class E> class QSet;
@@ -30,7 +31,8 @@ class QString;
  * A cache that stores a limited number of key-value pairs for a limited period of time. Entries remain in the cache
  * until they grow too old or the maximum size of the cache is reached. Entries are evicted from the cache
  * automatically, oldest to newest. Keys must be represented as QStrings and values as QVariants, since Qt does
- * not allow template classes to derive from QObject.
+ * not allow template classes to derive from QObject. The cache may be used from any thread, but eviction signals are
+ * emitted from the thread that inserts or sweeps.
  */
 class TimeLimitedCache : public QObject {
     Q_OBJECT
@@ -50,14 +52,14 @@ public:
     bool insertNew(const QString& key, const QVariant& value);
 
     // Return the current number of entries in the cache.
-    int size() const { return _lookupTable.size(); }
+    int size() const;
 
     // Returns true if the key is contained within this cache.
-    bool contains(const QString& key) const { return _lookupTable.contains(key); }
+    bool contains(const QString& key) const;
 
     // Returns the value for the given key. If the key does not exist in the cache, a default constructed value is
     // returned.
-    const QVariant value(const QString& key) const { return _lookupTable.value(key); }
+    const QVariant value(const QString& key) const;
 
 signals:
     // Emitted when one or more entries are evicted from the cache.
@@ -68,8 +70,9 @@ protected:
     void timerEvent(QTimerEvent* event);
 
 private:
-    // Reduce the size of the cache to "retention %" of maximum. Oldest entries are removed first.
-    void reduceSize();
+    // Reduce the size of the cache to "retention %" of maximum. Oldest entries are removed first. The removed keys
+    // are added to the argument. The caller must hold the mutex.
+    void reduceSize(QSet<QString>& evictedKeys);
 
     // Default interval between time-based eviction sweeps.
     static const uint DEFAULT_TIMER_INTERVAL_MS;
@@ -95,6 +98,9 @@ private:
     // Map of cache entry times to keys.
     QMultiMap<qlonglong, QString> _keysByRequestTimeMs;
 
+    // Guards the lookup table and entry times.
+    mutable QMutex _mutex;
+
 };
 
 #endif /* TIMELIMITEDCACHE_H_ */
@@ -0,0 +1,303 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "TrafficGenerator.h"
+
+#include <pcap/pcap.h>
+#include <netinet/in.h>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/qmath.h>
+
+#include <string.h>
+
+#include "tcpdump-includes/ether.h"
+#include "tcpdump-includes/ethertype.h"
+#include "tcpdump-includes/sll.h"
+#include "tcpdump-includes/ip.h"
+#include "tcpdump-includes/ip6.h"
+
+const int TrafficGenerator::DEFAULT_FLOW_COUNT = 10000;
+const int TrafficGenerator::DEFAULT_PACKET_RATE = 10000;
+const double TrafficGenerator::DEFAULT_ZIPF_SKEW = 1.0;
+const quint32 TrafficGenerator::DEFAULT_SEED = 1;
+
+// Time of the first packet unless set otherwise.
+static const time_t DEFAULT_START_SECS = 1000000000;
+
+// Addresses of the local host, in network byte order.
+static const quint8 LOCAL_ADDR4[4] = { 10, 0, 0, 1 };
+static const quint8 LOCAL_ADDR6[16] = { 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// First remote addresses. Each flow adds its rank to these.
+static const quint32 FIRST_REMOTE_ADDR4 = 0x0a800001;                           // 10.128.0.1
+static const quint8 REMOTE_PREFIX6[12] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0 };    // 2001:db8::/96
+
+// MAC address of the local host, and of the router all remote hosts are behind.
+static const u_int8_t LOCAL_MAC[ETHER_ADDR_LEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const u_int8_t ROUTER_MAC[ETHER_ADDR_LEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0xfe };
+
+// ARP hardware type of Ethernet in cooked headers.
+static const int ARPHRD_ETHER_TYPE = 1;
+
+// VLAN of tagged frames.
+static const int VLAN_ID = 42;
+
+// Lengths of the transport headers (without options).
+static const int TCP_HEADER_LEN = 20;
+static const int UDP_HEADER_LEN = 8;
+
+// Length of each IPv6 extension header: the minimum, filled up with a PadN option.
+static const int IPV6_EXT_HEADER_LEN = 8;
+
+// Local ports are ephemeral. Remote ports are well-known.
+static const int FIRST_LOCAL_PORT = 32768;
+static const int LOCAL_PORTS = 28232;
+static const quint16 TCP_PORTS[] = { 80, 443, 22, 993 };
+static const quint16 UDP_PORTS[] = { 53, 123, 443, 5353 };
+static const int REMOTE_PORTS = 4;
+
+// Payload of a full-size segment, and the max payload of a small packet.
+static const int FULL_PAYLOAD = 1460;
+static const int SMALL_PAYLOAD = 512;
+
+// Max captured length of written trace files.
+static const int TRACE_SNAPLEN = 65535;
+
+TrafficGenerator::TrafficGenerator() :
+    _linkType(DLT_EN10MB), _flowCount(DEFAULT_FLOW_COUNT), _packetRate(DEFAULT_PACKET_RATE),
+    _zipfSkew(DEFAULT_ZIPF_SKEW), _ipv6Percent(0), _extensionHeaders(false), _vlan(false), _seed(DEFAULT_SEED),
+    _random(DEFAULT_SEED), _packetCount(0) {
+    _startTime.tv_sec = DEFAULT_START_SECS;
+    _startTime.tv_usec = 0;
+}
+
+TrafficGenerator::~TrafficGenerator() {
+}
+
+void TrafficGenerator::restart() {
+    // Xorshift never leaves zero, so that seed is replaced.
+    _random = _seed ? _seed : DEFAULT_SEED;
+    _packetCount = 0;
+    const int flowCount = qMax(1, _flowCount);
+    _flows.resize(flowCount);
+    _cumulativeShares.resize(flowCount);
+    double total = 0;
+    for (int rank = 0; rank < flowCount; ++rank) {
+        Flow& flow = _flows[rank];
+        ::memset(flow.remoteAddr, 0, sizeof(flow.remoteAddr));
+        flow.ipv6 = (int)(nextRandom() % 100) < _ipv6Percent;
+        flow.tcp = nextRandom() % 4 != 0;       // three in four flows are TCP
+        if (flow.ipv6) {
+            ::memcpy(flow.remoteAddr, REMOTE_PREFIX6, sizeof(REMOTE_PREFIX6));
+            const quint32 host = htonl(rank + 1);
+            ::memcpy(flow.remoteAddr + sizeof(REMOTE_PREFIX6), &host, 4);
+        } else {
+            const quint32 addr = htonl(FIRST_REMOTE_ADDR4 + rank);
+            ::memcpy(flow.remoteAddr, &addr, 4);
+        }
+        flow.localPort = FIRST_LOCAL_PORT + rank % LOCAL_PORTS;
+        const int port = nextRandom() % REMOTE_PORTS;
+        flow.remotePort = flow.tcp ? TCP_PORTS[port] : UDP_PORTS[port];
+        total += 1.0 / qPow(rank + 1, _zipfSkew);
+        _cumulativeShares[rank] = total;
+    }
+    for (int rank = 0; rank < flowCount; ++rank) {
+        _cumulativeShares[rank] /= total;
+    }
+}
+
+void TrafficGenerator::nextPacket(pcap_pkthdr& header, QByteArray& frame) {
+    if (_flows.isEmpty()) {
+        restart();
+    }
+    const Flow& flow = _flows.at(nextFlow());
+    const bool outbound = nextRandom() & 1;
+    const int payloadLength = nextPayloadLength();
+    const int linkLength = linkHeaderLength();
+    const int extLength = (flow.ipv6 && _extensionHeaders) ? 2 * IPV6_EXT_HEADER_LEN : 0;
+    const int ipLength = (flow.ipv6 ? sizeof(ip6_hdr) : sizeof(ip)) + extLength;
+    const int transportLength = flow.tcp ? TCP_HEADER_LEN : UDP_HEADER_LEN;
+    const u_int8_t protocol = flow.tcp ? IPPROTO_TCP : IPPROTO_UDP;
+    frame.resize(linkLength + ipLength + transportLength);
+    u_char* data = reinterpret_cast<u_char*>(frame.data());
+    ::memset(data, 0, frame.size());
+    writeLinkHeader(data, outbound, flow.ipv6);
+
+    // Network layer.
+    u_char* ipStart = data + linkLength;
+    const quint8* localAddr = flow.ipv6 ? LOCAL_ADDR6 : LOCAL_ADDR4;
+    const quint8* srcAddr = outbound ? localAddr : flow.remoteAddr;
+    const quint8* destAddr = outbound ? flow.remoteAddr : localAddr;
+    if (flow.ipv6) {
+        ip6_hdr* iptr = (ip6_hdr*)ipStart;
+        iptr->ip6_flow = htonl(0x60000000);     // version 6
+        iptr->ip6_plen = htons(extLength + transportLength + payloadLength);
+        iptr->ip6_nxt = extLength ? IPPROTO_HOPOPTS : protocol;
+        iptr->ip6_hlim = 64;
+        ::memcpy(&iptr->ip6_src, srcAddr, 16);
+        ::memcpy(&iptr->ip6_dst, destAddr, 16);
+        if (extLength) {
+            u_char* ext = ipStart + sizeof(ip6_hdr);
+            ip6_hbh* hopByHop = (ip6_hbh*)ext;
+            hopByHop->ip6h_nxt = IPPROTO_DSTOPTS;
+            hopByHop->ip6h_len = 0;
+            ext[2] = IP6OPT_PADN;
+            ext[3] = IPV6_EXT_HEADER_LEN - 4;
+            ip6_dest* destOptions = (ip6_dest*)(ext + IPV6_EXT_HEADER_LEN);
+            destOptions->ip6d_nxt = protocol;
+            destOptions->ip6d_len = 0;
+            ext[IPV6_EXT_HEADER_LEN + 2] = IP6OPT_PADN;
+            ext[IPV6_EXT_HEADER_LEN + 3] = IPV6_EXT_HEADER_LEN - 4;
+        }
+    } else {
+        ip* iptr = (ip*)ipStart;
+        iptr->ip_vhl = 0x45;                    // version 4, 20-byte header
+        iptr->ip_len = htons(ipLength + transportLength + payloadLength);
+        iptr->ip_id = htons(_packetCount & 0xffff);
+        iptr->ip_off = htons(IP_DF);
+        iptr->ip_ttl = 64;
+        iptr->ip_p = protocol;
+        ::memcpy(&iptr->ip_src, srcAddr, 4);
+        ::memcpy(&iptr->ip_dst, destAddr, 4);
+    }
+
+    // Transport layer.
+    u_char* transport = ipStart + ipLength;
+    const u_int16_t ports[2] = { htons(outbound ? flow.localPort : flow.remotePort),
+            htons(outbound ? flow.remotePort : flow.localPort) };
+    ::memcpy(transport, ports, sizeof(ports));
+    if (flow.tcp) {
+        const u_int32_t sequence = htonl(_packetCount);
+        ::memcpy(transport + 4, &sequence, 4);
+        transport[12] = (TCP_HEADER_LEN / 4) << 4;      // data offset
+        transport[13] = payloadLength ? 0x18 : 0x10;    // PSH+ACK or ACK
+    } else {
+        const u_int16_t length = htons(UDP_HEADER_LEN + payloadLength);
+        ::memcpy(transport + 4, &length, 2);
+    }
+
+    // Only headers are captured. Timestamps follow the packet rate.
+    header.caplen = frame.size();
+    header.len = frame.size() + payloadLength;
+    const qlonglong micros = _startTime.tv_usec + _packetCount * 1000000 / qMax(1, _packetRate);
+    header.ts.tv_sec = _startTime.tv_sec + micros / 1000000;
+    header.ts.tv_usec = micros % 1000000;
+    ++_packetCount;
+}
+
+bool TrafficGenerator::writeFile(const QString& fileName, int packets, QString& error) {
+    pcap_t* handle = pcap_open_dead(_linkType, TRACE_SNAPLEN);
+    if (!handle) {
+        error = QObject::tr("Can't write packets of data link type %1.").arg(_linkType);
+        return false;
+    }
+    pcap_dumper_t* dumper = pcap_dump_open(handle, QFile::encodeName(fileName).constData());
+    if (!dumper) {
+        error = QObject::tr("Can't open file %1. (%2)").arg(fileName).arg(pcap_geterr(handle));
+        pcap_close(handle);
+        return false;
+    }
+    restart();
+    pcap_pkthdr header;
+    QByteArray frame;
+    for (int i = 0; i < packets; ++i) {
+        nextPacket(header, frame);
+        pcap_dump((u_char*)dumper, &header, (const u_char*)frame.constData());
+    }
+    bool ok = pcap_dump_flush(dumper) == 0;
+    if (!ok) {
+        error = QObject::tr("Can't write file %1.").arg(fileName);
+    }
+    pcap_dump_close(dumper);
+    pcap_close(handle);
+    return ok;
+}
+
+QList<QHostAddress> TrafficGenerator::localAddresses() {
+    QList<QHostAddress> result;
+    quint32 addr4 = 0;
+    ::memcpy(&addr4, LOCAL_ADDR4, 4);
+    Q_IPV6ADDR addr6;
+    ::memcpy(addr6.c, LOCAL_ADDR6, 16);
+    result << QHostAddress(ntohl(addr4)) << QHostAddress(addr6);
+    return result;
+}
+
+quint32 TrafficGenerator::nextRandom() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+int TrafficGenerator::nextFlow() {
+    const double share = nextUniform();
+    QVector<double>::const_iterator i = qLowerBound(_cumulativeShares.constBegin(), _cumulativeShares.constEnd(),
+            share);
+    return qMin((int)(i - _cumulativeShares.constBegin()), _flows.size() - 1);
+}
+
+int TrafficGenerator::nextPayloadLength() {
+    // Roughly the trimodal mix of packet sizes seen on the Internet: acknowledgements, small packets, and full-size
+    // segments.
+    const quint32 kind = nextRandom() % 10;
+    if (kind < 4) {
+        return 0;
+    } else if (kind < 6) {
+        return 1 + nextRandom() % SMALL_PAYLOAD;
+    } else {
+        return FULL_PAYLOAD;
+    }
+}
+
+int TrafficGenerator::linkHeaderLength() const {
+    switch (_linkType) {
+    case DLT_EN10MB:
+        return ETHER_HDRLEN + (_vlan ? sizeof(vlan_8021q_header) : 0);
+    case DLT_LINUX_SLL:
+        return SLL_HDR_LEN;
+    default:
+        return 0;
+    }
+}
+
+void TrafficGenerator::writeLinkHeader(u_char* data, bool outbound, bool ipv6) const {
+    const u_int16_t etherType = ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP;
+    if (_linkType == DLT_EN10MB) {
+        ether_header* eptr = (ether_header*)data;
+        ::memcpy(eptr->ether_dhost, outbound ? ROUTER_MAC : LOCAL_MAC, ETHER_ADDR_LEN);
+        ::memcpy(eptr->ether_shost, outbound ? LOCAL_MAC : ROUTER_MAC, ETHER_ADDR_LEN);
+        if (_vlan) {
+            eptr->ether_type = htons(ETHERTYPE_8021Q);
+            vlan_8021q_header* vptr = (vlan_8021q_header*)(data + ETHER_HDRLEN);
+            vptr->priority_cfi_vid = htons(VLAN_ID);
+            vptr->ether_type = htons(etherType);
+        } else {
+            eptr->ether_type = htons(etherType);
+        }
+    } else if (_linkType == DLT_LINUX_SLL) {
+        sll_header* sptr = (sll_header*)data;
+        sptr->sll_pkttype = htons(outbound ? LINUX_SLL_OUTGOING : LINUX_SLL_HOST);
+        sptr->sll_hatype = htons(ARPHRD_ETHER_TYPE);
+        sptr->sll_halen = htons(ETHER_ADDR_LEN);
+        ::memcpy(sptr->sll_addr, outbound ? LOCAL_MAC : ROUTER_MAC, ETHER_ADDR_LEN);
+        sptr->sll_protocol = htons(etherType);
+    }
+}
@@ -0,0 +1,161 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef TRAFFICGENERATOR_H_
+#define TRAFFICGENERATOR_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtNetwork/QHostAddress>
+
+#include <sys/time.h>
+#include <sys/types.h>
+
+struct pcap_pkthdr;
+class QString;
+
+/*
+ * Synthesizes reproducible packet streams for load tests. Frames carry TCP or UDP packets over IPv4 or IPv6
+ * (optionally with hop-by-hop and destination options extension headers) in Ethernet (optionally 802.1Q tagged), Linux
+ * cooked, or raw IP encapsulation. Every flow is between one local host and a remote host of its own. How often each
+ * flow sends is Zipf-distributed by flow rank, so a few flows carry most of the traffic as on real networks. Packet
+ * sizes are a mix of acknowledgements, small packets, and full-size segments. Timestamps advance at a fixed packet
+ * rate. Only the headers of each frame are captured; the wire length includes the payload.
+ *
+ * The stream depends only on the settings and the random seed. Settings take effect when the generator restarts, which
+ * happens before the first packet and on every call to "restart".
+ *
+ * This class is reentrant, but NOT thread-safe.
+ */
+class TrafficGenerator {
+public:
+    // New generator with default settings.
+    TrafficGenerator();
+    virtual ~TrafficGenerator();
+
+    // Data link type of the frames (DLT_EN10MB, DLT_LINUX_SLL, or DLT_RAW from libpcap).
+    int getLinkType() const { return _linkType; }
+    void setLinkType(int linkType) { _linkType = linkType; }
+
+    // Number of distinct flows.
+    int getFlowCount() const { return _flowCount; }
+    void setFlowCount(int flowCount) { _flowCount = flowCount; }
+
+    // Packets per second of the timestamps.
+    int getPacketRate() const { return _packetRate; }
+    void setPacketRate(int packetRate) { _packetRate = packetRate; }
+
+    // Skew of the Zipf distribution of packets over flows. The flow of rank k sends in proportion to 1 / k^skew. A skew
+    // of 0 spreads packets evenly.
+    double getZipfSkew() const { return _zipfSkew; }
+    void setZipfSkew(double zipfSkew) { _zipfSkew = zipfSkew; }
+
+    // Percentage of flows over IPv6.
+    int getIpv6Percent() const { return _ipv6Percent; }
+    void setIpv6Percent(int ipv6Percent) { _ipv6Percent = ipv6Percent; }
+
+    // True if IPv6 packets carry hop-by-hop and destination options extension headers.
+    bool getExtensionHeaders() const { return _extensionHeaders; }
+    void setExtensionHeaders(bool extensionHeaders) { _extensionHeaders = extensionHeaders; }
+
+    // True if Ethernet frames are 802.1Q tagged.
+    bool getVlan() const { return _vlan; }
+    void setVlan(bool vlan) { _vlan = vlan; }
+
+    // Seed of the pseudo-random sequence.
+    quint32 getSeed() const { return _seed; }
+    void setSeed(quint32 seed) { _seed = seed; }
+
+    // Timestamp of the first packet.
+    timeval getStartTime() const { return _startTime; }
+    void setStartTime(const timeval& startTime) { _startTime = startTime; }
+
+    // Lay out the flows again and start over from the first packet.
+    void restart();
+
+    // Generate the next frame. The pcap header and frame arguments are overwritten. The frame's buffer is reused
+    // between calls if possible.
+    void nextPacket(pcap_pkthdr& header, QByteArray& frame);
+
+    // Number of packets generated since the last restart.
+    qlonglong getPacketCount() const { return _packetCount; }
+
+    // Write the given number of packets from the start of the stream to a trace file in libpcap format. Returns true if
+    // successful. Otherwise, false is returned and the error argument is populated.
+    bool writeFile(const QString& fileName, int packets, QString& error);
+
+    // Addresses of the local host. The remote host of every flow has a different address.
+    static QList<QHostAddress> localAddresses();
+
+    // Default settings.
+    static const int DEFAULT_FLOW_COUNT;
+    static const int DEFAULT_PACKET_RATE;
+    static const double DEFAULT_ZIPF_SKEW;
+    static const quint32 DEFAULT_SEED;
+
+private:
+    // One flow of the stream.
+    struct Flow {
+        quint8 remoteAddr[16];
+        quint16 localPort;
+        quint16 remotePort;
+        bool tcp;
+        bool ipv6;
+    };
+
+    // Next number of the pseudo-random sequence (xorshift).
+    quint32 nextRandom();
+
+    // Pseudo-random number in [0, 1).
+    double nextUniform() { return nextRandom() / 4294967296.0; }
+
+    // Pick the flow of the next packet from the Zipf distribution.
+    int nextFlow();
+
+    // Pick the payload length of the next packet.
+    int nextPayloadLength();
+
+    // Length of the data link header of each frame.
+    int linkHeaderLength() const;
+
+    // Write the data link header of a packet of the given direction and IP version to the start of a frame.
+    void writeLinkHeader(u_char* data, bool outbound, bool ipv6) const;
+
+    // Settings
+    int _linkType;
+    int _flowCount;
+    int _packetRate;
+    double _zipfSkew;
+    int _ipv6Percent;
+    bool _extensionHeaders;
+    bool _vlan;
+    quint32 _seed;
+    timeval _startTime;
+
+    // Flows by rank, and the cumulative distribution of packets over them.
+    QVector<Flow> _flows;
+    QVector<double> _cumulativeShares;
+
+    // State of the pseudo-random sequence.
+    quint32 _random;
+
+    // Packets generated since the last restart.
+    qlonglong _packetCount;
+};
+
+#endif /* TRAFFICGENERATOR_H_ */
@@ -17,10 +17,18 @@
 
 #include <QtCore/QList>
 #include <QtCore/QHash>
+#include <QtCore/QHashIterator>
+#include <QtCore/QMutableHashIterator>
+#include <QtCore/QMutableSetIterator>
 #include <QtCore/QListIterator>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QSetIterator>
 #include <QtCore/QDebug>
+#include <QtCore/QtConcurrentRun>
+#include <QtCore/QVector>
+
+#include <algorithm>
 
 #include "Watcher.h"
 #include "OsProcess.h"
@@ -31,39 +39,99 @@
 #include "ConnectionProcessCorrelator.h"
 #include "DateTimeUtils.h"
 #include "PcapManager.h"
+#include "CaptureSettings.h"
+#include "FlowBatchCodec.h"
+#include "SharedFlowRing.h"
 
 
 // Default interval between wake-up times when the watcher performs its duties.
 const int Watcher::DEFAULT_TIMER_INTERVAL_MS = 500;
 
+// Interval between wake-ups and updates while there's no traffic.
+const int Watcher::QUIET_INTERVAL_MS = 5000;
+
 // Default interval between attempts to map captured packet endpoints to OS processes and connections.
 const int Watcher::DEFAULT_CORRELATION_INTERVAL_MS = 2000;
 
 // Default interval between update signals.
 const int Watcher::DEFAULT_UPDATE_INTERVAL_MS = 1000;
 
+// Default interval between full correlations.
+const int Watcher::DEFAULT_REFRESH_INTERVAL_MS = 60000;
+
+// Most endpoint pairs to look up one by one.
+const int Watcher::MAX_TARGETED_ENDPOINTS = 256;
+
+// Most targeted lookups of an endpoint pair without a match between full correlations. About ten seconds' worth.
+const int Watcher::MAX_ENDPOINT_LOOKUPS = 5;
+
+// Time after which interest in a kind of update runs out. Same as the capture timeout.
+const int Watcher::INTEREST_TIMEOUT_MS = 30000;
+
+// Number of delta updates between keyframes.
+const int Watcher::KEYFRAME_INTERVAL = 30;
+
+// Slots of shared rings. A few seconds' worth gives slow readers time to catch up.
+const int Watcher::SHARED_RING_SLOTS = 4;
+
+// Initial slot size of shared rings. Enough for about 2500 flows. Rings with larger slots replace it as needed.
+const int Watcher::SHARED_RING_SLOT_SIZE = 256 * 1024;
+
+// Endpoint pair of the capture statistics that passed a selection's filter, with its value of the selection's sort key.
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >::const_iterator CaptureStatsIterator;
+struct SelectionCandidate {
+    qlonglong value;
+    CaptureStatsIterator entry;
+};
+
+// True if the first candidate is busier than the second.
+static bool busierThan(const SelectionCandidate& candidate1, const SelectionCandidate& candidate2) {
+    return candidate1.value > candidate2.value;
+}
+
+// Remove the entries of a table of times that are no later than the given time.
+static void expireTimes(QHash<QString, qlonglong>& timesMs, qlonglong expiryMs) {
+    QMutableHashIterator<QString, qlonglong> i(timesMs);
+    while (i.hasNext()) {
+        if (i.next().value() <= expiryMs) {
+            i.remove();
+        }
+    }
+}
+
 Watcher::Watcher() :
     _timerIntervalMs(DEFAULT_TIMER_INTERVAL_MS), _updateIntervalMs(DEFAULT_UPDATE_INTERVAL_MS),
-    _correlationIntervalMs(DEFAULT_CORRELATION_INTERVAL_MS ), _correlator(new ConnectionProcessCorrelator),
+    _correlationIntervalMs(DEFAULT_CORRELATION_INTERVAL_MS ), _refreshIntervalMs(DEFAULT_REFRESH_INTERVAL_MS),
+    _correlator(new ConnectionProcessCorrelator),
     _pcapManager(new PcapManager), _resolveNames(false), _osProcessSortAscending(true) {
     init();
 }
 
 Watcher::Watcher(IConnectionProcessCorrelator* correlator, IPcapManager* pcapManager, int timerIntervalMs,
-        int updateIntervalMs, int correlationIntervalMs) :
+        int updateIntervalMs, int correlationIntervalMs, int refreshIntervalMs) :
      _timerIntervalMs(timerIntervalMs), _updateIntervalMs(updateIntervalMs),
-     _correlationIntervalMs(correlationIntervalMs), _correlator(correlator), _pcapManager(pcapManager),
+     _correlationIntervalMs(correlationIntervalMs), _refreshIntervalMs(refreshIntervalMs), _correlator(correlator),
+     _pcapManager(pcapManager),
      _resolveNames(false), _osProcessSortAscending(true) {
     init();
 }
 
 void Watcher::init() {
-    startTimer(_timerIntervalMs);
-    _lastUpdateMs = DateTimeUtils::currentTimeMs();
-    _lastCorrelationMs = _lastUpdateMs;
+    connect(&_correlationWatcher, SIGNAL(finished()), this, SLOT(correlationFinished()));
+    // The timer starts when a client first shows interest.
+    _wakeUpIntervalMs = 0;
+    _lastCorrelationMs = DateTimeUtils::currentTimeMs();
+    _lastRefreshMs = 0;
+    _refreshing = false;
+    _sharedSequence = 0;
 }
 
 Watcher::~Watcher() {
+    _correlationWatcher.waitForFinished();
+    QListIterator<QString> i(_sharedRings.keys());
+    while (i.hasNext()) {
+        retireSharedRing(i.next());
+    }
     delete _pcapManager;
     _pcapManager = NULL;
     delete _correlator;
@@ -71,56 +139,266 @@ Watcher::~Watcher() {
 }
 
 void Watcher::showInterest(const QString& device) {
+    bool newSubscription = !_fullInterestMs.contains(device);
+    _fullInterestMs.insert(device, DateTimeUtils::currentTimeMs());
     _pcapManager->showInterest(device);
+    wakeUp(device, newSubscription);
+}
+
+void Watcher::showDeltaInterest(const QString& device) {
+    // A new delta state starts with a keyframe.
+    bool newSubscription = !_deltaStates.contains(device);
+    _deltaStates[device].interestMs = DateTimeUtils::currentTimeMs();
+    _pcapManager->showInterest(device);
+    wakeUp(device, newSubscription);
+}
+
+void Watcher::showPackedInterest(const QString& device) {
+    bool newSubscription = !_packedInterestMs.contains(device);
+    _packedInterestMs.insert(device, DateTimeUtils::currentTimeMs());
+    _pcapManager->showInterest(device);
+    wakeUp(device, newSubscription);
+}
+
+int Watcher::openSharedRing(const QString& device, QString& error) {
+    SharedFlowRing* ring = _sharedRings.value(device);
+    if (!ring) {
+        ring = new SharedFlowRing;
+        if (!ring->create(SHARED_RING_SLOTS, SHARED_RING_SLOT_SIZE, error)) {
+            delete ring;
+            return -1;
+        }
+        _sharedRings.insert(device, ring);
+    }
+    int fd = ring->openReader(error);
+    if (fd >= 0) {
+        bool newSubscription = !_sharedInterestMs.contains(device);
+        _sharedInterestMs.insert(device, DateTimeUtils::currentTimeMs());
+        _pcapManager->showInterest(device);
+        wakeUp(device, newSubscription);
+    }
+    return fd;
+}
+
+void Watcher::showSelectedInterest(const QString& device, const FlowSelection& selection) {
+    if (selection.isValid()) {
+        // A new selection state is due for an update right away.
+        QHash<FlowSelection, SelectionState>& states = _selectionStates[device];
+        bool newSubscription = !states.contains(selection);
+        states[selection].interestMs = DateTimeUtils::currentTimeMs();
+        _pcapManager->showInterest(device);
+        wakeUp(device, newSubscription);
+    }
+}
+
+void Watcher::resync(const QString& device) {
+    QHash<QString, DeltaState>::iterator i = _deltaStates.find(device);
+    if (i != _deltaStates.end()) {
+        i.value().sinceKeyframe = -1;
+    }
 }
 
 void Watcher::timerEvent(QTimerEvent* event) {
     qlonglong currTime = DateTimeUtils::currentTimeMs();
-    QString correlationError;
-    bool correlated = true;
+    QStringList devices = _pcapManager->findCurrentDevices();
     // Querying the OS for connections and processes is expensive, so we try to minimize it. Only update
-    // connection processes if the correlation interval has passed AND there has been some captured traffic.
-    if (_lastCorrelationMs + _correlationIntervalMs <= currTime && _pcapManager->anyTrafficSince(_lastCorrelationMs / 1000)) {
-        // Do OS connection and process correlation.
-        _connectionProcesses.clear();
-        correlated = _correlator->correlate(_connectionProcesses, correlationError);
-        _lastCorrelationMs = currTime;
+    // connection processes if the correlation interval has passed AND there has been some captured traffic. A full
+    // correlation is only done once per refresh interval. In between, only captured endpoint pairs that haven't been
+    // matched yet are looked for, a few times each, and if there are none, nothing is done. The correlation runs on a
+    // worker thread so that updates keep coming while it's slow. Updates use the previous correlation until it's done.
+    if (!_correlationWatcher.isRunning() && _lastCorrelationMs + _correlationIntervalMs <= currTime) {
+        bool start = false;
+        if ((_lastRefreshMs + _refreshIntervalMs <= currTime || _unmatchedEndpoints.size() > MAX_TARGETED_ENDPOINTS)
+                && anyTraffic(devices, (currTime - _lastCorrelationMs) / 1000)) {
+            // Do full OS connection and process correlation. It covers all unmatched endpoint pairs so far, so they
+            // aren't looked for again until the next one.
+            _refreshing = true;
+            _endpointLookups.clear();
+            QSetIterator<IpEndpointPair> j(_unmatchedEndpoints);
+            while (j.hasNext()) {
+                _endpointLookups.insert(j.next(), MAX_ENDPOINT_LOOKUPS);
+            }
+            _lastRefreshMs = currTime;
+            start = true;
+        } else if (!_unmatchedEndpoints.isEmpty()) {
+            // Look for the unmatched endpoint pairs only.
+            _refreshing = false;
+            _pendingEndpoints = _unmatchedEndpoints;
+            QSetIterator<IpEndpointPair> j(_unmatchedEndpoints);
+            while (j.hasNext()) {
+                _endpointLookups[j.next()]++;
+            }
+            start = true;
+        }
+        if (start) {
+            _unmatchedEndpoints.clear();
+            _pendingConnectionProcesses.clear();
+            _correlationError.clear();
+            _correlationWatcher.setFuture(QtConcurrent::run(this, &Watcher::correlateInBackground));
+            _lastCorrelationMs = currTime;
+        }
     }
-    if (!correlated) {
-        // Connection-process correlation failed. Cancel all packet captures.
-        QStringList devices = _pcapManager->findCurrentDevices();
-        if (!devices.isEmpty()) {
-            QListIterator<QString> i(devices);
-            while (i.hasNext()) {
-                const QString& device = i.next();
-                emit failure(device, correlationError);
+    expireInterest(currTime);
+    bool allQuiet = true;
+    QListIterator<QString> i(devices);
+    while (i.hasNext()) {
+        const QString& device = i.next();
+        // While a device hasn't seen traffic for a while, every kind of update of it backs off to the quiet interval.
+        // Its capture tells by its own clock, which is the trace's if it's replayed.
+        bool quiet = _pcapManager->isIdle(device, QUIET_INTERVAL_MS / 1000);
+        allQuiet = allQuiet && quiet;
+        int updateIntervalMs = quiet ? qMax(_updateIntervalMs, QUIET_INTERVAL_MS) : _updateIntervalMs;
+        bool updateDue = _lastUpdateMs.value(device) + updateIntervalMs <= currTime;
+        // Find the updates of this device that are due. The full, packed, shared, and delta updates are due together.
+        // Each selection is due at its own interval.
+        bool defaultDue = updateDue && (_fullInterestMs.contains(device) || _packedInterestMs.contains(device)
+                || _sharedInterestMs.contains(device) || _deltaStates.contains(device));
+        QList<FlowSelection> dueSelections;
+        QHash<QString, QHash<FlowSelection, SelectionState> >::iterator states = _selectionStates.find(device);
+        if (states != _selectionStates.end()) {
+            QMutableHashIterator<FlowSelection, SelectionState> j(states.value());
+            while (j.hasNext()) {
+                j.next();
+                int intervalMs = j.key().getUpdateIntervalMs() > 0 ? j.key().getUpdateIntervalMs() : _updateIntervalMs;
+                if (quiet) {
+                    intervalMs = qMax(intervalMs, QUIET_INTERVAL_MS);
+                }
+                if (j.value().lastUpdateMs + intervalMs <= currTime) {
+                    j.value().lastUpdateMs = currTime;
+                    dueSelections << j.key();
+                }
             }
-            _pcapManager->releaseAll();
         }
-    } else if (_lastUpdateMs + _updateIntervalMs <= currTime) {
-        QStringList devices = _pcapManager->findCurrentDevices();
-        QListIterator<QString> i(devices);
-        while (i.hasNext()) {
-            // Get capture statistics for this device and emit signal.
-            const QString& device = i.next();
+        if (defaultDue || !dueSelections.isEmpty()) {
+            // Get capture statistics for this device once and emit the signals that are due.
             QString captureError;
             QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > captureStats;
             bool ok = _pcapManager->fillStatistics(device, captureStats, captureError);
             if (!ok) {
-                // Encountered an error. Let listeners know.
+                // Encountered an error. Let listeners know. Deltas start over with a keyframe.
                 emit failure(device, captureError);
+                resync(device);
             } else {
-                // Send update to listeners.
-                QList<CommunicationFlow> flows;
-                createFlows(captureStats, flows);
-                emit update(device, flows);
+                // All flows are created at most once, for the usual kinds of update and any selections of all flows.
+                bool correlate = !CaptureSettings::isReplayDevice(device);
+                QList<CommunicationFlow> allFlows;
+                bool allFlowsCreated = false;
+                if (defaultDue) {
+                    createFlows(captureStats, correlate, FlowSelection(), allFlows);
+                    allFlowsCreated = true;
+                    if (_fullInterestMs.contains(device)) {
+                        emit update(device, allFlows);
+                    }
+                    if (_packedInterestMs.contains(device) || _sharedInterestMs.contains(device)) {
+                        QByteArray packedFlows = FlowBatchCodec::encode(allFlows);
+                        if (_packedInterestMs.contains(device)) {
+                            emit updatePacked(device, packedFlows);
+                        }
+                        if (_sharedInterestMs.contains(device)) {
+                            publishShared(device, packedFlows);
+                        }
+                    }
+                    if (_deltaStates.contains(device)) {
+                        emitDelta(device, allFlows);
+                    }
+                }
+                QListIterator<FlowSelection> k(dueSelections);
+                while (k.hasNext()) {
+                    const FlowSelection& selection = k.next();
+                    if (selection.isRestrictive()) {
+                        QList<CommunicationFlow> flows;
+                        createFlows(captureStats, correlate, selection, flows);
+                        emit updateSelected(device, selection, flows);
+                    } else {
+                        if (!allFlowsCreated) {
+                            createFlows(captureStats, correlate, FlowSelection(), allFlows);
+                            allFlowsCreated = true;
+                        }
+                        emit updateSelected(device, selection, allFlows);
+                    }
+                }
+            }
+        }
+        if (updateDue) {
+            _lastUpdateMs.insert(device, currTime);
+        }
+        // If the capture encountered an error or expired, release it so we won't consider it next time. Clients
+        // must show interest again.
+        if ((updateDue || !dueSelections.isEmpty()) && !_pcapManager->isActive(device)) {
+            _pcapManager->release(device);
+            _lastUpdateMs.remove(device);
+            _fullInterestMs.remove(device);
+            _packedInterestMs.remove(device);
+            _sharedInterestMs.remove(device);
+            retireSharedRing(device);
+            _selectionStates.remove(device);
+            _deltaStates.remove(device);
+        }
+    }
+
+    // Sleep once there's nothing left to watch, until a client shows interest again. Else, wake up at the pace of the
+    // traffic.
+    if (devices.isEmpty() && !hasInterest()) {
+        _timer.stop();
+    } else {
+        scheduleWakeUps(allQuiet ? qMax(_timerIntervalMs, QUIET_INTERVAL_MS) : _timerIntervalMs);
+    }
+}
+
+bool Watcher::correlateInBackground() {
+    if (_refreshing) {
+        return _correlator->correlate(_pendingConnectionProcesses, _correlationError);
+    } else {
+        return _correlator->correlateEndpoints(_pendingEndpoints, _pendingConnectionProcesses, _correlationError);
+    }
+}
+
+void Watcher::correlationFinished() {
+    _pendingEndpoints.clear();
+    if (_correlationWatcher.result()) {
+        if (_refreshing) {
+            _connectionProcesses = _pendingConnectionProcesses;
+        } else {
+            // Add the newly matched endpoint pairs to the last correlation.
+            QHashIterator<IpEndpointPair, QList<OsProcess> > i(_pendingConnectionProcesses);
+            while (i.hasNext()) {
+                i.next();
+                _connectionProcesses.insert(i.key(), i.value());
             }
-            // If the capture encountered an error or expired, release it so we won't consider it next time.
-            if (!_pcapManager->isActive(device)) {
-                _pcapManager->release(device);
+        }
+        _pendingConnectionProcesses.clear();
+
+        // Endpoint pairs noted while the correlation ran may have been matched by it.
+        QMutableSetIterator<IpEndpointPair> j(_unmatchedEndpoints);
+        while (j.hasNext()) {
+            if (_connectionProcesses.contains(j.next())) {
+                j.remove();
             }
         }
-        _lastUpdateMs = currTime;
+    } else {
+        // Connection-process correlation failed. Cancel all packet captures. Start over with a full correlation.
+        _connectionProcesses.clear();
+        _unmatchedEndpoints.clear();
+        _endpointLookups.clear();
+        _lastRefreshMs = 0;
+        QStringList devices = _pcapManager->findCurrentDevices();
+        if (!devices.isEmpty()) {
+            QListIterator<QString> i(devices);
+            while (i.hasNext()) {
+                const QString& device = i.next();
+                emit failure(device, _correlationError);
+            }
+            _pcapManager->releaseAll();
+            _fullInterestMs.clear();
+            _packedInterestMs.clear();
+            _sharedInterestMs.clear();
+            _selectionStates.clear();
+            QListIterator<QString> j(_sharedRings.keys());
+            while (j.hasNext()) {
+                retireSharedRing(j.next());
+            }
+            _deltaStates.clear();
+        }
     }
 }
 
@@ -129,36 +407,202 @@ QStringList Watcher::findDevices(QString& error) const {
 }
 
 void Watcher::createFlows(const QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& captureStats,
-        QList<CommunicationFlow>& result) {
+        bool correlate, const FlowSelection& selection, QList<CommunicationFlow>& result) {
 
-    if (!captureStats.isEmpty() && !_connectionProcesses.isEmpty()) {
-        // Iterate over the smaller of the two hashes.
-        QListIterator<IpEndpointPair>* iter = NULL;
-        if (captureStats.size() > _connectionProcesses.size()) {
-            iter = new QListIterator<IpEndpointPair>(_connectionProcesses.uniqueKeys());
-        } else {
-            iter = new QListIterator<IpEndpointPair>(captureStats.uniqueKeys());
-        }
-        while (iter->hasNext()) {
-            const IpEndpointPair& ipEndpointPair = iter->next();
-            if (_connectionProcesses.contains(ipEndpointPair) && captureStats.contains(ipEndpointPair)) {
-                // Endpoints appear in the kernel connection table and the packet capture. Add to result.
-                const QPair<FlowMetrics, FlowStatistics>& numbers = captureStats[ipEndpointPair];
-                IpEndpointPair flowEndpoints = ipEndpointPair;
-                if (_resolveNames) {
-                    QString hostName = _hostNameResolver.resolve(flowEndpoints.getRemoteAddr().toString());
-                    flowEndpoints.setRemoteHostName(hostName);
-                }
-                QList<OsProcess> osProcesses = _connectionProcesses[ipEndpointPair];
-                sortProcesses(osProcesses);
-                CommunicationFlow flow(flowEndpoints, osProcesses, numbers.first, numbers.second);
-                result.append(flow);
+    // Without a filter or limit, every match becomes a flow right away. Else, the matches that pass the filter are
+    // collected first, and flows are created only for the busiest of them.
+    bool restrictive = selection.isRestrictive();
+    QVector<SelectionCandidate> candidates;
+    for (CaptureStatsIterator iter = captureStats.constBegin(); iter != captureStats.constEnd(); ++iter) {
+        const IpEndpointPair& ipEndpointPair = iter.key();
+        if (!correlate || _connectionProcesses.contains(ipEndpointPair)) {
+            // Endpoints appear in the kernel connection table and the packet capture (or we don't care). Add to
+            // result.
+            if (!restrictive) {
+                result.append(createFlow(ipEndpointPair, iter.value()));
+            } else if (selection.matches(ipEndpointPair, _connectionProcesses.value(ipEndpointPair))) {
+                SelectionCandidate candidate;
+                candidate.value = selection.sortValue(iter.value().first, iter.value().second);
+                candidate.entry = iter;
+                candidates.append(candidate);
+            }
+        } else if (_endpointLookups.value(ipEndpointPair) < MAX_ENDPOINT_LOOKUPS) {
+            // Not matched yet, but it may still turn up. Look for it next time.
+            _unmatchedEndpoints.insert(ipEndpointPair);
+        }
+    }
+
+    // Partially sort the candidates so that the busiest come first in order. The rest stay unsorted.
+    int count = candidates.size();
+    if (selection.getLimit() > 0) {
+        count = qMin(count, selection.getLimit());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), busierThan);
+    }
+    for (int i = 0; i < count; i++) {
+        result.append(createFlow(candidates.at(i).entry.key(), candidates.at(i).entry.value()));
+    }
+}
+
+QList<CommunicationFlow> Watcher::fetchHistory(const QString& device, int windowSecs, QString& error) {
+    QList<CommunicationFlow> result;
+    if (windowSecs <= 0) {
+        error = tr("Invalid history range: %1 seconds").arg(windowSecs);
+        return result;
+    }
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > captureStats;
+    if (_pcapManager->fillHistory(device, windowSecs, captureStats, error)) {
+        QHashIterator<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > i(captureStats);
+        while (i.hasNext()) {
+            i.next();
+            result.append(createFlow(i.key(), i.value()));
+        }
+    }
+    return result;
+}
+
+CommunicationFlow Watcher::createFlow(const IpEndpointPair& ipEndpointPair,
+        const QPair<FlowMetrics, FlowStatistics>& numbers) {
+    IpEndpointPair flowEndpoints = ipEndpointPair;
+    if (_resolveNames) {
+        QString hostName = _hostNameResolver.resolve(flowEndpoints.getRemoteAddr().toString());
+        flowEndpoints.setRemoteHostName(hostName);
+    }
+    QList<OsProcess> osProcesses = _connectionProcesses.value(ipEndpointPair);
+    sortProcesses(osProcesses);
+    return CommunicationFlow(flowEndpoints, osProcesses, numbers.first, numbers.second);
+}
+
+void Watcher::emitDelta(const QString& device, const QList<CommunicationFlow>& flows) {
+    DeltaState& state = _deltaStates[device];
+    bool keyframe = state.sinceKeyframe < 0 || state.sinceKeyframe >= KEYFRAME_INTERVAL;
+
+    // Find the flows that were added or changed since the last delta. The remote host name isn't part of endpoint pair
+    // equality, so it's compared separately.
+    QHash<IpEndpointPair, CommunicationFlow> current;
+    current.reserve(flows.size());
+    QList<CommunicationFlow> changed;
+    QListIterator<CommunicationFlow> i(flows);
+    while (i.hasNext()) {
+        const CommunicationFlow& flow = i.next();
+        IpEndpointPair ipEndpointPair = flow.getIpEndpointPair();
+        if (!keyframe) {
+            QHash<IpEndpointPair, CommunicationFlow>::const_iterator last = state.flows.constFind(ipEndpointPair);
+            if (last == state.flows.constEnd() || !(last.value() == flow)
+                    || last.value().getIpEndpointPair().getRemoteHostName() != ipEndpointPair.getRemoteHostName()) {
+                changed.append(flow);
             }
         }
-        delete iter;
-        iter = NULL;
+        current.insert(ipEndpointPair, flow);
     }
 
+    // Find the flows that are gone.
+    QList<IpEndpointPair> removed;
+    if (!keyframe) {
+        QHashIterator<IpEndpointPair, CommunicationFlow> j(state.flows);
+        while (j.hasNext()) {
+            j.next();
+            if (!current.contains(j.key())) {
+                removed.append(j.key());
+            }
+        }
+    }
+
+    state.flows = current;
+    state.sequence++;
+    state.sinceKeyframe = keyframe ? 0 : state.sinceKeyframe + 1;
+    emit updateDelta(device, state.sequence, keyframe, keyframe ? flows : changed, removed);
+}
+
+void Watcher::publishShared(const QString& device, const QByteArray& packedFlows) {
+    SharedFlowRing* ring = _sharedRings.value(device);
+    if (!ring) {
+        return;
+    }
+    if (packedFlows.size() > ring->getSlotSize()) {
+        // Outgrown. Leave some room to grow further before the next replacement.
+        SharedFlowRing* largerRing = new SharedFlowRing;
+        QString error;
+        if (!largerRing->create(SHARED_RING_SLOTS, qMax(ring->getSlotSize() * 2, packedFlows.size()), error)) {
+            qWarning("[%s]: Skipped a shared update. %s", device.toLatin1().constData(), error.toLatin1().constData());
+            delete largerRing;
+            return;
+        }
+        retireSharedRing(device);
+        _sharedRings.insert(device, largerRing);
+        ring = largerRing;
+    }
+    ring->publish(++_sharedSequence, packedFlows);
+    emit updateShared(device, _sharedSequence);
+}
+
+void Watcher::retireSharedRing(const QString& device) {
+    SharedFlowRing* ring = _sharedRings.take(device);
+    if (ring) {
+        ring->retire();
+        delete ring;
+    }
+}
+
+void Watcher::expireInterest(qlonglong currTime) {
+    expireTimes(_fullInterestMs, currTime - INTEREST_TIMEOUT_MS);
+    expireTimes(_packedInterestMs, currTime - INTEREST_TIMEOUT_MS);
+    QMutableHashIterator<QString, qlonglong> i(_sharedInterestMs);
+    while (i.hasNext()) {
+        if (i.next().value() <= currTime - INTEREST_TIMEOUT_MS) {
+            retireSharedRing(i.key());
+            i.remove();
+        }
+    }
+    QMutableHashIterator<QString, DeltaState> j(_deltaStates);
+    while (j.hasNext()) {
+        if (j.next().value().interestMs <= currTime - INTEREST_TIMEOUT_MS) {
+            j.remove();
+        }
+    }
+    QMutableHashIterator<QString, QHash<FlowSelection, SelectionState> > k(_selectionStates);
+    while (k.hasNext()) {
+        QHash<FlowSelection, SelectionState>& states = k.next().value();
+        QMutableHashIterator<FlowSelection, SelectionState> l(states);
+        while (l.hasNext()) {
+            if (l.next().value().interestMs <= currTime - INTEREST_TIMEOUT_MS) {
+                l.remove();
+            }
+        }
+        if (states.isEmpty()) {
+            k.remove();
+        }
+    }
+}
+
+bool Watcher::hasInterest() const {
+    return !_fullInterestMs.isEmpty() || !_packedInterestMs.isEmpty() || !_sharedInterestMs.isEmpty()
+            || !_selectionStates.isEmpty() || !_deltaStates.isEmpty();
+}
+
+bool Watcher::anyTraffic(const QStringList& devices, int secs) const {
+    QListIterator<QString> i(devices);
+    while (i.hasNext()) {
+        if (!_pcapManager->isIdle(i.next(), secs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Watcher::wakeUp(const QString& device, bool newSubscription) {
+    if (newSubscription) {
+        _lastUpdateMs.remove(device);
+        scheduleWakeUps(_timerIntervalMs);
+    } else if (!_timer.isActive()) {
+        scheduleWakeUps(_timerIntervalMs);
+    }
+}
+
+void Watcher::scheduleWakeUps(int intervalMs) {
+    if (!_timer.isActive() || _wakeUpIntervalMs != intervalMs) {
+        _wakeUpIntervalMs = intervalMs;
+        _timer.start(intervalMs, this);
+    }
 }
 
 void Watcher::sortProcesses(QList<OsProcess>& osProcesses) {
@@ -20,10 +20,15 @@
 
 #include "HostNameResolver.h"
 #include "IPcapManager.h"
+#include "FlowSelection.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QBasicTimer>
 #include <QtCore/QHash>
 #include <QtCore/QDebug>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QSet>
+#include <QtCore/QString>
 
 class PcapThread;
 class QTimerEvent;
@@ -36,12 +41,18 @@ class CommunicationFlow;
 class FlowMetrics;
 class FlowStatistics;
 class IConnectionProcessCorrelator;
+class QByteArray;
+class SharedFlowRing;
 
 
 /*
  * Main interface that provides access to real-time traffic flows. Fetch methods must be
  * invoked with high privilege (i.e. root or whatever privilege is required to perform packet
  * captures and access all process file descriptors on the host).
+ *
+ * The watcher only wakes up while clients are interested in some device. Each time, it fetches the capture statistics
+ * of a device once and hands them to every kind of update that is due. A device that hasn't seen traffic for a while
+ * backs off to being updated once per quiet interval, and while none has, so does waking up.
  */
 class Watcher : public QObject {
     Q_OBJECT
@@ -52,7 +63,7 @@ public:
     // New instance with the given helpers and time intervals. Useful for unit testing. This object takes ownership over
     // the helpers' memory. Time intervals can also be set here.
     Watcher(IConnectionProcessCorrelator* correlator, IPcapManager* pcapManager, int timerIntervalMs, int updateIntervalMs,
-            int correlationIntervalMs);
+            int correlationIntervalMs, int refreshIntervalMs);
 
     virtual ~Watcher();
 
@@ -69,6 +80,19 @@ public:
     bool getOsProcessSortAscending() const { return _osProcessSortAscending; }
     void setOsProcessSortAscending(bool osProcessSortAscending) { _osProcessSortAscending  = osProcessSortAscending; }
 
+    // Fetch the traffic of a device over a longer time range of the given number of seconds (up to an hour) from
+    // the device's downsampled history. Unlike updates, the result includes flows whose connections have closed;
+    // their process lists are empty. The device must be watched already. Updates the error argument if the history
+    // cannot be obtained.
+    QList<CommunicationFlow> fetchHistory(const QString& device, int windowSecs, QString& error);
+
+    // Same as "showInterest", but the watcher publishes updates for the device to a ring in shared memory and emits
+    // "updateShared" signals instead of "update" signals. All clients of a device share its ring. Returns a new
+    // read-only descriptor of the ring, which the caller must close, or -1 if the ring can't be created or opened, in
+    // which case the error argument is populated. Clients call this periodically like "showInterest" and map the ring
+    // again when they get a descriptor of a different one.
+    int openSharedRing(const QString& device, QString& error);
+
     // A custom pcap filter applied across all devices.
     QString getCustomFilter() const { return _pcapManager->getCustomFilter(); }
     void setCustomFilter(const QString& customFilter) { _pcapManager->setCustomFilter(customFilter); }
@@ -84,10 +108,43 @@ public slots:
     // "findDevices" to see what devices are available.
     void showInterest(const QString& device);
 
+    // Same as "showInterest", but the watcher emits "updateDelta" signals for the device instead of "update" signals.
+    // Each kind of update is only emitted while some client shows interest in it.
+    void showDeltaInterest(const QString& device);
+
+    // Same as "showInterest", but the watcher emits "updatePacked" signals for the device instead of "update" signals.
+    void showPackedInterest(const QString& device);
+
+    // Same as "showInterest", but the watcher emits "updateSelected" signals for the device with only the flows of the
+    // selection instead of "update" signals. Each distinct selection is a subscription of its own, updated at its own
+    // interval. If the selection is invalid, no action is taken.
+    void showSelectedInterest(const QString& device, const FlowSelection& selection);
+
+    // Make the next delta update for the device a keyframe. Clients call this when they miss an update.
+    void resync(const QString& device);
+
 signals:
     // Traffic update for the specified device.
     void update(const QString& device, const QList<CommunicationFlow>& flows);
 
+    // Traffic update for the specified device that carries only the flows added or changed since the previous delta
+    // update and the endpoint pairs of the flows that were removed. Sequence numbers count up by one per device. A
+    // keyframe carries all current flows (and no removals) and replaces the previous ones. Keyframes are emitted
+    // periodically, after a failure, and when asked for by "resync".
+    void updateDelta(const QString& device, qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+            const QList<IpEndpointPair>& removed);
+
+    // Traffic update for the specified device with the flows packed into a compact byte array by FlowBatchCodec.
+    void updatePacked(const QString& device, const QByteArray& flows);
+
+    // Traffic update for the specified device with the flows of a selection that clients showed interest in. Clients
+    // ignore the updates of other selections.
+    void updateSelected(const QString& device, const FlowSelection& selection, const QList<CommunicationFlow>& flows);
+
+    // Indicates that the snapshot with the given sequence number is in the shared ring of the specified device. The
+    // sequence numbers of all devices' snapshots count up together.
+    void updateShared(const QString& device, qulonglong sequence);
+
     // Indicates a failure watching the given device. After a failure signal, there will be no further updates until
     // a client shows interest in the device again.
     void failure(const QString& device, const QString& error);
@@ -96,14 +153,55 @@ protected:
     // Perform periodic tasks (emit signals, compute statistics, etc.).
     void timerEvent(QTimerEvent* event);
 
+private slots:
+    // Take the result of a background correlation. On failure, all packet captures are cancelled.
+    void correlationFinished();
+
 private:
+    // Correlate OS connections and processes into the pending result. Runs on a worker thread.
+    bool correlateInBackground();
+
     // Generate communication flows by matching up packet capture statistics to corresponding OS
-    // connections and processes. For each match, a row is added to the result argument. Optionally,
-    // host names will be resolved in this step. If the same socket (IP endpoint pair) is shared by
+    // connections and processes. For each match, a row is added to the result argument. Endpoint pairs without a
+    // match are noted for the next targeted correlation unless they have been looked for too often. Optionally, host
+    // names will be resolved in this step. If the same socket (IP endpoint pair) is shared by
     // multiple processes, the process list in the resultant communication flow object is ordered
-    // according to the watcher's "OS process sort asending" property.
-    void createFlows(const QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& captureStats,
-            QList<CommunicationFlow>& result);
+    // according to the watcher's "OS process sort asending" property. If the correlate argument is false (e.g. for
+    // replayed traffic, which has no local connections), all endpoint pairs are added without looking for a match.
+    // Only the flows of the given selection are added. Its filter and limit apply before any flows are created.
+    void createFlows(const QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& captureStats, bool correlate,
+            const FlowSelection& selection, QList<CommunicationFlow>& result);
+
+    // Create a communication flow from the capture statistics of one endpoint pair and the processes (if any)
+    // currently using the connection. Optionally, the remote host name is resolved in this step.
+    CommunicationFlow createFlow(const IpEndpointPair& ipEndpointPair, const QPair<FlowMetrics, FlowStatistics>& numbers);
+
+    // Emit a delta update for a device with the given current flows, comparing them to the last flows emitted.
+    void emitDelta(const QString& device, const QList<CommunicationFlow>& flows);
+
+    // Publish packed flows to the shared ring of a device and emit an "updateShared" signal. If they don't fit, the
+    // ring is replaced with one of larger slots.
+    void publishShared(const QString& device, const QByteArray& packedFlows);
+
+    // Retire and delete the shared ring of a device, if any. Clients keep their mappings until they notice.
+    void retireSharedRing(const QString& device);
+
+    // Forget interest that has timed out, along with the delta state of devices nobody wants deltas of anymore.
+    void expireInterest(qlonglong currTime);
+
+    // True if clients are interested in any kind of update of any device.
+    bool hasInterest() const;
+
+    // True if any of the devices has seen traffic in the last given number of seconds.
+    bool anyTraffic(const QStringList& devices, int secs) const;
+
+    // Make sure the watcher wakes up for a subscription to a device that clients showed interest in. A new subscription
+    // brings the watcher back to its usual pace even if it has backed off, and the next wake-up sends the usual kinds
+    // of update of the device.
+    void wakeUp(const QString& device, bool newSubscription);
+
+    // Wake up at the given interval from now on.
+    void scheduleWakeUps(int intervalMs);
 
     // Sort the list of processes according to this watcher's "OS process sort asending" property.
     // If true, processes are sorted oldest-to-newest. Else, newest-to-oldest. Returns a reference
@@ -127,6 +225,10 @@ private:
     static const int DEFAULT_TIMER_INTERVAL_MS;
     const int _timerIntervalMs;
 
+    // Least interval between updates of any kind of a device that hasn't seen traffic for that long, and between
+    // wake-ups while no device has.
+    static const int QUIET_INTERVAL_MS;
+
     // Interval between update signals.
     static const int DEFAULT_UPDATE_INTERVAL_MS;
     const int _updateIntervalMs;
@@ -135,15 +237,93 @@ private:
     static const int DEFAULT_CORRELATION_INTERVAL_MS;
     const int _correlationIntervalMs;
 
-    // Time we last emitted a signal with a traffic update (or error) for devices.
-    qlonglong _lastUpdateMs;
+    // Interval between full correlations, which refresh the processes of known connections and forget closed ones.
+    // In between, only endpoint pairs without a match are correlated.
+    static const int DEFAULT_REFRESH_INTERVAL_MS;
+    const int _refreshIntervalMs;
+
+    // Most endpoint pairs to correlate in a targeted correlation. If there are more, a full correlation is cheaper.
+    static const int MAX_TARGETED_ENDPOINTS;
+
+    // Most targeted correlations that look for an endpoint pair without a match between full correlations.
+    static const int MAX_ENDPOINT_LOOKUPS;
+
+    // Time after which interest in a kind of update runs out unless it's renewed.
+    static const int INTEREST_TIMEOUT_MS;
+
+    // Number of delta updates between keyframes.
+    static const int KEYFRAME_INTERVAL;
+
+    // Number of slots in shared rings, and the initial size of each.
+    static const int SHARED_RING_SLOTS;
+    static const int SHARED_RING_SLOT_SIZE;
+
+    // Time we last emitted signals with the full, packed, shared, and delta updates (or errors) for each device. A
+    // device without one is due right away.
+    QHash<QString, qlonglong> _lastUpdateMs;
+
+    // Timer of the wake-ups, if clients are interested in anything, and its current interval.
+    QBasicTimer _timer;
+    int _wakeUpIntervalMs;
 
     // Time we last correlated OS connections with processes.
     qlonglong _lastCorrelationMs;
 
+    // Time of the last full correlation (or 0 if the next correlation must be a full one).
+    qlonglong _lastRefreshMs;
+
     // The most recent correlation of OS connections and processes.
     QHash<IpEndpointPair, QList<OsProcess> > _connectionProcesses;
 
+    // Correlation in progress on a worker thread, with its result and error. The worker owns the result and error until
+    // it finishes.
+    QFutureWatcher<bool> _correlationWatcher;
+    QHash<IpEndpointPair, QList<OsProcess> > _pendingConnectionProcesses;
+    QString _correlationError;
+
+    // True if the correlation in progress is a full one. Else, it's a targeted one for the pending endpoint pairs.
+    bool _refreshing;
+    QSet<IpEndpointPair> _pendingEndpoints;
+
+    // Captured endpoint pairs without a match to look for in the next correlation.
+    QSet<IpEndpointPair> _unmatchedEndpoints;
+
+    // Number of correlations that looked for captured endpoint pairs without a match since the last full correlation
+    // started. A full correlation counts as the most there can be. Pairs are looked for until they're matched or the
+    // count reaches the max, and then not again until after the next full correlation.
+    QHash<IpEndpointPair, int> _endpointLookups;
+
+    // Time clients last showed interest in each device's full, packed, and shared updates.
+    QHash<QString, qlonglong> _fullInterestMs;
+    QHash<QString, qlonglong> _packedInterestMs;
+    QHash<QString, qlonglong> _sharedInterestMs;
+
+    // Updates of a selection: time clients last showed interest in them and time the last one was emitted (or 0 if
+    // none has been).
+    struct SelectionState {
+        SelectionState() : interestMs(0), lastUpdateMs(0) { }
+        qlonglong interestMs;
+        qlonglong lastUpdateMs;
+    };
+
+    // Updates of each selection of each device.
+    QHash<QString, QHash<FlowSelection, SelectionState> > _selectionStates;
+
+    // Shared rings of snapshots by device, and the sequence number of the last snapshot published to any of them.
+    QHash<QString, SharedFlowRing*> _sharedRings;
+    qulonglong _sharedSequence;
+
+    // Delta updates of a device: time clients last showed interest in them, the sequence number of the last one, the
+    // number emitted since the last keyframe (or -1 if the next must be a keyframe), and the flows they add up to.
+    struct DeltaState {
+        DeltaState() : interestMs(0), sequence(0), sinceKeyframe(-1) { }
+        qlonglong interestMs;
+        qulonglong sequence;
+        int sinceKeyframe;
+        QHash<IpEndpointPair, CommunicationFlow> flows;
+    };
+    QHash<QString, DeltaState> _deltaStates;
+
     // Correlates the current OS connections and processes.
     IConnectionProcessCorrelator* _correlator;
 
@@ -22,14 +22,23 @@
 #include "OsProcess.h"
 #include "FlowMetrics.h"
 #include "FlowStatistics.h"
+#include "FlowBatchCodec.h"
+#include "FlowSelection.h"
+#include "SharedFlowRing.h"
 
 #include <QtDBus/QDBusReply>
+#include <QtDBus/QDBusPendingCallWatcher>
+#include <QtDBus/QDBusPendingReply>
+#ifdef HAVE_UNIX_FD_PASSING
+#include <QtDBus/QDBusUnixFileDescriptor>
+#endif
 #include <QtCore/QString>
 #include <QtCore/QList>
 #include <QtCore/QStringList>
 
 WatcherClient::WatcherClient(const QDBusConnection& connection, QObject* parent)
-    : QDBusAbstractInterface("org.socketsentry.Watcher", "/Watcher", staticInterfaceName(), connection, parent) {
+    : QDBusAbstractInterface("org.socketsentry.Watcher", "/Watcher", staticInterfaceName(), connection, parent),
+      _sharedRingsUnavailable(false) {
 
     qDBusRegisterMetaType<IpEndpointPair>();
     qDBusRegisterMetaType<FlowMetrics>();
@@ -38,6 +47,16 @@ WatcherClient::WatcherClient(const QDBusConnection& connection, QObject* parent)
     qDBusRegisterMetaType<CommunicationFlow>();
     qDBusRegisterMetaType<QList<CommunicationFlow> >();
     qDBusRegisterMetaType<QList<OsProcess> >();
+    qDBusRegisterMetaType<QList<IpEndpointPair> >();
+    qDBusRegisterMetaType<FlowSelection>();
+
+    connect(this, SIGNAL(updateDelta(const QString&, qulonglong, bool, const QList<CommunicationFlow>&,
+            const QList<IpEndpointPair>&)), this, SLOT(applyDelta(const QString&, qulonglong, bool,
+            const QList<CommunicationFlow>&, const QList<IpEndpointPair>&)));
+    connect(this, SIGNAL(updatePacked(const QString&, const QByteArray&)),
+            this, SLOT(unpackUpdate(const QString&, const QByteArray&)));
+    connect(this, SIGNAL(updateShared(const QString&, qulonglong)), this, SLOT(readShared(const QString&, qulonglong)));
+    connect(this, SIGNAL(failure(const QString&, const QString&)), this, SLOT(forgetDelta(const QString&)));
 
     // Tickle the service to make sure it's up. Without this, automatic relay of signals doesn't
     // seem to work starting with Qt 4.6 / KDE 4.4. (Older versions worked fine.)
@@ -45,6 +64,7 @@ WatcherClient::WatcherClient(const QDBusConnection& connection, QObject* parent)
 }
 
 WatcherClient::~WatcherClient() {
+    qDeleteAll(_sharedRings);
 }
 
 void WatcherClient::showInterest(const QString& device) {
@@ -53,6 +73,118 @@ void WatcherClient::showInterest(const QString& device) {
     callWithArgumentList(QDBus::NoBlock, QLatin1String("showInterest"), argumentList);
 }
 
+void WatcherClient::showDeltaInterest(const QString& device) {
+    QList<QVariant> argumentList;
+    argumentList << qVariantFromValue(device);
+    callWithArgumentList(QDBus::NoBlock, QLatin1String("showDeltaInterest"), argumentList);
+}
+
+void WatcherClient::showPackedInterest(const QString& device) {
+    QList<QVariant> argumentList;
+    argumentList << qVariantFromValue(device);
+    callWithArgumentList(QDBus::NoBlock, QLatin1String("showPackedInterest"), argumentList);
+}
+
+void WatcherClient::showSelectedInterest(const QString& device, const FlowSelection& selection) {
+    QList<QVariant> argumentList;
+    argumentList << qVariantFromValue(device) << qVariantFromValue(selection);
+    callWithArgumentList(QDBus::NoBlock, QLatin1String("showSelectedInterest"), argumentList);
+}
+
+void WatcherClient::showSharedInterest(const QString& device) {
+#ifdef HAVE_UNIX_FD_PASSING
+    bool canPassFds = connection().connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing;
+    if (!_sharedRingsUnavailable && canPassFds) {
+        QList<QVariant> argumentList;
+        argumentList << qVariantFromValue(device);
+        QDBusPendingCallWatcher* call = new QDBusPendingCallWatcher(
+                asyncCallWithArgumentList(QLatin1String("openSharedRing"), argumentList), this);
+        _openingRings.insert(call, device);
+        connect(call, SIGNAL(finished(QDBusPendingCallWatcher*)),
+                this, SLOT(sharedRingOpened(QDBusPendingCallWatcher*)));
+        return;
+    }
+#endif
+    showDeltaInterest(device);
+}
+
+void WatcherClient::resync(const QString& device) {
+    QList<QVariant> argumentList;
+    argumentList << qVariantFromValue(device);
+    callWithArgumentList(QDBus::NoBlock, QLatin1String("resync"), argumentList);
+}
+
+void WatcherClient::applyDelta(const QString& device, qulonglong sequence, bool keyframe,
+        const QList<CommunicationFlow>& flows, const QList<IpEndpointPair>& removed) {
+    FlowDeltaTracker& tracker = _deltaTrackers[device];
+    // Ask for a resync only once after losing track, not for every update until the keyframe.
+    bool lostTrack = tracker.isSynchronized() || tracker.getSequence() == 0;
+    if (tracker.apply(sequence, keyframe, flows, removed)) {
+        emit flowsUpdated(device, tracker.getFlows());
+    } else if (lostTrack) {
+        resync(device);
+    }
+}
+
+void WatcherClient::unpackUpdate(const QString& device, const QByteArray& flows) {
+    QList<CommunicationFlow> result;
+    QString error;
+    if (FlowBatchCodec::decode(flows, result, error)) {
+        emit flowsUpdated(device, result);
+    } else {
+        qWarning("[%s]: Dropped a packed update. %s", device.toLatin1().constData(), error.toLatin1().constData());
+    }
+}
+
+void WatcherClient::readShared(const QString& device, qulonglong sequence) {
+    SharedFlowRing* ring = _sharedRings.value(device);
+    if (!ring) {
+        return;
+    }
+    QList<CommunicationFlow> flows;
+    if (ring->read(sequence, flows)) {
+        emit flowsUpdated(device, flows);
+    } else if (ring->isRetired()) {
+        showSharedInterest(device);
+    }
+}
+
+void WatcherClient::sharedRingOpened(QDBusPendingCallWatcher* call) {
+    QString device = _openingRings.take(call);
+    call->deleteLater();
+#ifdef HAVE_UNIX_FD_PASSING
+    QDBusPendingReply<QDBusUnixFileDescriptor> reply = *call;
+    QString error;
+    if (reply.isError()) {
+        error = reply.error().message();
+    } else {
+        int fd = reply.value().fileDescriptor();
+        SharedFlowRing* ring = _sharedRings.value(device);
+        if (ring && ring->isSameRing(fd)) {
+            return;
+        }
+        SharedFlowRing* newRing = new SharedFlowRing;
+        if (newRing->attach(fd, error)) {
+            delete ring;
+            _sharedRings.insert(device, newRing);
+            return;
+        }
+        delete newRing;
+    }
+    // Stop reading rings altogether, so no device gets both delta and shared updates.
+    qWarning("[%s]: Using delta updates instead of a shared ring. %s", device.toLatin1().constData(),
+            error.toLatin1().constData());
+    _sharedRingsUnavailable = true;
+    qDeleteAll(_sharedRings);
+    _sharedRings.clear();
+    showDeltaInterest(device);
+#endif
+}
+
+void WatcherClient::forgetDelta(const QString& device) {
+    _deltaTrackers.remove(device);
+}
+
 QStringList WatcherClient::findDevices(QString& error) {
     QDBusReply<QStringList> reply = call("findDevices");
     if(reply.isValid()) {
@@ -64,6 +196,17 @@ QStringList WatcherClient::findDevices(QString& error) {
     }
 }
 
+QList<CommunicationFlow> WatcherClient::fetchHistory(const QString& device, int windowSecs, QString& error) {
+    QDBusReply<QList<CommunicationFlow> > reply = call("fetchHistory", device, windowSecs);
+    if(reply.isValid()) {
+        return reply.value();
+    } else {
+        error = reply.error().message();
+        QList<CommunicationFlow> empty;
+        return empty;
+    }
+}
+
 bool WatcherClient::getResolveNames() {
     QDBusReply<bool> reply = call("getResolveNames");
     return reply.value();
@@ -18,16 +18,29 @@
 #ifndef WATCHERCLIENT_H_
 #define WATCHERCLIENT_H_
 
+#include "FlowDeltaTracker.h"
+
 #include <QtDBus/QtDBus>
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 
 class QString;
 class QDBusConnection;
 template <class E> class QList;
 class CommunicationFlow;
+class IpEndpointPair;
+class FlowSelection;
+class SharedFlowRing;
+class QDBusPendingCallWatcher;
 
 /*
- * Client proxy for Watcher D-Bus service.
+ * Client proxy for Watcher D-Bus service. For devices that the client shows delta, packed, or shared interest in, the
+ * proxy reconstructs the current flows from the service's delta updates, unpacks them from its packed updates, or
+ * reads them from the device's shared ring, and emits them with "flowsUpdated" signals. If it misses a delta update,
+ * it asks the service to resync and skips delta updates until the next keyframe.
+ *
+ * Shared interest needs a bus connection that passes file descriptors. Without one, or if the service can't open a
+ * shared ring, the proxy shows delta interest instead from then on.
  */
 class WatcherClient : public QDBusAbstractInterface {
     Q_OBJECT
@@ -41,6 +54,7 @@ public:
 
     // Refer to Watcher method declarations for information on these methods.
     QStringList findDevices(QString& error);
+    QList<CommunicationFlow> fetchHistory(const QString& device, int windowSecs, QString& error);
 
     bool getResolveNames();
     void setResolveNames(bool resolveNames);
@@ -55,11 +69,57 @@ public:
 public slots:
     // Refer to Watcher method declarations for information on these methods.
     Q_NOREPLY void showInterest(const QString& device);
+    Q_NOREPLY void showDeltaInterest(const QString& device);
+    Q_NOREPLY void showPackedInterest(const QString& device);
+    Q_NOREPLY void showSelectedInterest(const QString& device, const FlowSelection& selection);
+    Q_NOREPLY void resync(const QString& device);
+
+    // Show interest in a device's shared updates. The proxy opens the device's shared ring with the service's
+    // "openSharedRing" method, and maps it again if the service hands out a different one.
+    Q_NOREPLY void showSharedInterest(const QString& device);
 
 signals:
     // Refer to Watcher method declarations for information on these methods.
     void failure(const QString& device, const QString& error);
     void update(const QString& device, const QList<CommunicationFlow>& flows);
+    void updateDelta(const QString& device, qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+            const QList<IpEndpointPair>& removed);
+    void updatePacked(const QString& device, const QByteArray& flows);
+    void updateShared(const QString& device, qulonglong sequence);
+    void updateSelected(const QString& device, const FlowSelection& selection, const QList<CommunicationFlow>& flows);
+
+    // All current flows of a device, reconstructed from delta updates, unpacked from packed updates, or read from a
+    // shared ring. Not relayed from the service.
+    void flowsUpdated(const QString& device, const QList<CommunicationFlow>& flows);
+
+private slots:
+    // Apply a delta update to the device's flows and emit them if they're current.
+    void applyDelta(const QString& device, qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+            const QList<IpEndpointPair>& removed);
+
+    // Unpack a packed update and emit its flows.
+    void unpackUpdate(const QString& device, const QByteArray& flows);
+
+    // Read a snapshot from the device's shared ring and emit its flows. If the ring is retired, open the new one.
+    // Snapshots of devices without a ring are shared with other clients and ignored.
+    void readShared(const QString& device, qulonglong sequence);
+
+    // Map the shared ring that the service opened, or fall back to delta updates if it couldn't.
+    void sharedRingOpened(QDBusPendingCallWatcher* call);
+
+    // Forget the flows of a device that failed. The service sends a keyframe once the device is watched again.
+    void forgetDelta(const QString& device);
+
+private:
+    // Reconstructed flows by device.
+    QHash<QString, FlowDeltaTracker> _deltaTrackers;
+
+    // Mapped shared rings by device, and the devices of pending calls to open them.
+    QHash<QString, SharedFlowRing*> _sharedRings;
+    QHash<QDBusPendingCallWatcher*, QString> _openingRings;
+
+    // True if shared rings turned out to be unavailable.
+    bool _sharedRingsUnavailable;
 };
 
 #endif /* WATCHERCLIENT_H_ */
@@ -30,12 +30,24 @@
 // The interval between device interest renewals.
 const int WatcherClientConsolePrinter::RENEWAL_INTERVAL_MS = 5000;
 
-WatcherClientConsolePrinter::WatcherClientConsolePrinter(WatcherClient* parent) :
-    QObject(parent) {
+WatcherClientConsolePrinter::WatcherClientConsolePrinter(WatcherClient* parent, bool shared,
+        const FlowSelection& selection) :
+    QObject(parent), _selection(selection) {
 
-    connect(this, SIGNAL(renew(const QString&)), parent, SLOT(showInterest(const QString&)));
-    connect(parent, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)),
-            this, SLOT(printUpdate(const QString&, const QList<CommunicationFlow>&)));
+    if (!(selection == FlowSelection())) {
+        connect(this, SIGNAL(renewSelected(const QString&, const FlowSelection&)),
+                parent, SLOT(showSelectedInterest(const QString&, const FlowSelection&)));
+        connect(parent, SIGNAL(updateSelected(const QString&, const FlowSelection&, const QList<CommunicationFlow>&)),
+                this, SLOT(printSelectedUpdate(const QString&, const FlowSelection&, const QList<CommunicationFlow>&)));
+    } else if (shared) {
+        connect(this, SIGNAL(renew(const QString&)), parent, SLOT(showSharedInterest(const QString&)));
+        connect(parent, SIGNAL(flowsUpdated(const QString&, const QList<CommunicationFlow>&)),
+                this, SLOT(printUpdate(const QString&, const QList<CommunicationFlow>&)));
+    } else {
+        connect(this, SIGNAL(renew(const QString&)), parent, SLOT(showInterest(const QString&)));
+        connect(parent, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)),
+                this, SLOT(printUpdate(const QString&, const QList<CommunicationFlow>&)));
+    }
     connect(parent, SIGNAL(failure(const QString&, const QString&)),
             this, SLOT(printFailure(const QString&, const QString&)));
     startTimer(RENEWAL_INTERVAL_MS);
@@ -47,7 +59,15 @@ WatcherClientConsolePrinter::~WatcherClientConsolePrinter() {
 void WatcherClientConsolePrinter::timerEvent(QTimerEvent* event) {
     QSetIterator<QString> i(_devices);
     while (i.hasNext()) {
-        emit renew(i.next());
+        renewDevice(i.next());
+    }
+}
+
+void WatcherClientConsolePrinter::renewDevice(const QString& device) {
+    if (!(_selection == FlowSelection())) {
+        emit renewSelected(device, _selection);
+    } else {
+        emit renew(device);
     }
 }
 
@@ -63,6 +83,13 @@ void WatcherClientConsolePrinter::printUpdate(const QString& device, const QList
     out.flush();
 }
 
+void WatcherClientConsolePrinter::printSelectedUpdate(const QString& device, const FlowSelection& selection,
+        const QList<CommunicationFlow>& flows) {
+    if (selection == _selection) {
+        printUpdate(device, flows);
+    }
+}
+
 void WatcherClientConsolePrinter::printFailure(const QString& device, const QString& error) {
     QTextStream out(stdout);
     out << QString("[%1]: -- ERROR: %2").arg(device).arg(error) << endl;
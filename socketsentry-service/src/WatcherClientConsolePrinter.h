@@ -18,6 +18,8 @@
 #ifndef WATCHERCLIENTCONSOLEPRINTER_H_
 #define WATCHERCLIENTCONSOLEPRINTER_H_
 
+#include "FlowSelection.h"
+
 #include <QtCore/QObject>
 #include <QtCore/QSet>
 #include <QtCore/QString>
@@ -38,13 +40,17 @@ class WatcherClientConsolePrinter : public QObject {
     Q_OBJECT
 
 public:
-    WatcherClientConsolePrinter(WatcherClient* parent);
+    // New printer. If the selection isn't the default one (it restricts flows or has an update interval of its own), the
+    // printer shows interest in that selection of devices and prints its updates. Else, if the shared argument is true, it shows shared interest in devices and prints the flows read
+    // from the service's shared rings. Else, it prints full updates.
+    WatcherClientConsolePrinter(WatcherClient* parent, bool shared = false,
+            const FlowSelection& selection = FlowSelection());
     virtual ~WatcherClientConsolePrinter();
 
     // Add a device to the watch set.
     void addDevice(const QString& deviceName) {
         _devices.insert(deviceName);
-        emit renew(deviceName);
+        renewDevice(deviceName);
     }
 
     // Remove a device from the watch set.
@@ -52,6 +58,7 @@ public:
 
 signals:
     void renew(const QString& device);
+    void renewSelected(const QString& device, const FlowSelection& selection);
 
 protected:
     // Renew inteest in devices.
@@ -61,11 +68,21 @@ private slots:
     // Traffic update for the specified device.
     void printUpdate(const QString& device, const QList<CommunicationFlow>& flows);
 
+    // Traffic update for the specified device with the flows of a selection. Updates of other selections are ignored.
+    void printSelectedUpdate(const QString& device, const FlowSelection& selection,
+            const QList<CommunicationFlow>& flows);
+
     // Indicates a failure watching the given device. After a failure signal, there will be no further updates until
     // a client shows interest in the device again.
     void printFailure(const QString& device, const QString& error);
 
 private:
+    // Renew interest in a device.
+    void renewDevice(const QString& device);
+
+    // The selection of flows to print.
+    FlowSelection _selection;
+
     // Devvices we're interested in.
     QSet<QString> _devices;
 
@@ -30,6 +30,9 @@
 #include "OsProcess.h"
 #include "FlowMetrics.h"
 #include "FlowStatistics.h"
+#include "FlowSelection.h"
+
+#include <unistd.h>
 
 
 WatcherDBusAdaptor::WatcherDBusAdaptor(Watcher* parent) :
@@ -48,6 +51,8 @@ bool WatcherDBusAdaptor::openForBusiness(bool systemBus) {
     qDBusRegisterMetaType<CommunicationFlow>();
     qDBusRegisterMetaType<QList<CommunicationFlow> >();
     qDBusRegisterMetaType<QList<OsProcess> >();
+    qDBusRegisterMetaType<QList<IpEndpointPair> >();
+    qDBusRegisterMetaType<FlowSelection>();
     QDBusConnection dbus = systemBus ? QDBusConnection::systemBus() : QDBusConnection::sessionBus();
     if (!dbus.registerObject("/Watcher", _parent)) return false;
     if (!dbus.registerService("org.socketsentry.Watcher")) return false;
@@ -65,6 +70,49 @@ QStringList WatcherDBusAdaptor::findDevices(const QDBusMessage &msg) const {
     return result;
 }
 
+QList<CommunicationFlow> WatcherDBusAdaptor::fetchHistory(const QString& device, int windowSecs,
+        const QDBusMessage &msg) const {
+    QString error;
+    QList<CommunicationFlow> result = _parent->fetchHistory(device, windowSecs, error);
+    if(error.length() > 0) {
+        QDBusMessage reply = msg.createErrorReply("org.socketsentry.Failure", error);
+        QDBusConnection::systemBus().send(reply);
+    }
+    return result;
+}
+
+#ifdef HAVE_UNIX_FD_PASSING
+QDBusUnixFileDescriptor WatcherDBusAdaptor::openSharedRing(const QString& device, const QDBusMessage &msg) {
+    QString error;
+    int fd = _parent->openSharedRing(device, error);
+    if (fd < 0) {
+        QDBusMessage reply = msg.createErrorReply("org.socketsentry.Failure", error);
+        QDBusConnection::systemBus().send(reply);
+        return QDBusUnixFileDescriptor();
+    }
+    // The result holds a duplicate of the descriptor until the reply is sent.
+    QDBusUnixFileDescriptor result(fd);
+    ::close(fd);
+    return result;
+}
+#endif
+
 void WatcherDBusAdaptor::showInterest(const QString& device) {
     _parent->showInterest(device);
 }
+
+void WatcherDBusAdaptor::showDeltaInterest(const QString& device) {
+    _parent->showDeltaInterest(device);
+}
+
+void WatcherDBusAdaptor::showPackedInterest(const QString& device) {
+    _parent->showPackedInterest(device);
+}
+
+void WatcherDBusAdaptor::showSelectedInterest(const QString& device, const FlowSelection& selection) {
+    _parent->showSelectedInterest(device, selection);
+}
+
+void WatcherDBusAdaptor::resync(const QString& device) {
+    _parent->resync(device);
+}
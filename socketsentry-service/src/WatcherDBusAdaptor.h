@@ -22,11 +22,17 @@
 
 #include <QtDBus/QDBusAbstractAdaptor>
 #include <QtCore/QStringList>
+#ifdef HAVE_UNIX_FD_PASSING
+#include <QtDBus/QDBusUnixFileDescriptor>
+#endif
 
 class QDBusMessage;
 template <class E> class QList;
 class QStringList;
 class CommunicationFlow;
+class IpEndpointPair;
+class QByteArray;
+class FlowSelection;
 
 /*
  * D-Bus adaptor for the Watcher interface.
@@ -64,7 +70,16 @@ public slots:
 
     // Mirrors the public slots of Watcher, but takes a D-Bus message argument to relay errors back to the client.
     Q_NOREPLY void showInterest(const QString& device);
+    Q_NOREPLY void showDeltaInterest(const QString& device);
+    Q_NOREPLY void showPackedInterest(const QString& device);
+    Q_NOREPLY void showSelectedInterest(const QString& device, const FlowSelection& selection);
+    Q_NOREPLY void resync(const QString& device);
     QStringList findDevices(const QDBusMessage &msg) const;
+    QList<CommunicationFlow> fetchHistory(const QString& device, int windowSecs, const QDBusMessage &msg) const;
+#ifdef HAVE_UNIX_FD_PASSING
+    // Passing descriptors over D-Bus takes Qt 4.8. With older versions, clients fall back to other updates.
+    QDBusUnixFileDescriptor openSharedRing(const QString& device, const QDBusMessage &msg);
+#endif
 
     // This method simply returns true. Clients can call it to ensure the service is up.
     bool ping() const { return true; }
@@ -73,6 +88,19 @@ signals:
     // Traffic update for the specified device.
     void update(const QString& device, const QList<CommunicationFlow>& flows);
 
+    // Traffic update for the specified device carrying only the changes since the previous one (see Watcher).
+    void updateDelta(const QString& device, qulonglong sequence, bool keyframe, const QList<CommunicationFlow>& flows,
+            const QList<IpEndpointPair>& removed);
+
+    // Traffic update for the specified device with the flows packed into a byte array (see FlowBatchCodec).
+    void updatePacked(const QString& device, const QByteArray& flows);
+
+    // Traffic update for the specified device with the flows of a selection (see Watcher).
+    void updateSelected(const QString& device, const FlowSelection& selection, const QList<CommunicationFlow>& flows);
+
+    // Indicates that a snapshot of the specified device's flows is in its shared ring (see Watcher).
+    void updateShared(const QString& device, qulonglong sequence);
+
     // Indicates a failure watching the given device. After a failure signal, there will be no further updates until
     // a client shows interest in the device again.
     void failure(const QString& device, const QString& error);
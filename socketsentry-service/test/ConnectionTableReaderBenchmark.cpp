@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ConnectionTableReaderBenchmark.h"
+#include "ConnectionTables.h"
+#include "ProcNetReader.h"
+#include "SockDiagReader.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+
+#include <unistd.h>
+
+// Number of sockets in the benchmark tables.
+static const int BENCHMARK_SOCKETS = 100000;
+
+// Number of lines in the large IPv6 table. Every tenth socket is listening.
+static const int LARGE_TABLE_LINES = 200000;
+
+ConnectionTableReaderBenchmark::ConnectionTableReaderBenchmark() {
+}
+
+ConnectionTableReaderBenchmark::~ConnectionTableReaderBenchmark() {
+}
+
+void ConnectionTableReaderBenchmark::initTestCase() {
+    _netPath = QDir::temp().absoluteFilePath(QString("socketsentry-bench-net-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_netPath));
+    QFile udp(_netPath + "/udp");
+    QVERIFY(udp.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream udpOut(&udp);
+    udpOut << TABLE_HEADER;
+    for (int i = 0; i < BENCHMARK_SOCKETS; i++) {
+        writeLine(udpOut, i, 0xc0a86402, 1024 + i % 60000, 0x0a000000 + i, 53, 1, 100000 + i);
+    }
+    udp.close();
+
+    _largeNetPath = QDir::temp().absoluteFilePath(QString("socketsentry-bench-net6-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_largeNetPath));
+    QFile large(_largeNetPath + "/tcp6");
+    QVERIFY(large.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream largeOut(&large);
+    largeOut << TABLE_HEADER;
+    for (int i = 0; i < LARGE_TABLE_LINES; i++) {
+        writeLine6(largeOut, i, 0x9a3c1f00 + i, 1024 + i % 60000, 0x0b000000 + i * 7, 443, i % 10 ? 1 : 0x0a,
+                200000 + i);
+    }
+    large.close();
+}
+
+void ConnectionTableReaderBenchmark::cleanupTestCase() {
+    QDir(_netPath).remove("udp");
+    QDir().rmdir(_netPath);
+    QDir(_largeNetPath).remove("tcp6");
+    QDir().rmdir(_largeNetPath);
+}
+
+void ConnectionTableReaderBenchmark::benchmarkProcNet() {
+    ProcNetReader reader(_netPath);
+    QVector<SocketRecord> sockets;
+    QString error;
+    QBENCHMARK {
+        sockets.clear();
+        reader.readSockets(UDP, sockets, error);
+    }
+    QCOMPARE(sockets.size(), BENCHMARK_SOCKETS);
+}
+
+void ConnectionTableReaderBenchmark::benchmarkSockDiag() {
+    // The kernel sends a dump in chunks of about a page. Decode the same number of sockets as the /proc benchmark.
+    QByteArray chunk;
+    const int socketsPerChunk = 32;
+    for (int i = 0; i < socketsPerChunk; i++) {
+        appendMessage(chunk, 0xc0a86402, 1024 + i, 0x0a000000 + i, 53, 100000 + i);
+    }
+    const int chunks = BENCHMARK_SOCKETS / socketsPerChunk;
+    QVector<SocketRecord> sockets;
+    bool done = false;
+    QString error;
+    QBENCHMARK {
+        sockets.clear();
+        for (int i = 0; i < chunks; i++) {
+            SockDiagReader::parseMessages(chunk.constData(), chunk.size(), UDP, 0, sockets, done, error);
+        }
+    }
+    QCOMPARE(sockets.size(), chunks * socketsPerChunk);
+}
+
+void ConnectionTableReaderBenchmark::benchmarkProcNetTcp6() {
+    ProcNetReader reader(_largeNetPath);
+    QVector<SocketRecord> sockets;
+    QString error;
+    QBENCHMARK {
+        sockets.clear();
+        reader.readSockets(TCP6, sockets, error);
+    }
+    QCOMPARE(sockets.size(), LARGE_TABLE_LINES - LARGE_TABLE_LINES / 10);
+}
+
+void ConnectionTableReaderBenchmark::benchmarkRegexTcp6() {
+    QVector<SocketRecord> sockets;
+    QBENCHMARK {
+        sockets.clear();
+        regexReadSockets(_largeNetPath + "/tcp6", TCP6, sockets);
+    }
+    QCOMPARE(sockets.size(), LARGE_TABLE_LINES - LARGE_TABLE_LINES / 10);
+}
+
+QTEST_MAIN(ConnectionTableReaderBenchmark)
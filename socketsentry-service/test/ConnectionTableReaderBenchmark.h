@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef CONNECTIONTABLEREADERBENCHMARK_H_
+#define CONNECTIONTABLEREADERBENCHMARK_H_
+
+#include <QtTest/QtTest>
+#include <QtCore/QString>
+
+/*
+ * Benchmarks of the connection table readers (ProcNetReader and SockDiagReader) on synthetic tables of many sockets.
+ * Not run by ctest. See PipelineBenchmark.
+ */
+class ConnectionTableReaderBenchmark : public QObject {
+    Q_OBJECT
+
+public:
+    ConnectionTableReaderBenchmark();
+    virtual ~ConnectionTableReaderBenchmark();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Compare the readers on a synthetic table of many sockets.
+    void benchmarkProcNet();
+    void benchmarkSockDiag();
+
+    // Compare the parser with the regex-based parser it replaced on a large IPv6 table.
+    void benchmarkProcNetTcp6();
+    void benchmarkRegexTcp6();
+
+private:
+    // Directory of the synthetic IPv4 table.
+    QString _netPath;
+
+    // Directory of the large IPv6 table.
+    QString _largeNetPath;
+};
+
+#endif /* CONNECTIONTABLEREADERBENCHMARK_H_ */
@@ -0,0 +1,226 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ConnectionTableReaderTest.h"
+#include "ConnectionTables.h"
+#include "ProcNetReader.h"
+#include "SockDiagReader.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+
+// Number of lines in the IPv6 table compared with the regex-based parser. Every tenth socket is listening.
+static const int REGEX_TABLE_LINES = 2000;
+
+// Append the end of the dump for the given request to a buffer.
+static void appendDone(QByteArray& buffer, quint32 sequence = 0) {
+    QByteArray message(NLMSG_SPACE(sizeof(int)), '\0');
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(message.data());
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_seq = sequence;
+    buffer.append(message);
+}
+
+ConnectionTableReaderTest::ConnectionTableReaderTest() {
+}
+
+ConnectionTableReaderTest::~ConnectionTableReaderTest() {
+}
+
+void ConnectionTableReaderTest::initTestCase() {
+    _netPath = QDir::temp().absoluteFilePath(QString("socketsentry-net-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_netPath));
+
+    // Small IPv4 and IPv6 tables.
+    QFile tcp(_netPath + "/tcp");
+    QVERIFY(tcp.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream tcpOut(&tcp);
+    tcpOut << TABLE_HEADER;
+    tcpOut << "   0: 0100007F:1F4A 00000000:0000 0A 00000000:00000000 00:00000000 00000000  1000        0 8625 1 "
+            "ffff88012545cd00 100 0 0 10 0\n";
+    tcpOut << "   1: 0264A8C0:AE08 0101A8C0:0050 01 00000000:00000000 00:00000000 00000000  1000        0 9120 1 "
+            "ffff88012545d040 20 4 30 10 -1\n";
+    tcp.close();
+    QFile tcp6(_netPath + "/tcp6");
+    QVERIFY(tcp6.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream tcp6Out(&tcp6);
+    tcp6Out << TABLE_HEADER;
+    tcp6Out << "   0: 0000000000000000FFFF00000100007F:9C40 0000000000000000FFFF00000100007F:0016 01 "
+            "00000000:00000000 00:00000000 00000000  1000        0 7777 1 ffff880123d0c000 20 4 30 10 -1\n";
+    tcp6.close();
+
+    // IPv6 table for comparison with the regex-based parser. It lives in its own directory so the other tests keep
+    // their missing tcp6 or udp6 tables.
+    _regexNetPath = QDir::temp().absoluteFilePath(QString("socketsentry-net6-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_regexNetPath));
+    QFile regexTable(_regexNetPath + "/tcp6");
+    QVERIFY(regexTable.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream regexOut(&regexTable);
+    regexOut << TABLE_HEADER;
+    for (int i = 0; i < REGEX_TABLE_LINES; i++) {
+        writeLine6(regexOut, i, 0x9a3c1f00 + i, 1024 + i % 60000, 0x0b000000 + i * 7, 443, i % 10 ? 1 : 0x0a,
+                200000 + i);
+    }
+    regexTable.close();
+}
+
+void ConnectionTableReaderTest::cleanupTestCase() {
+    QDir dir(_netPath);
+    dir.remove("tcp");
+    dir.remove("tcp6");
+    QDir().rmdir(_netPath);
+    QDir(_regexNetPath).remove("tcp6");
+    QDir().rmdir(_regexNetPath);
+}
+
+void ConnectionTableReaderTest::testProcNet() {
+    ProcNetReader reader(_netPath);
+    QVector<SocketRecord> sockets;
+    QString error;
+    QVERIFY(reader.readSockets(TCP, sockets, error));
+    QCOMPARE(sockets.size(), 1);        // listening socket is skipped
+    const SocketRecord& socket = sockets.at(0);
+    QCOMPARE(socket.inode, 9120U);
+    QCOMPARE((int)socket.flow.localAddr[0], 192);
+    QCOMPARE((int)socket.flow.localAddr[3], 2);
+    QCOMPARE((int)socket.flow.localPort, 0xae08);
+    QCOMPARE((int)socket.flow.remoteAddr[3], 1);
+    QCOMPARE((int)socket.flow.remotePort, 80);
+    QCOMPARE(socket.flow.getTransport(), TCP);
+    QVERIFY(!socket.flow.isIpv6());
+
+    QVERIFY(reader.readSockets(TCP6, sockets, error));
+    QCOMPARE(sockets.size(), 2);
+    const SocketRecord& socket6 = sockets.at(1);
+    QCOMPARE(socket6.inode, 7777U);
+    QVERIFY(socket6.flow.isIpv6());
+    QCOMPARE((int)socket6.flow.localAddr[10], 0xff);    // ::ffff:127.0.0.1
+    QCOMPARE((int)socket6.flow.localAddr[12], 127);
+    QCOMPARE((int)socket6.flow.localAddr[15], 1);
+    QCOMPARE((int)socket6.flow.remotePort, 22);
+
+    QVERIFY(!reader.readSockets(UDP6, sockets, error));
+    QVERIFY(!error.isEmpty());
+}
+
+void ConnectionTableReaderTest::testProcNetLines() {
+    SocketRecord record;
+    const char* line = "   1: 0264A8C0:AE08 0101A8C0:0050 01 00000000:00000000 00:00000000 00000000  1000        0 "
+            "9120 1 ffff88012545d040 20 4 30 10 -1";
+    QVERIFY(ProcNetReader::parseLine(line, line + ::strlen(line), TCP, record));
+    QCOMPARE(record.inode, 9120U);
+    QCOMPARE((int)record.flow.localAddr[0], 192);
+    QCOMPARE((int)record.flow.remotePort, 80);
+
+    // Lower case hex digits are accepted.
+    line = "1: 0264a8c0:ae08 0101a8c0:0050 01 00000000:00000000 00:00000000 00000000 0 0 9120";
+    QVERIFY(ProcNetReader::parseLine(line, line + ::strlen(line), TCP, record));
+    QCOMPARE((int)record.flow.localPort, 0xae08);
+
+    // Header, truncated lines, wrong address size, and no inode are all rejected.
+    line = TABLE_HEADER;
+    QVERIFY(!ProcNetReader::parseLine(line, line + ::strlen(line) - 1, TCP, record));
+    line = "   1: 0264A8C0:AE08 0101A8C0:0050 01 00000000:00000000 00:00000000 00000000  1000        0 ";
+    QVERIFY(!ProcNetReader::parseLine(line, line + ::strlen(line), TCP, record));
+    line = "   1: 0264A8C0:AE08 0101A8C0:0050 01 00000000:00000000 00:00000000 00000000  1000        0 9120";
+    QVERIFY(!ProcNetReader::parseLine(line, line + 30, TCP, record));
+    QVERIFY(!ProcNetReader::parseLine(line, line + ::strlen(line), TCP6, record));
+    line = "   1: 0264A8C0:AE08 0101A8C0:0050 06 00000000:00000000 00:00000000 00000000  1000        0 0 1";
+    QVERIFY(!ProcNetReader::parseLine(line, line + ::strlen(line), TCP, record));
+}
+
+void ConnectionTableReaderTest::testProcNetMatchesRegex() {
+    ProcNetReader reader(_regexNetPath);
+    QVector<SocketRecord> sockets;
+    QString error;
+    QVERIFY(reader.readSockets(TCP6, sockets, error));
+    QVector<SocketRecord> expected;
+    regexReadSockets(_regexNetPath + "/tcp6", TCP6, expected);
+    QCOMPARE(sockets.size(), REGEX_TABLE_LINES - REGEX_TABLE_LINES / 10);
+    QCOMPARE(sockets.size(), expected.size());
+    for (int i = 0; i < sockets.size(); i++) {
+        QCOMPARE(sockets.at(i).inode, expected.at(i).inode);
+        QVERIFY(sockets.at(i).flow == expected.at(i).flow);
+    }
+}
+
+void ConnectionTableReaderTest::testSockDiagMessages() {
+    QByteArray buffer;
+    appendMessage(buffer, 0xc0a86402, 44552, 0xc0a80101, 80, 9120);
+    appendMessage(buffer, 0xc0a86402, 44553, 0xc0a80101, 80, 0);    // no inode (e.g. TIME_WAIT)
+    QVector<SocketRecord> sockets;
+    bool done = false;
+    QString error;
+    QVERIFY(SockDiagReader::parseMessages(buffer.constData(), buffer.size(), TCP, 0, sockets, done, error));
+    QVERIFY(!done);
+    QCOMPARE(sockets.size(), 1);
+    const SocketRecord& socket = sockets.at(0);
+    QCOMPARE(socket.inode, 9120U);
+    QCOMPARE((int)socket.flow.localAddr[0], 192);
+    QCOMPARE((int)socket.flow.localAddr[3], 2);
+    QCOMPARE((int)socket.flow.localPort, 44552);
+    QCOMPARE((int)socket.flow.remotePort, 80);
+    QCOMPARE(socket.flow.getTransport(), TCP);
+
+    buffer.clear();
+    appendDone(buffer);
+    QVERIFY(SockDiagReader::parseMessages(buffer.constData(), buffer.size(), TCP, 0, sockets, done, error));
+    QVERIFY(done);
+}
+
+void ConnectionTableReaderTest::testSockDiagError() {
+    QByteArray buffer(NLMSG_SPACE(sizeof(nlmsgerr)), '\0');
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer.data());
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(nlmsgerr));
+    header->nlmsg_type = NLMSG_ERROR;
+    reinterpret_cast<nlmsgerr*>(NLMSG_DATA(header))->error = -ENOENT;
+    QVector<SocketRecord> sockets;
+    bool done = false;
+    QString error;
+    QVERIFY(!SockDiagReader::parseMessages(buffer.constData(), buffer.size(), UDP6, 0, sockets, done, error));
+    QVERIFY(!error.isEmpty());
+}
+
+void ConnectionTableReaderTest::testSockDiagStaleMessages() {
+    // The tail of a dump that was cut short, followed by the reply to the current request.
+    QByteArray buffer;
+    appendMessage(buffer, 0xc0a86402, 44552, 0xc0a80101, 80, 9120, 6);
+    appendDone(buffer, 6);
+    appendMessage(buffer, 0xc0a86402, 44553, 0xc0a80101, 80, 9121, 7);
+    QVector<SocketRecord> sockets;
+    bool done = false;
+    QString error;
+    QVERIFY(SockDiagReader::parseMessages(buffer.constData(), buffer.size(), TCP, 7, sockets, done, error));
+    QVERIFY(!done);
+    QCOMPARE(sockets.size(), 1);
+    QCOMPARE(sockets.at(0).inode, 9121U);
+
+    buffer.clear();
+    appendDone(buffer, 7);
+    QVERIFY(SockDiagReader::parseMessages(buffer.constData(), buffer.size(), TCP, 7, sockets, done, error));
+    QVERIFY(done);
+}
+
+QTEST_MAIN(ConnectionTableReaderTest)
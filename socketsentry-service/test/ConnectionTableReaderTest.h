@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef CONNECTIONTABLEREADERTEST_H_
+#define CONNECTIONTABLEREADERTEST_H_
+
+#include <QtTest/QtTest>
+#include <QtCore/QString>
+
+/*
+ * Unit test for the connection table readers (ProcNetReader and SockDiagReader).
+ */
+class ConnectionTableReaderTest : public QObject {
+    Q_OBJECT
+
+public:
+    ConnectionTableReaderTest();
+    virtual ~ConnectionTableReaderTest();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Test reading IPv4 and IPv6 connection tables from text files.
+    void testProcNet();
+
+    // Test decoding single connection table lines, including malformed ones.
+    void testProcNetLines();
+
+    // Test that the parser agrees with the regex-based parser it replaced on an IPv6 table.
+    void testProcNetMatchesRegex();
+
+    // Test decoding sock_diag messages.
+    void testSockDiagMessages();
+
+    // Test that the kernel's error replies are reported.
+    void testSockDiagError();
+
+    // Test that messages left over from an earlier request are skipped.
+    void testSockDiagStaleMessages();
+
+private:
+    // Directory of the synthetic connection tables.
+    QString _netPath;
+
+    // Directory of the IPv6 table compared with the regex-based parser.
+    QString _regexNetPath;
+};
+
+#endif /* CONNECTIONTABLEREADERTEST_H_ */
@@ -0,0 +1,130 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef CONNECTIONTABLES_H_
+#define CONNECTIONTABLES_H_
+
+#include "SocketRecord.h"
+#include "FlowKey.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QChar>
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtCore/QString>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+/*
+ * Synthetic connection tables in the kernel's formats, and the regex-based parser that ProcNetReader replaced, for
+ * the connection table reader test and benchmark.
+ */
+
+// Header line of a connection table.
+static const char* TABLE_HEADER = "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  "
+        "timeout inode\n";
+
+// Write one IPv4 connection table line in the kernel's format.
+inline void writeLine(QTextStream& out, int slot, quint32 localAddr, int localPort, quint32 remoteAddr,
+        int remotePort, int state, int inode) {
+    out << QString("%1: %2:%3 %4:%5 %6 00000000:00000000 00:00000000 00000000  1000        0 %7 1 "
+            "ffff880123d0c000 20 4 30 10 -1\n")
+            .arg(slot, 4)
+            .arg(localAddr, 8, 16, QChar('0')).arg(localPort, 4, 16, QChar('0'))
+            .arg(remoteAddr, 8, 16, QChar('0')).arg(remotePort, 4, 16, QChar('0'))
+            .arg(state, 2, 16, QChar('0')).arg(inode).toUpper();
+}
+
+// Write one IPv6 connection table line in the kernel's format.
+inline void writeLine6(QTextStream& out, int slot, quint32 localHost, int localPort, quint32 remoteHost,
+        int remotePort, int state, int inode) {
+    out << QString("%1: 000080FE00000000%2%3:%4 B80D0120000000000000%5:%6 %7 00000000:00000000 00:00000000 "
+            "00000000  1000        0 %8 1 ffff880123d0c000 20 4 30 10 -1\n")
+            .arg(slot, 6)
+            .arg(localHost, 8, 16, QChar('0')).arg(~localHost, 8, 16, QChar('0')).arg(localPort, 4, 16, QChar('0'))
+            .arg(remoteHost, 12, 16, QChar('0')).arg(remotePort, 4, 16, QChar('0'))
+            .arg(state, 2, 16, QChar('0')).arg(inode).toUpper();
+}
+
+// The regex-based parser that ProcNetReader used before the hand-written one. Kept as a reference for correctness
+// and speed.
+inline void regexReadSockets(const QString& filename, const L4Protocol protocol, QVector<SocketRecord>& result) {
+    static const QString pattern("\\s*\\d+\\: (\\w{8,32})\\:(\\w{4}) (\\w{8,32})\\:(\\w{4}) (\\w{2}) "
+            "(?:[\\w:]+\\s+){5}(\\w+)[^\\r\\n]*");
+    const bool ipv6 = protocol == TCP6 || protocol == UDP6;
+    QRegExp regex(pattern);
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return;
+    QTextStream in(&file);
+    QString contents = in.readAll();
+    int pos = 0;
+    while ((pos = regex.indexIn(contents, pos)) != -1) {
+        pos += regex.matchedLength();
+        if (regex.cap(5).compare("0A", Qt::CaseInsensitive) == 0) continue;
+        SocketRecord record;
+        record.flow = FlowKey();
+        QByteArray local = QByteArray::fromHex(regex.cap(1).toAscii());
+        QByteArray remote = QByteArray::fromHex(regex.cap(3).toAscii());
+        if (local.size() != (ipv6 ? 16 : 4) || remote.size() != local.size()) continue;
+        for (int i = 0; i < local.size(); i += 4) {
+            quint32 word;
+            ::memcpy(&word, local.constData() + i, sizeof(word));
+            word = htonl(word);
+            ::memcpy(record.flow.localAddr + i, &word, sizeof(word));
+            ::memcpy(&word, remote.constData() + i, sizeof(word));
+            word = htonl(word);
+            ::memcpy(record.flow.remoteAddr + i, &word, sizeof(word));
+        }
+        bool ok = false;
+        record.flow.localPort = regex.cap(2).toUShort(&ok, 16);
+        if (!ok) continue;
+        record.flow.remotePort = regex.cap(4).toUShort(&ok, 16);
+        if (!ok) continue;
+        record.flow.transport = protocol;
+        record.flow.ipv6 = ipv6;
+        record.inode = regex.cap(6).toUInt(&ok, 10);
+        if (!ok || record.inode == 0) continue;
+        result.append(record);
+    }
+}
+
+// Append one sock_diag message for an IPv4 socket to a buffer, as part of the reply to the given request.
+inline void appendMessage(QByteArray& buffer, quint32 localAddr, int localPort, quint32 remoteAddr, int remotePort,
+        quint32 inode, quint32 sequence = 0) {
+    QByteArray message(NLMSG_SPACE(sizeof(inet_diag_msg)), '\0');
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(message.data());
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(inet_diag_msg));
+    header->nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    header->nlmsg_seq = sequence;
+    inet_diag_msg* socket = reinterpret_cast<inet_diag_msg*>(NLMSG_DATA(header));
+    socket->idiag_family = AF_INET;
+    socket->id.idiag_src[0] = htonl(localAddr);
+    socket->id.idiag_dst[0] = htonl(remoteAddr);
+    socket->id.idiag_sport = htons(localPort);
+    socket->id.idiag_dport = htons(remotePort);
+    socket->idiag_inode = inode;
+    buffer.append(message);
+}
+
+#endif /* CONNECTIONTABLES_H_ */
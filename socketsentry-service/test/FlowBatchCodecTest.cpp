@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowBatchCodecTest.h"
+#include "FlowBatchCodec.h"
+#include "CommunicationFlow.h"
+
+#include <QtCore/QDateTime>
+#include <QtNetwork/QHostAddress>
+
+// Create a flow of an IPv4 connection to a web server with one process.
+static CommunicationFlow makeFlow(int localPort, const QString& program, const QString& user) {
+    IpEndpointPair endpoints(QHostAddress("192.168.1.2"), localPort, QHostAddress("10.0.0.1"), 80, TCP);
+    QDateTime startTime;
+    startTime.setTimeSpec(Qt::UTC);
+    startTime.setTime_t(1280000000 + localPort);
+    OsProcess osProcess(1000 + localPort, program, user, startTime);
+    return CommunicationFlow(endpoints, osProcess, FlowMetrics(64000, 1200, 30, 40),
+            FlowStatistics(3200, 4500, 96000, true, false));
+}
+
+FlowBatchCodecTest::FlowBatchCodecTest() {
+}
+
+FlowBatchCodecTest::~FlowBatchCodecTest() {
+}
+
+void FlowBatchCodecTest::testRoundTrip() {
+    QList<CommunicationFlow> flows;
+
+    // IPv4 with a resolved host name.
+    CommunicationFlow flow1 = makeFlow(4000, "firefox", "rob");
+    IpEndpointPair endpoints1 = flow1.getIpEndpointPair();
+    endpoints1.setRemoteHostName("www.example.com");
+    flow1.setIpEndpointPair(endpoints1);
+    flows << flow1;
+
+    // IPv6 with a shared socket.
+    IpEndpointPair endpoints2(QHostAddress("2001:db8::1"), 5353, QHostAddress("ff02::fb"), 5353, UDP6);
+    CommunicationFlow flow2(endpoints2, QList<OsProcess>(), FlowMetrics(0, 512, 0, 4),
+            FlowStatistics(0, 100, 512, false, true));
+    QDateTime startTime = QDateTime::fromTime_t(1270000000);       // start times are whole seconds
+    flow2.addOsProcess(OsProcess(17, "avahi-daemon", "avahi", startTime));
+    flow2.addOsProcess(OsProcess(18, "avahi-daemon", "avahi", startTime));
+    flows << flow2;
+
+    // Aggregated hosts without ports, transport, or processes. Large counters.
+    IpEndpointPair endpoints3(QHostAddress("10.1.1.1"), QHostAddress("10.2.2.2"));
+    flows << CommunicationFlow(endpoints3, QList<OsProcess>(), FlowMetrics(1LL << 40, 5, 1LL << 33, 1),
+            FlowStatistics());
+
+    // Unknown addresses.
+    flows << CommunicationFlow(IpEndpointPair(), QList<OsProcess>(), FlowMetrics(), FlowStatistics());
+
+    QList<CommunicationFlow> result;
+    QString error;
+    QVERIFY(FlowBatchCodec::decode(FlowBatchCodec::encode(flows), result, error));
+    QVERIFY(error.isEmpty());
+    QCOMPARE(result.size(), flows.size());
+    for (int i = 0; i < flows.size(); i++) {
+        QCOMPARE(result[i], flows[i]);
+        QCOMPARE(result[i].getIpEndpointPair().getRemoteHostName(), flows[i].getIpEndpointPair().getRemoteHostName());
+        QCOMPARE(result[i].getIpEndpointPair().getRemoteAddr(), flows[i].getIpEndpointPair().getRemoteAddr());
+        QCOMPARE(result[i].getIpEndpointPair().getTransport(), flows[i].getIpEndpointPair().getTransport());
+    }
+    QCOMPARE(result[1].getOsProcesses().size(), 2);
+    QCOMPARE(result[1].getOsProcesses()[1].getPid(), 18U);
+
+    // No flows at all.
+    QVERIFY(FlowBatchCodec::decode(FlowBatchCodec::encode(QList<CommunicationFlow>()), result, error));
+    QVERIFY(result.isEmpty());
+}
+
+void FlowBatchCodecTest::testInterning() {
+    // Many flows of the same hosts, program, and user cost a fixed-width record and a process record each.
+    QList<CommunicationFlow> flows;
+    flows << makeFlow(4000, "firefox", "rob");
+    QByteArray one = FlowBatchCodec::encode(flows);
+    for (int i = 1; i < 100; i++) {
+        flows << makeFlow(4000 + i, "firefox", "rob");
+    }
+    QByteArray hundred = FlowBatchCodec::encode(flows);
+    const int recordsPerFlow = 84 + 16;
+    QCOMPARE(hundred.size() - one.size(), 99 * recordsPerFlow);
+
+    // A different program adds its name once.
+    flows << makeFlow(5000, "wget", "rob");
+    QByteArray newProgram = FlowBatchCodec::encode(flows);
+    QCOMPARE(newProgram.size() - hundred.size(), recordsPerFlow + 2 + 4);
+
+    // A different remote host adds its address once.
+    IpEndpointPair endpoints = flows.last().getIpEndpointPair();
+    endpoints.setRemoteAddr(QHostAddress("10.0.0.2"));
+    CommunicationFlow otherHost = flows.last();
+    otherHost.setIpEndpointPair(endpoints);
+    flows << otherHost << otherHost;
+    QByteArray newAddress = FlowBatchCodec::encode(flows);
+    QCOMPARE(newAddress.size() - newProgram.size(), 2 * recordsPerFlow + 1 + 4);
+}
+
+void FlowBatchCodecTest::testInvalidData() {
+    QList<CommunicationFlow> flows;
+    flows << makeFlow(4000, "firefox", "rob") << makeFlow(4001, "wget", "root");
+    QByteArray packed = FlowBatchCodec::encode(flows);
+    QList<CommunicationFlow> result;
+    QString error;
+
+    // Not packed flows.
+    QVERIFY(!FlowBatchCodec::decode(QByteArray("garbage"), result, error));
+    QVERIFY(!error.isEmpty());
+
+    // Another format version.
+    QByteArray otherVersion = packed;
+    otherVersion[4] = (char)(FlowBatchCodec::FORMAT_VERSION + 1);
+    error.clear();
+    QVERIFY(!FlowBatchCodec::decode(otherVersion, result, error));
+    QVERIFY(!error.isEmpty());
+
+    // Cut off at every length.
+    for (int length = 0; length < packed.size(); length++) {
+        error.clear();
+        QVERIFY(!FlowBatchCodec::decode(packed.left(length), result, error));
+        QVERIFY(!error.isEmpty());
+    }
+
+    // Too many strings for the data.
+    QByteArray manyStrings = packed;
+    manyStrings[11] = (char)0x7f;
+    error.clear();
+    QVERIFY(!FlowBatchCodec::decode(manyStrings, result, error));
+    QVERIFY(!error.isEmpty());
+
+    // The result is untouched by failures.
+    QVERIFY(result.isEmpty());
+}
+
+QTEST_MAIN(FlowBatchCodecTest)
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowDeltaTrackerTest.h"
+#include "FlowDeltaTracker.h"
+
+#include <QtNetwork/QHostAddress>
+
+// Create a flow to a remote port with the given number of bytes in.
+static CommunicationFlow makeFlow(int remotePort, qlonglong bytesIn) {
+    IpEndpointPair endpoints(QHostAddress("192.168.1.2"), 4000, QHostAddress("10.0.0.1"), remotePort, TCP);
+    return CommunicationFlow(endpoints, QList<OsProcess>(), FlowMetrics(bytesIn, 0, 1, 0), FlowStatistics());
+}
+
+FlowDeltaTrackerTest::FlowDeltaTrackerTest() {
+}
+
+FlowDeltaTrackerTest::~FlowDeltaTrackerTest() {
+}
+
+void FlowDeltaTrackerTest::testApply() {
+    FlowDeltaTracker tracker;
+    QVERIFY(!tracker.isSynchronized());
+
+    QList<CommunicationFlow> keyframe;
+    keyframe << makeFlow(80, 100) << makeFlow(443, 200);
+    QVERIFY(tracker.apply(7, true, keyframe, QList<IpEndpointPair>()));
+    QVERIFY(tracker.isSynchronized());
+    QCOMPARE(tracker.getSequence(), 7ULL);
+    QCOMPARE(tracker.getFlows().size(), 2);
+
+    // Change one flow, add one, and remove one.
+    QList<CommunicationFlow> changed;
+    changed << makeFlow(80, 150) << makeFlow(22, 10);
+    QList<IpEndpointPair> removed;
+    removed << makeFlow(443, 0).getIpEndpointPair();
+    QVERIFY(tracker.apply(8, false, changed, removed));
+    QList<CommunicationFlow> flows = tracker.getFlows();
+    QCOMPARE(flows.size(), 2);
+    QVERIFY(flows.contains(makeFlow(80, 150)));
+    QVERIFY(flows.contains(makeFlow(22, 10)));
+
+    // An empty delta changes nothing.
+    QVERIFY(tracker.apply(9, false, QList<CommunicationFlow>(), QList<IpEndpointPair>()));
+    QCOMPARE(tracker.getFlows().size(), 2);
+
+    // A keyframe replaces everything.
+    keyframe.clear();
+    keyframe << makeFlow(53, 5);
+    QVERIFY(tracker.apply(10, true, keyframe, QList<IpEndpointPair>()));
+    QCOMPARE(tracker.getFlows(), keyframe);
+}
+
+void FlowDeltaTrackerTest::testMissedUpdate() {
+    FlowDeltaTracker tracker;
+
+    // Deltas before the first keyframe can't be applied.
+    QList<CommunicationFlow> delta;
+    delta << makeFlow(80, 100);
+    QVERIFY(!tracker.apply(3, false, delta, QList<IpEndpointPair>()));
+    QVERIFY(!tracker.isSynchronized());
+
+    QVERIFY(tracker.apply(4, true, delta, QList<IpEndpointPair>()));
+    QVERIFY(tracker.isSynchronized());
+
+    // Skip a sequence number.
+    QVERIFY(!tracker.apply(6, false, QList<CommunicationFlow>(), QList<IpEndpointPair>()));
+    QVERIFY(!tracker.isSynchronized());
+    QVERIFY(tracker.getFlows().isEmpty());
+
+    // Later deltas are ignored too, even if they follow directly.
+    QVERIFY(!tracker.apply(7, false, delta, QList<IpEndpointPair>()));
+    QVERIFY(tracker.getFlows().isEmpty());
+
+    // The next keyframe gets the tracker back in sync.
+    QVERIFY(tracker.apply(8, true, delta, QList<IpEndpointPair>()));
+    QVERIFY(tracker.isSynchronized());
+    QCOMPARE(tracker.getFlows(), delta);
+
+    // Clearing starts over.
+    tracker.clear();
+    QVERIFY(!tracker.isSynchronized());
+    QCOMPARE(tracker.getSequence(), 0ULL);
+}
+
+QTEST_MAIN(FlowDeltaTrackerTest)
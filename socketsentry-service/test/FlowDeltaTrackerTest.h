@@ -0,0 +1,41 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWDELTATRACKERTEST_H_
+#define FLOWDELTATRACKERTEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for FlowDeltaTracker.
+ */
+class FlowDeltaTrackerTest : public QObject {
+    Q_OBJECT
+
+public:
+    FlowDeltaTrackerTest();
+    virtual ~FlowDeltaTrackerTest();
+
+private slots:
+    // Test that deltas add, change, and remove flows on top of a keyframe.
+    void testApply();
+
+    // Test that a missed update is detected and deltas are ignored until the next keyframe.
+    void testMissedUpdate();
+};
+
+#endif /* FLOWDELTATRACKERTEST_H_ */
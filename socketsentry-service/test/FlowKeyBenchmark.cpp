@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkAddressEntry>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+#include "FlowKeyBenchmark.h"
+#include "FlowKey.h"
+#include "IpEndpointPair.h"
+#include "InternetProtocolDecoder.h"
+#include "PacketBatch.h"
+
+// An outbound TCP/IPv4 packet from 192.168.168.131:1234 to 147.129.226.1:443.
+static QByteArray tcpPacket() {
+    return QByteArray::fromHex("45" "0000000000000000" "060000" "c0a8a883" "9381e201" "04d2" "01bb");
+}
+
+// Decoder that knows the local address of the packet above.
+static void initDecoder(InternetProtocolDecoder& decoder) {
+    QNetworkAddressEntry localAddressEntry;
+    localAddressEntry.setIp(QHostAddress("192.168.168.131"));
+    localAddressEntry.setBroadcast(QHostAddress("192.168.168.255"));
+    decoder.setLocalAddresses(QList<QNetworkAddressEntry>() << localAddressEntry);
+}
+
+FlowKeyBenchmark::FlowKeyBenchmark() {
+}
+
+FlowKeyBenchmark::~FlowKeyBenchmark() {
+}
+
+void FlowKeyBenchmark::benchmarkFlowKeyDecode() {
+    InternetProtocolDecoder decoder;
+    initDecoder(decoder);
+    QByteArray packet = tcpPacket();
+    const u_char* bytes = (const u_char*)packet.constData();
+    PacketBatch* batch = new PacketBatch;
+    QBENCHMARK {
+        FlowKey flow = FlowKey();
+        decoder.decode(UNKNOWN_DIRECTION, packet.size(), bytes, flow);
+        batch->add(flow, OUTBOUND, packet.size(), 1000);
+    }
+    delete batch;
+}
+
+void FlowKeyBenchmark::benchmarkEndpointPairDecode() {
+    InternetProtocolDecoder decoder;
+    initDecoder(decoder);
+    QByteArray packet = tcpPacket();
+    const u_char* bytes = (const u_char*)packet.constData();
+    QBENCHMARK {
+        IpEndpointPair endpoints;
+        decoder.decode(UNKNOWN_DIRECTION, packet.size(), bytes, endpoints);
+    }
+}
+
+QTEST_MAIN(FlowKeyBenchmark)
@@ -0,0 +1,41 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWKEYBENCHMARK_H_
+#define FLOWKEYBENCHMARK_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Benchmarks of decoding a packet with flow keys and with endpoint pairs. Not run by ctest. See PipelineBenchmark.
+ */
+class FlowKeyBenchmark : public QObject {
+    Q_OBJECT
+
+public:
+    FlowKeyBenchmark();
+    virtual ~FlowKeyBenchmark();
+
+private slots:
+    // Measure decoding and batching a packet with flow keys.
+    void benchmarkFlowKeyDecode();
+
+    // Measure decoding a packet to an endpoint pair, for comparison.
+    void benchmarkEndpointPairDecode();
+};
+
+#endif /* FLOWKEYBENCHMARK_H_ */
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkAddressEntry>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+#include <new>
+#include <stdlib.h>
+
+#include "FlowKeyTest.h"
+#include "FlowKey.h"
+#include "IpEndpointPair.h"
+#include "InternetProtocolDecoder.h"
+#include "PacketBatch.h"
+
+// Count heap allocations made through operator new in this test program.
+static int allocationCount = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    allocationCount++;
+    void* ptr = ::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+    ::free(ptr);
+}
+
+// An outbound TCP/IPv4 packet from 192.168.168.131:1234 to 147.129.226.1:443.
+static QByteArray tcpPacket() {
+    return QByteArray::fromHex("45" "0000000000000000" "060000" "c0a8a883" "9381e201" "04d2" "01bb");
+}
+
+// Decoder that knows the local address of the packet above.
+static void initDecoder(InternetProtocolDecoder& decoder) {
+    QNetworkAddressEntry localAddressEntry;
+    localAddressEntry.setIp(QHostAddress("192.168.168.131"));
+    localAddressEntry.setBroadcast(QHostAddress("192.168.168.255"));
+    decoder.setLocalAddresses(QList<QNetworkAddressEntry>() << localAddressEntry);
+}
+
+FlowKeyTest::FlowKeyTest() {
+}
+
+FlowKeyTest::~FlowKeyTest() {
+}
+
+void FlowKeyTest::testEndpointPairConversion() {
+    IpEndpointPair ipv4Flow(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP);
+    FlowKey ipv4Key = FlowKey::fromEndpointPair(ipv4Flow);
+    QVERIFY(!ipv4Key.isIpv6());
+    QCOMPARE(ipv4Key.getTransport(), TCP);
+    QCOMPARE(ipv4Key.toEndpointPair(), ipv4Flow);
+
+    IpEndpointPair ipv6Flow(QHostAddress("2001::1"), 5353, QHostAddress("2001:50::55"), 53, UDP6);
+    FlowKey ipv6Key = FlowKey::fromEndpointPair(ipv6Flow);
+    QVERIFY(ipv6Key.isIpv6());
+    QCOMPARE(ipv6Key.toEndpointPair(), ipv6Flow);
+    QVERIFY(ipv4Key != ipv6Key);
+}
+
+void FlowKeyTest::testHash() {
+    QHostAddress first("192.168.100.1");
+    QHostAddress second("10.10.1.1");
+    FlowKey key = FlowKey::fromEndpointPair(IpEndpointPair(first, 123, second, 80, TCP));
+    FlowKey sameKey = FlowKey::fromEndpointPair(IpEndpointPair(first, 123, second, 80, TCP));
+    FlowKey swappedKey = FlowKey::fromEndpointPair(IpEndpointPair(second, 80, first, 123, TCP));
+    QVERIFY(key == sameKey);
+    QCOMPARE(qHash(key), qHash(sameKey));
+    QVERIFY(key != swappedKey);
+    QVERIFY(qHash(key) != qHash(swappedKey));
+}
+
+void FlowKeyTest::testNoAllocationsPerPacket() {
+    InternetProtocolDecoder decoder;
+    initDecoder(decoder);
+    QByteArray packet = tcpPacket();
+    const u_char* bytes = (const u_char*)packet.constData();
+    PacketBatch* batch = new PacketBatch;
+
+    // Old way: every packet allocates.
+    int before = allocationCount;
+    for (int i = 0; i < 1000; i++) {
+        IpEndpointPair endpoints;
+        QCOMPARE(decoder.decode(UNKNOWN_DIRECTION, packet.size(), bytes, endpoints), OUTBOUND);
+    }
+    QVERIFY(allocationCount - before >= 1000);
+
+    // New way: no packet allocates.
+    before = allocationCount;
+    for (int i = 0; i < 1000; i++) {
+        FlowKey flow = FlowKey();
+        QCOMPARE(decoder.decode(UNKNOWN_DIRECTION, packet.size(), bytes, flow), OUTBOUND);
+        batch->add(flow, OUTBOUND, packet.size(), 1000 + i / 100);
+    }
+    QCOMPARE(allocationCount - before, 0);
+    QCOMPARE(batch->size(), 10);
+    delete batch;
+}
+
+QTEST_MAIN(FlowKeyTest)
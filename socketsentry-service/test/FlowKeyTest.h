@@ -0,0 +1,44 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWKEYTEST_H_
+#define FLOWKEYTEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for FlowKey and its use on the packet capture path.
+ */
+class FlowKeyTest : public QObject {
+    Q_OBJECT
+
+public:
+    FlowKeyTest();
+    virtual ~FlowKeyTest();
+
+private slots:
+    // Test conversion to and from endpoint pairs.
+    void testEndpointPairConversion();
+
+    // Test that the hash distinguishes the two directions of a flow.
+    void testHash();
+
+    // Test that decoding and batching packets with flow keys doesn't allocate memory.
+    void testNoAllocationsPerPacket();
+};
+
+#endif /* FLOWKEYTEST_H_ */
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "FlowSelectionTest.h"
+#include "FlowSelection.h"
+#include "IpEndpointPair.h"
+#include "OsProcess.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QDateTime>
+#include <QtNetwork/QHostAddress>
+
+FlowSelectionTest::FlowSelectionTest() {
+}
+
+FlowSelectionTest::~FlowSelectionTest() {
+}
+
+void FlowSelectionTest::testValidity() {
+    FlowSelection selection;
+    QVERIFY(selection.isValid());
+    QVERIFY(!selection.isRestrictive());
+
+    QVERIFY(FlowSelection(SORT_BY_TOTAL, 10).isRestrictive());
+    QVERIFY(!FlowSelection(SORT_BY_TOTAL, -1).isValid());
+    QVERIFY(!FlowSelection((FlowSortKey)7, 10).isValid());
+
+    selection.setPortRange(1024, 80);
+    QVERIFY(!selection.isValid());
+    selection.setPortRange(80, 80);
+    QVERIFY(selection.isValid());
+    QVERIFY(selection.isRestrictive());
+
+    selection = FlowSelection();
+    selection.setRemoteSubnet("not a subnet");
+    QVERIFY(!selection.isValid());
+    selection.setRemoteSubnet("10.0.0.0/8");
+    QVERIFY(selection.isValid());
+    QVERIFY(selection.isRestrictive());
+    selection.setRemoteSubnet("");
+    QVERIFY(!selection.isRestrictive());
+
+    selection.setUser("rob");
+    QVERIFY(selection.isRestrictive());
+
+    // The update interval is no filter.
+    selection = FlowSelection();
+    selection.setUpdateIntervalMs(-1);
+    QVERIFY(!selection.isValid());
+    selection.setUpdateIntervalMs(5000);
+    QVERIFY(selection.isValid());
+    QVERIFY(!selection.isRestrictive());
+}
+
+void FlowSelectionTest::testMatches() {
+    IpEndpointPair web(QHostAddress("192.168.1.2"), 4000, QHostAddress("10.0.0.1"), 80, TCP);
+    IpEndpointPair dns(QHostAddress("192.168.1.2"), 5000, QHostAddress("192.168.1.1"), 53, UDP);
+    QDateTime startTime = QDateTime::fromTime_t(1270000000);
+    QList<OsProcess> browser;
+    browser << OsProcess(100, "firefox", "rob", startTime);
+    QList<OsProcess> shared;
+    shared << OsProcess(200, "bash", "root", startTime) << OsProcess(201, "wget", "rob", startTime);
+
+    // Everything passes an empty filter, even flows without processes.
+    FlowSelection selection;
+    QVERIFY(selection.matches(web, browser));
+    QVERIFY(selection.matches(dns, QList<OsProcess>()));
+
+    // Either port can be in range.
+    selection.setPortRange(53, 80);
+    QVERIFY(selection.matches(web, browser));
+    QVERIFY(selection.matches(dns, browser));
+    selection.setPortRange(4000, 4000);
+    QVERIFY(selection.matches(web, browser));
+    QVERIFY(!selection.matches(dns, browser));
+
+    // Remote addresses only.
+    selection = FlowSelection();
+    selection.setRemoteSubnet("10.0.0.0/8");
+    QVERIFY(selection.matches(web, browser));
+    QVERIFY(!selection.matches(dns, browser));
+    selection.setRemoteSubnet("192.168.1.2/32");
+    QVERIFY(!selection.matches(web, browser));
+
+    // Program and user must belong to the same process.
+    selection = FlowSelection();
+    selection.setProgram("wget");
+    QVERIFY(selection.matches(web, shared));
+    QVERIFY(!selection.matches(web, browser));
+    QVERIFY(!selection.matches(web, QList<OsProcess>()));
+    selection.setUser("rob");
+    QVERIFY(selection.matches(web, shared));
+    selection.setUser("root");
+    QVERIFY(!selection.matches(web, shared));
+    selection.setProgram("");
+    QVERIFY(selection.matches(web, shared));
+    QVERIFY(!selection.matches(web, browser));
+}
+
+void FlowSelectionTest::testSortValue() {
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QCOMPARE(FlowSelection(SORT_BY_RATE, 1).sortValue(metrics, stats), 7700LL);
+    QCOMPARE(FlowSelection(SORT_BY_PEAK, 1).sortValue(metrics, stats), 96000LL);
+    QCOMPARE(FlowSelection(SORT_BY_TOTAL, 1).sortValue(metrics, stats), 65200LL);
+}
+
+void FlowSelectionTest::testEquality() {
+    FlowSelection first(SORT_BY_PEAK, 5);
+    first.setProgram("firefox");
+    first.setPortRange(1, 1023);
+    first.setRemoteSubnet("10.0.0.0/8");
+    FlowSelection second(SORT_BY_PEAK, 5);
+    second.setProgram("firefox");
+    second.setPortRange(1, 1023);
+    second.setRemoteSubnet("10.0.0.0/8");
+    QVERIFY(first == second);
+    QCOMPARE(qHash(first), qHash(second));
+
+    second.setUser("rob");
+    QVERIFY(!(first == second));
+    QVERIFY(!(FlowSelection(SORT_BY_PEAK, 5) == FlowSelection(SORT_BY_RATE, 5)));
+    QVERIFY(!(FlowSelection(SORT_BY_PEAK, 5) == FlowSelection(SORT_BY_PEAK, 6)));
+    FlowSelection slow;
+    slow.setUpdateIntervalMs(5000);
+    QVERIFY(!(slow == FlowSelection()));
+}
+
+QTEST_MAIN(FlowSelectionTest)
@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWSELECTIONTEST_H_
+#define FLOWSELECTIONTEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for FlowSelection.
+ */
+class FlowSelectionTest : public QObject {
+    Q_OBJECT
+
+public:
+    FlowSelectionTest();
+    virtual ~FlowSelectionTest();
+
+private slots:
+    // Test which selections are valid and which narrow down the flows.
+    void testValidity();
+
+    // Test filtering by ports, remote subnet, program, and user.
+    void testMatches();
+
+    // Test the measure of how busy a flow is for each sort key.
+    void testSortValue();
+
+    // Test that equal selections are equal and hash alike.
+    void testEquality();
+};
+
+#endif /* FLOWSELECTIONTEST_H_ */
@@ -0,0 +1,149 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <QtCore/QSet>
+
+#include "FlowSlotTableTest.h"
+#include "FlowSlotTable.h"
+#include "NetworkHistory.h"
+
+// Create a distinct flow key for a number.
+static FlowKey makeFlow(int n) {
+    FlowKey flow = FlowKey();
+    flow.localAddr[0] = 192;
+    flow.localAddr[1] = 168;
+    flow.localAddr[2] = n >> 16;
+    flow.localAddr[3] = n >> 8;
+    flow.remoteAddr[0] = 10;
+    flow.remoteAddr[3] = n;
+    flow.localPort = 1024 + n;
+    flow.remotePort = 80;
+    flow.transport = TCP;
+    return flow;
+}
+
+// Create counters.
+static FlowCounters makeCounters(qlonglong bytesIn, qlonglong bytesOut) {
+    FlowCounters counters;
+    counters.bytesIn = bytesIn;
+    counters.bytesOut = bytesOut;
+    counters.packetsIn = bytesIn ? 1 : 0;
+    counters.packetsOut = bytesOut ? 1 : 0;
+    return counters;
+}
+
+FlowSlotTableTest::FlowSlotTableTest() {
+}
+
+FlowSlotTableTest::~FlowSlotTableTest() {
+}
+
+void FlowSlotTableTest::testAddAndFind() {
+    const int flows = 5000;
+    FlowSlotTable table;
+    for (int i = 0; i < flows; i++) {
+        QVERIFY(table.add(makeFlow(i), makeCounters(i, 0)));
+    }
+    for (int i = 0; i < flows; i += 2) {
+        QVERIFY(table.add(makeFlow(i), makeCounters(1, 100)));
+    }
+    QCOMPARE(table.size(), flows);
+    QVERIFY(table.capacity() >= flows);
+
+    for (int i = 0; i < flows; i++) {
+        const FlowCounters* counters = table.find(makeFlow(i));
+        QVERIFY(counters);
+        QCOMPARE(counters->bytesIn, (qlonglong)(i % 2 ? i : i + 1));
+        QCOMPARE(counters->bytesOut, (qlonglong)(i % 2 ? 0 : 100));
+    }
+    QVERIFY(!table.find(makeFlow(flows)));
+
+    // The iterator visits each flow once.
+    QSet<int> visited;
+    FlowSlotTableIterator iter(table);
+    while (iter.hasNext()) {
+        iter.next();
+        int n = iter.key().localPort - 1024;
+        QVERIFY(!visited.contains(n));
+        visited.insert(n);
+    }
+    QCOMPARE(visited.size(), flows);
+}
+
+void FlowSlotTableTest::testClearAndCopy() {
+    FlowSlotTable table;
+    for (int i = 0; i < 1000; i++) {
+        table.add(makeFlow(i), makeCounters(10, 20));
+    }
+    int capacity = table.capacity();
+    FlowSlotTable copy(table);
+
+    // Clearing a shared table leaves the copy alone.
+    table.clear();
+    QVERIFY(table.isEmpty());
+    QVERIFY(!table.find(makeFlow(1)));
+    QCOMPARE(copy.size(), 1000);
+    QVERIFY(copy.find(makeFlow(1)));
+    QCOMPARE(table.capacity(), capacity);
+
+    // So does writing to it.
+    table.add(makeFlow(1), makeCounters(5, 0));
+    QCOMPARE(copy.find(makeFlow(1))->bytesIn, 10LL);
+    QCOMPARE(table.find(makeFlow(1))->bytesIn, 5LL);
+
+    // Clearing an unshared table keeps its capacity.
+    copy.clear();
+    QCOMPARE(copy.capacity(), capacity);
+    QVERIFY(copy.isEmpty());
+    FlowSlotTableIterator iter(copy);
+    QVERIFY(!iter.hasNext());
+}
+
+void FlowSlotTableTest::testOverflow() {
+    FlowSlotTable table(100);
+    for (int i = 0; i < 150; i++) {
+        QCOMPARE(table.add(makeFlow(i), makeCounters(10, 0)), i < 100);
+    }
+    QCOMPARE(table.size(), 100);
+    QCOMPARE(table.getOverflow().bytesIn, 500LL);
+    QCOMPARE(table.getOverflow().packetsIn, 50LL);
+
+    // Existing flows can still be updated.
+    QVERIFY(table.add(makeFlow(99), makeCounters(10, 0)));
+    QCOMPARE(table.find(makeFlow(99))->bytesIn, 20LL);
+
+    table.clear();
+    QCOMPARE(table.getOverflow().bytesIn, 0LL);
+    QVERIFY(table.add(makeFlow(120), makeCounters(10, 0)));
+}
+
+void FlowSlotTableTest::testHistoryOverflow() {
+    const time_t time = 1000;
+    NetworkHistory history(3, 2);
+    history.setMaxFlowsPerSecond(2);
+    history.record(makeFlow(1), makeCounters(10, 0), time);
+    history.record(makeFlow(2), makeCounters(10, 0), time);
+    history.record(makeFlow(3), makeCounters(10, 10), time);
+    history.record(makeFlow(3), makeCounters(10, 0), time + 1);
+    QCOMPARE(history.getOverflowPackets(), 2LL);
+
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > result;
+    history.exportStatistics(result, time + 2);
+    QCOMPARE(result.size(), 3);
+}
+
+QTEST_MAIN(FlowSlotTableTest)
@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef FLOWSLOTTABLETEST_H_
+#define FLOWSLOTTABLETEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for FlowSlotTable.
+ */
+class FlowSlotTableTest : public QObject {
+    Q_OBJECT
+
+public:
+    FlowSlotTableTest();
+    virtual ~FlowSlotTableTest();
+
+private slots:
+    // Test adding and finding flows, including growth of the table.
+    void testAddAndFind();
+
+    // Test that clearing keeps the table's memory and doesn't affect copies.
+    void testClearAndCopy();
+
+    // Test that flows beyond the max are counted as overflow.
+    void testOverflow();
+
+    // Test that network history counts overflow packets.
+    void testHistoryOverflow();
+};
+
+#endif /* FLOWSLOTTABLETEST_H_ */
@@ -0,0 +1,119 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "HistoryTierTest.h"
+#include "HistoryTier.h"
+
+// Create a distinct flow key for a number.
+static FlowKey makeFlow(int n) {
+    FlowKey flow = FlowKey();
+    flow.localAddr[0] = 192;
+    flow.localAddr[1] = 168;
+    flow.remoteAddr[0] = 10;
+    flow.remoteAddr[3] = n;
+    flow.localPort = 1024 + n;
+    flow.remotePort = 80;
+    flow.transport = TCP;
+    return flow;
+}
+
+// Create counters of inbound traffic.
+static FlowCounters makeCounters(qlonglong bytesIn) {
+    FlowCounters counters;
+    counters.bytesIn = bytesIn;
+    counters.bytesOut = 0;
+    counters.packetsIn = 1;
+    counters.packetsOut = 0;
+    return counters;
+}
+
+HistoryTierTest::HistoryTierTest() {
+}
+
+HistoryTierTest::~HistoryTierTest() {
+}
+
+void HistoryTierTest::testRollUp() {
+    HistoryTier tier(10, 6);
+    for (time_t time = 100; time < 130; time++) {
+        tier.record(makeFlow(1), makeCounters(time), time);
+    }
+    tier.record(makeFlow(2), makeCounters(7), 125);
+    QCOMPARE(tier.getSpanSecs(), 60);
+
+    QHash<FlowKey, FlowWindow> result;
+    tier.exportSince(100, result);
+    QCOMPARE(result.size(), 2);
+    const FlowWindow& window = result.value(makeFlow(1));
+    QCOMPARE(window.getTotals().bytesIn, 3435LL);       // 100 + 101 + ... + 129
+    QCOMPARE(window.getTotals().packetsIn, 30LL);
+    QCOMPARE(window.getSlotCount(), 3);                 // one per bucket
+    QCOMPARE(window.getPeakBytes(), 1245LL);            // 120 + 121 + ... + 129
+    QCOMPARE(result.value(makeFlow(2)).getTotals().bytesIn, 7LL);
+
+    // The start of the range is rounded down to a bucket boundary.
+    result.clear();
+    tier.exportSince(115, result);
+    QCOMPARE(result.value(makeFlow(1)).getTotals().bytesIn, 2390LL);
+}
+
+void HistoryTierTest::testTopFlows() {
+    HistoryTier tier(10, 6, 2);
+    tier.record(makeFlow(1), makeCounters(100), 100);
+    tier.record(makeFlow(2), makeCounters(300), 101);
+    tier.record(makeFlow(3), makeCounters(200), 102);
+    tier.record(makeFlow(1), makeCounters(50), 103);
+
+    // The open bucket has every flow.
+    QHash<FlowKey, FlowWindow> result;
+    tier.exportSince(100, result);
+    QCOMPARE(result.size(), 3);
+
+    // Once sealed, only the busiest two remain.
+    tier.rollForward(110);
+    result.clear();
+    tier.exportSince(100, result);
+    QCOMPARE(result.size(), 2);
+    QVERIFY(result.contains(makeFlow(2)));
+    QVERIFY(result.contains(makeFlow(3)));
+}
+
+void HistoryTierTest::testExpiry() {
+    HistoryTier tier(10, 3);
+    tier.record(makeFlow(1), makeCounters(100), 100);
+    tier.record(makeFlow(2), makeCounters(100), 115);
+    tier.record(makeFlow(3), makeCounters(100), 125);
+
+    QHash<FlowKey, FlowWindow> result;
+    tier.exportSince(0, result);
+    QCOMPARE(result.size(), 3);
+
+    // Late traffic for a sealed bucket is ignored.
+    tier.record(makeFlow(4), makeCounters(100), 119);
+    result.clear();
+    tier.exportSince(0, result);
+    QCOMPARE(result.size(), 3);
+
+    // The tier spans three buckets, so the first one is gone.
+    tier.rollForward(130);
+    result.clear();
+    tier.exportSince(0, result);
+    QCOMPARE(result.size(), 2);
+    QVERIFY(!result.contains(makeFlow(1)));
+}
+
+QTEST_MAIN(HistoryTierTest)
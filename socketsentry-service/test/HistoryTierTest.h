@@ -0,0 +1,44 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef HISTORYTIERTEST_H_
+#define HISTORYTIERTEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for HistoryTier.
+ */
+class HistoryTierTest : public QObject {
+    Q_OBJECT
+
+public:
+    HistoryTierTest();
+    virtual ~HistoryTierTest();
+
+private slots:
+    // Test that seconds are summed into buckets and exported by range.
+    void testRollUp();
+
+    // Test that sealed buckets keep only their busiest flows.
+    void testTopFlows();
+
+    // Test that buckets older than the tier's span are forgotten.
+    void testExpiry();
+};
+
+#endif /* HISTORYTIERTEST_H_ */
@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "KernelFlowThreadTest.h"
+#include "TestMain.h"
+#include "KernelFlowThread.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtNetwork/QHostAddress>
+#include <QtTest/QTest>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > StatsTable;
+
+// Ports of the test traffic.
+static const quint16 SENDER_PORT = 41001;
+static const quint16 RECEIVER_PORT = 41002;
+
+// Send UDP datagrams over loopback from the sender port to the receiver port.
+static void sendDatagrams(bool ipv6, int count, int payloadLength) {
+    int family = ipv6 ? AF_INET6 : AF_INET;
+    sockaddr_storage senderAddr;
+    sockaddr_storage receiverAddr;
+    ::memset(&senderAddr, 0, sizeof(senderAddr));
+    ::memset(&receiverAddr, 0, sizeof(receiverAddr));
+    socklen_t addrLength;
+    if (ipv6) {
+        sockaddr_in6* sender = reinterpret_cast<sockaddr_in6*>(&senderAddr);
+        sender->sin6_family = AF_INET6;
+        sender->sin6_addr = in6addr_loopback;
+        sender->sin6_port = htons(SENDER_PORT);
+        sockaddr_in6* receiver = reinterpret_cast<sockaddr_in6*>(&receiverAddr);
+        *receiver = *sender;
+        receiver->sin6_port = htons(RECEIVER_PORT);
+        addrLength = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in* sender = reinterpret_cast<sockaddr_in*>(&senderAddr);
+        sender->sin_family = AF_INET;
+        sender->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sender->sin_port = htons(SENDER_PORT);
+        sockaddr_in* receiver = reinterpret_cast<sockaddr_in*>(&receiverAddr);
+        *receiver = *sender;
+        receiver->sin_port = htons(RECEIVER_PORT);
+        addrLength = sizeof(sockaddr_in);
+    }
+    int receiver = ::socket(family, SOCK_DGRAM, 0);
+    int sender = ::socket(family, SOCK_DGRAM, 0);
+    QVERIFY(receiver >= 0 && sender >= 0);
+    QCOMPARE(::bind(receiver, reinterpret_cast<sockaddr*>(&receiverAddr), addrLength), 0);
+    QCOMPARE(::bind(sender, reinterpret_cast<sockaddr*>(&senderAddr), addrLength), 0);
+    QByteArray payload(payloadLength, 'x');
+    for (int i = 0; i < count; ++i) {
+        QCOMPARE((int)::sendto(sender, payload.constData(), payload.size(), 0,
+                reinterpret_cast<sockaddr*>(&receiverAddr), addrLength), payloadLength);
+    }
+    ::close(sender);
+    ::close(receiver);
+}
+
+KernelFlowThreadTest::KernelFlowThreadTest() {
+}
+
+KernelFlowThreadTest::~KernelFlowThreadTest() {
+}
+
+void KernelFlowThreadTest::testLoopbackUdp() {
+    KernelFlowThread thread(0, "lo", "", 1024);
+    thread.begin();
+    StatsTable stats;
+    QString error;
+    if (!thread.fillStatistics(stats, error)) {
+        thread.wait();
+        QSKIP(QString("Can't count flows in the kernel: %1").arg(error).toLatin1().constData(), SkipSingle);
+    }
+
+    sendDatagrams(false, 10, 100);
+    sendDatagrams(true, 3, 50);
+
+    // The map is read once a second and statistics don't include the current second.
+    QTest::qWait(2500);
+    stats.clear();
+    QVERIFY(thread.fillStatistics(stats, error));
+    thread.cancel();
+    thread.wait();
+
+    // Each datagram is counted once, with a UDP header, an IP header, and a fake Ethernet header.
+    IpEndpointPair ipv4Flow(QHostAddress("127.0.0.1"), RECEIVER_PORT, QHostAddress("127.0.0.1"), SENDER_PORT, UDP);
+    QVERIFY(stats.contains(ipv4Flow));
+    QCOMPARE(stats.value(ipv4Flow).first.getPacketsIn(), 10LL);
+    QCOMPARE(stats.value(ipv4Flow).first.getBytesIn(), 10LL * (100 + 8 + 20 + 14));
+    QCOMPARE(stats.value(ipv4Flow).first.getPacketsOut(), 0LL);
+    IpEndpointPair ipv6Flow(QHostAddress("::1"), RECEIVER_PORT, QHostAddress("::1"), SENDER_PORT, UDP6);
+    QVERIFY(stats.contains(ipv6Flow));
+    QCOMPARE(stats.value(ipv6Flow).first.getPacketsIn(), 3LL);
+    QCOMPARE(stats.value(ipv6Flow).first.getBytesIn(), 3LL * (50 + 8 + 40 + 14));
+}
+
+void KernelFlowThreadTest::testCustomFilter() {
+    KernelFlowThread thread(0, "lo", "port 53", 1024);
+    thread.begin();
+    StatsTable stats;
+    QString error;
+    QVERIFY(!thread.fillStatistics(stats, error));
+    QVERIFY(error.contains("filter"));
+    thread.wait();
+}
+
+QTEST_GMOCK_MAIN(KernelFlowThreadTest)
@@ -0,0 +1,42 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef KERNELFLOWTHREADTEST_H_
+#define KERNELFLOWTHREADTEST_H_
+
+#include <QtCore/QObject>
+
+/*
+ * Test for KernelFlowThread. It counts real traffic on the loopback device, so it needs the privileges to load eBPF
+ * programs and open packet sockets (e.g. root in a local network namespace). Without them, the tests are skipped.
+ */
+class KernelFlowThreadTest : public QObject {
+    Q_OBJECT
+
+public:
+    KernelFlowThreadTest();
+    virtual ~KernelFlowThreadTest();
+
+private slots:
+    // Test that IPv4 and IPv6 UDP datagrams over loopback are counted once each, inbound to the receiver.
+    void testLoopbackUdp();
+
+    // Test that custom capture filters are refused.
+    void testCustomFilter();
+};
+
+#endif /* KERNELFLOWTHREADTEST_H_ */
@@ -28,6 +28,7 @@
 #include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QPair>
+#include <QtCore/QSet>
 #include <gmock/gmock.h>
 
 /*
@@ -36,6 +37,8 @@
 class MockConnectionProcessCorrelator : public IConnectionProcessCorrelator {
 public:
     MOCK_METHOD2(correlate, bool(QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error));
+    MOCK_METHOD3(correlateEndpoints, bool(const QSet<IpEndpointPair>& endpoints,
+            QHash<IpEndpointPair, QList<OsProcess> >& result, QString& error));
 };
 
 #endif /* MOCKCONNECTIONPROCESSCORRELATOR_H_ */
@@ -40,9 +40,11 @@ public:
     MOCK_CONST_METHOD0(findCurrentDevices, QStringList());
     MOCK_CONST_METHOD3(fillStatistics, bool(const QString& device, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
             QString& error));
+    MOCK_CONST_METHOD4(fillHistory, bool(const QString& device, int windowSecs,
+            QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error));
     MOCK_METHOD1(release, void(const QString& device));
     MOCK_METHOD0(releaseAll, void());
-    MOCK_CONST_METHOD1(anyTrafficSince, bool(time_t));
+    MOCK_CONST_METHOD2(isIdle, bool(const QString& device, int secs));
     MOCK_CONST_METHOD0(isStopped, bool());
     MOCK_CONST_METHOD1(isActive, bool(const QString& device));
     MOCK_CONST_METHOD0(getCustomFilter, QString());
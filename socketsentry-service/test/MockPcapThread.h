@@ -37,10 +37,12 @@ public:
     MOCK_METHOD0(keepAlive, bool());
     MOCK_METHOD0(cancel, void());
     MOCK_METHOD2(fillStatistics, bool(QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result, QString& error));
+    MOCK_METHOD3(fillHistory, bool(int windowSecs, QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> >& result,
+            QString& error));
     MOCK_METHOD0(begin, void());
     MOCK_CONST_METHOD0(isDone, bool());
     MOCK_CONST_METHOD0(canContinue, bool());
-    MOCK_CONST_METHOD1(anyTrafficSince, bool(time_t));
+    MOCK_CONST_METHOD1(isIdle, bool(int secs));
 
 };
 
@@ -18,13 +18,47 @@
 #include <QtNetwork/QHostAddress>
 #include <QtCore/QHash>
 #include <QtCore/QPair>
+#include <QtCore/QVector>
 #include <sys/time.h>
+#include <stdlib.h>
 
 #include "NetworkHistoryTest.h"
 #include "NetworkHistory.h"
 #include "IpEndpointPair.h"
 #include "FlowMetrics.h"
 #include "FlowStatistics.h"
+#include "PacketBatch.h"
+#include "FlowKey.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+// Number of heap allocations while counting is turned on. Qt containers allocate with malloc and realloc, which this
+// test interposes on to count calls.
+static bool countAllocations = false;
+static int allocations = 0;
+
+extern "C" void* malloc(size_t size) __THROW {
+    if (countAllocations) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) __THROW {
+    if (countAllocations) {
+        allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+// Record a little traffic of each flow at the given time.
+static void recordFlows(NetworkHistory& history, const QVector<FlowKey>& flows, time_t time) {
+    FlowCounters counters = { 1000, 100, 2, 1 };
+    for (int i = 0; i < flows.size(); i++) {
+        history.record(flows.at(i), counters, time);
+    }
+}
 
 NetworkHistoryTest::NetworkHistoryTest() {
 }
@@ -134,4 +168,144 @@ void NetworkHistoryTest::verifySingleResult(const QHash<IpEndpointPair, QPair<Fl
     QCOMPARE(actualPair.first, metrics);
 }
 
+void NetworkHistoryTest::testRecordBatch() {
+    IpEndpointPair webFlow(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP);
+    IpEndpointPair sshFlow(QHostAddress("192.168.100.1"), 543, QHostAddress("10.10.1.20"), 22, TCP);
+    const time_t time = 1000;
+    FlowKey webKey = FlowKey::fromEndpointPair(webFlow);
+    FlowKey sshKey = FlowKey::fromEndpointPair(sshFlow);
+    PacketBatch batch;
+    batch.add(webKey, INBOUND, 1000, time);
+    batch.add(sshKey, OUTBOUND, 300, time);
+    batch.add(webKey, OUTBOUND, 200, time);
+    batch.add(webKey, INBOUND, 500, time + 1);
+
+    // Batched recording matches recording each packet.
+    NetworkHistory batchHistory(3, 2);
+    batchHistory.recordBatch(batch);
+    NetworkHistory packetHistory(3, 2);
+    packetHistory.record(webFlow, FlowMetrics(1000, 0, 1, 0), time);
+    packetHistory.record(sshFlow, FlowMetrics(0, 300, 0, 1), time);
+    packetHistory.record(webFlow, FlowMetrics(0, 200, 0, 1), time);
+    packetHistory.record(webFlow, FlowMetrics(500, 0, 1, 0), time + 1);
+
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > batchResult;
+    batchHistory.exportStatistics(batchResult, time + 2);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > packetResult;
+    packetHistory.exportStatistics(packetResult, time + 2);
+    QCOMPARE(batchResult.size(), 2);
+    QCOMPARE(batchResult.value(webFlow).first, FlowMetrics(1500, 200, 2, 1));
+    QCOMPARE(batchResult.value(webFlow), packetResult.value(webFlow));
+    QCOMPARE(batchResult.value(sshFlow), packetResult.value(sshFlow));
+    QVERIFY(batchHistory.anyTrafficSince(time + 1));
+}
+
+void NetworkHistoryTest::testLateRecords() {
+    IpEndpointPair endpoints(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP);
+    const time_t time = 1000;
+    NetworkHistory history(4, 3);
+    history.record(endpoints, FlowMetrics(100, 0, 1, 0), time);
+    history.record(endpoints, FlowMetrics(50, 0, 1, 0), time + 1);
+    history.record(endpoints, FlowMetrics(10, 0, 1, 0), time + 2);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > result;
+
+    history.exportStatistics(result, time + 3);
+    QCOMPARE(result.value(endpoints).first, FlowMetrics(160, 0, 3, 0));
+    QCOMPARE(result.value(endpoints).second, FlowStatistics(30, 0, 100, false, true));
+
+    history.exportStatistics(result, time + 4);
+    QCOMPARE(result.value(endpoints).second.getPeakBytesPerSec(), 50LL);    // peak at time+0 expired
+
+    // Records arriving after their slots have entered the statistics window are still counted.
+    history.record(endpoints, FlowMetrics(70, 0, 1, 0), time + 2);
+    history.record(endpoints, FlowMetrics(0, 4, 0, 1), time + 3);
+    history.exportStatistics(result, time + 4);
+    QCOMPARE(result.value(endpoints).first, FlowMetrics(130, 4, 3, 1));
+    QCOMPARE(result.value(endpoints).second, FlowStatistics(40, 2, 80, true, false));
+
+    history.exportStatistics(result, time + 7);
+    QCOMPARE(result.size(), 0);
+}
+
+void NetworkHistoryTest::testExportHistory() {
+    IpEndpointPair webFlow(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP);
+    IpEndpointPair sshFlow(QHostAddress("192.168.100.1"), 543, QHostAddress("10.10.1.20"), 22, TCP);
+    const time_t time = 10000;
+    NetworkHistory history;
+    for (int i = 0; i < 100; i++) {
+        history.record(webFlow, FlowMetrics(1000, 0, 1, 0), time + i);
+    }
+    history.record(sshFlow, FlowMetrics(0, 500, 0, 1), time + 50);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > result;
+
+    // Ten minutes come from the ten-second tier. Rates are averages over the range, peaks are bucket averages.
+    history.exportHistory(600, result, time + 100);
+    QCOMPARE(result.size(), 2);
+    QCOMPARE(result.value(webFlow).first, FlowMetrics(100000, 0, 100, 0));
+    QCOMPARE(result.value(webFlow).second, FlowStatistics(166, 0, 1000, false, false));
+    QCOMPARE(result.value(sshFlow).first, FlowMetrics(0, 500, 0, 1));
+    QCOMPARE(result.value(sshFlow).second, FlowStatistics(0, 0, 50, false, false));
+
+    // Short ranges are rounded out to whole buckets.
+    history.exportHistory(20, result, time + 100);
+    QCOMPARE(result.size(), 1);
+    QCOMPARE(result.value(webFlow).first, FlowMetrics(20000, 0, 20, 0));
+
+    // An hour comes from the one-minute tier.
+    history.exportHistory(3600, result, time + 100);
+    QCOMPARE(result.value(webFlow).first, FlowMetrics(100000, 0, 100, 0));
+    QCOMPARE(result.value(webFlow).second.getPeakBytesPerSec(), 1000LL);
+
+    // Long after the traffic, it's gone from all tiers.
+    history.exportHistory(3600, result, time + 5000);
+    QCOMPARE(result.size(), 0);
+}
+
+void NetworkHistoryTest::testPublishAllocations() {
+    QVector<FlowKey> flows;
+    for (int i = 0; i < 1000; i++) {
+        flows.append(FlowKey::fromEndpointPair(
+                IpEndpointPair(QHostAddress("192.168.100.1"), 1024 + i, QHostAddress("10.10.1.1"), 80, TCP)));
+    }
+
+    // Two identical histories. The results of one are published (kept) while it rolls; the other's are discarded.
+    const time_t time = 10000;
+    NetworkHistory discarded;
+    NetworkHistory published;
+    for (time_t t = time; t < time + 4; t++) {
+        recordFlows(discarded, flows, t);
+        recordFlows(published, flows, t);
+    }
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > statistics;
+    discarded.exportStatistics(statistics, time + 3);
+    discarded.snapshotTiers(time + 3);
+    statistics.clear();
+    published.exportStatistics(statistics, time + 3);
+    TierSnapshot tiers = published.snapshotTiers(time + 3);
+    QCOMPARE(statistics.size(), flows.size());
+
+    // Roll both forward with more traffic.
+    allocations = 0;
+    countAllocations = true;
+    recordFlows(discarded, flows, time + 4);
+    countAllocations = false;
+    const int discardedAllocations = allocations;
+    allocations = 0;
+    countAllocations = true;
+    recordFlows(published, flows, time + 4);
+    countAllocations = false;
+    const int publishedAllocations = allocations;
+
+    // The published results don't make the roll copy the history per flow. Only the vector of tiers and each tier's
+    // open bucket are copied, in one piece each.
+    QVERIFY(publishedAllocations - discardedAllocations <= 1 + tiers.tiers.size());
+
+    // The published results are unchanged.
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > history;
+    NetworkHistory::exportHistory(tiers, 600, history);
+    QCOMPARE(history.size(), flows.size());
+    QCOMPARE(history.values().first().first, FlowMetrics(3000, 300, 6, 3));
+    QCOMPARE(statistics.values().first().first, FlowMetrics(3000, 300, 6, 3));
+}
+
 QTEST_MAIN(NetworkHistoryTest)
@@ -44,6 +44,10 @@ private:
 private slots:
     void testExportStatistics();
     void testRecordAndRoll();
+    void testRecordBatch();
+    void testLateRecords();
+    void testExportHistory();
+    void testPublishAllocations();
 };
 
 #endif /* NETWORKHISTORYTEST_H_ */
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <QtNetwork/QHostAddress>
+
+#include "PacketBatchTest.h"
+#include "PacketBatch.h"
+#include "IpEndpointPair.h"
+#include "FlowKey.h"
+
+PacketBatchTest::PacketBatchTest() {
+}
+
+PacketBatchTest::~PacketBatchTest() {
+}
+
+void PacketBatchTest::testAggregation() {
+    FlowKey webFlow = FlowKey::fromEndpointPair(
+            IpEndpointPair(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP));
+    FlowKey sshFlow = FlowKey::fromEndpointPair(
+            IpEndpointPair(QHostAddress("192.168.100.1"), 543, QHostAddress("10.10.1.20"), 22, TCP));
+    const time_t time = 1000;
+    PacketBatch batch;
+    QVERIFY(batch.isEmpty());
+
+    batch.add(webFlow, INBOUND, 1500, time);
+    batch.add(webFlow, INBOUND, 1500, time);
+    batch.add(sshFlow, OUTBOUND, 100, time);
+    batch.add(webFlow, OUTBOUND, 60, time);                 // same flow again, after another flow
+    batch.add(webFlow, INBOUND, 1500, time + 1);            // same flow, next second
+    FlowKey sameWebFlow = webFlow;
+    batch.add(sameWebFlow, INBOUND, 40, time);              // equal but not identical flow
+
+    QCOMPARE(batch.size(), 3);
+    const PacketBatch::Entry& web = batch.at(0);
+    QVERIFY(web.flow == webFlow);
+    QCOMPARE((qlonglong)web.sampleTime, (qlonglong)time);
+    QCOMPARE(web.bytesIn, 3040LL);
+    QCOMPARE(web.packetsIn, 3LL);
+    QCOMPARE(web.bytesOut, 60LL);
+    QCOMPARE(web.packetsOut, 1LL);
+
+    const PacketBatch::Entry& ssh = batch.at(1);
+    QVERIFY(ssh.flow == sshFlow);
+    QCOMPARE(ssh.bytesIn, 0LL);
+    QCOMPARE(ssh.bytesOut, 100LL);
+
+    const PacketBatch::Entry& webLater = batch.at(2);
+    QVERIFY(webLater.flow == webFlow);
+    QCOMPARE((qlonglong)webLater.sampleTime, (qlonglong)(time + 1));
+    QCOMPARE(webLater.bytesIn, 1500LL);
+}
+
+void PacketBatchTest::testFullAndClear() {
+    const time_t time = 1000;
+    PacketBatch batch;
+    for (int i = 0; i < PacketBatch::CAPACITY; i++) {
+        QVERIFY(!batch.isFull());
+        FlowKey flow = FlowKey::fromEndpointPair(
+                IpEndpointPair(QHostAddress("192.168.100.1"), 1024 + i, QHostAddress("10.10.1.1"), 80, TCP));
+        batch.add(flow, INBOUND, 100, time);
+    }
+    QVERIFY(batch.isFull());
+    QCOMPARE(batch.size(), PacketBatch::CAPACITY);
+
+    batch.clear();
+    QVERIFY(batch.isEmpty());
+    FlowKey flow = FlowKey::fromEndpointPair(
+            IpEndpointPair(QHostAddress("192.168.100.1"), 1024, QHostAddress("10.10.1.1"), 80, TCP));
+    batch.add(flow, OUTBOUND, 200, time);
+    QCOMPARE(batch.size(), 1);
+    QCOMPARE(batch.at(0).bytesIn, 0LL);                     // no leftovers from before clearing
+    QCOMPARE(batch.at(0).bytesOut, 200LL);
+}
+
+QTEST_MAIN(PacketBatchTest)
@@ -99,9 +99,9 @@ protected:
 
         // First thread reports no traffic.
         MockPcapThread* mock = new MockPcapThread();
-        EXPECT_CALL(*mock, anyTrafficSince(_))
+        EXPECT_CALL(*mock, isIdle(_))
             .Times(AnyNumber())
-            .WillRepeatedly(Return(_createdOneThread));
+            .WillRepeatedly(Return(!_createdOneThread));
         EXPECT_CALL(*mock, begin())
             .Times(1);
         EXPECT_CALL(*mock, cancel())
@@ -200,13 +200,15 @@ void PcapManagerTest::testThreadManagement() {
     QVERIFY(pcapManager.isStopped());
 }
 
-void PcapManagerTest::testAnyTrafficSince() {
+void PcapManagerTest::testIdle() {
     TrafficTestPcapManager pcapManager;
     pcapManager.showInterest("eth0");
-    time_t timeSecs = 1000;
-    QVERIFY(!pcapManager.anyTrafficSince(timeSecs));
+    int secs = 5;
+    QVERIFY(pcapManager.isIdle("eth0", secs));
     pcapManager.showInterest("eth1");
-    QVERIFY(pcapManager.anyTrafficSince(timeSecs));
+    QVERIFY(!pcapManager.isIdle("eth1", secs));
+    QVERIFY(pcapManager.isIdle("eth0", secs));
+    QVERIFY(pcapManager.isIdle("eth2", secs));      // not captured
     pcapManager.releaseAll();
     QTest::qWait(TIMER_INTERVAL_MS * 2 + 500);      // allow threads to drain out
     QVERIFY(pcapManager.isStopped());
@@ -37,8 +37,8 @@ private slots:
     // Test thread lifecycle management.
     void testThreadManagement();
 
-    // Test query for traffic since a given time.
-    void testAnyTrafficSince();
+    // Test query for devices without traffic for a given number of seconds.
+    void testIdle();
 
     // Test that manager queries threads for their status on demand.
     void testActiveThreadProbe();
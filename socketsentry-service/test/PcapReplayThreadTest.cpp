@@ -0,0 +1,193 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PcapReplayThreadTest.h"
+#include "TestMain.h"
+#include "PcapReplayThread.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QTime>
+#include <QtNetwork/QHostAddress>
+#include <QtTest/QTest>
+
+#include <arpa/inet.h>
+#include <string.h>
+
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > StatsTable;
+
+// Start time of the trace (and the simulated clock).
+static const quint32 TRACE_START = 1000000000;
+
+// Request and response payload sizes, and the size of their Ethernet, IPv4, and UDP headers.
+static const int REQUEST_PAYLOAD = 100;
+static const int RESPONSE_PAYLOAD = 200;
+static const int HEADERS = 14 + 20 + 8;
+
+// Append a value to a buffer in host byte order.
+template <class T> static void append(QByteArray& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Append a libpcap record of an Ethernet frame with a UDP datagram to a trace.
+static void appendDatagram(QByteArray& trace, quint32 seconds, quint32 micros, const char* srcAddr, quint16 srcPort,
+        const char* destAddr, quint16 destPort, int payloadLength) {
+    QByteArray frame(HEADERS + payloadLength, '\0');
+    u_char* bytes = reinterpret_cast<u_char*>(frame.data());
+    bytes[12] = 0x08;                           // EtherType IPv4
+    u_char* ip = bytes + 14;
+    ip[0] = 0x45;                               // version 4, 20-byte header
+    quint16 ipLength = htons(20 + 8 + payloadLength);
+    ::memcpy(ip + 2, &ipLength, 2);
+    ip[8] = 64;                                 // TTL
+    ip[9] = 17;                                 // UDP
+    ::inet_pton(AF_INET, srcAddr, ip + 12);
+    ::inet_pton(AF_INET, destAddr, ip + 16);
+    u_char* udp = ip + 20;
+    quint16 ports[3] = { htons(srcPort), htons(destPort), htons(8 + payloadLength) };
+    ::memcpy(udp, ports, sizeof(ports));
+
+    append(trace, seconds);
+    append(trace, micros);
+    append(trace, (quint32)frame.size());       // captured length
+    append(trace, (quint32)frame.size());       // original length
+    trace.append(frame);
+}
+
+// Wait until the replay thread has replayed the whole trace. Returns false if it takes more than the given time.
+static bool waitForReplay(const PcapReplayThread& thread, int timeoutMs) {
+    QTime timer;
+    timer.start();
+    while (!thread.isReplayDone() && timer.elapsed() < timeoutMs) {
+        QTest::qWait(10);
+    }
+    return thread.isReplayDone();
+}
+
+PcapReplayThreadTest::PcapReplayThreadTest() {
+}
+
+PcapReplayThreadTest::~PcapReplayThreadTest() {
+}
+
+void PcapReplayThreadTest::initTestCase() {
+    QByteArray trace;
+    append(trace, (quint32)0xa1b2c3d4);         // magic
+    append(trace, (quint16)2);                  // major version
+    append(trace, (quint16)4);                  // minor version
+    append(trace, (qint32)0);                   // time zone
+    append(trace, (quint32)0);                  // timestamp accuracy
+    append(trace, (quint32)65535);              // snapshot length
+    append(trace, (quint32)1);                  // Ethernet
+
+    // Three requests one second apart, each answered a quarter second later except the last.
+    for (quint32 i = 0; i < 3; ++i) {
+        appendDatagram(trace, TRACE_START + i, 0, "10.0.0.1", 5000, "10.0.0.2", 53, REQUEST_PAYLOAD);
+        if (i < 2) {
+            appendDatagram(trace, TRACE_START + i, 250000, "10.0.0.2", 53, "10.0.0.1", 5000, RESPONSE_PAYLOAD);
+        }
+    }
+    QVERIFY(_trace.open());
+    QCOMPARE(_trace.write(trace), (qint64)trace.size());
+    QVERIFY(_trace.flush());
+}
+
+void PcapReplayThreadTest::testReplayAsFastAsPossible() {
+    QList<QHostAddress> localAddresses;
+    localAddresses << QHostAddress("10.0.0.1");
+    PcapReplayThread thread(0, "file:" + _trace.fileName(), _trace.fileName(), "", 0, localAddresses);
+    thread.begin();
+    QVERIFY(waitForReplay(thread, 5000));
+    QCOMPARE(thread.getPacketsReplayed(), 5);
+
+    // Idleness is measured on the trace's clock, which ends a second after the last packet, not on the system's.
+    QVERIFY(!thread.isIdle(5));
+    QVERIFY(thread.isIdle(0));
+
+    StatsTable stats;
+    QString error;
+    QVERIFY(thread.fillStatistics(stats, error));
+    thread.cancel();
+    thread.wait();
+
+    QCOMPARE(stats.size(), 1);
+    IpEndpointPair flow(QHostAddress("10.0.0.1"), 5000, QHostAddress("10.0.0.2"), 53, UDP);
+    QVERIFY(stats.contains(flow));
+    const FlowMetrics& metrics = stats.value(flow).first;
+    QCOMPARE(metrics.getPacketsOut(), 3LL);
+    QCOMPARE(metrics.getBytesOut(), 3LL * (HEADERS + REQUEST_PAYLOAD));
+    QCOMPARE(metrics.getPacketsIn(), 2LL);
+    QCOMPARE(metrics.getBytesIn(), 2LL * (HEADERS + RESPONSE_PAYLOAD));
+
+    // The last second of the trace only had a request.
+    const FlowStatistics& statistics = stats.value(flow).second;
+    QVERIFY(statistics.isSendingNow());
+    QVERIFY(!statistics.isReceivingNow());
+}
+
+void PcapReplayThreadTest::testReplaySpeed() {
+    // The trace spans two seconds, which takes half a second at 4x.
+    PcapReplayThread thread(0, "file:" + _trace.fileName(), _trace.fileName(), "", 4);
+    QTime timer;
+    timer.start();
+    thread.begin();
+    QVERIFY(waitForReplay(thread, 5000));
+    int elapsedMs = timer.elapsed();
+    thread.cancel();
+    thread.wait();
+    QVERIFY2(elapsedMs >= 450, QString::number(elapsedMs).toLatin1().constData());
+    QVERIFY2(elapsedMs < 2000, QString::number(elapsedMs).toLatin1().constData());
+}
+
+void PcapReplayThreadTest::testNoLocalAddresses() {
+    PcapReplayThread thread(0, "file:" + _trace.fileName(), _trace.fileName(), "", 0);
+    thread.begin();
+    QVERIFY(waitForReplay(thread, 5000));
+    StatsTable stats;
+    QString error;
+    QVERIFY(thread.fillStatistics(stats, error));
+    thread.cancel();
+    thread.wait();
+
+    // Requests and responses look like separate outbound flows.
+    QCOMPARE(stats.size(), 2);
+    IpEndpointPair requests(QHostAddress("10.0.0.1"), 5000, QHostAddress("10.0.0.2"), 53, UDP);
+    IpEndpointPair responses(QHostAddress("10.0.0.2"), 53, QHostAddress("10.0.0.1"), 5000, UDP);
+    QVERIFY(stats.contains(requests));
+    QVERIFY(stats.contains(responses));
+    QCOMPARE(stats.value(requests).first.getPacketsOut(), 3LL);
+    QCOMPARE(stats.value(responses).first.getPacketsOut(), 2LL);
+    QCOMPARE(stats.value(responses).first.getPacketsIn(), 0LL);
+}
+
+void PcapReplayThreadTest::testMissingFile() {
+    PcapReplayThread thread(0, "file:/nonexistent/trace.pcap", "/nonexistent/trace.pcap", "", 0);
+    thread.begin();
+    StatsTable stats;
+    QString error;
+    QVERIFY(!thread.fillStatistics(stats, error));
+    QVERIFY(error.contains("trace"));
+    thread.wait();
+    QVERIFY(!thread.isReplayDone());
+}
+
+QTEST_GMOCK_MAIN(PcapReplayThreadTest)
@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PCAPREPLAYTHREADTEST_H_
+#define PCAPREPLAYTHREADTEST_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QTemporaryFile>
+
+/*
+ * Unit test for PcapReplayThread. Replays a small trace file of a UDP request/response exchange.
+ */
+class PcapReplayThreadTest : public QObject {
+    Q_OBJECT
+
+public:
+    PcapReplayThreadTest();
+    virtual ~PcapReplayThreadTest();
+
+private slots:
+    // Write the trace file.
+    void initTestCase();
+
+    // Test that the whole trace is recorded and exported as of the simulated time just after the last packet.
+    void testReplayAsFastAsPossible();
+
+    // Test that packets are paced according to their timestamps and the replay speed.
+    void testReplaySpeed();
+
+    // Test that packet sources are taken to be local if no local addresses are given.
+    void testNoLocalAddresses();
+
+    // Test that a missing trace file is reported as a capture error.
+    void testMissingFile();
+
+private:
+    // The trace file.
+    QTemporaryFile _trace;
+};
+
+#endif /* PCAPREPLAYTHREADTEST_H_ */
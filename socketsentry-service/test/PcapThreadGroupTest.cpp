@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PcapThreadGroupTest.h"
+#include "TestMain.h"
+#include "PcapThreadGroup.h"
+#include "MockPcapThread.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtNetwork/QHostAddress>
+#include <QtTest/QTest>
+#include <gmock/gmock.h>
+
+using ::testing::Return;
+using ::testing::AnyNumber;
+using ::testing::DoAll;
+using ::testing::SetArgReferee;
+using ::testing::_;
+
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > StatsTable;
+
+PcapThreadGroupTest::PcapThreadGroupTest() {
+}
+
+PcapThreadGroupTest::~PcapThreadGroupTest() {
+}
+
+void PcapThreadGroupTest::testFillStatistics() {
+    IpEndpointPair webFlow(QHostAddress("192.168.100.1"), 123, QHostAddress("10.10.1.1"), 80, TCP);
+    IpEndpointPair sshFlow(QHostAddress("192.168.100.1"), 543, QHostAddress("10.10.1.20"), 22, TCP);
+    IpEndpointPair dnsFlow(QHostAddress("192.168.100.1"), 5353, QHostAddress("10.10.1.53"), 53, UDP);
+
+    // Each worker sees a different part of the traffic. The web flow shows up on both.
+    StatsTable firstShard;
+    firstShard.insert(webFlow, qMakePair(FlowMetrics(1000, 200, 10, 2), FlowStatistics(100, 20, 500, true, false)));
+    firstShard.insert(sshFlow, qMakePair(FlowMetrics(50, 60, 1, 1), FlowStatistics(5, 6, 60, false, false)));
+    StatsTable secondShard;
+    secondShard.insert(webFlow, qMakePair(FlowMetrics(0, 300, 0, 3), FlowStatistics(0, 30, 300, false, true)));
+    secondShard.insert(dnsFlow, qMakePair(FlowMetrics(90, 70, 1, 1), FlowStatistics(9, 7, 90, false, false)));
+
+    MockPcapThread* first = new MockPcapThread();
+    EXPECT_CALL(*first, fillStatistics(_, _))
+        .WillOnce(DoAll(SetArgReferee<0>(firstShard), Return(true)));
+    MockPcapThread* second = new MockPcapThread();
+    EXPECT_CALL(*second, fillStatistics(_, _))
+        .WillOnce(DoAll(SetArgReferee<0>(secondShard), Return(true)));
+    PcapThreadGroup group(QList<IPcapThread*>() << first << second);
+
+    StatsTable result;
+    QString error;
+    QVERIFY(group.fillStatistics(result, error));
+    QVERIFY(error.isEmpty());
+    QCOMPARE(result.size(), 3);
+    QCOMPARE(result[webFlow].first, FlowMetrics(1000, 500, 10, 5));
+    QCOMPARE(result[webFlow].second, FlowStatistics(100, 50, 800, true, true));
+    QCOMPARE(result[sshFlow].first, FlowMetrics(50, 60, 1, 1));
+    QCOMPARE(result[dnsFlow].first, FlowMetrics(90, 70, 1, 1));
+}
+
+void PcapThreadGroupTest::testFillStatisticsError() {
+    MockPcapThread* first = new MockPcapThread();
+    EXPECT_CALL(*first, fillStatistics(_, _))
+        .WillOnce(Return(true));
+    MockPcapThread* second = new MockPcapThread();
+    EXPECT_CALL(*second, fillStatistics(_, _))
+        .WillOnce(DoAll(SetArgReferee<1>(QString("Capture failed")), Return(false)));
+    PcapThreadGroup group(QList<IPcapThread*>() << first << second);
+
+    StatsTable result;
+    QString error;
+    QVERIFY(!group.fillStatistics(result, error));
+    QCOMPARE(error, QString("Capture failed"));
+    QVERIFY(result.isEmpty());
+}
+
+void PcapThreadGroupTest::testKeepAlive() {
+    MockPcapThread* first = new MockPcapThread();
+    EXPECT_CALL(*first, keepAlive())
+        .WillOnce(Return(true))
+        .WillOnce(Return(false));
+    EXPECT_CALL(*first, cancel())
+        .Times(1);
+    MockPcapThread* second = new MockPcapThread();
+    EXPECT_CALL(*second, keepAlive())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*second, cancel())
+        .Times(1);
+    PcapThreadGroup group(QList<IPcapThread*>() << first << second);
+
+    QVERIFY(group.keepAlive());
+    QVERIFY(!group.keepAlive());
+}
+
+QTEST_GMOCK_MAIN(PcapThreadGroupTest)
@@ -0,0 +1,44 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PCAPTHREADGROUPTEST_H_
+#define PCAPTHREADGROUPTEST_H_
+
+#include <QtCore/QObject>
+
+/*
+ * Unit test for PcapThreadGroup.
+ */
+class PcapThreadGroupTest : public QObject {
+    Q_OBJECT
+
+public:
+    PcapThreadGroupTest();
+    virtual ~PcapThreadGroupTest();
+
+private slots:
+    // Test that statistics from all workers are merged.
+    void testFillStatistics();
+
+    // Test that an error from any worker fails the whole group.
+    void testFillStatisticsError();
+
+    // Test that the group shuts down all workers if any of them is shutting down.
+    void testKeepAlive();
+};
+
+#endif /* PCAPTHREADGROUPTEST_H_ */
@@ -0,0 +1,662 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "PipelineBenchmark.h"
+#include "TestMain.h"
+#include "MockConnectionProcessCorrelator.h"
+#include "MockPcapManager.h"
+#include "Watcher.h"
+#include "DataLinkPacketDecoder.h"
+#include "InternetProtocolDecoder.h"
+#include "NetworkHistory.h"
+#include "FlowKey.h"
+#include "FlowSlotTable.h"
+#include "ProcNetReader.h"
+#include "ProcessSocketIndex.h"
+#include "SocketRecord.h"
+#include "CommunicationFlow.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+#include "OsProcess.h"
+#include "FlowBatchCodec.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QTextStream>
+#include <QtCore/QTime>
+#include <QtCore/QVector>
+#include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusMetaType>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkAddressEntry>
+
+#include <pcap/pcap.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+using ::testing::AnyNumber;
+using ::testing::DoAll;
+using ::testing::Return;
+using ::testing::SetArgReferee;
+using ::testing::_;
+
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > StatsTable;
+
+// Number of distinct packets decoded per benchmark iteration.
+static const int DECODE_PACKETS = 1024;
+
+// UDP payload size of the decoded packets.
+static const int DECODE_PAYLOAD = 64;
+
+// Time of the first second recorded in the history benchmarks.
+static const time_t BENCHMARK_START = 1000000000;
+
+// Seconds of traffic in the history before it is exported.
+static const int EXPORT_FILL_SECS = 10;
+
+// Device name of the watcher benchmark.
+static const QString BENCHMARK_DEVICE("eth0");
+
+// The watcher benchmark triggers updates itself, so its own timer should rarely fire. Full correlations are
+// only done once.
+static const int WATCHER_TIMER_INTERVAL_MS = 1000;
+static const int WATCHER_REFRESH_INTERVAL_MS = 3600000;
+
+// Longest wait for the watcher's first correlation.
+static const int CORRELATION_TIMEOUT_MS = 10000;
+
+/*
+ * Watcher whose periodic tasks can be performed on demand. Every call is an update.
+ */
+class BenchmarkWatcher : public Watcher {
+public:
+    BenchmarkWatcher(IConnectionProcessCorrelator* correlator, IPcapManager* pcapManager) :
+        Watcher(correlator, pcapManager, WATCHER_TIMER_INTERVAL_MS, 0, 0, WATCHER_REFRESH_INTERVAL_MS) { }
+
+    void tick() { timerEvent(NULL); }
+};
+
+// Key of one of the benchmark flows. The local endpoint is 10.0.0.1. Each index has a different remote address.
+static FlowKey benchmarkFlow(int index) {
+    FlowKey flow = FlowKey();
+    flow.localAddr[0] = 10;
+    flow.localAddr[3] = 1;
+    flow.remoteAddr[0] = 10;
+    flow.remoteAddr[1] = (index >> 16) & 0xff;
+    flow.remoteAddr[2] = (index >> 8) & 0xff;
+    flow.remoteAddr[3] = index & 0xff;
+    flow.localPort = 1024 + index % 60000;
+    flow.remotePort = 80;
+    flow.transport = TCP;
+    return flow;
+}
+
+// Keys of the given number of benchmark flows.
+static QVector<FlowKey> benchmarkFlows(int count) {
+    QVector<FlowKey> result(count);
+    for (int i = 0; i < count; ++i) {
+        result[i] = benchmarkFlow(i);
+    }
+    return result;
+}
+
+// Counters of one second of traffic of a benchmark flow.
+static FlowCounters benchmarkCounters() {
+    FlowCounters counters;
+    counters.bytesIn = 1500;
+    counters.bytesOut = 120;
+    counters.packetsIn = 1;
+    counters.packetsOut = 2;
+    return counters;
+}
+
+// Build a frame of the given link type with a UDP datagram between a local and a remote host. Even-numbered frames
+// are outbound, odd-numbered ones inbound. Each index has a different remote port.
+static QByteArray buildFrame(int linkType, bool vlan, bool ipv6, int index) {
+    const bool outbound = index % 2 == 0;
+    QByteArray frame;
+    const char* etherType = ipv6 ? "\x86\xdd" : "\x08\x00";
+    if (linkType == DLT_EN10MB) {
+        const char* localMac = "\x00\x16\x3e\x00\x00\x01";
+        const char* remoteMac = "\x00\x16\x3e\x00\x00\x02";
+        frame.append(QByteArray(outbound ? remoteMac : localMac, 6));
+        frame.append(QByteArray(outbound ? localMac : remoteMac, 6));
+        if (vlan) {
+            frame.append(QByteArray("\x81\x00\x00\x2a", 4));
+        }
+        frame.append(QByteArray(etherType, 2));
+    } else if (linkType == DLT_LINUX_SLL) {
+        QByteArray header(16, '\0');
+        header[1] = outbound ? 4 : 0;           // LINUX_SLL_OUTGOING or LINUX_SLL_HOST
+        header[3] = 1;                          // ARPHRD_ETHER
+        header[5] = 6;                          // address length
+        header.replace(14, 2, QByteArray(etherType, 2));
+        frame.append(header);
+    }
+
+    const int linkLength = frame.size();
+    const int ipLength = ipv6 ? 40 : 20;
+    frame.append(QByteArray(ipLength + 8 + DECODE_PAYLOAD, '\0'));
+    u_char* ip = reinterpret_cast<u_char*>(frame.data()) + linkLength;
+    u_char localAddr[16];
+    u_char remoteAddr[16];
+    if (ipv6) {
+        ::inet_pton(AF_INET6, "fd00::1", localAddr);
+        ::inet_pton(AF_INET6, "fd00::2", remoteAddr);
+        ip[0] = 0x60;                           // version 6
+        quint16 payloadLength = htons(8 + DECODE_PAYLOAD);
+        ::memcpy(ip + 4, &payloadLength, 2);
+        ip[6] = 17;                             // UDP
+        ip[7] = 64;                             // hop limit
+        ::memcpy(ip + 8, outbound ? localAddr : remoteAddr, 16);
+        ::memcpy(ip + 24, outbound ? remoteAddr : localAddr, 16);
+    } else {
+        ::inet_pton(AF_INET, "10.0.0.1", localAddr);
+        ::inet_pton(AF_INET, "10.0.0.2", remoteAddr);
+        ip[0] = 0x45;                           // version 4, 20-byte header
+        quint16 totalLength = htons(20 + 8 + DECODE_PAYLOAD);
+        ::memcpy(ip + 2, &totalLength, 2);
+        ip[8] = 64;                             // TTL
+        ip[9] = 17;                             // UDP
+        ::memcpy(ip + 12, outbound ? localAddr : remoteAddr, 4);
+        ::memcpy(ip + 16, outbound ? remoteAddr : localAddr, 4);
+    }
+    const quint16 localPort = 5353;
+    const quint16 remotePort = 1024 + index;
+    quint16 udp[4] = { htons(outbound ? localPort : remotePort), htons(outbound ? remotePort : localPort),
+            htons(8 + DECODE_PAYLOAD), 0 };
+    ::memcpy(ip + ipLength, udp, sizeof(udp));
+    return frame;
+}
+
+// Write one IPv4 connection table line in the kernel's format.
+static void writeLine(QTextStream& out, int slot, quint32 localAddr, int localPort, quint32 remoteAddr,
+        int remotePort, int inode) {
+    out << QString("%1: %2:%3 %4:%5 01 00000000:00000000 00:00000000 00000000  1000        0 %6 1 "
+            "ffff880123d0c000 20 4 30 10 -1\n")
+            .arg(slot, 4)
+            .arg(localAddr, 8, 16, QChar('0')).arg(localPort, 4, 16, QChar('0'))
+            .arg(remoteAddr, 8, 16, QChar('0')).arg(remotePort, 4, 16, QChar('0'))
+            .arg(inode).toUpper();
+}
+
+// Remove a directory tree. Symbolic links are removed, not followed.
+static void removeTree(const QString& path) {
+    QDir dir(path);
+    QFileInfoList entries = dir.entryInfoList(QDir::AllEntries | QDir::System | QDir::Hidden | QDir::NoDotAndDotDot);
+    for (int i = 0; i < entries.size(); ++i) {
+        const QFileInfo& entry = entries.at(i);
+        if (entry.isDir() && !entry.isSymLink()) {
+            removeTree(entry.absoluteFilePath());
+        } else {
+            dir.remove(entry.fileName());
+        }
+    }
+    QDir().rmdir(path);
+}
+
+// Read the TCP connection table and look up the processes holding each socket in the index, the way the correlator
+// does on its /proc fallback. Returns the number of sockets matched to a process.
+static int correlateSockets(ProcNetReader& reader, ProcessSocketIndex& index) {
+    QVector<SocketRecord> sockets;
+    QString error;
+    if (!reader.readSockets(TCP, sockets, error)) {
+        return 0;
+    }
+    QList<int> inodes;
+    for (int i = 0; i < sockets.size(); ++i) {
+        inodes.append(sockets.at(i).inode);
+    }
+    if (!index.update(inodes, error)) {
+        return 0;
+    }
+    int matched = 0;
+    for (int i = 0; i < sockets.size(); ++i) {
+        QList<OsProcess> processes;
+        index.findProcesses(sockets.at(i).inode, processes);
+        if (!processes.isEmpty()) {
+            matched++;
+        }
+    }
+    return matched;
+}
+
+// Flows of a watcher update between the benchmark flows, each with one process.
+static QList<CommunicationFlow> benchmarkCommunicationFlows(int count) {
+    QList<CommunicationFlow> result;
+    const QDateTime startTime = QDateTime::currentDateTime();
+    for (int i = 0; i < count; ++i) {
+        OsProcess process(1000 + i % 500, "firefox", "rob", startTime);
+        result.append(CommunicationFlow(benchmarkFlow(i).toEndpointPair(), process, FlowMetrics(1500, 120, 1, 2),
+                FlowStatistics(1500, 120, 1500, true, true)));
+    }
+    return result;
+}
+
+// Round up a D-Bus message body size to the given alignment.
+static int alignWire(int size, int alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Size of a D-Bus message body after appending a string.
+static int addWireString(int size, const QString& string) {
+    return alignWire(size, 4) + 4 + string.toUtf8().size() + 1;
+}
+
+// Size of the body of an "update" signal on the wire, following the D-Bus marshalling rules for its signature,
+// "sa((sqssqi)(xxxx)(xxxbb)a(ussu))".
+static int structWireSize(const QString& device, const QList<CommunicationFlow>& flows) {
+    int size = alignWire(addWireString(0, device), 4) + 4;
+    size = alignWire(size, 8);
+    QListIterator<CommunicationFlow> i(flows);
+    while (i.hasNext()) {
+        const CommunicationFlow& flow = i.next();
+        const IpEndpointPair ipEndpointPair = flow.getIpEndpointPair();
+        // The flow and endpoint pair structures start at the same offset.
+        size = alignWire(size, 8);
+        size = addWireString(size, ipEndpointPair.getLocalAddr().toString());
+        size = alignWire(size, 2) + 2;                  // local port
+        size = addWireString(size, ipEndpointPair.getRemoteAddr().toString());
+        size = addWireString(size, ipEndpointPair.getRemoteHostName());
+        size = alignWire(size, 2) + 2;                  // remote port
+        size = alignWire(size, 4) + 4;                  // transport
+        size = alignWire(size, 8) + 4 * 8;              // metrics
+        size = alignWire(size, 8) + 3 * 8 + 2 * 4;      // statistics
+        size = alignWire(alignWire(size, 4) + 4, 8);    // process array length, padded to the first element
+        QListIterator<OsProcess> j(flow.getOsProcesses());
+        while (j.hasNext()) {
+            const OsProcess& osProcess = j.next();
+            size = alignWire(size, 8) + 4;              // PID
+            size = addWireString(size, osProcess.getProgram());
+            size = addWireString(size, osProcess.getUser());
+            size = alignWire(size, 4) + 4;              // start time
+        }
+    }
+    return size;
+}
+
+// Size of the body of an "updatePacked" signal on the wire. Its signature is "say".
+static int packedWireSize(const QString& device, const QByteArray& packed) {
+    return alignWire(addWireString(0, device), 4) + 4 + packed.size();
+}
+
+PipelineBenchmark::PipelineBenchmark() : _lastUpdateSize(0) {
+}
+
+PipelineBenchmark::~PipelineBenchmark() {
+}
+
+void PipelineBenchmark::updateReceived(const QString& device, const QList<CommunicationFlow>& flows) {
+    Q_UNUSED(device);
+    _lastUpdateSize = flows.size();
+}
+
+int PipelineBenchmark::echoPacked(const QByteArray& flows) {
+    QList<CommunicationFlow> result;
+    QString error;
+    return FlowBatchCodec::decode(flows, result, error) ? result.size() : -1;
+}
+
+void PipelineBenchmark::initTestCase() {
+    qDBusRegisterMetaType<IpEndpointPair>();
+    qDBusRegisterMetaType<FlowMetrics>();
+    qDBusRegisterMetaType<FlowStatistics>();
+    qDBusRegisterMetaType<OsProcess>();
+    qDBusRegisterMetaType<CommunicationFlow>();
+    qDBusRegisterMetaType<QList<CommunicationFlow> >();
+    qDBusRegisterMetaType<QList<OsProcess> >();
+}
+
+void PipelineBenchmark::cleanup() {
+    if (!_procPath.isEmpty()) {
+        removeTree(_procPath);
+        _procPath.clear();
+    }
+}
+
+void PipelineBenchmark::addFlowCountRows() {
+    QTest::addColumn<int>("flows");
+    QTest::newRow("1k flows") << 1000;
+    QTest::newRow("10k flows") << 10000;
+    QTest::newRow("100k flows") << 100000;
+}
+
+void PipelineBenchmark::benchmarkDecode_data() {
+    QTest::addColumn<int>("linkType");
+    QTest::addColumn<bool>("vlan");
+    QTest::addColumn<bool>("ipv6");
+    QTest::newRow("Ethernet IPv4") << (int)DLT_EN10MB << false << false;
+    QTest::newRow("Ethernet 802.1Q IPv4") << (int)DLT_EN10MB << true << false;
+    QTest::newRow("Ethernet IPv6") << (int)DLT_EN10MB << false << true;
+    QTest::newRow("Raw IPv4") << (int)DLT_RAW << false << false;
+    QTest::newRow("Raw IPv6") << (int)DLT_RAW << false << true;
+    QTest::newRow("Cooked IPv4") << (int)DLT_LINUX_SLL << false << false;
+    QTest::newRow("Cooked IPv6") << (int)DLT_LINUX_SLL << false << true;
+}
+
+void PipelineBenchmark::benchmarkDecode() {
+    QFETCH(int, linkType);
+    QFETCH(bool, vlan);
+    QFETCH(bool, ipv6);
+
+    QVector<QByteArray> frames(DECODE_PACKETS);
+    for (int i = 0; i < DECODE_PACKETS; ++i) {
+        frames[i] = buildFrame(linkType, vlan, ipv6, i);
+    }
+    // Without a network interface, the Ethernet decoder leaves the direction to the IP decoder, which finds it from the
+    // local addresses.
+    DataLinkPacketDecoder* decoder = DataLinkPacketDecoder::fromLinkType(linkType, NULL);
+    QVERIFY(decoder);
+    QList<QNetworkAddressEntry> localAddresses;
+    QNetworkAddressEntry entry;
+    entry.setIp(QHostAddress("10.0.0.1"));
+    localAddresses << entry;
+    entry.setIp(QHostAddress("fd00::1"));
+    localAddresses << entry;
+    InternetProtocolDecoder ipDecoder;
+    ipDecoder.setLocalAddresses(localAddresses);
+
+    int decoded = 0;
+    pcap_pkthdr pcapHdr;
+    ::memset(&pcapHdr, 0, sizeof(pcapHdr));
+    QBENCHMARK {
+        decoded = 0;
+        for (int i = 0; i < DECODE_PACKETS; ++i) {
+            const QByteArray& frame = frames.at(i);
+            const u_char* packet = reinterpret_cast<const u_char*>(frame.constData());
+            pcapHdr.caplen = pcapHdr.len = frame.size();
+            IpHeader ipHeader = decoder->decode(&pcapHdr, packet);
+            if (ipHeader.start) {
+                FlowKey flow = FlowKey();
+                if (ipDecoder.decode(ipHeader.direction, frame.size() - (ipHeader.start - packet), ipHeader.start,
+                        flow) != UNKNOWN_DIRECTION) {
+                    decoded++;
+                }
+            }
+        }
+    }
+    delete decoder;
+    QCOMPARE(decoded, DECODE_PACKETS);
+}
+
+void PipelineBenchmark::benchmarkRecord_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkRecord() {
+    QFETCH(int, flows);
+    const QVector<FlowKey> keys = benchmarkFlows(flows);
+    const FlowCounters counters = benchmarkCounters();
+    NetworkHistory history;
+    history.setMaxFlowsPerSecond(flows);
+    time_t sampleTime = BENCHMARK_START;
+    QBENCHMARK {
+        // Each iteration records the next second.
+        ++sampleTime;
+        for (int i = 0; i < flows; ++i) {
+            history.record(keys.at(i), counters, sampleTime);
+        }
+    }
+    StatsTable result;
+    history.exportStatistics(result, sampleTime + 1);
+    QCOMPARE(result.size(), flows);
+}
+
+void PipelineBenchmark::benchmarkExportStatistics_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkExportStatistics() {
+    QFETCH(int, flows);
+    const QVector<FlowKey> keys = benchmarkFlows(flows);
+    const FlowCounters counters = benchmarkCounters();
+    NetworkHistory history;
+    history.setMaxFlowsPerSecond(flows);
+    for (int sec = 0; sec < EXPORT_FILL_SECS; ++sec) {
+        for (int i = 0; i < flows; ++i) {
+            history.record(keys.at(i), counters, BENCHMARK_START + sec);
+        }
+    }
+    StatsTable result;
+    QBENCHMARK {
+        result.clear();
+        history.exportStatistics(result, BENCHMARK_START + EXPORT_FILL_SECS);
+    }
+    QCOMPARE(result.size(), flows);
+}
+
+void PipelineBenchmark::createProcTree(int processes, int socketsPerProcess) {
+    _procPath = QDir::temp().absoluteFilePath(QString("socketsentry-benchmark-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_procPath + "/net"));
+    QFile table(_procPath + "/net/tcp");
+    QVERIFY(table.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream tableOut(&table);
+    tableOut << "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n";
+    int slot = 0;
+    for (int p = 0; p < processes; ++p) {
+        const quint32 pid = 1000 + p;
+        const QString pidPath = QString("%1/%2").arg(_procPath).arg(pid);
+        QVERIFY(QDir().mkpath(pidPath + "/fd"));
+        QFile status(pidPath + "/status");
+        QVERIFY(status.open(QIODevice::WriteOnly | QIODevice::Text));
+        QTextStream statusOut(&status);
+        statusOut << "Name:\tprocess" << pid << "\nState:\tS (sleeping)\nUid:\t0\t0\t0\t0\n";
+        status.close();
+
+        // A regular file descriptor first, then the sockets.
+        QVERIFY(QFile::link("/dev/null", pidPath + "/fd/0"));
+        for (int s = 0; s < socketsPerProcess; ++s) {
+            const int inode = 100000 + slot;
+            const QString link = QString("%1/fd/%2").arg(pidPath).arg(s + 1);
+            QVERIFY(::symlink(QString("socket:[%1]").arg(inode).toLatin1().constData(),
+                    QFile::encodeName(link).constData()) == 0);
+            writeLine(tableOut, slot, 0x0100000a, 1024 + slot % 60000, 0x0a000000 + slot, 80, inode);
+            slot++;
+        }
+    }
+}
+
+void PipelineBenchmark::benchmarkCorrelation_data() {
+    QTest::addColumn<int>("processes");
+    QTest::addColumn<int>("socketsPerProcess");
+    QTest::addColumn<bool>("incremental");
+    QTest::newRow("100 processes x 10 sockets, full") << 100 << 10 << false;
+    QTest::newRow("100 processes x 10 sockets, incremental") << 100 << 10 << true;
+    QTest::newRow("1000 processes x 10 sockets, full") << 1000 << 10 << false;
+    QTest::newRow("1000 processes x 10 sockets, incremental") << 1000 << 10 << true;
+    QTest::newRow("1000 processes x 100 sockets, full") << 1000 << 100 << false;
+    QTest::newRow("1000 processes x 100 sockets, incremental") << 1000 << 100 << true;
+}
+
+void PipelineBenchmark::benchmarkCorrelation() {
+    QFETCH(int, processes);
+    QFETCH(int, socketsPerProcess);
+    QFETCH(bool, incremental);
+    createProcTree(processes, socketsPerProcess);
+    ProcNetReader reader(_procPath + "/net");
+    int matched = 0;
+    if (incremental) {
+        // Nothing changes between updates, so none of the processes are rescanned.
+        ProcessSocketIndex index(_procPath);
+        correlateSockets(reader, index);
+        QBENCHMARK {
+            matched = correlateSockets(reader, index);
+        }
+        QCOMPARE(index.getLastRescanCount(), 0);
+    } else {
+        QBENCHMARK {
+            ProcessSocketIndex index(_procPath);
+            matched = correlateSockets(reader, index);
+        }
+    }
+    QCOMPARE(matched, processes * socketsPerProcess);
+}
+
+void PipelineBenchmark::benchmarkCreateFlows_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkCreateFlows() {
+    QFETCH(int, flows);
+    StatsTable captureStats;
+    QHash<IpEndpointPair, QList<OsProcess> > correlation;
+    const QDateTime startTime = QDateTime::currentDateTime();
+    for (int i = 0; i < flows; ++i) {
+        const IpEndpointPair endpoints = benchmarkFlow(i).toEndpointPair();
+        captureStats.insert(endpoints,
+                qMakePair(FlowMetrics(1500, 120, 1, 2), FlowStatistics(1500, 120, 1500, true, true)));
+        QList<OsProcess> processes;
+        processes << OsProcess(1000 + i % 500, "firefox", "rob", startTime);
+        correlation.insert(endpoints, processes);
+    }
+
+    MockPcapManager* mockPcapManager = new MockPcapManager;
+    EXPECT_CALL(*mockPcapManager, showInterest(BENCHMARK_DEVICE))
+        .Times(AnyNumber());
+    EXPECT_CALL(*mockPcapManager, findCurrentDevices())
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(QStringList() << BENCHMARK_DEVICE));
+    EXPECT_CALL(*mockPcapManager, fillStatistics(BENCHMARK_DEVICE, _, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(DoAll(SetArgReferee<1>(captureStats), Return(true)));
+    EXPECT_CALL(*mockPcapManager, isActive(BENCHMARK_DEVICE))
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapManager, isIdle(_, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(false));
+    MockConnectionProcessCorrelator* mockCorrelator = new MockConnectionProcessCorrelator;
+    EXPECT_CALL(*mockCorrelator, correlate(_, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(DoAll(SetArgReferee<0>(correlation), Return(true)));
+    EXPECT_CALL(*mockCorrelator, correlateEndpoints(_, _, _))
+        .Times(AnyNumber())
+        .WillRepeatedly(Return(true));
+
+    // The first update starts the correlation. Wait until an update matches all flows.
+    BenchmarkWatcher watcher(mockCorrelator, mockPcapManager);
+    connect(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)),
+            this, SLOT(updateReceived(const QString&, const QList<CommunicationFlow>&)));
+    watcher.showInterest(BENCHMARK_DEVICE);
+    _lastUpdateSize = 0;
+    QTime timer;
+    timer.start();
+    while (_lastUpdateSize < flows && timer.elapsed() < CORRELATION_TIMEOUT_MS) {
+        watcher.tick();
+        QTest::qWait(10);
+    }
+    QCOMPARE(_lastUpdateSize, flows);
+
+    QBENCHMARK {
+        watcher.tick();
+    }
+    QCOMPARE(_lastUpdateSize, flows);
+}
+
+void PipelineBenchmark::benchmarkMarshalFlows_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkMarshalFlows() {
+    QFETCH(int, flows);
+    const QList<CommunicationFlow> update = benchmarkCommunicationFlows(flows);
+    qDebug("%.1f bytes per flow on the wire", (double)structWireSize(BENCHMARK_DEVICE, update) / flows);
+    QBENCHMARK {
+        QDBusArgument argument;
+        argument << update;
+    }
+}
+
+void PipelineBenchmark::benchmarkMarshalPacked_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkMarshalPacked() {
+    QFETCH(int, flows);
+    const QList<CommunicationFlow> update = benchmarkCommunicationFlows(flows);
+    qDebug("%.1f bytes per flow on the wire",
+            (double)packedWireSize(BENCHMARK_DEVICE, FlowBatchCodec::encode(update)) / flows);
+    QBENCHMARK {
+        QDBusArgument argument;
+        argument << FlowBatchCodec::encode(update);
+    }
+}
+
+void PipelineBenchmark::benchmarkUnpack_data() {
+    addFlowCountRows();
+}
+
+void PipelineBenchmark::benchmarkUnpack() {
+    QFETCH(int, flows);
+    const QByteArray packed = FlowBatchCodec::encode(benchmarkCommunicationFlows(flows));
+    QBENCHMARK {
+        QList<CommunicationFlow> result;
+        QString error;
+        FlowBatchCodec::decode(packed, result, error);
+    }
+}
+
+void PipelineBenchmark::benchmarkRoundTrip_data() {
+    QTest::addColumn<bool>("packed");
+    QTest::addColumn<int>("flows");
+    QTest::newRow("structures 1k flows") << false << 1000;
+    QTest::newRow("structures 10k flows") << false << 10000;
+    QTest::newRow("packed 1k flows") << true << 1000;
+    QTest::newRow("packed 10k flows") << true << 10000;
+}
+
+void PipelineBenchmark::benchmarkRoundTrip() {
+    QFETCH(bool, packed);
+    QFETCH(int, flows);
+
+    // Calls between two different connections go through the bus, so the receiver has to unmarshal the update.
+    QDBusConnection sender = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "benchmark-sender");
+    QDBusConnection receiver = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "benchmark-receiver");
+    if (!sender.isConnected() || !receiver.isConnected()) {
+        QSKIP("No D-Bus session bus", SkipAll);
+    }
+    QVERIFY(receiver.registerObject("/PipelineBenchmark", this, QDBusConnection::ExportAllSlots));
+
+    const QList<CommunicationFlow> update = benchmarkCommunicationFlows(flows);
+    const QDBusMessage call = QDBusMessage::createMethodCall(receiver.baseService(), "/PipelineBenchmark", "",
+            packed ? "echoPacked" : "echoFlows");
+    QBENCHMARK {
+        QDBusMessage message = call;
+        if (packed) {
+            message << FlowBatchCodec::encode(update);
+        } else {
+            message << QVariant::fromValue(update);
+        }
+        // Keep the event loop going so the receiving connection can answer.
+        QDBusMessage reply = sender.call(message, QDBus::BlockWithGui);
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(reply.arguments().value(0).toInt(), flows);
+    }
+    receiver.unregisterObject("/PipelineBenchmark");
+}
+
+QTEST_GMOCK_MAIN(PipelineBenchmark)
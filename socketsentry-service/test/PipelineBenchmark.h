@@ -0,0 +1,105 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PIPELINEBENCHMARK_H_
+#define PIPELINEBENCHMARK_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+
+template <class T> class QList;
+class CommunicationFlow;
+
+/*
+ * End-to-end benchmarks of the service's pipeline, from decoding captured packets to marshalling the flows sent to
+ * clients. Unlike the unit tests, the suite isn't run by ctest. Build the "benchmark" target to run it and write the
+ * results in QTestLib's XML format to PipelineBenchmark.xml in the build directory, where they can be compared
+ * between builds.
+ */
+class PipelineBenchmark : public QObject {
+    Q_OBJECT
+
+public:
+    PipelineBenchmark();
+    virtual ~PipelineBenchmark();
+
+public slots:
+    // Note the size of a watcher update.
+    void updateReceived(const QString& device, const QList<CommunicationFlow>& flows);
+
+    // Receive the flows of a watcher update over D-Bus in either format and return how many there are.
+    int echoFlows(const QList<CommunicationFlow>& flows) { return flows.size(); }
+    int echoPacked(const QByteArray& flows);
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    // Decode packets through each data link decoder and the IP decoder into flow keys.
+    void benchmarkDecode_data();
+    void benchmarkDecode();
+
+    // Record one second of traffic of many flows in the history.
+    void benchmarkRecord_data();
+    void benchmarkRecord();
+
+    // Export the statistics of many flows from a full history.
+    void benchmarkExportStatistics_data();
+    void benchmarkExportStatistics();
+
+    // Correlate connections with processes over a synthetic /proc tree, from scratch and incrementally.
+    void benchmarkCorrelation_data();
+    void benchmarkCorrelation();
+
+    // Match the statistics of many flows to correlated processes in a watcher update.
+    void benchmarkCreateFlows_data();
+    void benchmarkCreateFlows();
+
+    // Marshal a watcher update of many flows into a D-Bus argument.
+    void benchmarkMarshalFlows_data();
+    void benchmarkMarshalFlows();
+
+    // Pack a watcher update of many flows and marshal the result into a D-Bus argument.
+    void benchmarkMarshalPacked_data();
+    void benchmarkMarshalPacked();
+
+    // Unpack a packed watcher update of many flows.
+    void benchmarkUnpack_data();
+    void benchmarkUnpack();
+
+    // Send a watcher update of many flows in either format from one session bus connection to another and have it
+    // unmarshalled there. Skipped without a session bus.
+    void benchmarkRoundTrip_data();
+    void benchmarkRoundTrip();
+
+private:
+    // Add the common flow counts as rows of a data-driven benchmark.
+    static void addFlowCountRows();
+
+    // Create a synthetic /proc tree of processes holding the given number of sockets each, with a TCP connection
+    // table of all of them in its "net" directory.
+    void createProcTree(int processes, int socketsPerProcess);
+
+    // Root of the synthetic /proc tree.
+    QString _procPath;
+
+    // Size of the last watcher update.
+    int _lastUpdateSize;
+};
+
+#endif /* PIPELINEBENCHMARK_H_ */
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ProcessSocketIndexBenchmark.h"
+#include "ProcessSocketIndex.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Number of sockets of the benchmark process.
+static const int BENCHMARK_SOCKETS = 50000;
+
+// The QDir-based scanner that ProcessSocketIndex used before the getdents64 one. Kept as a reference for correctness
+// and speed.
+static QVector<quint32> qDirReadSocketInodes(const QString& fdPath) {
+    QVector<quint32> result;
+    QDir fdDir(fdPath);
+    QStringList fds = fdDir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot);
+    char target[64];
+    for (int i = 0; i < fds.size(); i++) {
+        QByteArray fdLink = QFile::encodeName(fdPath + '/' + fds.at(i));
+        ssize_t length = ::readlink(fdLink.constData(), target, sizeof(target) - 1);
+        if (length > 8 && ::memcmp(target, "socket:[", 8) == 0) {
+            target[length] = '\0';
+            result.append(::strtoul(target + 8, NULL, 10));
+        }
+    }
+    qSort(result);
+    return result;
+}
+
+ProcessSocketIndexBenchmark::ProcessSocketIndexBenchmark() {
+}
+
+ProcessSocketIndexBenchmark::~ProcessSocketIndexBenchmark() {
+}
+
+void ProcessSocketIndexBenchmark::initTestCase() {
+    _procPath = QDir::temp().absoluteFilePath(QString("socketsentry-bench-proc-%1").arg(::getpid()));
+    _fdPath = _procPath + "/4000/fd";
+    QVERIFY(QDir().mkpath(_fdPath));
+    QVERIFY(QFile::link("/dev/null", _fdPath + "/0"));
+    for (int i = 0; i < BENCHMARK_SOCKETS; i++) {
+        const QString link = QString("%1/%2").arg(_fdPath).arg(i + 1);
+        QVERIFY(::symlink(QString("socket:[%1]").arg(100000 + i).toLatin1().constData(),
+                link.toLatin1().constData()) == 0);
+    }
+}
+
+void ProcessSocketIndexBenchmark::cleanupTestCase() {
+    QDir fdDir(_fdPath);
+    QStringList fds = fdDir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot);
+    for (int i = 0; i < fds.size(); i++) {
+        fdDir.remove(fds.at(i));
+    }
+    QDir procDir(_procPath);
+    procDir.rmdir("4000/fd");
+    procDir.rmdir("4000");
+    QDir().rmdir(_procPath);
+}
+
+void ProcessSocketIndexBenchmark::benchmarkReadSocketInodes() {
+    QVector<quint32> inodes;
+    QBENCHMARK {
+        inodes = ProcessSocketIndex::readSocketInodes(_fdPath);
+    }
+    QCOMPARE(inodes.size(), BENCHMARK_SOCKETS);
+    QCOMPARE(inodes, qDirReadSocketInodes(_fdPath));
+}
+
+void ProcessSocketIndexBenchmark::benchmarkReadSocketInodesQDir() {
+    QVector<quint32> inodes;
+    QBENCHMARK {
+        inodes = qDirReadSocketInodes(_fdPath);
+    }
+    QCOMPARE(inodes.size(), BENCHMARK_SOCKETS);
+}
+
+QTEST_MAIN(ProcessSocketIndexBenchmark)
@@ -0,0 +1,445 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ProcessSocketIndexTest.h"
+#include "ProcessSocketIndex.h"
+#include "ProcEventListener.h"
+#include "OsProcess.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QTextStream>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+// Number of sockets of the process whose descriptors take several reads of the directory.
+static const int MANY_SOCKETS = 2000;
+
+// Append one proc connector message to a buffer.
+static void appendEvent(QByteArray& buffer, const proc_event& event) {
+    const int payload = sizeof(cn_msg) + sizeof(proc_event);
+    QByteArray message(NLMSG_SPACE(payload), '\0');
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(message.data());
+    header->nlmsg_len = NLMSG_LENGTH(payload);
+    header->nlmsg_type = NLMSG_DONE;
+    cn_msg* connectorMessage = reinterpret_cast<cn_msg*>(NLMSG_DATA(header));
+    connectorMessage->id.idx = CN_IDX_PROC;
+    connectorMessage->id.val = CN_VAL_PROC;
+    connectorMessage->len = sizeof(proc_event);
+    ::memcpy(connectorMessage->data, &event, sizeof(event));
+    buffer.append(message);
+}
+
+ProcessSocketIndexTest::ProcessSocketIndexTest() {
+}
+
+ProcessSocketIndexTest::~ProcessSocketIndexTest() {
+}
+
+void ProcessSocketIndexTest::init() {
+    _procPath = QDir::temp().absoluteFilePath(QString("socketsentry-proc-%1").arg(::getpid()));
+    QVERIFY(QDir().mkpath(_procPath));
+    QVERIFY(QDir().mkpath(_procPath + "/self"));      // not a process directory
+}
+
+void ProcessSocketIndexTest::cleanup() {
+    QDir procDir(_procPath);
+    QStringList entries = procDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries.at(i) != "self") {
+            removeProcess(entries.at(i).toUInt());
+        }
+    }
+    QDir selfDir(_procPath + "/self");
+    QStringList nsFiles = selfDir.entryList(QDir::Files);
+    for (int i = 0; i < nsFiles.size(); i++) {
+        selfDir.remove(nsFiles.at(i));
+    }
+    QDir().rmdir(_procPath + "/self");
+    procDir.remove("stat");
+    QDir().rmdir(_procPath);
+}
+
+void ProcessSocketIndexTest::addProcess(quint32 pid, const QString& name, const QList<quint32>& inodes) {
+    const QString pidPath = QString("%1/%2").arg(_procPath).arg(pid);
+    QVERIFY(QDir().mkpath(pidPath + "/fd"));
+    QFile status(pidPath + "/status");
+    QVERIFY(status.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream out(&status);
+    out << "Name:\t" << name << "\nState:\tS (sleeping)\nUid:\t0\t0\t0\t0\n";
+    status.close();
+
+    // A regular file descriptor first, then the sockets.
+    QVERIFY(QFile::link("/dev/null", pidPath + "/fd/0"));
+    for (int i = 0; i < inodes.size(); i++) {
+        addSocket(pid, i + 1, inodes.at(i));
+    }
+}
+
+void ProcessSocketIndexTest::addSocket(quint32 pid, int fd, quint32 inode) {
+    const QString link = QString("%1/%2/fd/%3").arg(_procPath).arg(pid).arg(fd);
+    QVERIFY(::symlink(QString("socket:[%1]").arg(inode).toLatin1().constData(), link.toLatin1().constData()) == 0);
+}
+
+void ProcessSocketIndexTest::setNetNamespace(quint32 pid, const QString& netNamespace) {
+    const QString nsPath = QString("%1/%2/ns").arg(_procPath).arg(pid);
+    const QString nsFile = _procPath + "/self/" + netNamespace;
+    QVERIFY(QDir().mkpath(nsPath));
+    if (!QFile::exists(nsFile)) {
+        QFile file(nsFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+    QVERIFY(::link(QFile::encodeName(nsFile).constData(), QFile::encodeName(nsPath + "/net").constData()) == 0);
+}
+
+void ProcessSocketIndexTest::setStartTime(quint32 pid, quint64 startTime) {
+    // The command name has a space and a parenthesis, like those that trip up naive parsers.
+    QFile stat(QString("%1/%2/stat").arg(_procPath).arg(pid));
+    QVERIFY(stat.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream out(&stat);
+    out << pid << " (my (app) S 1 " << pid << " " << pid << " 0 -1 4194560 1 0 0 0 0 0 0 0 20 0 1 0 " << startTime
+            << " 4485120 211 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 0 0 0 0 0 0\n";
+}
+
+void ProcessSocketIndexTest::removeProcess(quint32 pid) {
+    QDir fdDir(QString("%1/%2/fd").arg(_procPath).arg(pid));
+    QStringList fds = fdDir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot);
+    for (int i = 0; i < fds.size(); i++) {
+        fdDir.remove(fds.at(i));
+    }
+    QDir pidDir(QString("%1/%2").arg(_procPath).arg(pid));
+    pidDir.remove("ns/net");
+    pidDir.rmdir("ns");
+    pidDir.remove("status");
+    pidDir.remove("stat");
+    pidDir.rmdir("fd");
+    QDir().rmdir(pidDir.path());
+}
+
+void ProcessSocketIndexTest::testNewProcess() {
+    addProcess(123, "sshd", QList<quint32>() << 555 << 556);
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555 << 556, error));
+    QCOMPARE(index.getProcessCount(), 1);
+    QCOMPARE(index.getLastRescanCount(), 1);
+
+    QList<OsProcess> processes;
+    index.findProcesses(555, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getPid(), 123U);
+    QCOMPARE(processes.at(0).getProgram(), QString("sshd"));
+    QVERIFY(!processes.at(0).getUser().isEmpty());
+
+    processes.clear();
+    index.findProcesses(557, processes);
+    QVERIFY(processes.isEmpty());
+}
+
+void ProcessSocketIndexTest::testIncrementalUpdate() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555, error));
+
+    // Only the new process is scanned.
+    addProcess(124, "firefox", QList<quint32>() << 600 << 601);
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 601, error));
+    QCOMPARE(index.getProcessCount(), 2);
+    QCOMPARE(index.getLastRescanCount(), 1);
+    QList<OsProcess> processes;
+    index.findProcesses(601, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getProgram(), QString("firefox"));
+
+    // Nothing changed.
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 601, error));
+    QCOMPARE(index.getLastRescanCount(), 0);
+
+    // The exited process is dropped.
+    removeProcess(123);
+    QVERIFY(index.update(QList<int>() << 600, error));
+    QCOMPARE(index.getProcessCount(), 1);
+    processes.clear();
+    index.findProcesses(555, processes);
+    QVERIFY(processes.isEmpty());
+}
+
+void ProcessSocketIndexTest::testNewSocket() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    addProcess(124, "firefox", QList<quint32>() << 600);
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+
+    addSocket(124, 5, 602);
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 602, error));
+    QList<OsProcess> processes;
+    index.findProcesses(602, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getPid(), 124U);
+    processes.clear();
+    index.findProcesses(600, processes);
+    QCOMPARE(processes.size(), 1);
+}
+
+void ProcessSocketIndexTest::testOrphanSocket() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    addProcess(124, "firefox", QList<quint32>() << 600);
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+
+    // The unknown socket causes one full rescan, but not another.
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 999, error));
+    QCOMPARE(index.getLastRescanCount(), 2);
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 999, error));
+    QCOMPARE(index.getLastRescanCount(), 0);
+
+    // Once it's gone and comes back, it's chased again.
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 999, error));
+    QCOMPARE(index.getLastRescanCount(), 2);
+}
+
+void ProcessSocketIndexTest::testParallelScan() {
+    const int processes = 200;
+    QList<int> inodes;
+    for (int i = 0; i < processes; i++) {
+        addProcess(1000 + i, "worker", QList<quint32>() << 5000 + i << 5000 + i << 9000);     // one shared by all
+        inodes << 5000 + i;
+    }
+    inodes << 9000;
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(inodes, error));
+    QCOMPARE(index.getLastRescanCount(), processes);
+    for (int i = 0; i < processes; i++) {
+        QList<OsProcess> found;
+        index.findProcesses(5000 + i, found);
+        QCOMPARE(found.size(), 1);      // once, even though it's open twice
+        QCOMPARE(found.at(0).getPid(), quint32(1000 + i));
+    }
+    QList<OsProcess> sharing;
+    index.findProcesses(9000, sharing);
+    QCOMPARE(sharing.size(), processes);
+}
+
+void ProcessSocketIndexTest::testNetNamespaces() {
+    addProcess(100, "init", QList<quint32>() << 1001);
+    addProcess(200, "nginx", QList<quint32>() << 2001);
+    addProcess(201, "nginx", QList<quint32>() << 2002);
+    addProcess(300, "unknown", QList<quint32>() << 3001);     // namespace can't be read
+    setNetNamespace(100, "host");
+    setNetNamespace(200, "container");
+    setNetNamespace(201, "container");
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>(), error));
+    QHash<quint64, quint32> namespaces = index.getNetNamespaces();
+    QCOMPARE(namespaces.size(), 2);
+    struct stat nsStat;
+    QVERIFY(::stat(QFile::encodeName(_procPath + "/self/container").constData(), &nsStat) == 0);
+    QVERIFY(namespaces.contains(nsStat.st_ino));
+    QVERIFY(namespaces.value(nsStat.st_ino) == 200 || namespaces.value(nsStat.st_ino) == 201);
+
+    // A namespace goes away with its last process.
+    removeProcess(200);
+    QVERIFY(index.update(QList<int>(), error));
+    QCOMPARE(index.getNetNamespaces().value(nsStat.st_ino), 201U);
+    removeProcess(201);
+    QVERIFY(index.update(QList<int>(), error));
+    QCOMPARE(index.getNetNamespaces().size(), 1);
+    QVERIFY(!index.getNetNamespaces().contains(nsStat.st_ino));
+}
+
+void ProcessSocketIndexTest::testPidReuse() {
+    const uint bootTime = 1000000000;
+    const long clockTicks = ::sysconf(_SC_CLK_TCK);
+    QFile stat(_procPath + "/stat");
+    QVERIFY(stat.open(QIODevice::WriteOnly | QIODevice::Text));
+    QTextStream(&stat) << "cpu  1 2 3 4\nbtime " << bootTime << "\nprocesses 1234\n";
+    stat.close();
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    setStartTime(123, clockTicks * 50 + clockTicks / 2);
+    ProcessSocketIndex index(_procPath);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555, error));
+    QList<OsProcess> processes;
+    index.findProcesses(555, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getStartTime(), QDateTime::fromTime_t(bootTime + 50).addMSecs(500).toUTC());
+
+    // Another program with the same PID and descriptors. Only the start time tells them apart.
+    removeProcess(123);
+    addProcess(123, "nginx", QList<quint32>() << 555);
+    setStartTime(123, clockTicks * 60);
+    QVERIFY(index.update(QList<int>() << 555, error));
+    QCOMPARE(index.getLastRescanCount(), 1);
+    processes.clear();
+    index.findProcesses(555, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getProgram(), QString("nginx"));
+    QCOMPARE(processes.at(0).getStartTime(), QDateTime::fromTime_t(bootTime + 60).toUTC());
+
+    // The same process is left alone.
+    QVERIFY(index.update(QList<int>() << 555, error));
+    QCOMPARE(index.getLastRescanCount(), 0);
+}
+
+void ProcessSocketIndexTest::testOwnSockets() {
+    int sockets[2];
+    QVERIFY(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    struct stat first;
+    struct stat second;
+    QVERIFY(::fstat(sockets[0], &first) == 0);
+    QVERIFY(::fstat(sockets[1], &second) == 0);
+    QVector<quint32> inodes = ProcessSocketIndex::readSocketInodes("/proc/self/fd");
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+    QVERIFY(inodes.contains(first.st_ino));
+    QVERIFY(inodes.contains(second.st_ino));
+
+    // A missing directory has no sockets.
+    QVERIFY(ProcessSocketIndex::readSocketInodes(_procPath + "/1/fd").isEmpty());
+}
+
+void ProcessSocketIndexTest::testManySockets() {
+    // The descriptors are added in reverse, and the last one twice, to check the result is sorted without duplicates.
+    const quint32 pid = 4000;
+    addProcess(pid, "server", QList<quint32>());
+    QVector<quint32> expected;
+    for (int i = 0; i < MANY_SOCKETS; i++) {
+        addSocket(pid, i + 1, 100000 + MANY_SOCKETS - 1 - i);
+        expected.prepend(100000 + MANY_SOCKETS - 1 - i);
+    }
+    addSocket(pid, MANY_SOCKETS + 1, 100000);
+    QCOMPARE(ProcessSocketIndex::readSocketInodes(QString("%1/%2/fd").arg(_procPath).arg(pid)), expected);
+}
+
+void ProcessSocketIndexTest::testProcessEvents() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    ProcessSocketIndex index(_procPath);
+    index.setEventDriven(true);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555, error));     // first update reads everything
+    QCOMPARE(index.getProcessCount(), 1);
+
+    // Without an event, the new process isn't noticed.
+    addProcess(124, "firefox", QList<quint32>() << 600);
+    QVERIFY(index.update(QList<int>() << 555, error));
+    QCOMPARE(index.getLastRescanCount(), 0);
+    QCOMPARE(index.getProcessCount(), 1);
+
+    // With one, only the new process is scanned.
+    index.processStarted(124);
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+    QCOMPARE(index.getLastRescanCount(), 1);
+    QList<OsProcess> processes;
+    index.findProcesses(600, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getProgram(), QString("firefox"));
+
+    // An exited process is dropped without a look at /proc.
+    index.processExited(123);
+    QVERIFY(index.update(QList<int>() << 600, error));
+    QCOMPARE(index.getProcessCount(), 1);
+    processes.clear();
+    index.findProcesses(555, processes);
+    QVERIFY(processes.isEmpty());
+
+    // After a resync, the whole directory is read again.
+    index.resync();
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+    QCOMPARE(index.getProcessCount(), 2);
+}
+
+void ProcessSocketIndexTest::testNewSocketWithEvents() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    addProcess(124, "firefox", QList<quint32>() << 600);
+    ProcessSocketIndex index(_procPath);
+    index.setEventDriven(true);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555 << 600, error));
+
+    // A long-running process opens connections. No event tells about them. (The real /proc reports the number of
+    // descriptors as the directory size. Other file systems may only grow the size a block at a time.)
+    const QByteArray fdPath = QFile::encodeName(QString("%1/124/fd").arg(_procPath));
+    struct stat before;
+    QVERIFY(::stat(fdPath.constData(), &before) == 0);
+    struct stat after = before;
+    for (int fd = 5; after.st_size == before.st_size && fd < 10000; fd++) {
+        addSocket(124, fd, 597 + fd);
+        QVERIFY(::stat(fdPath.constData(), &after) == 0);
+    }
+    QVERIFY(after.st_size != before.st_size);
+
+    // Only that process is rescanned.
+    QVERIFY(index.update(QList<int>() << 555 << 600 << 602, error));
+    QCOMPARE(index.getLastRescanCount(), 1);
+    QList<OsProcess> processes;
+    index.findProcesses(602, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getPid(), 124U);
+}
+
+void ProcessSocketIndexTest::testProcEventMessages() {
+    addProcess(123, "sshd", QList<quint32>() << 555);
+    ProcessSocketIndex index(_procPath);
+    index.setEventDriven(true);
+    QString error;
+    QVERIFY(index.update(QList<int>() << 555, error));
+    addProcess(124, "firefox", QList<quint32>() << 600);
+    addProcess(125, "thread", QList<quint32>() << 700);
+
+    QByteArray buffer;
+    proc_event event;
+    ::memset(&event, 0, sizeof(event));
+    event.what = proc_event::PROC_EVENT_FORK;
+    event.event_data.fork.parent_pid = 1;
+    event.event_data.fork.parent_tgid = 1;
+    event.event_data.fork.child_pid = 124;
+    event.event_data.fork.child_tgid = 124;
+    appendEvent(buffer, event);
+    event.event_data.fork.child_pid = 125;      // a new thread, not a process
+    event.event_data.fork.child_tgid = 1;
+    appendEvent(buffer, event);
+    ::memset(&event, 0, sizeof(event));
+    event.what = proc_event::PROC_EVENT_EXIT;
+    event.event_data.exit.process_pid = 123;
+    event.event_data.exit.process_tgid = 123;
+    appendEvent(buffer, event);
+    ProcEventListener::parseMessages(buffer.constData(), buffer.size(), index);
+    QVERIFY(index.update(QList<int>() << 600, error));
+    QCOMPARE(index.getProcessCount(), 1);
+    QList<OsProcess> processes;
+    index.findProcesses(600, processes);
+    QCOMPARE(processes.size(), 1);
+    QCOMPARE(processes.at(0).getPid(), 124U);
+}
+
+QTEST_MAIN(ProcessSocketIndexTest)
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PROCESSSOCKETINDEXTEST_H_
+#define PROCESSSOCKETINDEXTEST_H_
+
+#include <QtTest/QtTest>
+#include <QtCore/QString>
+
+/*
+ * Unit test for ProcessSocketIndex and ProcEventListener. Runs against a fake /proc directory.
+ */
+class ProcessSocketIndexTest : public QObject {
+    Q_OBJECT
+
+public:
+    ProcessSocketIndexTest();
+    virtual ~ProcessSocketIndexTest();
+
+private slots:
+    void init();
+    void cleanup();
+
+    // Test indexing the sockets of a new process.
+    void testNewProcess();
+
+    // Test that only new processes are rescanned and exited ones are dropped.
+    void testIncrementalUpdate();
+
+    // Test that a socket opened by a known process is found.
+    void testNewSocket();
+
+    // Test that a socket that can't be found doesn't trigger a full rescan every time.
+    void testOrphanSocket();
+
+    // Test scanning enough processes to use the thread pool.
+    void testParallelScan();
+
+    // Test that processes are grouped by network namespace.
+    void testNetNamespaces();
+
+    // Test that a PID reused by another process is detected by its start time, which is also the one reported.
+    void testPidReuse();
+
+    // Test reading the sockets of this very process from the real /proc.
+    void testOwnSockets();
+
+    // Test reading the descriptors of a process with more sockets than one read of the directory returns.
+    void testManySockets();
+
+    // Test that process events name the processes to rescan and exited processes to drop.
+    void testProcessEvents();
+
+    // Test that a socket opened by a known process is found with process events, without a full rescan.
+    void testNewSocketWithEvents();
+
+    // Test decoding proc connector messages.
+    void testProcEventMessages();
+
+private:
+    // Add a fake process with the given socket inodes to the fake /proc directory.
+    void addProcess(quint32 pid, const QString& name, const QList<quint32>& inodes);
+
+    // Add a socket descriptor to a fake process.
+    void addSocket(quint32 pid, int fd, quint32 inode);
+
+    // Put a fake process into a fake network namespace. Processes in the same namespace share its file.
+    void setNetNamespace(quint32 pid, const QString& netNamespace);
+
+    // Write the stat file of a fake process with the given start time in clock ticks since boot.
+    void setStartTime(quint32 pid, quint64 startTime);
+
+    // Remove a fake process.
+    void removeProcess(quint32 pid);
+
+    // Fake /proc directory.
+    QString _procPath;
+};
+
+#endif /* PROCESSSOCKETINDEXTEST_H_ */
@@ -0,0 +1,191 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "SharedFlowRingTest.h"
+#include "SharedFlowRing.h"
+#include "FlowBatchCodec.h"
+#include "CommunicationFlow.h"
+
+#include <QtCore/QTemporaryFile>
+#include <QtNetwork/QHostAddress>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Slots of the rings under test.
+static const int SLOT_COUNT = 4;
+static const int SLOT_SIZE = 4096;
+
+// Create the given number of flows to remote ports counting up from 1000, each with its own number of bytes in.
+static QList<CommunicationFlow> makeFlows(int count, qlonglong bytesIn) {
+    QList<CommunicationFlow> result;
+    for (int i = 0; i < count; i++) {
+        IpEndpointPair endpoints(QHostAddress("192.168.1.2"), 4000, QHostAddress("10.0.0.1"), 1000 + i, TCP);
+        result << CommunicationFlow(endpoints, QList<OsProcess>(), FlowMetrics(bytesIn + i, 0, 1, 0),
+                FlowStatistics());
+    }
+    return result;
+}
+
+// Create a ring and attach a reader to it. Returns the descriptor of the reader, which the caller must close.
+static int openRing(SharedFlowRing& writer, SharedFlowRing& reader) {
+    QString error;
+    if (!writer.create(SLOT_COUNT, SLOT_SIZE, error)) {
+        qWarning("%s", error.toLatin1().constData());
+        return -1;
+    }
+    int fd = writer.openReader(error);
+    if (fd < 0 || !reader.attach(fd, error)) {
+        qWarning("%s", error.toLatin1().constData());
+    }
+    return fd;
+}
+
+SharedFlowRingTest::SharedFlowRingTest() {
+}
+
+SharedFlowRingTest::~SharedFlowRingTest() {
+}
+
+void SharedFlowRingTest::testPublishAndRead() {
+    SharedFlowRing writer;
+    SharedFlowRing reader;
+    int fd = openRing(writer, reader);
+    QVERIFY(fd >= 0);
+    QVERIFY(reader.isOpen());
+    QVERIFY(reader.isSameRing(fd));
+    QCOMPARE(reader.getSlotCount(), SLOT_COUNT);
+    QCOMPARE(reader.getSlotSize(), SLOT_SIZE);
+    ::close(fd);
+
+    // Nothing published yet.
+    QList<CommunicationFlow> result;
+    QVERIFY(!reader.read(1, result));
+
+    QList<CommunicationFlow> flows = makeFlows(3, 100);
+    QVERIFY(writer.publish(1, FlowBatchCodec::encode(flows)));
+    QVERIFY(reader.read(1, result));
+    QCOMPARE(result, flows);
+
+    // Sequence numbers may skip.
+    QVERIFY(writer.publish(3, FlowBatchCodec::encode(QList<CommunicationFlow>())));
+    QVERIFY(reader.read(3, result));
+    QVERIFY(result.isEmpty());
+    QVERIFY(!reader.read(2, result));
+
+    // Another ring is a different one.
+    SharedFlowRing otherWriter;
+    SharedFlowRing otherReader;
+    int otherFd = openRing(otherWriter, otherReader);
+    QVERIFY(otherFd >= 0);
+    QVERIFY(!reader.isSameRing(otherFd));
+    ::close(otherFd);
+}
+
+void SharedFlowRingTest::testCapacity() {
+    SharedFlowRing writer;
+    SharedFlowRing reader;
+    int fd = openRing(writer, reader);
+    QVERIFY(fd >= 0);
+    ::close(fd);
+
+    // One more snapshot than there are slots overwrites the oldest.
+    for (int i = 1; i <= SLOT_COUNT + 1; i++) {
+        QVERIFY(writer.publish(i, FlowBatchCodec::encode(makeFlows(2, i))));
+    }
+    QList<CommunicationFlow> result;
+    QVERIFY(!reader.read(1, result));
+    for (int i = 2; i <= SLOT_COUNT + 1; i++) {
+        QVERIFY(reader.read(i, result));
+        QCOMPARE(result, makeFlows(2, i));
+    }
+
+    // A snapshot that doesn't fit leaves the ring as it was.
+    QByteArray tooLarge = FlowBatchCodec::encode(makeFlows(100, 0));
+    QVERIFY(tooLarge.size() > SLOT_SIZE);
+    QVERIFY(!writer.publish(SLOT_COUNT + 2, tooLarge));
+    QVERIFY(!reader.read(SLOT_COUNT + 2, result));
+    QVERIFY(reader.read(2, result));
+}
+
+void SharedFlowRingTest::testRetire() {
+    SharedFlowRing writer;
+    SharedFlowRing reader;
+    int fd = openRing(writer, reader);
+    QVERIFY(fd >= 0);
+    ::close(fd);
+    QVERIFY(!reader.isRetired());
+    writer.retire();
+    QVERIFY(reader.isRetired());
+}
+
+void SharedFlowRingTest::testReadOnly() {
+    SharedFlowRing writer;
+    SharedFlowRing reader;
+    int fd = openRing(writer, reader);
+    QVERIFY(fd >= 0);
+    void* mapping = ::mmap(NULL, SLOT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    QVERIFY(mapping == MAP_FAILED);
+    QVERIFY(::ftruncate(fd, 0) != 0);
+    ::close(fd);
+}
+
+void SharedFlowRingTest::testReopenForWriting() {
+    SharedFlowRing writer;
+    SharedFlowRing reader;
+    int fd = openRing(writer, reader);
+    QVERIFY(fd >= 0);
+
+    // Root may reopen the memory file in spite of its permissions, but the seals still keep it from writing.
+    QByteArray path = QString("/proc/self/fd/%1").arg(fd).toLatin1();
+    int writable = ::open(path.constData(), O_RDWR);
+    if (writable >= 0) {
+        void* mapping = ::mmap(NULL, SLOT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, writable, 0);
+        QVERIFY(mapping == MAP_FAILED);
+        QVERIFY(::write(writable, "x", 1) < 0);
+        ::close(writable);
+    }
+    ::close(fd);
+
+    // The writer can still publish.
+    QVERIFY(writer.publish(1, FlowBatchCodec::encode(makeFlows(1, 100))));
+    QList<CommunicationFlow> result;
+    QVERIFY(reader.read(1, result));
+    QCOMPARE(result.size(), 1);
+}
+
+void SharedFlowRingTest::testAttachInvalid() {
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QString error;
+    SharedFlowRing reader;
+
+    // Too short.
+    QVERIFY(!reader.attach(file.handle(), error));
+    QVERIFY(!error.isEmpty());
+
+    // Long enough, but not a ring.
+    file.write(QByteArray(SLOT_SIZE, 'x'));
+    file.flush();
+    error.clear();
+    QVERIFY(!reader.attach(file.handle(), error));
+    QVERIFY(!error.isEmpty());
+    QVERIFY(!reader.isOpen());
+}
+
+QTEST_MAIN(SharedFlowRingTest)
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SHAREDFLOWRINGTEST_H_
+#define SHAREDFLOWRINGTEST_H_
+
+#include <QtTest/QtTest>
+
+/*
+ * Unit test for SharedFlowRing.
+ */
+class SharedFlowRingTest : public QObject {
+    Q_OBJECT
+
+public:
+    SharedFlowRingTest();
+    virtual ~SharedFlowRingTest();
+
+private slots:
+    // Test that a reader reads the snapshots that the writer publishes.
+    void testPublishAndRead();
+
+    // Test that old snapshots are overwritten and that snapshots too large for a slot are refused.
+    void testCapacity();
+
+    // Test that readers see the ring retired.
+    void testRetire();
+
+    // Test that readers can't map the ring for writing.
+    void testReadOnly();
+
+    // Test that readers can't write to the ring through a descriptor they reopen for writing.
+    void testReopenForWriting();
+
+    // Test that memory files other than rings are rejected.
+    void testAttachInvalid();
+};
+
+#endif /* SHAREDFLOWRINGTEST_H_ */
@@ -0,0 +1,273 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "TrafficGeneratorTest.h"
+#include "TestMain.h"
+#include "TrafficGenerator.h"
+#include "SyntheticTrafficThread.h"
+#include "DataLinkPacketDecoder.h"
+#include "InternetProtocolDecoder.h"
+#include "FlowKey.h"
+#include "IpEndpointPair.h"
+#include "FlowMetrics.h"
+#include "FlowStatistics.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTime>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkAddressEntry>
+#include <QtTest/QTest>
+
+#include <pcap/pcap.h>
+#include <string.h>
+
+typedef QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > StatsTable;
+
+// Generate packets and count them by flow. Each packet must decode to a flow with a local address of the generator.
+// Returns false if one doesn't.
+static bool countFlows(TrafficGenerator& generator, int packets, QHash<FlowKey, int>& result) {
+    DataLinkPacketDecoder* decoder = DataLinkPacketDecoder::fromLinkType(generator.getLinkType(), NULL);
+    if (!decoder) {
+        return false;
+    }
+    QList<QNetworkAddressEntry> localAddresses;
+    QListIterator<QHostAddress> i(TrafficGenerator::localAddresses());
+    while (i.hasNext()) {
+        QNetworkAddressEntry entry;
+        entry.setIp(i.next());
+        localAddresses << entry;
+    }
+    InternetProtocolDecoder ipDecoder;
+    ipDecoder.setLocalAddresses(localAddresses);
+
+    bool ok = true;
+    pcap_pkthdr header;
+    QByteArray frame;
+    for (int n = 0; n < packets && ok; ++n) {
+        generator.nextPacket(header, frame);
+        const u_char* bytes = (const u_char*)frame.constData();
+        IpHeader ipHeader = decoder->decode(&header, bytes);
+        FlowKey flow = FlowKey();
+        Direction direction = UNKNOWN_DIRECTION;
+        if (ipHeader.start) {
+            // Decode without the link layer's direction, then make sure they agree.
+            direction = ipDecoder.decode(UNKNOWN_DIRECTION, bytes + header.caplen - ipHeader.start, ipHeader.start,
+                    flow);
+        }
+        ok = direction != UNKNOWN_DIRECTION
+                && (ipHeader.direction == UNKNOWN_DIRECTION || ipHeader.direction == direction)
+                && TrafficGenerator::localAddresses().contains(flow.toEndpointPair().getLocalAddr());
+        result[flow]++;
+    }
+    delete decoder;
+    return ok;
+}
+
+// Share of the packets of the busiest flow.
+static double busiestShare(const QHash<FlowKey, int>& flows, int packets) {
+    int busiest = 0;
+    QHashIterator<FlowKey, int> i(flows);
+    while (i.hasNext()) {
+        busiest = qMax(busiest, i.next().value());
+    }
+    return (double)busiest / packets;
+}
+
+TrafficGeneratorTest::TrafficGeneratorTest() {
+}
+
+TrafficGeneratorTest::~TrafficGeneratorTest() {
+}
+
+void TrafficGeneratorTest::testDecode_data() {
+    QTest::addColumn<int>("linkType");
+    QTest::addColumn<bool>("vlan");
+    QTest::addColumn<bool>("extensionHeaders");
+    QTest::newRow("Ethernet") << (int)DLT_EN10MB << false << false;
+    QTest::newRow("Ethernet 802.1Q") << (int)DLT_EN10MB << true << false;
+    QTest::newRow("Cooked") << (int)DLT_LINUX_SLL << false << false;
+    QTest::newRow("Raw") << (int)DLT_RAW << false << false;
+    QTest::newRow("Raw IPv6 extension headers") << (int)DLT_RAW << false << true;
+}
+
+void TrafficGeneratorTest::testDecode() {
+    QFETCH(int, linkType);
+    QFETCH(bool, vlan);
+    QFETCH(bool, extensionHeaders);
+    TrafficGenerator generator;
+    generator.setLinkType(linkType);
+    generator.setVlan(vlan);
+    generator.setExtensionHeaders(extensionHeaders);
+    generator.setFlowCount(50);
+    generator.setIpv6Percent(50);
+    QHash<FlowKey, int> flows;
+    QVERIFY(countFlows(generator, 5000, flows));
+    QCOMPARE(flows.size(), 50);
+
+    // Both IP versions and transports are there.
+    QSet<int> transports;
+    QHashIterator<FlowKey, int> i(flows);
+    while (i.hasNext()) {
+        transports.insert(i.next().key().transport);
+    }
+    QCOMPARE(transports.size(), 4);
+}
+
+void TrafficGeneratorTest::testReproducible() {
+    TrafficGenerator generator1;
+    TrafficGenerator generator2;
+    pcap_pkthdr header1;
+    pcap_pkthdr header2;
+    QByteArray frame1;
+    QByteArray frame2;
+    for (int i = 0; i < 1000; ++i) {
+        generator1.nextPacket(header1, frame1);
+        generator2.nextPacket(header2, frame2);
+        QCOMPARE(frame1, frame2);
+        QCOMPARE(header1.len, header2.len);
+    }
+
+    // The stream starts over on restart.
+    generator2.restart();
+    generator1.restart();
+    generator1.nextPacket(header1, frame1);
+    generator2.nextPacket(header2, frame2);
+    QCOMPARE(frame1, frame2);
+
+    generator2.setSeed(TrafficGenerator::DEFAULT_SEED + 1);
+    generator2.restart();
+    bool different = false;
+    for (int i = 0; i < 100 && !different; ++i) {
+        generator1.nextPacket(header1, frame1);
+        generator2.nextPacket(header2, frame2);
+        different = frame1 != frame2;
+    }
+    QVERIFY(different);
+}
+
+void TrafficGeneratorTest::testZipfSkew() {
+    // With a skew of 1, the busiest of 100 flows sends 1 / H(100) = 19.3% of the packets.
+    const int packets = 50000;
+    TrafficGenerator generator;
+    generator.setLinkType(DLT_RAW);
+    generator.setFlowCount(100);
+    QHash<FlowKey, int> flows;
+    QVERIFY(countFlows(generator, packets, flows));
+    double share = busiestShare(flows, packets);
+    QVERIFY(share > 0.17 && share < 0.22);
+
+    // Without skew, every flow sends about 1%.
+    generator.setZipfSkew(0);
+    generator.restart();
+    flows.clear();
+    QVERIFY(countFlows(generator, packets, flows));
+    QCOMPARE(flows.size(), 100);
+    QVERIFY(busiestShare(flows, packets) < 0.015);
+}
+
+void TrafficGeneratorTest::testTimestamps() {
+    TrafficGenerator generator;
+    generator.setPacketRate(1000);
+    timeval startTime;
+    startTime.tv_sec = 2000000000;
+    startTime.tv_usec = 750000;
+    generator.setStartTime(startTime);
+    pcap_pkthdr header;
+    QByteArray frame;
+    generator.nextPacket(header, frame);
+    QCOMPARE(header.ts.tv_sec, startTime.tv_sec);
+    QCOMPARE(header.ts.tv_usec, startTime.tv_usec);
+    for (int i = 1; i <= 500; ++i) {
+        generator.nextPacket(header, frame);
+    }
+    QCOMPARE(header.ts.tv_sec, startTime.tv_sec + 1);
+    QCOMPARE(header.ts.tv_usec, (suseconds_t)250000);
+    QCOMPARE(generator.getPacketCount(), 501LL);
+
+    // Only headers are captured.
+    QVERIFY(header.caplen == (uint)frame.size());
+    QVERIFY(header.len >= header.caplen);
+}
+
+void TrafficGeneratorTest::testWriteFile() {
+    QTemporaryFile trace;
+    QVERIFY(trace.open());
+    TrafficGenerator generator;
+    generator.setLinkType(DLT_LINUX_SLL);
+    QString error;
+    QVERIFY(generator.writeFile(trace.fileName(), 100, error));
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t* handle = pcap_open_offline(QFile::encodeName(trace.fileName()).constData(), errbuf);
+    QVERIFY(handle);
+    QCOMPARE(pcap_datalink(handle), (int)DLT_LINUX_SLL);
+    generator.restart();
+    pcap_pkthdr* header = NULL;
+    const u_char* bytes = NULL;
+    pcap_pkthdr expectedHeader;
+    QByteArray expectedFrame;
+    int packets = 0;
+    while (pcap_next_ex(handle, &header, &bytes) == 1) {
+        generator.nextPacket(expectedHeader, expectedFrame);
+        if (header->len != expectedHeader.len || header->caplen != (uint)expectedFrame.size()
+                || ::memcmp(bytes, expectedFrame.constData(), header->caplen) != 0) {
+            break;
+        }
+        ++packets;
+    }
+    pcap_close(handle);
+    QCOMPARE(packets, 100);
+}
+
+void TrafficGeneratorTest::testFeed() {
+    TrafficGenerator generator;
+    generator.setFlowCount(10);
+    generator.setPacketRate(1000);
+    SyntheticTrafficThread thread(0, "synthetic", generator, 500);
+    thread.begin();
+    QTime timer;
+    timer.start();
+    while (!thread.isFeedDone() && timer.elapsed() < 5000) {
+        QTest::qWait(10);
+    }
+    QVERIFY(thread.isFeedDone());
+    QCOMPARE(thread.getPacketsFed(), 500);
+
+    // Statistics don't include the current second, so wait for the next one.
+    QTest::qWait(1100);
+    StatsTable stats;
+    QString error;
+    QVERIFY(thread.fillStatistics(stats, error));
+    thread.cancel();
+    thread.wait();
+    QCOMPARE(stats.size(), 10);
+    qlonglong packets = 0;
+    QHashIterator<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > i(stats);
+    while (i.hasNext()) {
+        i.next();
+        packets += i.value().first.getPacketsIn() + i.value().first.getPacketsOut();
+    }
+    QCOMPARE(packets, 500LL);
+}
+
+QTEST_GMOCK_MAIN(TrafficGeneratorTest)
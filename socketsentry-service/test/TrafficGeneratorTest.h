@@ -0,0 +1,54 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by Rob Hasselbaum <rob@hasselbaum.net>             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef TRAFFICGENERATORTEST_H_
+#define TRAFFICGENERATORTEST_H_
+
+#include <QtCore/QObject>
+
+/*
+ * Unit test for TrafficGenerator and SyntheticTrafficThread.
+ */
+class TrafficGeneratorTest : public QObject {
+    Q_OBJECT
+
+public:
+    TrafficGeneratorTest();
+    virtual ~TrafficGeneratorTest();
+
+private slots:
+    // Test that every generated frame decodes to one of the flows, in the direction the link layer tells (if any).
+    void testDecode_data();
+    void testDecode();
+
+    // Test that the same settings and seed give the same stream, and a different seed a different one.
+    void testReproducible();
+
+    // Test that packets are spread over flows according to the Zipf skew.
+    void testZipfSkew();
+
+    // Test that timestamps advance at the packet rate.
+    void testTimestamps();
+
+    // Test that a written trace file can be read back with libpcap.
+    void testWriteFile();
+
+    // Test that the in-process feed records every packet.
+    void testFeed();
+};
+
+#endif /* TRAFFICGENERATORTEST_H_ */
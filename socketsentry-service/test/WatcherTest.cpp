@@ -25,6 +25,9 @@
 #include "FlowStatistics.h"
 #include "OsProcess.h"
 #include "CommunicationFlow.h"
+#include "FlowBatchCodec.h"
+#include "SharedFlowRing.h"
+#include "FlowSelection.h"
 
 #include <QtCore/QString>
 #include <QtTest/QSignalSpy>
@@ -32,8 +35,11 @@
 #include <QtNetwork/QHostAddress>
 #include <QtCore/QHash>
 #include <QtCore/QPair>
+#include <QtCore/QSet>
 #include <QtCore/QDateTime>
 
+#include <unistd.h>
+
 using ::testing::Expectation;
 using ::testing::Return;
 using ::testing::AtLeast;
@@ -46,6 +52,12 @@ using ::testing::_;
 
 ACTION_P(ReturnPointee, p) { return *p; }
 
+// Count the calls of a mock method.
+ACTION_P(CountCall, counter) { ++*counter; }
+
+// Take a while to correlate, then succeed.
+ACTION_P(SleepAndSucceed, ms) { QTest::qSleep(ms); return true; }
+
 WatcherTest::WatcherTest() {
 }
 
@@ -95,7 +107,7 @@ void WatcherTest::testVariableOsConnections() {
 
     // Create watcher and set it to monitor "eth0". It should emit some signals over time.
     const int correlationIntervalMs = 200;
-    Watcher watcher(mockCorrelator, mockPcapMngr, 25, 100, correlationIntervalMs);
+    Watcher watcher(mockCorrelator, mockPcapMngr, 25, 100, correlationIntervalMs, correlationIntervalMs);
     QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
     QSignalSpy failureSpy(&watcher, SIGNAL(failure(const QString&, const QString&)));
     watcher.showInterest(eth0);
@@ -146,7 +158,7 @@ void WatcherTest::testVariableCaptures() {
 
     // Create watcher and set it to monitor "eth0". It should emit some signals over time.
     const int updateIntervalMs = 100;
-    Watcher watcher(mockCorrelator, mockPcapMngr, 25, updateIntervalMs, 200);
+    Watcher watcher(mockCorrelator, mockPcapMngr, 25, updateIntervalMs, 200, 200);
     QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
     QSignalSpy failureSpy(&watcher, SIGNAL(failure(const QString&, const QString&)));
     watcher.showInterest(eth0);
@@ -181,6 +193,156 @@ void WatcherTest::verifyUpdateSignals(QSignalSpy& updateSpy, const QString& devi
     }
 }
 
+void WatcherTest::testSlowCorrelation() {
+    QString eth0 = "eth0";
+    MockPcapManager* mockPcapMngr = createNicePcapManager(eth0);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(eth0, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isActive(eth0))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    // The first correlation takes much longer than the update interval.
+    const int correlationMs = 1000;
+    MockConnectionProcessCorrelator* mockCorrelator = new MockConnectionProcessCorrelator;
+    EXPECT_CALL(*mockCorrelator, correlate(_, _))
+        .Times(AtLeast(1))
+        .WillOnce(SleepAndSucceed(correlationMs))
+        .WillRepeatedly(Return(true));
+
+    const int updateIntervalMs = 100;
+    Watcher watcher(mockCorrelator, mockPcapMngr, 25, updateIntervalMs, 50, 50);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    watcher.showInterest(eth0);
+    QTest::qWait(correlationMs);
+
+    // Updates weren't held up by the correlation.
+    QVERIFY(updateSpy.count() >= correlationMs / updateIntervalMs / 2);
+}
+
+void WatcherTest::testTargetedCorrelation() {
+    QString eth0 = "eth0";
+    MockPcapManager* mockPcapMngr = createNicePcapManager(eth0);
+
+    // The pcap manager returns one endpoint pair at first. A second one shows up after the first correlation.
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > firstStats;
+    firstStats.insert(endpoints1, QPair<FlowMetrics, FlowStatistics>(metrics, stats));
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > laterStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(eth0, _, _))
+        .Times(AtLeast(7))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(laterStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(eth0))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    // The full correlation finds the first endpoint pair. The second one is looked for on its own, exactly once.
+    QHash<IpEndpointPair, QList<OsProcess> > fullCorrelation;
+    QList<OsProcess> processes1;
+    processes1 << OsProcess(222, "firefox", "rob", QDateTime::currentDateTime());
+    fullCorrelation.insert(endpoints1, processes1);
+    QHash<IpEndpointPair, QList<OsProcess> > targetedCorrelation;
+    QList<OsProcess> processes2;
+    processes2 << OsProcess(333, "wget", "rob", QDateTime::currentDateTime());
+    targetedCorrelation.insert(endpoints2, processes2);
+    QSet<IpEndpointPair> unmatched;
+    unmatched << endpoints2;
+    MockConnectionProcessCorrelator* mockCorrelator = new MockConnectionProcessCorrelator;
+    EXPECT_CALL(*mockCorrelator, correlate(_, _))
+        .Times(1)
+        .WillOnce(DoAll(SetArgReferee<0>(fullCorrelation), Return(true)));
+    EXPECT_CALL(*mockCorrelator, correlateEndpoints(unmatched, _, _))
+        .Times(1)
+        .WillOnce(DoAll(SetArgReferee<1>(targetedCorrelation), Return(true)));
+
+    // The refresh interval is much longer than the test, so there's only one full correlation.
+    const int correlationIntervalMs = 100;
+    Watcher watcher(mockCorrelator, mockPcapMngr, 25, 50, correlationIntervalMs, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    watcher.showInterest(eth0);
+    QTest::qWait(correlationIntervalMs * 5 + 1000);
+
+    // The last update includes both flows.
+    QVERIFY(!updateSpy.isEmpty());
+    const QList<CommunicationFlow>& flows = qvariant_cast<QList<CommunicationFlow> >(updateSpy.last().at(1));
+    QCOMPARE(flows.size(), 2);
+    QVERIFY(flows.contains(CommunicationFlow(endpoints1, processes1, metrics, stats)));
+    QVERIFY(flows.contains(CommunicationFlow(endpoints2, processes2, FlowMetrics(), FlowStatistics())));
+}
+
+void WatcherTest::testTargetedRetry() {
+    QString eth0 = "eth0";
+    MockPcapManager* mockPcapMngr = createNicePcapManager(eth0);
+
+    // The pcap manager returns one endpoint pair at first. A second one shows up after the first correlation.
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > firstStats;
+    firstStats.insert(endpoints1, QPair<FlowMetrics, FlowStatistics>(metrics, stats));
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > laterStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(eth0, _, _))
+        .Times(AtLeast(7))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(laterStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(eth0))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    // The full correlation finds the first endpoint pair. The first targeted correlation misses the second one (e.g.
+    // its process hasn't been indexed yet), and the next one finds it. Then it isn't looked for anymore.
+    QHash<IpEndpointPair, QList<OsProcess> > fullCorrelation;
+    QList<OsProcess> processes1;
+    processes1 << OsProcess(222, "firefox", "rob", QDateTime::currentDateTime());
+    fullCorrelation.insert(endpoints1, processes1);
+    QHash<IpEndpointPair, QList<OsProcess> > targetedCorrelation;
+    QList<OsProcess> processes2;
+    processes2 << OsProcess(333, "wget", "rob", QDateTime::currentDateTime());
+    targetedCorrelation.insert(endpoints2, processes2);
+    QSet<IpEndpointPair> unmatched;
+    unmatched << endpoints2;
+    MockConnectionProcessCorrelator* mockCorrelator = new MockConnectionProcessCorrelator;
+    EXPECT_CALL(*mockCorrelator, correlate(_, _))
+        .Times(1)
+        .WillOnce(DoAll(SetArgReferee<0>(fullCorrelation), Return(true)));
+    EXPECT_CALL(*mockCorrelator, correlateEndpoints(unmatched, _, _))
+        .Times(2)
+        .WillOnce(Return(true))
+        .WillOnce(DoAll(SetArgReferee<1>(targetedCorrelation), Return(true)));
+
+    // The refresh interval is much longer than the test, so there's only one full correlation.
+    const int correlationIntervalMs = 100;
+    Watcher watcher(mockCorrelator, mockPcapMngr, 25, 50, correlationIntervalMs, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    watcher.showInterest(eth0);
+    QTest::qWait(correlationIntervalMs * 6 + 1000);
+
+    // The last update includes both flows.
+    QVERIFY(!updateSpy.isEmpty());
+    const QList<CommunicationFlow>& flows = qvariant_cast<QList<CommunicationFlow> >(updateSpy.last().at(1));
+    QCOMPARE(flows.size(), 2);
+    QVERIFY(flows.contains(CommunicationFlow(endpoints1, processes1, metrics, stats)));
+    QVERIFY(flows.contains(CommunicationFlow(endpoints2, processes2, FlowMetrics(), FlowStatistics())));
+}
+
 void WatcherTest::testProcessSorting() {
     // One device.
     QString eth0 = "eth0";
@@ -217,7 +379,7 @@ void WatcherTest::testProcessSorting() {
 
     // Create watcher and set it to monitor "eth0". It should emit some signals over time.
     const int updateIntervalMs = 10;
-    Watcher watcher(mockCorrelator, mockPcapMngr, 5, updateIntervalMs, 5);
+    Watcher watcher(mockCorrelator, mockPcapMngr, 5, updateIntervalMs, 5, 5);
     watcher.setOsProcessSortAscending(true);
     QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
     watcher.showInterest(eth0);
@@ -239,8 +401,442 @@ void WatcherTest::testProcessSorting() {
 
 }
 
+void WatcherTest::testFetchHistory() {
+    QString eth0 = "eth0";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(17, 0, 9000, false, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats = createPacketStats(endpoints1, endpoints2, metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillHistory(eth0, 3600, _, _))
+        .Times(1)
+        .WillOnce(DoAll(SetArgReferee<2>(filledStats), Return(true)));
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 1000, 1000, 1000, 1000);
+
+    // Both flows are included even though neither has a known connection.
+    QString error;
+    QList<CommunicationFlow> flows = watcher.fetchHistory(eth0, 3600, error);
+    QVERIFY(error.isEmpty());
+    QCOMPARE(flows.size(), 2);
+    QVERIFY(flows.contains(CommunicationFlow(endpoints1, QList<OsProcess>(), metrics, stats)));
+
+    // Invalid ranges are rejected without asking the pcap manager.
+    flows = watcher.fetchHistory(eth0, 0, error);
+    QVERIFY(flows.isEmpty());
+    QVERIFY(!error.isEmpty());
+}
+
+void WatcherTest::testDeltaUpdates() {
+    // Replayed traffic isn't correlated, so every endpoint pair becomes a flow right away.
+    QString device = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(device))
+        .Times(1);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << device));
+
+    // The pcap manager returns two endpoint pairs twice. Then the first one changes and the second one goes away.
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > firstStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    FlowMetrics laterMetrics(128000, 2400, 60, 80);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > laterStats;
+    laterStats.insert(endpoints1, QPair<FlowMetrics, FlowStatistics>(laterMetrics, stats));
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(device, _, _))
+        .Times(AtLeast(4))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillOnce(DoAll(SetArgReferee<1>(firstStats), Return(true)))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(laterStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(device))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(false));
+
+    // The correlation intervals are much longer than the test.
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    QSignalSpy deltaSpy(&watcher, SIGNAL(updateDelta(const QString&, qulonglong, bool, const QList<CommunicationFlow>&,
+            const QList<IpEndpointPair>&)));
+    watcher.showDeltaInterest(device);
+    QTest::qWait(updateIntervalMs * 5 + 500);
+
+    // Nobody wants full updates.
+    QCOMPARE(updateSpy.count(), 0);
+    QVERIFY(deltaSpy.count() >= 4);
+
+    // The first delta is a keyframe with both flows.
+    QList<QVariant> args = deltaSpy.takeFirst();
+    QCOMPARE(args.at(0).toString(), device);
+    QCOMPARE(args.at(1).toULongLong(), 1ULL);
+    QVERIFY(args.at(2).toBool());
+    QList<CommunicationFlow> flows = qvariant_cast<QList<CommunicationFlow> >(args.at(3));
+    QCOMPARE(flows.size(), 2);
+    QVERIFY(flows.contains(CommunicationFlow(endpoints1, QList<OsProcess>(), metrics, stats)));
+    QVERIFY(qvariant_cast<QList<IpEndpointPair> >(args.at(4)).isEmpty());
+
+    // Nothing changed in the second.
+    args = deltaSpy.takeFirst();
+    QCOMPARE(args.at(1).toULongLong(), 2ULL);
+    QVERIFY(!args.at(2).toBool());
+    QVERIFY(qvariant_cast<QList<CommunicationFlow> >(args.at(3)).isEmpty());
+    QVERIFY(qvariant_cast<QList<IpEndpointPair> >(args.at(4)).isEmpty());
+
+    // The third carries the changed flow and the removed one.
+    args = deltaSpy.takeFirst();
+    QCOMPARE(args.at(1).toULongLong(), 3ULL);
+    QVERIFY(!args.at(2).toBool());
+    flows = qvariant_cast<QList<CommunicationFlow> >(args.at(3));
+    QCOMPARE(flows.size(), 1);
+    QCOMPARE(flows[0], CommunicationFlow(endpoints1, QList<OsProcess>(), laterMetrics, stats));
+    QList<IpEndpointPair> removed = qvariant_cast<QList<IpEndpointPair> >(args.at(4));
+    QCOMPARE(removed.size(), 1);
+    QCOMPARE(removed[0], endpoints2);
+
+    // The rest are empty and numbered in sequence.
+    qulonglong sequence = 3;
+    while (!deltaSpy.isEmpty()) {
+        args = deltaSpy.takeFirst();
+        QCOMPARE(args.at(1).toULongLong(), ++sequence);
+        QVERIFY(!args.at(2).toBool());
+        QVERIFY(qvariant_cast<QList<CommunicationFlow> >(args.at(3)).isEmpty());
+    }
+
+    // After a resync, the next delta is a keyframe with the remaining flow.
+    watcher.resync(device);
+    QTest::qWait(updateIntervalMs * 2 + 500);
+    QVERIFY(!deltaSpy.isEmpty());
+    args = deltaSpy.takeFirst();
+    QCOMPARE(args.at(1).toULongLong(), sequence + 1);
+    QVERIFY(args.at(2).toBool());
+    QCOMPARE(qvariant_cast<QList<CommunicationFlow> >(args.at(3)).size(), 1);
+}
+
+void WatcherTest::testPackedUpdates() {
+    QString device = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(device))
+        .Times(2);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << device));
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(device, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(filledStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(device))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(false));
+
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    QSignalSpy packedSpy(&watcher, SIGNAL(updatePacked(const QString&, const QByteArray&)));
+    watcher.showPackedInterest(device);
+    watcher.showInterest(device);
+    QTest::qWait(updateIntervalMs * 2 + 500);
+
+    // Every tick sends both kinds of update with the same flows.
+    QVERIFY(!packedSpy.isEmpty());
+    QCOMPARE(packedSpy.count(), updateSpy.count());
+    while (!packedSpy.isEmpty()) {
+        QList<QVariant> packedArgs = packedSpy.takeFirst();
+        QList<QVariant> updateArgs = updateSpy.takeFirst();
+        QCOMPARE(packedArgs.at(0).toString(), device);
+        QList<CommunicationFlow> flows;
+        QString error;
+        QVERIFY(FlowBatchCodec::decode(packedArgs.at(1).toByteArray(), flows, error));
+        QCOMPARE(flows, qvariant_cast<QList<CommunicationFlow> >(updateArgs.at(1)));
+        QCOMPARE(flows.size(), 2);
+    }
+}
+
+void WatcherTest::testSharedUpdates() {
+    QString device = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(device))
+        .Times(3);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << device));
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(device, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(filledStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(device))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(false));
+
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    QSignalSpy sharedSpy(&watcher, SIGNAL(updateShared(const QString&, qulonglong)));
+    QString error;
+    int fd = watcher.openSharedRing(device, error);
+    QVERIFY(fd >= 0);
+    SharedFlowRing reader;
+    QVERIFY(reader.attach(fd, error));
+    ::close(fd);
+
+    // Another client gets the same ring.
+    int otherFd = watcher.openSharedRing(device, error);
+    QVERIFY(otherFd >= 0);
+    QVERIFY(reader.isSameRing(otherFd));
+    ::close(otherFd);
+
+    watcher.showInterest(device);
+    QTest::qWait(updateIntervalMs * 2 + 500);
+
+    // Every tick publishes a snapshot with the same flows as the full update. Sequence numbers count up.
+    QVERIFY(!sharedSpy.isEmpty());
+    QCOMPARE(sharedSpy.count(), updateSpy.count());
+    qulonglong lastSequence = 0;
+    while (!sharedSpy.isEmpty()) {
+        QList<QVariant> sharedArgs = sharedSpy.takeFirst();
+        QList<QVariant> updateArgs = updateSpy.takeFirst();
+        QCOMPARE(sharedArgs.at(0).toString(), device);
+        qulonglong sequence = sharedArgs.at(1).toULongLong();
+        QVERIFY(sequence > lastSequence);
+        lastSequence = sequence;
+        if (sharedSpy.isEmpty()) {
+            QList<CommunicationFlow> flows;
+            QVERIFY(reader.read(sequence, flows));
+            QCOMPARE(flows, qvariant_cast<QList<CommunicationFlow> >(updateArgs.at(1)));
+            QCOMPARE(flows.size(), 2);
+        }
+    }
+    QVERIFY(!reader.isRetired());
+}
+
+void WatcherTest::testSelectedUpdates() {
+    QString device = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(device))
+        .Times(2);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << device));
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    IpEndpointPair endpoints3 = createEndpoints(6442, "192.168.1.5");
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats;
+    filledStats.insert(endpoints1, qMakePair(FlowMetrics(64000, 1200, 30, 40),
+            FlowStatistics(100, 100, 200, true, true)));                    // most bytes
+    filledStats.insert(endpoints2, qMakePair(FlowMetrics(500, 500, 5, 5),
+            FlowStatistics(3200, 4500, 96000, true, false)));               // only one with a port in 4000-5000
+    filledStats.insert(endpoints3, qMakePair(FlowMetrics(9000, 0, 9, 0), FlowStatistics()));
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(device, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(filledStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(device))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(false));
+
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    QSignalSpy selectedSpy(&watcher, SIGNAL(updateSelected(const QString&, const FlowSelection&,
+            const QList<CommunicationFlow>&)));
+    FlowSelection busiest(SORT_BY_TOTAL, 1);
+    FlowSelection ports;
+    ports.setPortRange(4000, 5000);
+    FlowSelection invalid(SORT_BY_TOTAL, -1);
+    watcher.showSelectedInterest(device, busiest);
+    watcher.showSelectedInterest(device, ports);
+    watcher.showSelectedInterest(device, invalid);     // ignored
+    QTest::qWait(updateIntervalMs * 2 + 500);
+
+    // Nobody asked for full updates. Every tick sends one update for each valid selection.
+    QVERIFY(updateSpy.isEmpty());
+    QVERIFY(!selectedSpy.isEmpty());
+    QCOMPARE(selectedSpy.count() % 2, 0);
+    while (!selectedSpy.isEmpty()) {
+        QList<QVariant> args = selectedSpy.takeFirst();
+        QCOMPARE(args.at(0).toString(), device);
+        FlowSelection selection = qvariant_cast<FlowSelection>(args.at(1));
+        QList<CommunicationFlow> flows = qvariant_cast<QList<CommunicationFlow> >(args.at(2));
+        QCOMPARE(flows.size(), 1);
+        if (selection == busiest) {
+            QCOMPARE(flows[0].getIpEndpointPair(), endpoints1);
+        } else {
+            QVERIFY(selection == ports);
+            QCOMPARE(flows[0].getIpEndpointPair(), endpoints2);
+        }
+    }
+}
+
+void WatcherTest::testUpdateIntervals() {
+    QString device = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(device))
+        .Times(4);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << device));
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    int fills = 0;
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(device, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(DoAll(CountCall(&fills), SetArgReferee<1>(filledStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(device))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    bool idle = false;
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(ReturnPointee(&idle));
+
+    // Two selections at the default interval and one at four times that.
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy selectedSpy(&watcher, SIGNAL(updateSelected(const QString&, const FlowSelection&,
+            const QList<CommunicationFlow>&)));
+    FlowSelection all;
+    FlowSelection busiest(SORT_BY_TOTAL, 1);
+    FlowSelection slow;
+    slow.setUpdateIntervalMs(updateIntervalMs * 4);
+    watcher.showSelectedInterest(device, all);
+    watcher.showSelectedInterest(device, busiest);
+    watcher.showSelectedInterest(device, slow);
+    QTest::qWait(updateIntervalMs * 10 + 100);
+
+    // Each selection is updated at its own pace.
+    int allCount = 0;
+    int busiestCount = 0;
+    int slowCount = 0;
+    while (!selectedSpy.isEmpty()) {
+        QList<QVariant> args = selectedSpy.takeFirst();
+        FlowSelection selection = qvariant_cast<FlowSelection>(args.at(1));
+        QList<CommunicationFlow> flows = qvariant_cast<QList<CommunicationFlow> >(args.at(2));
+        if (selection == all) {
+            QCOMPARE(flows.size(), 2);
+            allCount++;
+        } else if (selection == busiest) {
+            QCOMPARE(flows.size(), 1);
+            busiestCount++;
+        } else {
+            QVERIFY(selection == slow);
+            QCOMPARE(flows.size(), 2);
+            slowCount++;
+        }
+    }
+    QCOMPARE(busiestCount, allCount);
+    QVERIFY(slowCount >= 1);
+    QVERIFY(allCount >= slowCount * 2);
+
+    // The statistics are fetched once for all selections that are due together.
+    QVERIFY(fills >= allCount);
+    QVERIFY(fills <= allCount + slowCount);
+
+    // Once there's no traffic, every selection backs off to the quiet interval, which is longer than the test.
+    idle = true;
+    QTest::qWait(updateIntervalMs * 2);
+    selectedSpy.clear();
+    QTest::qWait(updateIntervalMs * 10);
+    QVERIFY(selectedSpy.isEmpty());
+
+    // A new selection gets its first update right away anyway.
+    FlowSelection top(SORT_BY_PEAK, 1);
+    watcher.showSelectedInterest(device, top);
+    QTest::qWait(updateIntervalMs * 2);
+    QCOMPARE(selectedSpy.count(), 1);
+    QVERIFY(qvariant_cast<FlowSelection>(selectedSpy.first().at(1)) == top);
+}
+
+void WatcherTest::testReplayDeviceTraffic() {
+    // The live device has been idle for a while. The replayed trace has recent traffic on its own clock, even though
+    // its packets were captured long ago.
+    QString eth0 = "eth0";
+    QString replay = "file:trace.pcap";
+    MockPcapManager* mockPcapMngr = new MockPcapManager;
+    EXPECT_CALL(*mockPcapMngr, showInterest(eth0))
+        .Times(1);
+    EXPECT_CALL(*mockPcapMngr, showInterest(replay))
+        .Times(1);
+    EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(QStringList() << eth0 << replay));
+    EXPECT_CALL(*mockPcapMngr, isIdle(eth0, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, isIdle(replay, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(false));
+    IpEndpointPair endpoints1 = createEndpoints(2920, "147.129.1.1");
+    IpEndpointPair endpoints2 = createEndpoints(4345, "10.20.1.1");
+    FlowMetrics metrics(64000, 1200, 30, 40);
+    FlowStatistics stats(3200, 4500, 96000, true, false);
+    QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > filledStats = createPacketStats(endpoints1, endpoints2,
+            metrics, stats);
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(eth0, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mockPcapMngr, fillStatistics(replay, _, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(DoAll(SetArgReferee<1>(filledStats), Return(true)));
+    EXPECT_CALL(*mockPcapMngr, isActive(_))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    const int updateIntervalMs = 100;
+    Watcher watcher(new MockConnectionProcessCorrelator, mockPcapMngr, 25, updateIntervalMs, 60000, 60000);
+    QSignalSpy updateSpy(&watcher, SIGNAL(update(const QString&, const QList<CommunicationFlow>&)));
+    watcher.showInterest(eth0);
+    watcher.showInterest(replay);
+    QTest::qWait(updateIntervalMs * 10 + 100);
+
+    // The idle device only gets its first update within the quiet interval. The replayed trace keeps the usual pace.
+    int eth0Count = 0;
+    int replayCount = 0;
+    while (!updateSpy.isEmpty()) {
+        QList<QVariant> args = updateSpy.takeFirst();
+        if (args.at(0).toString() == eth0) {
+            eth0Count++;
+        } else {
+            QCOMPARE(args.at(0).toString(), replay);
+            QCOMPARE(qvariant_cast<QList<CommunicationFlow> >(args.at(1)).size(), 2);
+            replayCount++;
+        }
+    }
+    QCOMPARE(eth0Count, 1);
+    QVERIFY(replayCount >= 5);
+}
+
 void WatcherTest::initTestCase() {
     qRegisterMetaType<QList<CommunicationFlow> >("QList<CommunicationFlow>");
+    qRegisterMetaType<QList<IpEndpointPair> >("QList<IpEndpointPair>");
+    qRegisterMetaType<FlowSelection>("FlowSelection");
 }
 
 QHash<IpEndpointPair, QPair<FlowMetrics, FlowStatistics> > WatcherTest::createPacketStats(const IpEndpointPair& endpoints1,
@@ -262,9 +858,9 @@ MockPcapManager* WatcherTest::createNicePcapManager(const QString& deviceName) c
     MockPcapManager* mockPcapMngr = new MockPcapManager;
     EXPECT_CALL(*mockPcapMngr, showInterest(deviceName))
         .Times(AtLeast(1));
-    EXPECT_CALL(*mockPcapMngr, anyTrafficSince(_))
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
         .Times(AtLeast(1))
-        .WillRepeatedly(Return(true));
+        .WillRepeatedly(Return(false));
     EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
         .Times(AtLeast(1))
         .WillRepeatedly(Return(fullDeviceList));
@@ -281,9 +877,9 @@ MockPcapManager* WatcherTest::createFullServicePcapManager(const QString& device
     MockPcapManager* mockPcapMngr = new MockPcapManager;
     EXPECT_CALL(*mockPcapMngr, showInterest(deviceName))
         .Times(1);
-    EXPECT_CALL(*mockPcapMngr, anyTrafficSince(_))
+    EXPECT_CALL(*mockPcapMngr, isIdle(_, _))
         .Times(AtLeast(1))
-        .WillRepeatedly(Return(true));
+        .WillRepeatedly(Return(false));
     {
         InSequence s;
         EXPECT_CALL(*mockPcapMngr, findCurrentDevices())
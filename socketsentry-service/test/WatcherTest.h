@@ -45,8 +45,30 @@ private slots:
     void testVariableOsConnections();
     // Ensure the watcher reacts correctly when the pcap manager returns some valid data and an error.
     void testVariableCaptures();
+    // Ensure updates keep coming while a slow correlation runs.
+    void testSlowCorrelation();
+    // Ensure only endpoint pairs without a match are correlated between full correlations.
+    void testTargetedCorrelation();
+    // Ensure an endpoint pair that a targeted correlation missed is looked for again until it's matched.
+    void testTargetedRetry();
     // Ensure the watcher sorts processes correctly in shared socket situations.
     void testProcessSorting();
+    // Ensure the watcher returns flows from the downsampled history, including those without processes.
+    void testFetchHistory();
+    // Ensure delta updates carry only changes after a keyframe, and a resync brings on another keyframe.
+    void testDeltaUpdates();
+    // Ensure packed updates carry the same flows as full ones.
+    void testPackedUpdates();
+    // Ensure shared updates publish the same flows as full ones to one ring for all clients.
+    void testSharedUpdates();
+    // Ensure selected updates carry only the busiest or matching flows for each selection.
+    void testSelectedUpdates();
+    // Ensure each selection is updated at its own interval from statistics fetched once, and updates back off while
+    // there's no traffic.
+    void testUpdateIntervals();
+    // Ensure updates back off for each device on its own, so a replayed trace with traffic on its clock keeps the usual
+    // pace next to an idle device.
+    void testReplayDeviceTraffic();
 
 private:
     // Create a dummy endpoint pair with variable local port and remote address.